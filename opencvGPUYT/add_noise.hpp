@@ -2,7 +2,7 @@
 #include <opencv2/opencv.hpp>
 
 // Add noise to grayscale image
-void addNoiseGray(const cv::Mat& input, cv::Mat& output,
+inline void addNoiseGray(const cv::Mat& input, cv::Mat& output,
     float noiseStd = 10.0f) {
     // Check if input is empty
     if (input.empty()) {
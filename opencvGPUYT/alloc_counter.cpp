@@ -0,0 +1,150 @@
+#include "alloc_counter.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <opencv2/core.hpp>
+#ifndef STKMB_NO_CUDA
+#include <opencv2/core/cuda.hpp>
+#endif
+
+namespace {
+
+    std::atomic<uint64_t> heapAllocations{ 0 };
+    std::atomic<uint64_t> matAllocations{ 0 };
+    std::atomic<uint64_t> gpuMatAllocations{ 0 };
+
+    void* countedMalloc(size_t size) {
+        heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        return std::malloc(size == 0 ? 1 : size);
+    }
+
+    void* countedAlignedMalloc(size_t size, size_t alignment) {
+        heapAllocations.fetch_add(1, std::memory_order_relaxed);
+        if (size == 0) {
+            size = 1;
+        }
+#ifdef _WIN32
+        return _aligned_malloc(size, alignment);
+#else
+        void* p = nullptr;
+        return posix_memalign(&p, std::max(alignment, sizeof(void*)), size) == 0
+            ? p : nullptr;
+#endif
+    }
+
+    void alignedFree(void* p) {
+#ifdef _WIN32
+        _aligned_free(p);
+#else
+        std::free(p);
+#endif
+    }
+
+    // Counts every cv::Mat buffer and forwards to OpenCV's own allocator,
+    // which also stays in charge of freeing (it records itself in UMatData)
+    class CountingMatAllocator : public cv::MatAllocator {
+    public:
+        cv::UMatData* allocate(int dims, const int* sizes, int type,
+            void* data, size_t* step, cv::AccessFlag flags,
+            cv::UMatUsageFlags usageFlags) const override {
+            matAllocations.fetch_add(1, std::memory_order_relaxed);
+            return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data,
+                step, flags, usageFlags);
+        }
+
+        bool allocate(cv::UMatData* data, cv::AccessFlag flags,
+            cv::UMatUsageFlags usageFlags) const override {
+            return cv::Mat::getStdAllocator()->allocate(data, flags, usageFlags);
+        }
+
+        void deallocate(cv::UMatData* data) const override {
+            cv::Mat::getStdAllocator()->deallocate(data);
+        }
+    };
+
+#ifndef STKMB_NO_CUDA
+    // The same for GpuMat device buffers, forwarding to the allocator that
+    // was the default before install()
+    class CountingGpuMatAllocator : public cv::cuda::GpuMat::Allocator {
+    public:
+        explicit CountingGpuMatAllocator(cv::cuda::GpuMat::Allocator* next)
+            : next_(next) {}
+
+        bool allocate(cv::cuda::GpuMat* mat, int rows, int cols,
+            size_t elemSize) override {
+            gpuMatAllocations.fetch_add(1, std::memory_order_relaxed);
+            return next_->allocate(mat, rows, cols, elemSize);
+        }
+
+        void free(cv::cuda::GpuMat* mat) override { next_->free(mat); }
+
+    private:
+        cv::cuda::GpuMat::Allocator* next_;
+    };
+#endif
+
+} // namespace
+
+void AllocationCounter::install() {
+    static CountingMatAllocator allocator;
+    cv::Mat::setDefaultAllocator(&allocator);
+#ifndef STKMB_NO_CUDA
+    static CountingGpuMatAllocator gpuAllocator(
+        cv::cuda::GpuMat::defaultAllocator());
+    cv::cuda::GpuMat::setDefaultAllocator(&gpuAllocator);
+#endif
+}
+
+AllocationCounts AllocationCounter::snapshot() {
+    return { heapAllocations.load(std::memory_order_relaxed),
+        matAllocations.load(std::memory_order_relaxed),
+        gpuMatAllocations.load(std::memory_order_relaxed) };
+}
+
+// Replacements of the global allocation functions
+
+void* operator new(size_t size) {
+    if (void* p = countedMalloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedMalloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedMalloc(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    if (void* p = countedAlignedMalloc(size, static_cast<size_t>(alignment))) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { alignedFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    alignedFree(p);
+}
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+    alignedFree(p);
+}
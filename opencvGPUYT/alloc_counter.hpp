@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+
+// Heap allocation counters for the benchmark executable. Linking
+// alloc_counter.cpp replaces the global operator new/delete family, and
+// install() routes cv::Mat allocations (which bypass operator new) through a
+// counting wrapper of OpenCV's standard allocator, and likewise device
+// buffers of cv::cuda::GpuMat in CUDA builds. Counts cover every thread.
+struct AllocationCounts {
+    uint64_t heap = 0;    // operator new / new[] calls
+    uint64_t mats = 0;    // cv::Mat buffer allocations
+    uint64_t gpuMats = 0; // cv::cuda::GpuMat buffer allocations
+
+    uint64_t total() const { return heap + mats + gpuMats; }
+};
+
+class AllocationCounter {
+public:
+    // Make the counting allocator OpenCV's default; idempotent
+    static void install();
+
+    static AllocationCounts snapshot();
+};
+
+inline AllocationCounts operator-(const AllocationCounts& a,
+    const AllocationCounts& b) {
+    return { a.heap - b.heap, a.mats - b.mats, a.gpuMats - b.gpuMats };
+}
@@ -0,0 +1,203 @@
+#include "autotune.hpp"
+#include "cpu_denoiser.hpp"
+#include "opencv_threads.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace {
+
+    // Run settings over the noisy clip. Always measures the frame rate,
+    // leaving out the first frame (which sets up the engine's buffers);
+    // PSNR and SSIM against the clean clip only when asked to.
+    void runCandidate(const std::vector<cv::Mat>& clean,
+        const std::vector<cv::Mat>& noisy, const DenoiserOptions& base,
+        bool quality, TuningResult& result) {
+        DenoiserOptions options = base;
+        result.settings.applyTo(options);
+        options.threads = 0;
+        options.faceCascade.clear();
+        options.tuningProfiles.clear();
+
+        CpuDenoiser denoiser(options);
+        denoiser.init(noisy.front());
+        const int frames = static_cast<int>(noisy.size());
+        const int firstTimed = frames > 2 ? 2 : 1;
+        double seconds = 0.0, psnr = 0.0, similarity = 0.0;
+        cv::Mat output;
+        for (int f = 1; f < frames; ++f) {
+            auto begin = std::chrono::steady_clock::now();
+            denoiser.process(noisy[f], output);
+            if (f >= firstTimed) {
+                seconds += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - begin).count();
+            }
+            if (quality) {
+                psnr += cv::PSNR(output, clean[f]);
+                similarity += ssim(output, clean[f]);
+            }
+        }
+        result.fps = (frames - firstTimed) / std::max(seconds, 1e-9);
+        if (quality) {
+            result.psnr = psnr / (frames - 1);
+            result.ssim = similarity / (frames - 1);
+        }
+    }
+
+    bool dominates(const TuningResult& a, const TuningResult& b) {
+        return a.psnr >= b.psnr && a.ssim >= b.ssim && a.fps >= b.fps &&
+            (a.psnr > b.psnr || a.ssim > b.ssim || a.fps > b.fps);
+    }
+
+    // Mark the members of indices that no other member dominates
+    void markFront(std::vector<TuningResult>& results,
+        const std::vector<int>& indices) {
+        for (const int i : indices) {
+            results[i].pareto = std::none_of(indices.begin(), indices.end(),
+                [&](int j) { return dominates(results[j], results[i]); });
+        }
+    }
+
+} // namespace
+
+std::vector<TuningSettings> TuningSpace::candidates(
+    const TuningSettings& base) const {
+    std::vector<TuningSettings> settings;
+    for (const float q : processNoise) {
+        for (const int diameter : bilateralDiameter) {
+            for (const float sigma : bilateralSigma) {
+                for (const int levels : bilateralLevels) {
+                    TuningSettings candidate = base;
+                    candidate.filter = { q, diameter, sigma };
+                    candidate.bilateralLevels = levels;
+                    for (const int sparsePath : sparse) {
+                        candidate.sparse = sparsePath != 0;
+                        if (!candidate.sparse) {
+                            candidate.historySize = base.historySize;
+                            candidate.blockSize = base.blockSize;
+                            settings.push_back(candidate);
+                            continue;
+                        }
+                        for (const int history : historySize) {
+                            for (const int block : blockSize) {
+                                candidate.historySize = history;
+                                candidate.blockSize = block;
+                                settings.push_back(candidate);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return settings;
+}
+
+AutotuneReport autotune(const std::vector<cv::Mat>& clean,
+    const DenoiserOptions& base, const AutotuneOptions& options) {
+    CV_Assert(clean.size() >= 2 && options.noiseStd >= 0.0f);
+    for (const cv::Mat& frame : clean) {
+        CV_Assert(frame.type() == CV_8UC1 && frame.size() == clean[0].size());
+    }
+
+    // Noisy copies, the same for every candidate
+    cv::RNG rng(options.seed);
+    std::vector<cv::Mat> noisy(clean.size());
+    cv::Mat noise(clean[0].size(), CV_32F), value;
+    for (size_t f = 0; f < clean.size(); ++f) {
+        rng.fill(noise, cv::RNG::NORMAL, 0.0, options.noiseStd);
+        clean[f].convertTo(value, CV_32F);
+        value += noise;
+        value.convertTo(noisy[f], CV_8U); // Rounds and clips to [0, 255]
+    }
+
+    AutotuneReport report;
+    report.measuredNoise = estimateNoise(noisy.front());
+    const std::vector<TuningSettings> candidates =
+        options.space.candidates(TuningSettings::from(base));
+    CV_Assert(!candidates.empty());
+    report.results.resize(candidates.size());
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        report.results[i].settings = candidates[i];
+    }
+
+    {
+        const int threads = options.threads > 0 ? options.threads
+            : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        SerialOpenCv serialOpenCv;
+        ThreadPool pool(threads);
+        pool.parallelFor(static_cast<int>(candidates.size()), [&](int i) {
+            runCandidate(clean, noisy, base, true, report.results[i]);
+            });
+    }
+    std::vector<int> all(report.results.size());
+    for (size_t i = 0; i < all.size(); ++i) {
+        all[i] = static_cast<int>(i);
+    }
+    markFront(report.results, all);
+
+    // Time the front again without the other candidates competing
+    std::vector<int> front;
+    for (const int i : all) {
+        if (report.results[i].pareto) {
+            runCandidate(clean, noisy, base, false, report.results[i]);
+            front.push_back(i);
+        }
+    }
+    markFront(report.results, front);
+
+    double bestPsnr = -1.0;
+    int best = -1;
+    for (const int i : front) {
+        if (report.results[i].pareto && report.results[i].psnr > bestPsnr) {
+            bestPsnr = report.results[i].psnr;
+            best = i;
+        }
+    }
+    const double target = options.minPsnr > 0.0 ? options.minPsnr
+        : bestPsnr - 0.5;
+    report.chosen = best;
+    for (const int i : front) {
+        const TuningResult& result = report.results[i];
+        if (result.pareto && result.psnr >= target &&
+            result.fps > report.results[report.chosen].fps) {
+            report.chosen = i;
+        }
+    }
+    // The best candidate itself may miss an explicit target
+    if (report.results[report.chosen].psnr < target) {
+        report.chosen = best;
+    }
+    return report;
+}
+
+double ssim(const cv::Mat& a, const cv::Mat& b) {
+    CV_Assert(a.type() == CV_8UC1 && b.type() == CV_8UC1 &&
+        a.size() == b.size());
+    constexpr double c1 = 6.5025;  // (0.01 * 255)^2
+    constexpr double c2 = 58.5225; // (0.03 * 255)^2
+    auto window = [](const cv::Mat& plane) {
+        cv::Mat mean;
+        cv::GaussianBlur(plane, mean, cv::Size(11, 11), 1.5);
+        return mean;
+    };
+
+    cv::Mat x, y;
+    a.convertTo(x, CV_32F);
+    b.convertTo(y, CV_32F);
+    const cv::Mat muX = window(x);
+    const cv::Mat muY = window(y);
+    const cv::Mat muXX = muX.mul(muX);
+    const cv::Mat muYY = muY.mul(muY);
+    const cv::Mat muXY = muX.mul(muY);
+    const cv::Mat sigmaXX = window(x.mul(x)) - muXX;
+    const cv::Mat sigmaYY = window(y.mul(y)) - muYY;
+    const cv::Mat sigmaXY = window(x.mul(y)) - muXY;
+
+    const cv::Mat numerator = (2.0 * muXY + c1).mul(2.0 * sigmaXY + c2);
+    const cv::Mat denominator = (muXX + muYY + c1).mul(sigmaXX + sigmaYY + c2);
+    cv::Mat map;
+    cv::divide(numerator, denominator, map);
+    return cv::mean(map)[0];
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "tuning_profile.hpp"
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Values the autotuner combines. Every combination is one candidate;
+// history and block size only change the output of the sparse path, so
+// dense candidates keep the base options' values for them.
+struct TuningSpace {
+    std::vector<float> processNoise{ 0.05f, 0.1f, 0.2f };
+    std::vector<int> bilateralDiameter{ 3, 5, 7 };
+    std::vector<float> bilateralSigma{ 15.0f, 25.0f, 40.0f };
+    std::vector<int> bilateralLevels{ 0, 4, 8 }; // 0 = exact filter
+    std::vector<int> historySize{ 3, 5 };
+    std::vector<int> blockSize{ 8, 16 };
+    std::vector<int> sparse{ 0, 1 };
+
+    std::vector<TuningSettings> candidates(const TuningSettings& base) const;
+};
+
+struct AutotuneOptions {
+    float noiseStd = 10.0f; // Gaussian noise added to the clean clip
+    uint64_t seed = 12345;  // Of the noise
+    int threads = 0;        // Candidates evaluated at once, 0 = one per core
+    double minPsnr = 0.0;   // Quality the choice must reach, 0 = 0.5 dB
+                            // below the best candidate
+    TuningSpace space;
+};
+
+struct TuningResult {
+    TuningSettings settings;
+    double psnr = 0.0; // Mean over the clip, dB
+    double ssim = 0.0; // Mean over the clip
+    double fps = 0.0;
+    bool pareto = false; // No other result is at least as good in all three
+};
+
+struct AutotuneReport {
+    std::vector<TuningResult> results; // Every candidate, in space order
+    int chosen = -1;                   // Index into results
+    float measuredNoise = 0.0f;        // estimateNoise() of a noisy frame
+};
+
+// Search the space for the Pareto front of PSNR and SSIM against frames/s.
+// Adds noise to the clean luma frames (CV_8UC1) and runs every candidate,
+// applied on top of base, over the noisy clip with its own CpuDenoiser on
+// the whole-frame path. Candidates run in parallel on a pool with OpenCV's
+// own threading off; their fps under that load only selects the front,
+// whose members are then timed again one at a time with OpenCV's default
+// threading. The choice is the fastest front member reaching minPsnr, or
+// the best one when none does. Face detection is left out of the runs.
+AutotuneReport autotune(const std::vector<cv::Mat>& clean,
+    const DenoiserOptions& base, const AutotuneOptions& options);
+
+// Mean structural similarity of two gray frames (Gaussian window of 11
+// pixels, sigma 1.5)
+double ssim(const cv::Mat& a, const cv::Mat& b);
@@ -0,0 +1,144 @@
+#include "bench_suite.hpp"
+#include "benchmark.hpp"
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << std::filesystem::path(argv[0]).filename().string()
+            << " kalman|blocks|history|threads|profile|precision|bilateral|sparse|alloc|store|checkpoint|motion|roi|deadline|streams|api|kernels|graph|autotune [width height [iterations [blockSize [history]]]]\n"
+            << "       " << std::filesystem::path(argv[0]).filename().string()
+            << " suite [results.json [frames [threads]]]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string benchmark{ argv[1] };
+    if (benchmark == "suite") {
+        const std::string jsonPath = argc >= 3 ? argv[2] : "";
+        const int frames = argc >= 4 ? std::stoi(argv[3]) : 60;
+        const int threads = argc >= 5 ? std::stoi(argv[4]) : 0;
+        runBenchmarkSuite(jsonPath, frames, threads);
+        return EXIT_SUCCESS;
+    }
+
+    cv::Size size(1920, 1080);
+    int iterations = 100;
+    if (argc >= 4) {
+        size = cv::Size(std::stoi(argv[2]), std::stoi(argv[3]));
+    }
+    if (argc >= 5) {
+        iterations = std::stoi(argv[4]);
+    }
+    const int blockSize = argc >= 6 ? std::stoi(argv[5]) : 8;
+    const int historySize = argc >= 7 ? std::stoi(argv[6]) : 5;
+
+    if (benchmark == "kalman") {
+        if (!benchmarkKalmanUpdate(size, iterations)) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (benchmark == "blocks") {
+        if (!benchmarkBlockDistance(size, blockSize, historySize,
+            iterations)) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (benchmark == "history") {
+        benchmarkFrameHistory(size, historySize, iterations);
+    }
+    else if (benchmark == "sparse") {
+        // iterations is the clip length here
+        benchmarkSparse(size, iterations);
+    }
+    else if (benchmark == "alloc") {
+        // iterations is the number of frames counted after the warm-up
+        if (!benchmarkAllocations(size, iterations)) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (benchmark == "store") {
+        // iterations is the clip length here
+        if (!benchmarkFrameStore(size, iterations)) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (benchmark == "checkpoint") {
+        // iterations is the clip length here
+        if (!benchmarkCheckpoint(size, iterations)) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (benchmark == "motion") {
+        // iterations is the clip length here
+        benchmarkMotion(size, iterations);
+    }
+    else if (benchmark == "roi") {
+        // iterations is the clip length here
+        benchmarkRegions(size, iterations,
+            "haarcascade_frontalface_default.xml");
+    }
+    else if (benchmark == "deadline") {
+        // iterations is the clip length here
+        if (!benchmarkDeadline(size, iterations)) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (benchmark == "streams") {
+        // iterations is the clip length here
+        if (!benchmarkStreams(size, iterations,
+            4 * static_cast<int>(std::thread::hardware_concurrency()))) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (benchmark == "api") {
+        // iterations is the clip length here
+        if (!benchmarkApi(size, iterations)) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (benchmark == "kernels") {
+        if (!benchmarkKernels(size, iterations)) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (benchmark == "graph") {
+        // iterations is the clip length here
+        if (!benchmarkGraph(size, iterations)) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (benchmark == "autotune") {
+        // iterations is the clip length here
+        if (!benchmarkAutotune(size, iterations)) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (benchmark == "bilateral") {
+        if (!benchmarkBilateral(size, iterations)) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (benchmark == "threads") {
+        // iterations is the clip length here
+        if (!benchmarkThreadScaling(size, iterations,
+            static_cast<int>(std::thread::hardware_concurrency()))) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (benchmark == "profile") {
+        // iterations is the clip length here
+        benchmarkProfiler(size, iterations);
+    }
+    else if (benchmark == "precision") {
+        // iterations is the clip length here
+        benchmarkStatePrecision(size, iterations);
+    }
+    else {
+        std::cerr << "Unknown benchmark '" << benchmark << "'" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
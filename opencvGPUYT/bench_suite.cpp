@@ -0,0 +1,232 @@
+#include "bench_suite.hpp"
+#include "percentile.hpp"
+#include "stmkb_cpu.hpp"
+#include "synthetic_clip.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+    struct SuiteCase {
+        const char* name;
+        cv::Size size;
+        float noiseStd;
+    };
+
+    struct RunResult {
+        double fps = 0.0;
+        double meanMs = 0.0, p50Ms = 0.0, p95Ms = 0.0, p99Ms = 0.0;
+        double peakRssMb = 0.0;
+    };
+
+    // Distinct frames kept in memory per run; longer runs cycle through them
+    // so the 4K cases stay within a few hundred MB
+    constexpr int kMaxClipFrames = 16;
+
+    using Clock = std::chrono::steady_clock;
+
+    // Start a new peak RSS measurement where the platform allows it
+    void resetPeakRss() {
+#ifdef __linux__
+        // "5" resets the VmHWM high-water mark (Linux 4.0+)
+        std::ofstream clearRefs("/proc/self/clear_refs");
+        clearRefs << "5";
+#endif
+    }
+
+    double peakRssMb() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters{};
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+#ifdef __linux__
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind("VmHWM:", 0) == 0) {
+                return std::stod(line.substr(6)) / 1024.0; // kB
+            }
+        }
+#endif
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss / 1024.0; // kB on Linux
+#endif
+    }
+
+    RunResult summarize(std::vector<double> latenciesMs, double totalSeconds) {
+        RunResult result;
+        std::sort(latenciesMs.begin(), latenciesMs.end());
+        result.fps = latenciesMs.size() / totalSeconds;
+        double sum = 0.0;
+        for (double ms : latenciesMs) {
+            sum += ms;
+        }
+        result.meanMs = latenciesMs.empty() ? 0.0 : sum / latenciesMs.size();
+        result.p50Ms = percentile(latenciesMs, 0.50);
+        result.p95Ms = percentile(latenciesMs, 0.95);
+        result.p99Ms = percentile(latenciesMs, 0.99);
+        result.peakRssMb = peakRssMb();
+        return result;
+    }
+
+    double elapsedMs(Clock::time_point begin, Clock::time_point end) {
+        return std::chrono::duration<double, std::milli>(end - begin).count();
+    }
+
+    // Denoise the in-memory clip; only processFrame is timed
+    RunResult runInMemory(const std::vector<cv::Mat>& clip, int frames,
+        int threads) {
+        STKMBCpu denoiser(clip.front());
+        denoiser.setParallel(threads);
+
+        std::vector<double> latencies;
+        latencies.reserve(frames);
+        const auto begin = Clock::now();
+        for (int f = 1; f <= frames; ++f) {
+            const auto frameBegin = Clock::now();
+            denoiser.processFrame(clip[f % clip.size()]);
+            latencies.push_back(elapsedMs(frameBegin, Clock::now()));
+        }
+        const auto end = Clock::now();
+        return summarize(latencies, elapsedMs(begin, end) / 1000.0);
+    }
+
+    // Decode, denoise and encode through files, as the video tool does
+    RunResult runWithFileIo(const std::vector<cv::Mat>& clip, int frames,
+        int threads, const std::filesystem::path& workDir) {
+        const auto inputPath = (workDir / "suite_input.avi").string();
+        const auto outputPath = (workDir / "suite_output.avi").string();
+        const int fourcc = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+        const cv::Size size = clip.front().size();
+
+        {
+            cv::VideoWriter writer(inputPath, fourcc, 30.0, size, true);
+            if (!writer.isOpened()) {
+                throw std::runtime_error("Cannot write " + inputPath);
+            }
+            for (int f = 0; f <= frames; ++f) {
+                writer.write(clip[f % clip.size()]);
+            }
+        }
+
+        cv::VideoCapture capture(inputPath);
+        cv::VideoWriter writer(outputPath, fourcc, 30.0, size, true);
+        if (!capture.isOpened() || !writer.isOpened()) {
+            throw std::runtime_error("Cannot open the suite video files");
+        }
+
+        cv::Mat frame;
+        capture.read(frame);
+        STKMBCpu denoiser(frame);
+        denoiser.setParallel(threads);
+
+        std::vector<double> latencies;
+        latencies.reserve(frames);
+        const auto begin = Clock::now();
+        for (;;) {
+            const auto frameBegin = Clock::now();
+            if (!capture.read(frame)) {
+                break;
+            }
+            writer.write(denoiser.processFrame(frame));
+            latencies.push_back(elapsedMs(frameBegin, Clock::now()));
+        }
+        const auto end = Clock::now();
+
+        capture.release();
+        writer.release();
+        std::filesystem::remove(inputPath);
+        std::filesystem::remove(outputPath);
+        return summarize(latencies, elapsedMs(begin, end) / 1000.0);
+    }
+
+    void writeRun(std::ostream& json, const SuiteCase& suiteCase, bool io,
+        int frames, const RunResult& result) {
+        json << "    {\"resolution\": \"" << suiteCase.name << "\", "
+            << "\"width\": " << suiteCase.size.width << ", "
+            << "\"height\": " << suiteCase.size.height << ", "
+            << "\"noise_std\": " << suiteCase.noiseStd << ", "
+            << "\"file_io\": " << (io ? "true" : "false") << ", "
+            << "\"frames\": " << frames << ", "
+            << "\"fps\": " << result.fps << ", "
+            << "\"latency_ms\": {\"mean\": " << result.meanMs
+            << ", \"p50\": " << result.p50Ms << ", \"p95\": " << result.p95Ms
+            << ", \"p99\": " << result.p99Ms << "}, "
+            << "\"peak_rss_mb\": " << result.peakRssMb << "}";
+    }
+
+} // namespace
+
+void runBenchmarkSuite(const std::string& jsonPath, int frames, int threads) {
+    const SuiteCase cases[] = {
+        { "480p", cv::Size(854, 480), 5.0f },
+        { "480p", cv::Size(854, 480), 10.0f },
+        { "480p", cv::Size(854, 480), 20.0f },
+        { "1080p", cv::Size(1920, 1080), 5.0f },
+        { "1080p", cv::Size(1920, 1080), 10.0f },
+        { "1080p", cv::Size(1920, 1080), 20.0f },
+        { "4k", cv::Size(3840, 2160), 5.0f },
+        { "4k", cv::Size(3840, 2160), 10.0f },
+        { "4k", cv::Size(3840, 2160), 20.0f },
+    };
+    const auto workDir = std::filesystem::temp_directory_path();
+
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3)
+        << "{\n  \"suite\": \"stkmb_cpu\",\n"
+        << "  \"threads\": " << threads << ",\n"
+        << "  \"runs\": [\n";
+
+    bool first = true;
+    for (const auto& suiteCase : cases) {
+        const std::vector<cv::Mat> clip = makeSyntheticClip(suiteCase.size,
+            std::min(frames + 1, kMaxClipFrames), suiteCase.noiseStd);
+
+        for (bool io : { false, true }) {
+            std::cerr << "suite: " << suiteCase.name << " noise "
+                << suiteCase.noiseStd << (io ? " with" : " without")
+                << " file I/O" << std::endl;
+
+            resetPeakRss();
+            const RunResult result = io
+                ? runWithFileIo(clip, frames, threads, workDir)
+                : runInMemory(clip, frames, threads);
+
+            json << (first ? "" : ",\n");
+            writeRun(json, suiteCase, io, frames, result);
+            first = false;
+        }
+    }
+    json << "\n  ]\n}\n";
+
+    if (jsonPath.empty()) {
+        std::cout << json.str();
+    }
+    else {
+        std::ofstream file(jsonPath);
+        if (!file) {
+            throw std::runtime_error("Cannot write " + jsonPath);
+        }
+        file << json.str();
+        std::cerr << "suite: results written to " << jsonPath << std::endl;
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include <string>
+
+// Throughput/latency suite for the CPU denoiser. Runs STKMBCpu over
+// synthetic clips at 480p, 1080p and 4K and three noise levels, once on
+// in-memory frames and once through a VideoCapture -> denoise -> VideoWriter
+// loop on temporary files. Reports frames/s, p50/p95/p99 per-frame latency
+// and peak RSS per run, as JSON to jsonPath (stdout when empty).
+//
+// threads = 0 uses the whole-frame path, otherwise the strip-parallel one.
+// Needs neither CUDA nor a GPU.
+void runBenchmarkSuite(const std::string& jsonPath, int frames, int threads);
@@ -0,0 +1,1740 @@
+#include "benchmark.hpp"
+#include "alloc_counter.hpp"
+#include "autotune.hpp"
+#include "block_distance.hpp"
+#include "block_kernels.hpp"
+#include "checkpoint.hpp"
+#include "cpu_denoiser.hpp"
+#ifndef STKMB_NO_CUDA
+#include "cuda_denoiser.hpp"
+#endif
+#include "deadline.hpp"
+#include "face_regions.hpp"
+#include "fast_bilateral.hpp"
+#include "frame_store.hpp"
+#include "frame_ring.hpp"
+#include "stmkb_cpu.hpp"
+#include "strip_filters.hpp"
+#include "synthetic_clip.hpp"
+#include "kalman_kernel.hpp"
+#include "motion_search.hpp"
+#include "multi_stream.hpp"
+#include "profiler.hpp"
+#include "stkmb.hpp"
+#include "thread_pool.hpp"
+#include "video_processor.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+    // Swallows what a VideoProcessor prints
+    class NullBuffer : public std::streambuf {
+    protected:
+        int overflow(int c) override { return traits_type::not_eof(c); }
+    };
+
+    // In-memory BGR clip seen as a FrameSource
+    class ClipSource : public FrameSource {
+    public:
+        explicit ClipSource(const std::vector<cv::Mat>& clip) : clip_(clip) {
+            info_.size = clip.front().size();
+            info_.frameCount = static_cast<int>(clip.size());
+            info_.format = FrameFormat::Bgr;
+        }
+
+        const StreamInfo& info() const override { return info_; }
+
+        bool read(cv::Mat& frame) override {
+            if (next_ == clip_.size()) {
+                return false;
+            }
+            frame = clip_[next_++];
+            return true;
+        }
+
+    private:
+        const std::vector<cv::Mat>& clip_;
+        StreamInfo info_;
+        size_t next_ = 0;
+    };
+
+    struct KalmanPlanes {
+        cv::Mat z, blurred, bilateral, prevBlurred;
+        cv::Mat x, p, k, r;
+    };
+
+    KalmanPlanes makeRandomPlanes(const cv::Size& size) {
+        cv::RNG rng(12345);
+        KalmanPlanes planes;
+        auto random = [&](float lo, float hi) {
+            cv::Mat plane(size, CV_32F);
+            rng.fill(plane, cv::RNG::UNIFORM, cv::Scalar(lo), cv::Scalar(hi));
+            return plane;
+        };
+        planes.z = random(0.0f, 255.0f);
+        planes.blurred = random(0.0f, 255.0f);
+        planes.bilateral = random(0.0f, 255.0f);
+        planes.prevBlurred = random(0.0f, 255.0f);
+        planes.x = random(0.0f, 255.0f);
+        planes.p = random(0.5f, 2.0f);
+        planes.k = random(0.1f, 0.9f);
+        planes.r = random(1.0f, 10.0f);
+        return planes;
+    }
+
+    KalmanPlanes clonePlanes(const KalmanPlanes& src) {
+        return { src.z.clone(), src.blurred.clone(), src.bilateral.clone(),
+            src.prevBlurred.clone(), src.x.clone(), src.p.clone(),
+            src.k.clone(), src.r.clone() };
+    }
+
+    // Average milliseconds per call of update over the given iterations
+    double timeUpdate(const std::function<void()>& update, int iterations) {
+        update(); // Warm-up, first touch of the planes
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            update();
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(end - begin).count() /
+            iterations;
+    }
+
+} // namespace
+
+bool benchmarkKalmanUpdate(const cv::Size& size, int iterations) {
+    const KalmanPlanes initial = makeRandomPlanes(size);
+
+    // One step from the same state must give the same result
+    KalmanPlanes fused = clonePlanes(initial);
+    KalmanPlanes reference = clonePlanes(initial);
+    kalmanUpdateFused(fused.z, fused.blurred, fused.bilateral,
+        fused.prevBlurred, 0.1f, fused.x, fused.p, fused.k, fused.r);
+    kalmanUpdateReference(reference.z, reference.blurred, reference.bilateral,
+        reference.prevBlurred, 0.1f, reference.x, reference.p, reference.k,
+        reference.r);
+    // Relative to each plane's largest value: P grows with q * delta^2, so
+    // its absolute rounding error is far larger than K's. The fused kernel
+    // may contract multiply-adds, which changes the last bits only.
+    auto relativeDiff = [](const cv::Mat& a, const cv::Mat& b) {
+        return cv::norm(a, b, cv::NORM_INF) /
+            std::max(1.0, cv::norm(b, cv::NORM_INF));
+    };
+    const double maxDiff = std::max(
+        { relativeDiff(fused.x, reference.x),
+          relativeDiff(fused.p, reference.p),
+          relativeDiff(fused.k, reference.k),
+          relativeDiff(fused.r, reference.r) });
+    const bool agree = maxDiff < 1e-5;
+
+    fused = clonePlanes(initial);
+    reference = clonePlanes(initial);
+    const double fusedMs = timeUpdate([&] {
+        kalmanUpdateFused(fused.z, fused.blurred, fused.bilateral,
+            fused.prevBlurred, 0.1f, fused.x, fused.p, fused.k, fused.r);
+        }, iterations);
+    const double referenceMs = timeUpdate([&] {
+        kalmanUpdateReference(reference.z, reference.blurred,
+            reference.bilateral, reference.prevBlurred, 0.1f, reference.x,
+            reference.p, reference.k, reference.r);
+        }, iterations);
+
+    // Compulsory traffic of the update: 8 planes read, 4 planes written
+    const double bytes = 12.0 * sizeof(float) * size.area();
+    auto gbPerSecond = [&](double ms) { return bytes / (ms * 1.0e6); };
+
+    std::cout << std::fixed << std::setprecision(3)
+        << "Kalman update " << size.width << "x" << size.height << ", "
+        << iterations << " iterations\n"
+        << "  reference: " << referenceMs << " ms/frame, "
+        << gbPerSecond(referenceMs) << " GB/s effective\n"
+        << "  fused:     " << fusedMs << " ms/frame, "
+        << gbPerSecond(fusedMs) << " GB/s effective\n"
+        << "  speedup:   " << referenceMs / fusedMs << "x\n"
+        << "  max |fused - reference|: " << std::scientific << maxDiff
+        << std::fixed << " relative" << (agree ? "" : "  MISMATCH")
+        << std::endl;
+    return agree;
+}
+
+bool benchmarkBlockDistance(const cv::Size& size, int blockSize,
+    int historySize, int iterations) {
+    // A static scene seen through noise, so most blocks have small distances
+    cv::RNG rng(12345);
+    cv::Mat scene(size, CV_32F);
+    rng.fill(scene, cv::RNG::UNIFORM, cv::Scalar(0.0f), cv::Scalar(255.0f));
+    auto noisy = [&]() {
+        cv::Mat noise(size, CV_32F);
+        rng.fill(noise, cv::RNG::NORMAL, cv::Scalar(0.0f), cv::Scalar(10.0f));
+        return cv::Mat(scene + noise);
+    };
+
+    FrameRing history(size, CV_32F, historySize);
+    BlockDistanceCache cache(size, blockSize, historySize);
+    for (int i = 0; i < historySize; ++i) {
+        history.push(noisy());
+        cache.push(history.back());
+    }
+    const cv::Mat current = noisy();
+    std::vector<cv::Mat> incoming;
+    for (int i = 0; i <= historySize; ++i) {
+        incoming.push_back(noisy());
+    }
+
+    // Relative to the largest distance: the expansion subtracts terms of
+    // order 255^2 and S is a running CV_32F sum, so the cache keeps a small
+    // rounding error that resync() bounds. Drift in S grows past this.
+    auto relativeDiff = [&](const cv::Mat& cached, const cv::Mat& reference) {
+        return cv::norm(cached, reference, cv::NORM_INF) /
+            std::max(1.0, cv::norm(reference, cv::NORM_INF));
+    };
+
+    cv::Mat cached, reference;
+    cache.compute(current, cached);
+    blockDistanceReference(current,
+        std::vector<cv::Mat>(history.begin(), history.end()), blockSize,
+        reference);
+    const double initialDiff = relativeDiff(cached, reference);
+
+    // Steady state of the cache as the denoiser drives it: one frame leaves,
+    // one enters, S is rebuilt once per history cycle, one query
+    size_t next = 0;
+    const double cachedMs = timeUpdate([&] {
+        const cv::Mat& frame = incoming[next++ % incoming.size()];
+        cache.push(frame, &history.front());
+        history.push(frame);
+        if (cache.resyncDue()) {
+            cache.resync(history);
+        }
+        cache.compute(current, cached);
+        }, iterations);
+    const std::vector<cv::Mat> frames(history.begin(), history.end());
+    const double referenceMs = timeUpdate([&] {
+        blockDistanceReference(current, frames, blockSize, reference);
+        }, iterations);
+    const double steadyDiff = relativeDiff(cached, reference);
+    const bool agree = initialDiff < 1e-3 && steadyDiff < 1e-3;
+
+    std::cout << std::fixed << std::setprecision(3)
+        << "Block distance " << size.width << "x" << size.height << ", "
+        << blockSize << "x" << blockSize << " blocks, history " << historySize
+        << ", " << iterations << " iterations\n"
+        << "  reference: " << referenceMs << " ms/frame\n"
+        << "  cached:    " << cachedMs << " ms/frame\n"
+        << "  speedup:   " << referenceMs / cachedMs << "x\n"
+        << "  max |cached - reference|: " << std::scientific << initialDiff
+        << " relative, " << steadyDiff << " after the timed pushes"
+        << std::fixed << (agree ? "" : "  MISMATCH") << std::endl;
+    return agree;
+}
+
+void benchmarkFrameHistory(const cv::Size& size, int historySize,
+    int iterations) {
+    cv::Mat frame(size, CV_32F);
+    cv::randu(frame, cv::Scalar(0.0f), cv::Scalar(255.0f));
+
+    std::deque<cv::Mat> deque;
+    const double dequeMs = timeUpdate([&] {
+        if (static_cast<int>(deque.size()) >= historySize) {
+            deque.pop_front();
+        }
+        deque.push_back(frame.clone());
+        }, iterations);
+
+    FrameRing ring(size, CV_32F, historySize);
+    const double ringMs = timeUpdate([&] { ring.push(frame); }, iterations);
+
+    std::cout << std::fixed << std::setprecision(3)
+        << "Frame history " << size.width << "x" << size.height
+        << ", depth " << historySize << ", " << iterations << " iterations\n"
+        << "  deque + clone: " << dequeMs << " ms/frame\n"
+        << "  ring:          " << ringMs << " ms/frame\n"
+        << "  ring allocations: " << ring.allocations() << std::endl;
+}
+
+bool benchmarkThreadScaling(const cv::Size& size, int frames, int maxThreads) {
+    const std::vector<cv::Mat> clip = makeSyntheticClip(size, frames + 1, 10.0f);
+
+    // threads = 0 is the whole-frame path
+    auto run = [&](int threads, std::vector<cv::Mat>* outputs) {
+        STKMBCpu denoiser(clip.front());
+        denoiser.setParallel(threads);
+        auto begin = std::chrono::steady_clock::now();
+        for (int f = 1; f <= frames; ++f) {
+            cv::Mat output = denoiser.processFrame(clip[f]);
+            if (outputs) {
+                outputs->push_back(output);
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        return frames / std::chrono::duration<double>(end - begin).count();
+    };
+
+    auto maxDiff = [&](const std::vector<cv::Mat>& a,
+        const std::vector<cv::Mat>& b) {
+        double diff = 0.0;
+        for (int f = 0; f < frames; ++f) {
+            diff = std::max(diff, cv::norm(a[f], b[f], cv::NORM_INF));
+        }
+        return diff;
+    };
+
+    // cv::bilateralFilter interpolates its range weights where the strips'
+    // BilateralLut has them exact, so the whole-frame path may round a grey
+    // level differently; every strip run must match the 1-thread one exactly
+    constexpr double kWholeFrameTolerance = 2.0;
+    std::vector<cv::Mat> wholeFrame, serial;
+    const double wholeFrameFps = run(0, &wholeFrame);
+    const double serialFps = run(1, &serial);
+    const double wholeFrameDiff = maxDiff(wholeFrame, serial);
+    bool consistent = wholeFrameDiff <= kWholeFrameTolerance;
+    std::cout << std::fixed << std::setprecision(2)
+        << "Thread scaling " << size.width << "x" << size.height << ", "
+        << frames << " frames\n"
+        << "  whole-frame path: " << wholeFrameFps << " fps, max diff vs 1"
+        " thread " << wholeFrameDiff << (consistent ? "" : "  MISMATCH")
+        << "\n"
+        << "  1 thread:  " << serialFps << " fps\n";
+
+    for (int threads = 2; threads <= maxThreads; threads *= 2) {
+        std::vector<cv::Mat> outputs;
+        const double fps = run(threads, &outputs);
+        const double diff = maxDiff(outputs, serial);
+        consistent = consistent && diff == 0.0;
+        std::cout << "  " << threads << " threads: " << fps << " fps, "
+            << fps / serialFps << "x, max diff vs 1 thread " << diff
+            << (diff == 0.0 ? "" : "  MISMATCH") << "\n";
+    }
+    std::cout.flush();
+    return consistent;
+}
+
+void benchmarkProfiler(const cv::Size& size, int frames) {
+    const std::vector<cv::Mat> clip = makeSyntheticClip(size, frames + 1, 10.0f);
+
+    auto run = [&](bool profiled) {
+        Profiler::setEnabled(profiled);
+        STKMBCpu denoiser(clip.front());
+        cv::Mat output;
+        auto begin = std::chrono::steady_clock::now();
+        for (int f = 1; f <= frames; ++f) {
+            denoiser.processFrame(clip[f], output);
+        }
+        auto end = std::chrono::steady_clock::now();
+        Profiler::setEnabled(false);
+        return std::chrono::duration<double, std::milli>(end - begin).count() /
+            frames;
+    };
+
+    // Best of several alternating rounds to keep frequency drift out
+    run(false);
+    double disabled = 1e300, enabled = 1e300;
+    for (int round = 0; round < 5; ++round) {
+        disabled = std::min(disabled, run(false));
+        enabled = std::min(enabled, run(true));
+    }
+    Profiler::reset();
+
+    std::cout << std::fixed << std::setprecision(3)
+        << "Profiler overhead " << size.width << "x" << size.height << ", "
+        << frames << " frames\n"
+        << "  disabled: " << disabled << " ms/frame\n"
+        << "  enabled:  " << enabled << " ms/frame ("
+        << std::setprecision(2) << (enabled / disabled - 1.0) * 100.0
+        << "% over disabled)" << std::endl;
+}
+
+void benchmarkStatePrecision(const cv::Size& size, int frames) {
+    // Noise 0 gives the same scene without noise
+    const std::vector<cv::Mat> clean = makeSyntheticClip(size, frames + 1, 0.0f);
+
+    struct Run {
+        double fps = 0.0;
+        double psnr = 0.0; // Mean over frames, against the clean clip
+        size_t stateBytes = 0;
+        std::vector<cv::Mat> outputs;
+    };
+    auto run = [&](const std::vector<cv::Mat>& clip, StatePrecision precision) {
+        Run result;
+        STKMBCpu denoiser(clip.front(), 5, 8, precision);
+        auto begin = std::chrono::steady_clock::now();
+        for (int f = 1; f <= frames; ++f) {
+            result.outputs.push_back(denoiser.processFrame(clip[f]));
+        }
+        auto end = std::chrono::steady_clock::now();
+        result.fps = frames / std::chrono::duration<double>(end - begin).count();
+        for (int f = 0; f < frames; ++f) {
+            result.psnr += cv::PSNR(result.outputs[f], clean[f + 1]) / frames;
+        }
+        result.stateBytes = denoiser.stateBytes();
+        return result;
+    };
+
+    std::cout << std::fixed << std::setprecision(2)
+        << "State precision " << size.width << "x" << size.height << ", "
+        << frames << " frames\n";
+    for (float noise : { 5.0f, 10.0f, 20.0f }) {
+        const std::vector<cv::Mat> clip = makeSyntheticClip(size, frames + 1,
+            noise);
+        const Run full = run(clip, StatePrecision::Float32);
+        const Run compact = run(clip, StatePrecision::Compact);
+
+        double agreement = 0.0;
+        for (int f = 0; f < frames; ++f) {
+            agreement += cv::PSNR(compact.outputs[f], full.outputs[f]) / frames;
+        }
+
+        std::cout << "  noise " << noise << ":\n"
+            << "    float32: " << full.stateBytes / 1048576.0 << " MB state, "
+            << full.fps << " fps, " << full.psnr << " dB\n"
+            << "    compact: " << compact.stateBytes / 1048576.0 << " MB state, "
+            << compact.fps << " fps, " << compact.psnr << " dB ("
+            << compact.psnr - full.psnr << " dB), " << agreement
+            << " dB against float32\n";
+    }
+    std::cout.flush();
+}
+
+bool benchmarkBilateral(const cv::Size& size, int iterations) {
+    const float sigma = 25.0f; // STKMBCpu's sigmaValue_
+    cv::Mat gray, grayFloat;
+    cv::cvtColor(makeSyntheticClip(size, 1, 10.0f).front(), gray,
+        cv::COLOR_BGR2GRAY);
+    gray.convertTo(grayFloat, CV_32F);
+
+    // Every output is a weighted mean of its window, or the pixel itself,
+    // so it lies within the window's range; NaN fails the comparisons too
+    bool bounded = true;
+    auto withinWindow = [&](const cv::Mat& output, int d) {
+        const cv::Mat kernel = cv::Mat::ones(d, d, CV_8U);
+        cv::Mat low, high;
+        cv::erode(grayFloat, low, kernel, cv::Point(-1, -1), 1,
+            cv::BORDER_REFLECT_101);
+        cv::dilate(grayFloat, high, kernel, cv::Point(-1, -1), 1,
+            cv::BORDER_REFLECT_101);
+        const int pixels = output.rows * output.cols;
+        const bool within = cv::checkRange(output) &&
+            cv::countNonZero(output >= low - 1e-3f) == pixels &&
+            cv::countNonZero(output <= high + 1e-3f) == pixels;
+        bounded = bounded && within;
+        return within;
+    };
+
+    std::cout << std::fixed << std::setprecision(3)
+        << "Bilateral filter " << size.width << "x" << size.height << "\n";
+    for (int d : { 5, 7, 9 }) {
+        const int radius = d / 2;
+        cv::Mat padded;
+        cv::copyMakeBorder(gray, padded, radius, radius, radius, radius,
+            cv::BORDER_REFLECT_101);
+
+        cv::Mat exact;
+        const double exactMs = timeUpdate([&] {
+            cv::bilateralFilter(grayFloat, exact, d, sigma, sigma);
+            }, iterations);
+        std::cout << "  d=" << d << "\n"
+            << "    cv::bilateralFilter: " << exactMs << " ms\n";
+
+        auto report = [&](const std::string& name, double ms,
+            const cv::Mat& output) {
+            cv::Mat diff;
+            cv::absdiff(output, exact, diff);
+            double maxDiff = 0.0;
+            cv::minMaxLoc(diff, nullptr, &maxDiff);
+            std::cout << "    " << name << ": " << ms << " ms ("
+                << exactMs / ms << "x), mean abs diff "
+                << cv::mean(diff)[0] << ", max " << maxDiff
+                << (withinWindow(output, d) ? "" : "  OUT OF RANGE") << "\n";
+        };
+
+        const BilateralLut lut(d, sigma, sigma);
+        std::vector<float> scratch;
+        cv::Mat lutOutput;
+        report("BilateralLut", timeUpdate([&] {
+            lut.apply(padded, lutOutput, scratch);
+            }, iterations), lutOutput);
+
+        for (int levels : { 4, 8, 16 }) {
+            const FastBilateral fast(d, sigma, sigma, levels);
+            FastBilateral::Buffers buffers;
+            cv::Mat fastOutput;
+            const double ms = timeUpdate([&] {
+                fast.apply(padded, fastOutput, buffers);
+                }, iterations);
+            report("FastBilateral " + std::to_string(levels) + " levels, box "
+                + std::to_string(fast.boxSize()), ms, fastOutput);
+        }
+    }
+
+    // Levels 50 sigma apart: the weights far from a level underflow
+    {
+        const float narrow = 5.0f;
+        cv::Mat padded, exact, fastOutput;
+        cv::copyMakeBorder(gray, padded, 2, 2, 2, 2, cv::BORDER_REFLECT_101);
+        cv::bilateralFilter(grayFloat, exact, 5, narrow, sigma);
+        const FastBilateral fast(5, narrow, sigma, 2);
+        FastBilateral::Buffers buffers;
+        fast.apply(padded, fastOutput, buffers);
+        const bool finite = cv::checkRange(fastOutput);
+        const bool within = withinWindow(fastOutput, 5);
+        std::cout << "  sigmaColor " << narrow << ", 2 levels: "
+            << (finite ? "finite" : "NOT FINITE")
+            << (within ? ", within its windows" : ", OUT OF RANGE")
+            << ", max abs diff "
+            << (finite ? cv::norm(fastOutput, exact, cv::NORM_INF) : 0.0)
+            << "\n";
+    }
+    std::cout.flush();
+    return bounded;
+}
+
+void benchmarkSparse(const cv::Size& size, int frames) {
+    std::cout << std::fixed << std::setprecision(2)
+        << "Sparse processing " << size.width << "x" << size.height << ", "
+        << frames << " frames\n";
+
+    for (int panStep : { 0, 2 }) {
+        const std::vector<cv::Mat> clip = makeSyntheticClip(size, frames + 1,
+            10.0f, 12345, panStep);
+        const std::vector<cv::Mat> clean = makeSyntheticClip(size, frames + 1,
+            0.0f, 12345, panStep);
+
+        auto run = [&](bool sparse) {
+            STKMBCpu denoiser(clip.front());
+            denoiser.setSparse(sparse);
+            double psnr = 0.0, full = 0.0, temporal = 0.0, frozen = 0.0;
+            double seconds = 0.0;
+            cv::Mat output;
+            for (int f = 1; f <= frames; ++f) {
+                auto begin = std::chrono::steady_clock::now();
+                denoiser.processFrame(clip[f], output);
+                seconds += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - begin).count();
+                psnr += cv::PSNR(output, clean[f]) / frames;
+
+                const SparseStats& stats = denoiser.sparseStats();
+                const double blocks = std::max(1,
+                    stats.full + stats.temporal + stats.frozen);
+                full += stats.full / blocks / frames;
+                temporal += stats.temporal / blocks / frames;
+                frozen += stats.frozen / blocks / frames;
+            }
+            std::cout << "    " << (sparse ? "sparse" : "dense ") << ": "
+                << frames / seconds << " fps, " << psnr << " dB";
+            if (sparse) {
+                std::cout << ", blocks " << full * 100.0 << "% full, "
+                    << temporal * 100.0 << "% temporal, " << frozen * 100.0
+                    << "% frozen";
+            }
+            std::cout << "\n";
+        };
+
+        std::cout << "  " << (panStep ? "panning camera" : "static camera")
+            << ":\n";
+        run(false);
+        run(true);
+    }
+    std::cout.flush();
+}
+
+bool benchmarkAllocations(const cv::Size& size, int frames) {
+    // OpenCV's own worker threads allocate per parallel_for_ call; the strip
+    // path brings its own threads, so OpenCV runs serially for the count
+    const int openCvThreads = cv::getNumThreads();
+    cv::setNumThreads(0);
+    AllocationCounter::install();
+
+    // Enough frames to fill the history and grow every scratch buffer
+    constexpr int kWarmUp = 8;
+    const std::vector<cv::Mat> clip = makeSyntheticClip(size, 16, 10.0f);
+    std::vector<cv::Mat> lumaClip(clip.size());
+    for (size_t i = 0; i < clip.size(); ++i) {
+        cv::cvtColor(clip[i], lumaClip[i], cv::COLOR_BGR2GRAY);
+    }
+    const int threads =
+        std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+
+    std::cout << "Allocations per frame " << size.width << "x" << size.height
+        << ", " << frames << " frames after " << kWarmUp << " warm-up, N = "
+        << threads << "\n";
+    bool clean = true;
+    auto measure = [&](const char* name, bool luma, const char* note,
+        const std::function<void(const cv::Mat&, cv::Mat&)>& process) {
+        const std::vector<cv::Mat>& input = luma ? lumaClip : clip;
+        cv::Mat output;
+        for (int f = 1; f <= kWarmUp; ++f) {
+            process(input[f % input.size()], output);
+        }
+        uint64_t total = 0, worst = 0;
+        for (int f = kWarmUp + 1; f <= kWarmUp + frames; ++f) {
+            const AllocationCounts before = AllocationCounter::snapshot();
+            process(input[f % input.size()], output);
+            const uint64_t count =
+                (AllocationCounter::snapshot() - before).total();
+            total += count;
+            worst = std::max(worst, count);
+        }
+
+        // A note marks a configuration that is reported only
+        const bool failed = !note && total > 0;
+        clean = clean && !failed;
+        std::cout << "  " << (luma ? "luma " : "bgr  ") << std::left
+            << std::setw(20) << name << std::right << " "
+            << static_cast<double>(total) / frames << " mean, " << worst
+            << " max" << (failed ? "  FAILED" : "");
+        if (note) {
+            std::cout << "  (" << note << ")";
+        }
+        std::cout << "\n";
+    };
+
+    struct Config {
+        const char* name;
+        int threads;
+        bool sparse;
+        bool frameGraph;
+        BilateralMode bilateral;
+        StatePrecision precision;
+        const char* note;
+    };
+    const char* exactNote = "cv::bilateralFilter allocates, not asserted";
+    const Config configs[] = {
+        { "whole frame, exact", 0, false, true, BilateralMode::Exact,
+            StatePrecision::Float32, exactNote },
+        { "whole frame, fast", 0, false, true, BilateralMode::Fast,
+            StatePrecision::Float32, nullptr },
+        { "whole frame, compact", 0, false, true, BilateralMode::Fast,
+            StatePrecision::Compact, nullptr },
+        { "hand-written, fast", 0, false, false, BilateralMode::Fast,
+            StatePrecision::Float32, nullptr },
+        { "strip x1, exact", 1, false, true, BilateralMode::Exact,
+            StatePrecision::Float32, nullptr },
+        { "strip xN, exact", threads, false, true, BilateralMode::Exact,
+            StatePrecision::Float32, nullptr },
+        { "strip xN, fast", threads, false, true, BilateralMode::Fast,
+            StatePrecision::Float32, nullptr },
+        { "strip xN, compact", threads, false, true, BilateralMode::Exact,
+            StatePrecision::Compact, nullptr },
+        { "sparse x1", 0, true, true, BilateralMode::Exact,
+            StatePrecision::Float32, nullptr },
+        { "sparse xN, fast", threads, true, true, BilateralMode::Fast,
+            StatePrecision::Float32, nullptr },
+        { "sparse xN, compact", threads, true, true, BilateralMode::Exact,
+            StatePrecision::Compact, nullptr },
+    };
+    for (const bool luma : { false, true }) {
+        for (const Config& config : configs) {
+            STKMBCpu denoiser((luma ? lumaClip : clip).front(), 5, 8,
+                config.precision);
+            denoiser.setParallel(config.threads);
+            denoiser.setSparse(config.sparse);
+            denoiser.setBilateral(config.bilateral);
+            denoiser.setFrameGraph(config.frameGraph);
+            measure(config.name, luma, config.note,
+                [&](const cv::Mat& frame, cv::Mat& output) {
+                    denoiser.processFrame(frame, output);
+                });
+        }
+    }
+
+#ifndef STKMB_NO_CUDA
+    // STKMBGpu behind its backend, device buffers included
+    if (CudaDenoiser::available()) {
+        for (const bool luma : { false, true }) {
+            CudaDenoiser denoiser{ DenoiserOptions() };
+            denoiser.init((luma ? lumaClip : clip).front());
+            measure("cuda", luma, nullptr,
+                [&](const cv::Mat& frame, cv::Mat& output) {
+                    denoiser.process(frame, output);
+                });
+        }
+    }
+#endif
+
+    // The whole VideoProcessor pipeline on a Y4M luma clip with the fast
+    // filter. Runs of N and 2N frames share their setup, so the difference
+    // is what N more frames allocate; the progress bar redraws at most every
+    // 100 ms and may allocate for that, which stays well below one per frame.
+    {
+        const auto temporary = std::filesystem::temp_directory_path();
+        const std::string inputPath =
+            (temporary / "stkmb_bench_alloc.y4m").string();
+        const std::string outputPath =
+            (temporary / "stkmb_bench_alloc_out.y4m").string();
+        StreamInfo info;
+        info.size = size;
+        info.format = FrameFormat::Gray;
+        {
+            auto sink = openRawSink(inputPath, StreamFormat::Y4m, info,
+                FrameFormat::Gray);
+            for (int f = 0; f < 2 * frames; ++f) {
+                sink->write(lumaClip[f % lumaClip.size()]);
+            }
+            sink->close();
+        }
+
+        auto pipeline = [&](int count) {
+            DenoiserOptions options;
+            options.bilateralLevels = 8;
+            StreamOptions streams;
+            streams.inputFormat = StreamFormat::Y4m;
+            streams.frameLimit = count;
+            streams.outputPath = outputPath;
+            streams.outputFormat = StreamFormat::Y4m;
+            const AllocationCounts before = AllocationCounter::snapshot();
+            VideoProcessor(inputPath, std::make_unique<CpuDenoiser>(options),
+                4, ColorMode::Luma, streams).process();
+            return (AllocationCounter::snapshot() - before).total();
+        };
+        NullBuffer discard;
+        std::streambuf* console = std::cout.rdbuf(&discard);
+        const uint64_t shortRun = pipeline(frames);
+        const uint64_t longRun = pipeline(2 * frames);
+        std::cout.rdbuf(console);
+        std::filesystem::remove(inputPath);
+        std::filesystem::remove(outputPath);
+
+        const uint64_t extra = longRun > shortRun ? longRun - shortRun : 0;
+        const bool failed = extra >= static_cast<uint64_t>(frames);
+        clean = clean && !failed;
+        std::cout << "  luma VideoProcessor, fast " << extra << " more for "
+            << frames << " more frames" << (failed ? "  FAILED" : "") << "\n";
+    }
+
+    std::cout << (clean ? "No allocations in steady state"
+        : "Steady-state allocations found") << std::endl;
+
+    cv::setNumThreads(openCvThreads);
+    return clean;
+}
+
+bool benchmarkFrameStore(const cv::Size& size, int frames) {
+    CV_Assert(size.width % 2 == 0 && size.height % 2 == 0);
+    const std::vector<cv::Mat> clip = makeSyntheticClip(size, frames, 10.0f);
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "stkmb_bench.stkraw").string();
+    auto seconds = [](auto begin) {
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+    };
+
+    ClipSource source(clip);
+    auto begin = std::chrono::steady_clock::now();
+    writeFrameStore(source, path, FrameFormat::I420);
+    const double writeSeconds = seconds(begin);
+
+    int mismatches = 0;
+    {
+        FrameStoreSource store(path);
+        const double frameBytes = size.area() * 1.5;
+
+        // Sequential pass touching every byte through the mapping
+        begin = std::chrono::steady_clock::now();
+        cv::Mat frame;
+        double checksum = 0.0;
+        while (store.read(frame)) {
+            checksum += cv::sum(frame)[0];
+        }
+        const double readSeconds = seconds(begin);
+
+        // Random access against the frames that went in
+        cv::RNG rng(12345);
+        cv::Mat expected;
+        for (int i = 0; i < std::min(frames, 32); ++i) {
+            const int index = rng.uniform(0, frames);
+            cv::cvtColor(clip[index], expected, cv::COLOR_BGR2YUV_I420);
+            mismatches += !store.seek(index) || !store.read(frame) ||
+                cv::norm(frame, expected, cv::NORM_INF) != 0.0;
+        }
+
+        // Denoising straight from the mapped Y planes
+        store.seek(0);
+        store.read(frame);
+        STKMBCpu denoiser(frame.rowRange(0, size.height));
+        cv::Mat output;
+        begin = std::chrono::steady_clock::now();
+        while (store.read(frame)) {
+            denoiser.processFrame(frame.rowRange(0, size.height), output);
+        }
+        const double denoiseSeconds = seconds(begin);
+
+        std::cout << std::fixed << std::setprecision(2)
+            << "Frame store " << size.width << "x" << size.height << " I420, "
+            << frames << " frames, " << std::filesystem::file_size(path) / 1e6
+            << " MB\n"
+            << "  write:            " << frames / writeSeconds << " fps\n"
+            << "  mapped read:      " << frames / readSeconds << " fps, "
+            << frames * frameBytes / readSeconds / 1e9 << " GB/s (checksum "
+            << checksum << ")\n"
+            << "  denoise from map: " << (frames - 1) / denoiseSeconds
+            << " fps\n"
+            << "  random seeks:     "
+            << (mismatches == 0 ? "match" : "MISMATCH") << std::endl;
+    }
+    std::filesystem::remove(path);
+    return mismatches == 0;
+}
+
+bool benchmarkCheckpoint(const cv::Size& size, int frames) {
+    CV_Assert(frames >= 4);
+    const std::vector<cv::Mat> clip = makeSyntheticClip(size, frames, 10.0f);
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "stkmb_bench.ckpt").string();
+    const int resumeAt = frames / 2;
+    const int threads =
+        std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+    auto seconds = [](auto begin) {
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+    };
+
+    struct Config {
+        const char* name;
+        DenoiserOptions options;
+    };
+    std::vector<Config> configs(6);
+    configs[0].name = "whole frame";
+    configs[1].name = "strips";
+    configs[1].options.threads = threads;
+    configs[2].name = "strips, compact";
+    configs[2].options.threads = threads;
+    configs[2].options.compactState = true;
+    configs[3].name = "strips, fast";
+    configs[3].options.threads = threads;
+    configs[3].options.bilateralLevels = 8;
+    configs[4].name = "sparse";
+    configs[4].options.threads = threads;
+    configs[4].options.sparse = true;
+    configs[5].name = "motion";
+    configs[5].options.threads = threads;
+    configs[5].options.motion = true;
+
+    std::cout << std::fixed << std::setprecision(2) << "Checkpoint resume "
+        << size.width << "x" << size.height << ", " << frames
+        << " frames, resumed at frame " << resumeAt << "\n";
+    bool exact = true;
+    for (const Config& config : configs) {
+        // Uninterrupted run
+        CpuDenoiser reference(config.options);
+        reference.init(clip.front());
+        std::vector<cv::Mat> expected(frames);
+        for (int f = 0; f < frames; ++f) {
+            reference.process(clip[f], expected[f]);
+        }
+
+        // Interrupted run, checkpointed through the background writer
+        double saveSeconds = 0.0;
+        double writeSeconds = 0.0;
+        {
+            CpuDenoiser first(config.options);
+            first.init(clip.front());
+            CheckpointWriter writer(path, "bench", 0);
+            cv::Mat output;
+            for (int f = 0; f < resumeAt; ++f) {
+                first.process(clip[f], output);
+            }
+            auto begin = std::chrono::steady_clock::now();
+            writer.save(first, resumeAt);
+            saveSeconds = seconds(begin);
+            writer.flush();
+            writeSeconds = seconds(begin);
+        }
+
+        // A new engine picks up from the file
+        const Checkpoint checkpoint = readCheckpoint(path);
+        CpuDenoiser resumed(config.options);
+        resumed.init(clip[checkpoint.nextFrame]);
+        resumed.restoreState(checkpoint.state);
+        double diff = 0.0;
+        cv::Mat output;
+        for (int f = static_cast<int>(checkpoint.nextFrame); f < frames; ++f) {
+            resumed.process(clip[f], output);
+            diff = std::max(diff, cv::norm(output, expected[f], cv::NORM_INF));
+        }
+        exact = exact && diff == 0.0;
+
+        std::cout << "  " << std::left << std::setw(16) << config.name
+            << std::right << std::setw(8)
+            << std::filesystem::file_size(path) / 1e6 << " MB, save "
+            << saveSeconds * 1000.0 << " ms on the caller, written after "
+            << writeSeconds * 1000.0 << " ms, "
+            << (diff == 0.0 ? "bit-exact" : "MISMATCH") << "\n";
+    }
+
+    // A flipped byte must be caught by the checksum, and a state must not
+    // restore into an engine with other options
+    bool rejected = false;
+    {
+        std::FILE* file = std::fopen(path.c_str(), "r+b");
+        std::fseek(file, sizeof(CheckpointHeader) + 64, SEEK_SET);
+        const int byte = std::fgetc(file);
+        std::fseek(file, sizeof(CheckpointHeader) + 64, SEEK_SET);
+        std::fputc(byte ^ 0x01, file);
+        std::fclose(file);
+        try {
+            readCheckpoint(path);
+        }
+        catch (const std::runtime_error&) {
+            rejected = true;
+        }
+    }
+    bool mismatchRejected = false;
+    {
+        CpuDenoiser sparse(configs[4].options);
+        sparse.init(clip.front());
+        EngineState state;
+        sparse.saveState(state);
+        CpuDenoiser dense(configs[0].options);
+        dense.init(clip.front());
+        try {
+            dense.restoreState(state);
+        }
+        catch (const std::invalid_argument&) {
+            mismatchRejected = true;
+        }
+    }
+
+    // A held snapshot only reaches the file once its frames are written
+    bool heldBack = false;
+    {
+        std::filesystem::remove(path);
+        CpuDenoiser denoiser(configs[0].options);
+        denoiser.init(clip.front());
+        CheckpointWriter writer(path, "bench", 0);
+        writer.hold(denoiser, resumeAt);
+        writer.release(resumeAt - 1);
+        writer.flush();
+        const bool early = std::filesystem::exists(path);
+        writer.release(resumeAt);
+        writer.flush();
+        heldBack = !early && std::filesystem::exists(path) &&
+            readCheckpoint(path).nextFrame == resumeAt;
+    }
+    std::filesystem::remove(path);
+
+    std::cout << "  corrupted file:   " << (rejected ? "rejected" : "ACCEPTED")
+        << "\n  other options:    "
+        << (mismatchRejected ? "rejected" : "ACCEPTED")
+        << "\n  held snapshot:    "
+        << (heldBack ? "written after its frames" : "WRITTEN EARLY")
+        << std::endl;
+    return exact && rejected && mismatchRejected && heldBack;
+}
+
+void benchmarkMotion(const cv::Size& size, int frames) {
+    CV_Assert(frames >= 2);
+    constexpr int panStep = 2;
+    const int threads =
+        std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+    const std::vector<cv::Mat> clip = makeSyntheticClip(size, frames + 1,
+        10.0f, 12345, panStep);
+    const std::vector<cv::Mat> clean = makeSyntheticClip(size, frames + 1,
+        0.0f, 12345, panStep);
+    std::vector<cv::Mat> gray(clip.size());
+    for (size_t f = 0; f < clip.size(); ++f) {
+        cv::cvtColor(clip[f], gray[f], cv::COLOR_BGR2GRAY);
+    }
+
+    std::cout << std::fixed << std::setprecision(2) << "Motion search "
+        << size.width << "x" << size.height << ", " << frames
+        << " frames, pan of " << panStep << " px per frame\n";
+
+    // Throughput, and how many blocks find the pan. Blocks whose match
+    // would leave the frame and the moving square cannot, so a few percent
+    // off is expected.
+    ThreadPool pool(threads);
+    for (ThreadPool* p : { static_cast<ThreadPool*>(nullptr), &pool }) {
+        MotionSearch search(size);
+        double seconds = 0.0;
+        double found = 0.0;
+        for (int f = 1; f <= frames; ++f) {
+            auto begin = std::chrono::steady_clock::now();
+            search.estimate(gray[f], gray[f - 1], p);
+            seconds += std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - begin).count();
+
+            const cv::Mat& vectors = search.vectors();
+            int hits = 0;
+            for (int by = 0; by < vectors.rows; ++by) {
+                const cv::Point* row = vectors.ptr<cv::Point>(by);
+                for (int bx = 0; bx < vectors.cols; ++bx) {
+                    hits += row[bx] == cv::Point(panStep, 0);
+                }
+            }
+            found += static_cast<double>(hits) / vectors.total() / frames;
+        }
+        const double blocks = static_cast<double>(search.grid().area());
+        std::cout << "  " << (p ? std::to_string(threads) + " threads"
+            : std::string("1 thread")) << ": "
+            << seconds * 1000.0 / frames << " ms per frame, "
+            << blocks * frames / seconds / 1e6 << " M vectors/s, "
+            << found * 100.0 << "% of blocks on the pan\n";
+    }
+
+    // What the compensated state buys on the panning clip
+    auto run = [&](bool motion) {
+        DenoiserOptions options;
+        options.threads = threads;
+        options.motion = motion;
+        CpuDenoiser denoiser(options);
+        denoiser.init(clip.front());
+        double psnr = 0.0;
+        double seconds = 0.0;
+        cv::Mat output;
+        for (int f = 1; f <= frames; ++f) {
+            auto begin = std::chrono::steady_clock::now();
+            denoiser.process(clip[f], output);
+            seconds += std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - begin).count();
+            psnr += cv::PSNR(output, clean[f]) / frames;
+        }
+        std::cout << "  " << (motion ? "compensated" : "dense      ") << ": "
+            << frames / seconds << " fps, " << psnr << " dB\n";
+    };
+    run(false);
+    run(true);
+    std::cout.flush();
+}
+
+void benchmarkRegions(const cv::Size& size, int frames,
+    const std::string& cascadePath) {
+    CV_Assert(frames >= 1);
+    const std::vector<cv::Mat> clip = makeSyntheticClip(size, frames + 1,
+        10.0f);
+    const std::vector<cv::Mat> clean = makeSyntheticClip(size, frames + 1,
+        0.0f);
+    const int threads =
+        std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+    auto seconds = [](auto begin) {
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+    };
+
+    std::cout << std::fixed << std::setprecision(2) << "Region of interest "
+        << size.width << "x" << size.height << ", " << frames << " frames\n";
+
+    // Detector cost, which the interval divides
+    try {
+        FaceRegionOptions options;
+        options.cascadePath = cascadePath;
+        options.interval = 1;
+        FaceRegions faces(options);
+        for (int f = 1; f <= frames; ++f) {
+            faces.update(clip[f]);
+        }
+        const double perDetection =
+            faces.detectorSeconds() * 1000.0 / faces.detections();
+        std::cout << "  detector: " << perDetection << " ms per detection,"
+            << " per frame";
+        for (int interval : { 1, 5, 15, 30 }) {
+            std::cout << " " << perDetection / interval << " (every "
+                << interval << ")";
+        }
+        std::cout << "\n";
+
+        options.interval = 5;
+        options.background = true;
+        FaceRegions background(options);
+        auto begin = std::chrono::steady_clock::now();
+        for (int f = 1; f <= frames; ++f) {
+            background.update(clip[f]);
+        }
+        std::cout << "  background detection: " << seconds(begin) * 1000.0 /
+            frames << " ms per frame on the caller\n";
+    }
+    catch (const std::exception& e) {
+        std::cout << "  detector skipped: " << e.what() << "\n";
+    }
+
+    // Filter cost with a fixed region in the middle of the frame standing
+    // in for a face, against the dense strip path
+    const cv::Rect face(size.width * 3 / 8, size.height / 4, size.width / 4,
+        size.height / 2);
+    auto run = [&](bool regions) {
+        STKMBCpu denoiser(clip.front());
+        denoiser.setParallel(threads);
+        if (regions) {
+            denoiser.setRegionPriority(true);
+            denoiser.setPriorityRegions({ face });
+        }
+        double total = 0.0, inside = 0.0, outside = 0.0, full = 0.0;
+        cv::Mat output;
+        for (int f = 1; f <= frames; ++f) {
+            auto begin = std::chrono::steady_clock::now();
+            denoiser.processFrame(clip[f], output);
+            total += seconds(begin);
+
+            inside += cv::PSNR(output(face), clean[f](face)) / frames;
+            cv::Mat masked = output.clone();
+            cv::Mat reference = clean[f].clone();
+            masked(face).setTo(0);
+            reference(face).setTo(0);
+            outside += cv::PSNR(masked, reference) / frames;
+            if (regions) {
+                const SparseStats& stats = denoiser.sparseStats();
+                full += static_cast<double>(stats.full) / std::max(1,
+                    stats.full + stats.temporal + stats.frozen) / frames;
+            }
+        }
+        std::cout << "  " << (regions ? "region" : "dense ") << ": "
+            << total * 1000.0 / frames << " ms per frame, face "
+            << inside << " dB, elsewhere " << outside << " dB";
+        if (regions) {
+            std::cout << ", " << full * 100.0 << "% of blocks filtered";
+        }
+        std::cout << "\n";
+    };
+    run(false);
+    run(true);
+    std::cout.flush();
+}
+
+bool benchmarkDeadline(const cv::Size& size, int frames) {
+    CV_Assert(frames >= 1);
+    const std::vector<cv::Mat> clip = makeSyntheticClip(size, frames + 1,
+        10.0f);
+    const std::vector<cv::Mat> clean = makeSyntheticClip(size, frames + 1,
+        0.0f);
+    DenoiserOptions options;
+    options.threads =
+        std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+
+    std::cout << std::fixed << std::setprecision(2) << "Real-time mode "
+        << size.width << "x" << size.height << ", " << frames
+        << " frames\n";
+
+    // Cost and quality of every level, each switched to on a running engine.
+    // A compact state engine follows the same levels untimed.
+    std::vector<double> levelMs;
+    bool consistent = true;
+    {
+        DenoiserOptions compactOptions = options;
+        compactOptions.compactState = true;
+        CpuDenoiser denoiser(options);
+        CpuDenoiser compact(compactOptions);
+        denoiser.init(clip.front());
+        compact.init(clip.front());
+        cv::Mat output;
+        for (int level = 0; level < denoiser.qualityLevels(); ++level) {
+            denoiser.setQualityLevel(level);
+            compact.setQualityLevel(level);
+            double seconds = 0.0;
+            double psnr = 0.0;
+            double compactPsnr = 0.0;
+            for (int f = 1; f <= frames; ++f) {
+                auto begin = std::chrono::steady_clock::now();
+                denoiser.process(clip[f], output);
+                seconds += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - begin).count();
+                psnr += cv::PSNR(output, clean[f]) / frames;
+                compact.process(clip[f], output);
+                compactPsnr += cv::PSNR(output, clean[f]) / frames;
+            }
+            const bool close = std::abs(psnr - compactPsnr) <= 1.0;
+            consistent = consistent && close;
+            levelMs.push_back(seconds * 1000.0 / frames);
+            std::cout << "  level " << level << ": " << levelMs.back()
+                << " ms per frame, " << psnr << " dB, compact state "
+                << compactPsnr << " dB" << (close ? "" : " MISMATCH")
+                << "\n";
+        }
+    }
+
+    // The controller against a budget between the best and the cheapest
+    // level, then against one the cheapest level cannot meet
+    auto run = [&](const char* name, double budgetMs) {
+        CpuDenoiser denoiser(options);
+        denoiser.init(clip.front());
+        DeadlineOptions deadline;
+        deadline.budgetMs = budgetMs;
+        deadline.upAfter = 10;
+        DeadlineController controller(deadline, denoiser.qualityLevels());
+        cv::Mat output;
+        for (int pass = 0; pass < 3; ++pass) {
+            for (int f = 1; f <= frames; ++f) {
+                if (controller.dropNext()) {
+                    controller.dropped();
+                    continue;
+                }
+                auto begin = std::chrono::steady_clock::now();
+                denoiser.process(clip[f], output);
+                denoiser.setQualityLevel(controller.update(
+                    std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - begin).count()));
+            }
+        }
+        const DeadlineReport report = controller.report();
+        std::cout << "  " << name << " budget " << budgetMs << " ms: "
+            << report.hitRate() * 100.0 << "% on time, " << report.dropped
+            << " dropped, p50 " << report.p50 << " / p95 " << report.p95
+            << " / p99 " << report.p99 << " ms, " << report.switches
+            << " switches, frames per level";
+        for (int count : report.framesPerLevel) {
+            std::cout << " " << count;
+        }
+        std::cout << "\n";
+    };
+    run("moderate", (levelMs.front() + levelMs.back()) / 2.0);
+    run("overload", levelMs.back() * 0.6);
+    std::cout.flush();
+    return consistent;
+}
+
+bool benchmarkStreams(const cv::Size& size, int frames, int maxStreams) {
+    CV_Assert(frames >= 1 && maxStreams >= 1);
+    const std::vector<cv::Mat> clip = makeSyntheticClip(size, frames + 1,
+        10.0f);
+
+    std::cout << std::fixed << std::setprecision(1) << "Streams of "
+        << size.width << "x" << size.height << ", " << frames
+        << " frames each, " << std::thread::hardware_concurrency()
+        << " hardware threads\n";
+    std::cout << "  streams  per-stream threads  engine  engine batched"
+        "  (frames/s)\n";
+
+    bool consistent = true;
+    for (int streams = 1; streams <= maxStreams; streams *= 2) {
+        const double total = static_cast<double>(streams) * frames;
+
+        // Every stream on a thread of its own, as separate processes run
+        std::vector<cv::Mat> standalone(streams);
+        auto begin = std::chrono::steady_clock::now();
+        {
+            std::vector<std::thread> threads;
+            for (int s = 0; s < streams; ++s) {
+                threads.emplace_back([&, s] {
+                    STKMBCpu engine(clip.front());
+                    for (int f = 1; f <= frames; ++f) {
+                        engine.processFrame(clip[f], standalone[s]);
+                    }
+                    });
+            }
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+        }
+        const double separateFps = total / std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+
+        std::vector<StreamStats> stats(streams);
+        bool match = true;
+        auto shared = [&](bool batching) {
+            MultiStreamOptions options;
+            options.batching = batching;
+            MultiStreamEngine engine(options);
+            std::vector<cv::Mat> outputs(streams);
+            for (int s = 0; s < streams; ++s) {
+                engine.addStream(clip.front());
+            }
+            for (int f = 1; f <= frames; ++f) {
+                for (int s = 0; s < streams; ++s) {
+                    engine.submit(s, clip[f], outputs[s]);
+                }
+            }
+            engine.drain();
+            for (int s = 0; s < streams; ++s) {
+                stats[s] = engine.stats(s);
+                match = match && cv::norm(outputs[s], standalone[s],
+                    cv::NORM_INF) == 0.0;
+            }
+            return engine.aggregateFps();
+        };
+        const double engineFps = shared(false);
+        const double batchedFps = shared(true);
+
+        double slowest = 1e30, fastest = 0.0;
+        for (const StreamStats& stream : stats) {
+            const double fps = stream.frames / std::max(stream.seconds, 1e-9);
+            slowest = std::min(slowest, fps);
+            fastest = std::max(fastest, fps);
+        }
+        std::cout << "  " << std::setw(7) << streams << std::setw(20)
+            << separateFps << std::setw(8) << engineFps << std::setw(16)
+            << batchedFps << "  per stream " << slowest << ".." << fastest
+            << (match ? "" : "  OUTPUT MISMATCH") << "\n";
+        consistent = consistent && match;
+    }
+
+    // Engine settings reach every stream
+    MultiStreamOptions tuned;
+    tuned.historySize = 3;
+    tuned.blockSize = 16;
+    tuned.filter.processNoise = 0.05f;
+    tuned.filter.bilateralDiameter = 7;
+    tuned.filter.bilateralSigma = 30.0f;
+    STKMBCpu reference(clip.front(), tuned.historySize, tuned.blockSize,
+        tuned.precision, tuned.filter);
+    const int openCvThreads = cv::getNumThreads();
+    bool settingsMatch = true;
+    {
+        // Engines overlapping out of order leave OpenCV's thread count as
+        // they found it
+        auto outer = std::make_unique<MultiStreamEngine>(tuned);
+        MultiStreamEngine engine(tuned);
+        outer.reset();
+        engine.addStream(clip.front());
+        cv::Mat expected, output;
+        for (int f = 1; f <= frames; ++f) {
+            reference.processFrame(clip[f], expected);
+            engine.submit(0, clip[f], output);
+            engine.drain();
+            settingsMatch = settingsMatch &&
+                cv::norm(output, expected, cv::NORM_INF) == 0.0;
+        }
+    }
+    const bool restored = cv::getNumThreads() == openCvThreads;
+    std::cout << "  history 3, block 16, q 0.05, d 7, sigma 30: "
+        << (settingsMatch ? "matches STKMBCpu" : "OUTPUT MISMATCH")
+        << ", OpenCV threads " << (restored ? "restored" : "NOT RESTORED")
+        << std::endl;
+    return consistent && settingsMatch && restored;
+}
+
+bool benchmarkApi(const cv::Size& size, int frames) {
+    CV_Assert(frames >= 2);
+    const std::vector<cv::Mat> clip = makeSyntheticClip(size, frames, 10.0f);
+    std::vector<cv::Mat> luma(frames);
+    for (int f = 0; f < frames; ++f) {
+        cv::cvtColor(clip[f], luma[f], cv::COLOR_BGR2GRAY);
+    }
+    const int width = size.width;
+    const int height = size.height;
+    const int chromaRows = (height + 1) / 2;
+    const int chromaWidth = 2 * ((width + 1) / 2);
+    // Strides past the row, filled with a pattern that must survive
+    const size_t stride = width + 48;
+    const size_t chromaStride = chromaWidth + 16;
+    constexpr uint8_t kPadding = 0xA5;
+
+    std::cout << std::fixed << std::setprecision(2) << "Library interface "
+        << size.width << "x" << size.height << ", " << frames
+        << " frames, version " << stkmb_api_version() << "\n";
+    bool exact = true;
+    auto report = [&](const char* name, bool ok) {
+        std::cout << "  " << name << ": " << (ok ? "ok" : "MISMATCH") << "\n";
+        exact = exact && ok;
+    };
+
+    stkmb_settings tuned = stkmb_default_settings();
+    tuned.history_size = 3;
+    tuned.block_size = 16;
+    tuned.process_noise = 0.05f;
+    tuned.bilateral_diameter = 7;
+    tuned.bilateral_sigma = 30.0f;
+    tuned.threads =
+        std::max(2, static_cast<int>(std::thread::hardware_concurrency()));
+    DenoiserOptions tunedOptions;
+    tunedOptions.historySize = 3;
+    tunedOptions.blockSize = 16;
+    tunedOptions.filter = { 0.05f, 7, 30.0f };
+    tunedOptions.threads = tuned.threads;
+
+    struct Config {
+        const char* name;
+        stkmb_settings settings;
+        DenoiserOptions options;
+    };
+    const Config configs[] = {
+        { "defaults", stkmb_default_settings(), DenoiserOptions() },
+        { "tuned, strips", tuned, tunedOptions },
+    };
+    for (const Config& config : configs) {
+        std::cout << " " << config.name << "\n";
+        // Reference: CpuDenoiser on the plain luma planes
+        std::vector<cv::Mat> expected(frames);
+        double directSeconds = 0.0;
+        {
+            CpuDenoiser reference(config.options);
+            reference.init(luma.front());
+            for (int f = 0; f < frames; ++f) {
+                auto begin = std::chrono::steady_clock::now();
+                reference.process(luma[f], expected[f]);
+                directSeconds += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - begin).count();
+            }
+        }
+
+        // Gray frames in padded caller buffers
+        std::vector<uint8_t> input(stride * height);
+        std::vector<uint8_t> output(stride * height, kPadding);
+        cv::Mat inputPlane(height, width, CV_8U, input.data(), stride);
+        cv::Mat outputPlane(height, width, CV_8U, output.data(), stride);
+        bool same = true;
+        double apiSeconds = 0.0;
+        {
+            StkmbDenoiser denoiser(config.settings);
+            const stkmb_frame in = StkmbDenoiser::gray(input.data(), width,
+                height, stride);
+            const stkmb_frame out = StkmbDenoiser::gray(output.data(), width,
+                height, stride);
+            for (int f = 0; f < frames; ++f) {
+                luma[f].copyTo(inputPlane);
+                auto begin = std::chrono::steady_clock::now();
+                denoiser.process(in, out);
+                apiSeconds += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - begin).count();
+                same = same &&
+                    cv::norm(outputPlane, expected[f], cv::NORM_INF) == 0.0;
+            }
+        }
+        bool padding = true;
+        for (int y = 0; y < height; ++y) {
+            for (size_t x = width; x < stride; ++x) {
+                padding = padding && output[y * stride + x] == kPadding;
+            }
+        }
+        report("gray, padded stride", same && padding);
+        std::cout << "  " << apiSeconds * 1000.0 / frames
+            << " ms/frame through the interface, "
+            << directSeconds * 1000.0 / frames << " ms/frame directly\n";
+
+        // NV12 with its own output chroma, and with the input's chroma
+        std::vector<uint8_t> chroma(chromaStride * chromaRows);
+        std::vector<uint8_t> outputChroma(chromaStride * chromaRows, kPadding);
+        cv::Mat chromaPlane(chromaRows, chromaWidth, CV_8U, chroma.data(),
+            chromaStride);
+        cv::randu(chromaPlane, 16, 240);
+        const cv::Mat chromaBefore = chromaPlane.clone();
+        for (const bool shared : { false, true }) {
+            StkmbDenoiser denoiser(config.settings);
+            const stkmb_frame in = StkmbDenoiser::nv12(input.data(), stride,
+                chroma.data(), chromaStride, width, height);
+            const stkmb_frame out = StkmbDenoiser::nv12(output.data(), stride,
+                shared ? chroma.data() : outputChroma.data(), chromaStride,
+                width, height);
+            same = true;
+            for (int f = 0; f < frames; ++f) {
+                luma[f].copyTo(inputPlane);
+                denoiser.process(in, out);
+                same = same &&
+                    cv::norm(outputPlane, expected[f], cv::NORM_INF) == 0.0;
+            }
+            const cv::Mat outputChromaPlane(chromaRows, chromaWidth, CV_8U,
+                out.chroma, chromaStride);
+            same = same && cv::norm(outputChromaPlane, chromaBefore,
+                cv::NORM_INF) == 0.0;
+            report(shared ? "nv12, shared chroma" : "nv12, own chroma", same);
+        }
+    }
+
+    // Misuse must come back as errors, and leave the denoiser usable
+    {
+        std::vector<uint8_t> input(stride * height), output(stride * height);
+        StkmbDenoiser denoiser;
+        const stkmb_frame in = StkmbDenoiser::gray(input.data(), width, height,
+            stride);
+        const stkmb_frame out = StkmbDenoiser::gray(output.data(), width,
+            height, stride);
+        auto rejects = [&](const stkmb_frame& a, const stkmb_frame& b) {
+            return stkmb_process(denoiser.handle(), &a, &b) ==
+                STKMB_INVALID_ARGUMENT && *stkmb_last_error(denoiser.handle());
+        };
+        stkmb_frame narrow = out;
+        narrow.luma_stride = width - 1;
+        stkmb_frame smaller = StkmbDenoiser::gray(input.data(), width / 2,
+            height / 2, stride);
+        stkmb_frame smallerOut = StkmbDenoiser::gray(output.data(), width / 2,
+            height / 2, stride);
+        stkmb_frame nv12 = in;
+        nv12.format = STKMB_FORMAT_NV12;
+
+        bool rejected = rejects(in, in) && rejects(in, narrow) &&
+            rejects(nv12, out) && stkmb_process(denoiser.handle(), &in, nullptr)
+            == STKMB_INVALID_ARGUMENT;
+        denoiser.process(in, out);
+        rejected = rejected && *stkmb_last_error(denoiser.handle()) == '\0' &&
+            rejects(smaller, smallerOut);
+        denoiser.process(in, out);
+
+        stkmb_settings bad = stkmb_default_settings();
+        bad.bilateral_sigma = 0.0f;
+        stkmb_denoiser* handle = nullptr;
+        rejected = rejected &&
+            stkmb_create(&bad, &handle) == STKMB_INVALID_ARGUMENT && !handle &&
+            stkmb_process(nullptr, &in, &out) == STKMB_INVALID_ARGUMENT;
+        report("invalid frames and settings rejected", rejected);
+    }
+    std::cout.flush();
+    return exact;
+}
+
+bool benchmarkKernels(const cv::Size& size, int iterations) {
+    CV_Assert(iterations >= 1);
+    cv::RNG rng(7);
+    cv::Mat b(size, CV_32F);
+    rng.fill(b, cv::RNG::UNIFORM, 0.0f, 255.0f);
+    cv::Mat gray(size, CV_8U), shifted(size, CV_8U);
+    rng.fill(gray, cv::RNG::UNIFORM, 0, 256);
+    rng.fill(shifted, cv::RNG::UNIFORM, 0, 256);
+
+    std::cout << std::fixed << std::setprecision(3) << "Block kernels "
+        << size.width << "x" << size.height << ", " << iterations
+        << " iterations\n";
+    bool agree = true;
+    for (const int blockSize : { 4, 8, 16 }) {
+        const cv::Size grid((size.width - 1) / blockSize,
+            (size.height - 1) / blockSize);
+        std::vector<float> scratch(2 * grid.width * blockSize);
+        std::vector<double> aa(grid.width), ab(grid.width);
+        std::vector<double> aaRef(grid.width), abRef(grid.width);
+
+        struct Depth {
+            const char* name;
+            int type;
+            double high;
+        };
+        for (const Depth& depth : { Depth{ "8u", CV_8U, 256.0 },
+            Depth{ "16u", CV_16U, 65280.0 }, Depth{ "32f", CV_32F, 255.0 } }) {
+            cv::Mat a(size, depth.type);
+            rng.fill(a, cv::RNG::UNIFORM, 0.0, depth.high);
+            const BlockSumsKernel generic = blockSumsGeneric(depth.type);
+            const BlockSumsKernel fixed = blockSumsKernel(blockSize, depth.type);
+
+            auto time = [&](BlockSumsKernel kernel, std::vector<double>& outAA,
+                std::vector<double>& outAB) {
+                auto begin = std::chrono::steady_clock::now();
+                for (int i = 0; i < iterations; ++i) {
+                    for (int by = 0; by < grid.height; ++by) {
+                        kernel(a, &b, by, grid.width, blockSize, outAA.data(),
+                            outAB.data(), scratch.data());
+                    }
+                }
+                return std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - begin).count() /
+                    iterations;
+            };
+            const double genericMs = time(generic, aaRef, abRef);
+            const double fixedMs = time(fixed, aa, ab);
+
+            // The last block row computed by both
+            double error = 0.0;
+            for (int bx = 0; bx < grid.width; ++bx) {
+                error = std::max({ error,
+                    std::abs(aa[bx] - aaRef[bx]) / std::max(1.0, aaRef[bx]),
+                    std::abs(ab[bx] - abRef[bx]) / std::max(1.0, abRef[bx]) });
+            }
+            agree = agree && error < 1e-6;
+            std::cout << "  sums " << std::setw(2) << blockSize << "x"
+                << std::setw(2) << blockSize << " " << std::setw(3)
+                << depth.name << ": generic " << genericMs << " ms, "
+                << "specialised " << fixedMs << " ms, "
+                << std::setprecision(2) << genericMs / fixedMs << "x, "
+                << std::scientific << error << std::fixed
+                << std::setprecision(3) << " relative error\n";
+        }
+
+        // SAD of every block against the block one pixel down and right
+        const BlockSadKernel genericSad = blockSadGeneric();
+        const BlockSadKernel fixedSad = blockSadKernel(blockSize);
+        auto timeSad = [&](BlockSadKernel kernel, uint64_t& total) {
+            total = 0;
+            auto begin = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; ++i) {
+                for (int by = 0; by + 1 < grid.height; ++by) {
+                    for (int bx = 0; bx + 1 < grid.width; ++bx) {
+                        total += kernel(gray.ptr(by * blockSize) +
+                            bx * blockSize, gray.step,
+                            shifted.ptr(by * blockSize + 1) + bx * blockSize + 1,
+                            shifted.step, blockSize);
+                    }
+                }
+            }
+            return std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - begin).count() / iterations;
+        };
+        uint64_t genericTotal = 0, fixedTotal = 0;
+        const double genericMs = timeSad(genericSad, genericTotal);
+        const double fixedMs = timeSad(fixedSad, fixedTotal);
+        agree = agree && genericTotal == fixedTotal;
+        std::cout << "  sad  " << std::setw(2) << blockSize << "x"
+            << std::setw(2) << blockSize << "    : generic " << genericMs
+            << " ms, specialised " << fixedMs << " ms, "
+            << std::setprecision(2) << genericMs / fixedMs << "x"
+            << std::setprecision(3)
+            << (genericTotal == fixedTotal ? "" : ", SUMS DIFFER") << "\n";
+    }
+    std::cout.flush();
+    return agree;
+}
+
+bool benchmarkGraph(const cv::Size& size, int frames) {
+    CV_Assert(frames >= 2);
+    const std::vector<cv::Mat> clip = makeSyntheticClip(size, frames, 10.0f);
+    std::vector<cv::Mat> lumaClip(frames);
+    for (int f = 0; f < frames; ++f) {
+        cv::cvtColor(clip[f], lumaClip[f], cv::COLOR_BGR2GRAY);
+    }
+
+    struct Config {
+        const char* name;
+        StatePrecision precision;
+        KalmanUpdate update;
+        BilateralMode bilateral;
+    };
+    const Config configs[] = {
+        { "exact", StatePrecision::Float32, KalmanUpdate::Fused,
+            BilateralMode::Exact },
+        { "fast", StatePrecision::Float32, KalmanUpdate::Fused,
+            BilateralMode::Fast },
+        { "reference", StatePrecision::Float32, KalmanUpdate::Reference,
+            BilateralMode::Exact },
+        { "compact", StatePrecision::Compact, KalmanUpdate::Fused,
+            BilateralMode::Exact },
+        { "compact, fast", StatePrecision::Compact, KalmanUpdate::Fused,
+            BilateralMode::Fast },
+    };
+
+    std::cout << std::fixed << std::setprecision(2) << "Stage graph "
+        << size.width << "x" << size.height << ", " << frames << " frames\n";
+    bool identical = true;
+    for (const bool luma : { false, true }) {
+        const std::vector<cv::Mat>& input = luma ? lumaClip : clip;
+        for (const Config& config : configs) {
+            // The same clip through the graph and the hand-written sequence
+            double seconds[2] = { 0.0, 0.0 };
+            bool same = true;
+            std::string schedule;
+            size_t scratchBytes = 0;
+            STKMBCpu graph(input.front(), 5, 8, config.precision);
+            STKMBCpu direct(input.front(), 5, 8, config.precision);
+            direct.setFrameGraph(false);
+            cv::Mat graphOutput, directOutput;
+            for (STKMBCpu* denoiser : { &graph, &direct }) {
+                denoiser->setKalmanUpdate(config.update);
+                denoiser->setBilateral(config.bilateral);
+            }
+            for (int f = 1; f < frames; ++f) {
+                auto begin = std::chrono::steady_clock::now();
+                graph.processFrame(input[f], graphOutput);
+                auto middle = std::chrono::steady_clock::now();
+                direct.processFrame(input[f], directOutput);
+                auto end = std::chrono::steady_clock::now();
+                seconds[0] += std::chrono::duration<double>(middle - begin)
+                    .count();
+                seconds[1] += std::chrono::duration<double>(end - middle)
+                    .count();
+                same = same && cv::norm(graphOutput, directOutput,
+                    cv::NORM_INF) == 0.0;
+            }
+            if (graph.frameGraph()) {
+                schedule = graph.frameGraph()->describe();
+                scratchBytes = graph.frameGraph()->scratchBytes();
+            }
+            identical = identical && same;
+
+            const double graphMs = 1000.0 * seconds[0] / (frames - 1);
+            const double directMs = 1000.0 * seconds[1] / (frames - 1);
+            std::cout << "  " << (luma ? "luma " : "bgr  ") << std::left
+                << std::setw(14) << config.name << std::right << " graph "
+                << graphMs << " ms, hand-written " << directMs << " ms, "
+                << directMs / graphMs << "x, "
+                << (same ? "identical" : "OUTPUT DIFFERS") << "\n"
+                << "    " << schedule << "\n"
+                << "    " << scratchBytes / 1024 << " KiB of graph buffers\n";
+        }
+    }
+    std::cout.flush();
+    return identical;
+}
+
+bool benchmarkAutotune(const cv::Size& size, int frames) {
+    CV_Assert(frames >= 3);
+    const std::vector<cv::Mat> colorClip = makeSyntheticClip(size, frames, 0.0f);
+    std::vector<cv::Mat> clip(frames);
+    for (int f = 0; f < frames; ++f) {
+        cv::cvtColor(colorClip[f], clip[f], cv::COLOR_BGR2GRAY);
+    }
+
+    AutotuneOptions options;
+    options.space.processNoise = { 0.05f, 0.2f };
+    options.space.bilateralDiameter = { 5 };
+    options.space.bilateralSigma = { 25.0f };
+    options.space.bilateralLevels = { 0, 8 };
+    options.space.historySize = { 5 };
+    options.space.blockSize = { 8 };
+    const AutotuneReport report = autotune(clip, DenoiserOptions(), options);
+
+    std::cout << std::fixed << "Autotune " << size.width << "x" << size.height
+        << ", " << frames << " frames, noise " << std::setprecision(1)
+        << options.noiseStd << " (" << report.results.size()
+        << " candidates, * = Pareto front, > = chosen)\n";
+    for (size_t i = 0; i < report.results.size(); ++i) {
+        const TuningResult& result = report.results[i];
+        std::cout << (static_cast<int>(i) == report.chosen ? ">" : " ")
+            << (result.pareto ? "* " : "  ") << std::setprecision(2)
+            << result.psnr << " dB  SSIM " << std::setprecision(4)
+            << result.ssim << "  " << std::setprecision(1) << std::setw(7)
+            << result.fps << " frames/s  " << result.settings.describe()
+            << "\n";
+    }
+
+    // Noise estimate against the noise actually added
+    const float error = std::abs(report.measuredNoise - options.noiseStd) /
+        options.noiseStd;
+    const bool estimated = error <= 0.25f;
+    std::cout << "  Estimated noise " << report.measuredNoise << " ("
+        << std::setprecision(0) << 100.0f * error << "% off)\n";
+
+    // Two profiles through the file, the second saved twice
+    const std::string path = (std::filesystem::temp_directory_path() /
+        "stkmb_bench_profiles.txt").string();
+    std::filesystem::remove(path);
+    TuningProfile chosen;
+    chosen.size = size;
+    chosen.noise = options.noiseStd;
+    chosen.settings = report.results[report.chosen].settings;
+    chosen.psnr = report.results[report.chosen].psnr;
+    TuningProfile other = chosen;
+    other.noise = 2.0f * options.noiseStd;
+    other.settings.sparse = !other.settings.sparse;
+    saveTuningProfile(path, chosen);
+    saveTuningProfile(path, other);
+    saveTuningProfile(path, other);
+    const std::vector<TuningProfile> loaded = loadTuningProfiles(path);
+    const TuningProfile* low = findTuningProfile(loaded, size,
+        options.noiseStd + 1.0f);
+    const TuningProfile* high = findTuningProfile(loaded,
+        cv::Size(size.width + 2, size.height), 3.0f * options.noiseStd);
+    const bool roundTrip = loaded.size() == 2 && low && high &&
+        low->settings.describe() == chosen.settings.describe() &&
+        high->settings.describe() == other.settings.describe();
+    std::cout << "  Profile file round trip "
+        << (roundTrip ? "intact" : "LOST SETTINGS") << std::endl;
+
+    // A state saved under one profile, restored into an engine whose first
+    // frame picked the other, carries on under the first
+    DenoiserOptions profiled;
+    profiled.tuningProfiles = path;
+    profiled.noiseLevel = options.noiseStd;
+    CpuDenoiser original(profiled);
+    cv::Mat output, resumedOutput;
+    original.init(clip[0]);
+    original.process(clip[0], output);
+    original.process(clip[1], output);
+    EngineState state;
+    original.saveState(state);
+    profiled.noiseLevel = other.noise;
+    CpuDenoiser resumed(profiled);
+    resumed.init(clip[2]);
+    const std::string picked = resumed.capabilities().profile;
+    resumed.restoreState(state);
+    original.process(clip[2], output);
+    resumed.process(clip[2], resumedOutput);
+    std::filesystem::remove(path);
+    const bool resumes = picked != original.capabilities().profile &&
+        resumed.capabilities().profile == original.capabilities().profile &&
+        cv::norm(output, resumedOutput, cv::NORM_INF) == 0.0;
+    std::cout << "  Resumed under the saved profile "
+        << (resumes ? "yes" : "NO") << std::endl;
+    return estimated && roundTrip && resumes;
+}
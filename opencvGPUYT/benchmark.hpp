@@ -0,0 +1,148 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <string>
+
+// Time the fused Kalman update against the whole-frame cv::Mat expression
+// chain on random planes of the given size and print ms/frame plus the
+// effective bandwidth of each variant. Returns false unless one step of both
+// agrees to within 1e-5 of each plane's largest value.
+bool benchmarkKalmanUpdate(const cv::Size& size, int iterations);
+
+// Time the cached single-pass block distance against the per-block ROI
+// matching over a history of the given depth and print ms/frame plus the
+// largest difference between the two block maps. Returns false unless they
+// agree to within 1e-3 of the largest distance, both on the first query and
+// after the timed pushes have cycled the history.
+bool benchmarkBlockDistance(const cv::Size& size, int blockSize,
+    int historySize, int iterations);
+
+// Time pushing frames into a FrameRing against the std::deque push_back of a
+// clone plus pop_front it replaces, and print the ring's allocation counter
+void benchmarkFrameHistory(const cv::Size& size, int historySize,
+    int iterations);
+
+// Run STKMBCpu over a synthetic clip on the whole-frame path and on the
+// strip-parallel path with 1, 2, 4, ... up to maxThreads threads. Prints
+// frames/s and speedup per thread count. Returns false unless every thread
+// count produces the same output as the single-threaded strip path and the
+// whole-frame path stays within 2 grey levels of it (its
+// cv::bilateralFilter interpolates the range weights).
+bool benchmarkThreadScaling(const cv::Size& size, int frames, int maxThreads);
+
+// Run STKMBCpu over a synthetic clip with the stage profiler disabled and
+// enabled, alternating rounds, and print ms/frame for both. Disabled timers
+// are a relaxed load and a branch each, so that case should stay within 1%
+// of an uninstrumented build.
+void benchmarkProfiler(const cv::Size& size, int frames);
+
+// Run STKMBCpu densely and with sparse processing over a static-camera and a
+// panning synthetic clip, printing frames/s, the share of fully processed,
+// temporal-only and frozen blocks, and the PSNR of each run against the
+// clean clip
+void benchmarkSparse(const cv::Size& size, int frames);
+
+// Run STKMBCpu with float32 and compact state over synthetic clips at noise
+// levels 5, 10 and 20 and print the state footprint, frames/s and the mean
+// PSNR of each against the clean clip, plus the PSNR of compact against
+// float32 output
+void benchmarkStatePrecision(const cv::Size& size, int frames);
+
+// Time cv::bilateralFilter (as STKMBCpu calls it, on CV_32F), BilateralLut
+// and FastBilateral at 4, 8 and 16 levels for diameters 5, 7 and 9 on a
+// noisy synthetic frame, printing ms/frame and the mean and largest
+// absolute difference of each to cv::bilateralFilter; then FastBilateral
+// with levels 50 sigmaColor apart. Returns false when an output is not
+// finite or leaves the range of the pixels in its window.
+bool benchmarkBilateral(const cv::Size& size, int iterations);
+
+// Count heap and cv::Mat allocations per frame of STKMBCpu after a warm-up,
+// for BGR and luma input on the whole-frame path (stage graph and
+// hand-written), the strip path (1 and all threads, exact and fast
+// bilateral, float32 and compact state) and the sparse path; then of
+// STKMBGpu when a CUDA device is present, counting device buffers too, and
+// of the whole VideoProcessor pipeline. Every one must allocate nothing
+// except the whole-frame path with the exact bilateral filter, which is
+// reported only since cv::bilateralFilter allocates internally. Returns
+// false when an asserted configuration allocated.
+bool benchmarkAllocations(const cv::Size& size, int frames);
+
+// Write a synthetic clip into an I420 frame store in the temp directory,
+// then time the write, a sequential pass over the memory-mapped frames and
+// STKMBCpu fed straight from the mapping, and check that random seeks
+// return the frames that were stored. Returns false when one does not.
+bool benchmarkFrameStore(const cv::Size& size, int frames);
+
+// For the whole-frame, strip (float32, compact, fast bilateral), sparse and
+// motion-compensated paths, checkpoint CpuDenoiser halfway through a synthetic clip with
+// CheckpointWriter, resume a new engine from the file and check that it
+// matches an uninterrupted run bit for bit. Also prints the checkpoint size
+// and the time save() holds the caller, and checks that a corrupted file
+// and a state saved under other options are rejected and that a held
+// snapshot waits for release(). Returns false on any mismatch.
+bool benchmarkCheckpoint(const cv::Size& size, int frames);
+
+// MotionSearch on the panning synthetic clip, single-threaded and on a pool:
+// milliseconds per frame, vectors per second and the share of blocks that
+// find the known pan. Then the PSNR and speed of CpuDenoiser with and
+// without motion compensation on the same clip.
+void benchmarkMotion(const cv::Size& size, int frames);
+
+// Face detector cost per detection and per frame for a few detection
+// intervals (skipped when the cascade does not load), the caller's cost of
+// background detection, and the filter cost and PSNR inside and outside a
+// fixed region with STKMBCpu's region priority against the dense path
+void benchmarkRegions(const cv::Size& size, int frames,
+    const std::string& cascadePath);
+
+// Milliseconds per frame and PSNR of every CpuDenoiser quality level, then
+// DeadlineController runs over the synthetic clip against a budget between
+// the best and the cheapest level and against one below the cheapest: hit
+// rate, drops, latency percentiles and frames spent on each level. The
+// levels also run with compact state, whose history is trimmed on every
+// frame below full depth; returns false when its PSNR strays more than 1 dB
+// from the float state's at any level.
+bool benchmarkDeadline(const cv::Size& size, int frames);
+
+// Aggregate frames/s of STKMBCpu over 1, 2, 4, ... up to maxStreams streams
+// of the synthetic clip: one thread per stream, each with its own engine and
+// OpenCV's default threading (the stand-in for a process per stream), then
+// MultiStreamEngine on one pool without and with batching. Also prints the
+// slowest and fastest stream of the batched run and checks that a stream's
+// output matches the one of its standalone engine, also under non-default
+// engine settings, and that overlapping engines restore OpenCV's threads.
+// Returns false when either check fails.
+bool benchmarkStreams(const cv::Size& size, int frames, int maxStreams);
+
+// Drive the C interface (through StkmbDenoiser) with in-memory frames: gray
+// frames with padded strides and NV12 frames with separate and shared
+// chroma, under default and non-default settings. Checks that the luma
+// output matches CpuDenoiser bit for bit, that chroma and the padding are
+// left as they should be, and that bad frames are rejected; prints ms/frame
+// through the interface and directly. Returns false on any mismatch.
+bool benchmarkApi(const cv::Size& size, int frames);
+
+// Time the block sum kernel (block distance cache) and the SAD kernel
+// (motion search) specialised for block sizes 4, 8 and 16 and CV_8U, Q8.8
+// CV_16U and CV_32F pixels against their run-time sized versions, on random
+// planes of the given size. Prints ms per frame, the speedup and the largest
+// relative difference of the sums; returns false when a specialised kernel
+// disagrees with the generic one.
+bool benchmarkKernels(const cv::Size& size, int iterations);
+
+// STKMBCpu's whole-frame path on its stage graph against the hand-written
+// sequence it replaced, for BGR and luma frames under the exact and fast
+// bilateral filters, the reference Kalman update and compact state: ms per
+// frame of both, the compiled schedule (fused passes in brackets, dropped
+// stages) and the graph's buffer bytes. Returns false unless every output
+// is identical.
+bool benchmarkGraph(const cv::Size& size, int frames);
+
+// The autotuner over a small space on a clean synthetic clip with noise 10
+// added: every candidate's PSNR, SSIM and frames/s, the Pareto front and the
+// choice. Also saves two profiles to a temporary file, loads them back and
+// looks them up, checks that a state saved under one profile resumes under
+// it in an engine that picked the other, and compares estimateNoise() with
+// the added noise. Returns false when the round trip loses a setting, the
+// resumed engine switches profile or the estimate is off by more than a
+// quarter.
+bool benchmarkAutotune(const cv::Size& size, int frames);
@@ -0,0 +1,282 @@
+#include "block_distance.hpp"
+#include "block_kernels.hpp"
+#include "fixed_point.hpp"
+#include <algorithm>
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace {
+
+    // Number of blocks along one axis, matching the `pos < length - blockSize`
+    // loop of the original block matching
+    int blockCount(int length, int blockSize) {
+        return length > blockSize ? (length - 1) / blockSize : 0;
+    }
+
+    // History pixels widened to float, CV_16U rows being Q8.8 fixed point
+    inline float widen(float value) { return value; }
+    inline float widen(ushort value) { return fromFixedPoint(value); }
+
+    // sum += newest - oldest over the given rows, either frame may be absent
+    template <typename T>
+    void updateSum(cv::Mat& sum, const cv::Mat* newest, const cv::Mat* oldest) {
+        for (int row = 0; row < sum.rows; ++row) {
+            float* sumRow = sum.ptr<float>(row);
+            const T* newRow = newest ? newest->ptr<T>(row) : nullptr;
+            const T* oldRow = oldest ? oldest->ptr<T>(row) : nullptr;
+            for (int col = 0; col < sum.cols; ++col) {
+                if (newRow) {
+                    sumRow[col] += widen(newRow[col]);
+                }
+                if (oldRow) {
+                    sumRow[col] -= widen(oldRow[col]);
+                }
+            }
+        }
+    }
+
+} // namespace
+
+BlockDistanceCache::BlockDistanceCache(const cv::Size& frameSize,
+    int blockSize, int capacity)
+    : frameSize_(frameSize), blockSize_(blockSize) {
+    CV_Assert(blockSize > 0 && capacity > 0);
+    grid_ = cv::Size(blockCount(frameSize.width, blockSize),
+        blockCount(frameSize.height, blockSize));
+
+    sum_ = cv::Mat::zeros(frameSize, CV_32F);
+    energySum_ = cv::Mat::zeros(grid_, CV_64F);
+    for (int i = 0; i < capacity; ++i) {
+        energies_.push_back(cv::Mat::zeros(grid_, CV_64F));
+    }
+    currentEnergy_.create(grid_, CV_64F);
+    cross_.create(grid_, CV_64F);
+}
+
+void BlockDistanceCache::push(const cv::Mat& newest, const cv::Mat* oldest) {
+    pushRows(newest, oldest, cv::Range(0, grid_.height), scratch_);
+    commitPush(oldest != nullptr);
+}
+
+void BlockDistanceCache::pushRows(const cv::Mat& newest, const cv::Mat* oldest,
+    const cv::Range& blockRows, std::vector<float>& scratch) {
+    CV_Assert((newest.type() == CV_32F || newest.type() == CV_16U) &&
+        newest.size() == frameSize_);
+    const int capacity = static_cast<int>(energies_.size());
+    if (oldest) {
+        CV_Assert(size_ == capacity);
+        CV_Assert(oldest->type() == newest.type() &&
+            oldest->size() == frameSize_);
+    }
+    else {
+        CV_Assert(size_ < capacity);
+    }
+    if (blockRows.empty()) {
+        return;
+    }
+
+    // The newest frame takes the slot of the oldest one when full
+    const int slot = (head_ + size_) % capacity;
+    cv::Mat energy = energies_[slot];
+    cv::Mat energySum = energySum_.rowRange(blockRows);
+    if (oldest) {
+        energySum -= energy.rowRange(blockRows);
+    }
+    blockSums(newest, nullptr, energy, nullptr, blockRows, scratch);
+    energySum += energy.rowRange(blockRows);
+
+    const cv::Range rows(blockRows.start * blockSize_,
+        blockRows.end * blockSize_);
+    cv::Mat sum = sum_.rowRange(rows);
+    if (newest.type() == CV_32F) {
+        sum += newest.rowRange(rows);
+        if (oldest) {
+            sum -= oldest->rowRange(rows);
+        }
+    }
+    else {
+        // Sums of a few Q8.8 values are exact in float
+        const cv::Mat newestRows = newest.rowRange(rows);
+        const cv::Mat oldestRows = oldest ? oldest->rowRange(rows) : cv::Mat();
+        updateSum<ushort>(sum, &newestRows, oldest ? &oldestRows : nullptr);
+    }
+}
+
+void BlockDistanceCache::commitPush(bool dropOldest) {
+    const int capacity = static_cast<int>(energies_.size());
+    if (dropOldest) {
+        CV_Assert(size_ == capacity);
+        head_ = (head_ + 1) % capacity;
+    }
+    else {
+        CV_Assert(size_ < capacity);
+        ++size_;
+    }
+    ++pushedSinceResync_;
+}
+
+void BlockDistanceCache::compute(const cv::Mat& current, cv::Mat& motion) {
+    motion.create(grid_, CV_32F);
+    computeRows(current, motion, cv::Range(0, grid_.height), scratch_);
+}
+
+void BlockDistanceCache::computeRows(const cv::Mat& current, cv::Mat& motion,
+    const cv::Range& blockRows, std::vector<float>& scratch) {
+    CV_Assert(current.type() == CV_32F && current.size() == frameSize_);
+    CV_Assert(motion.type() == CV_32F && motion.size() == grid_);
+
+    if (size_ == 0) {
+        motion.rowRange(blockRows).setTo(0.0f);
+        return;
+    }
+
+    blockSums(current, &sum_, currentEnergy_, &cross_, blockRows, scratch);
+
+    const double invHistory = 1.0 / size_;
+    const double invArea = 1.0 / (blockSize_ * blockSize_);
+    for (int by = blockRows.start; by < blockRows.end; ++by) {
+        const double* cc = currentEnergy_.ptr<double>(by);
+        const double* cs = cross_.ptr<double>(by);
+        const double* hh = energySum_.ptr<double>(by);
+        float* out = motion.ptr<float>(by);
+        for (int bx = 0; bx < grid_.width; ++bx) {
+            const double ssd = cc[bx] - 2.0 * invHistory * cs[bx] +
+                invHistory * hh[bx];
+            // Cancellation can leave tiny negatives on identical blocks
+            out[bx] = static_cast<float>(std::max(ssd, 0.0) * invArea);
+        }
+    }
+}
+
+void BlockDistanceCache::blockSums(const cv::Mat& a, const cv::Mat* b,
+    cv::Mat& aa, cv::Mat* ab, const cv::Range& blockRows,
+    std::vector<float>& scratch) {
+    const int cols = grid_.width * blockSize_;
+    if (scratch.size() < 2 * static_cast<size_t>(cols)) {
+        scratch.resize(2 * static_cast<size_t>(cols));
+    }
+    const BlockSumsKernel kernel = blockSumsKernel(blockSize_, a.depth());
+    for (int by = blockRows.start; by < blockRows.end; ++by) {
+        kernel(a, b, by, grid_.width, blockSize_, aa.ptr<double>(by),
+            ab ? ab->ptr<double>(by) : nullptr, scratch.data());
+    }
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    cv::vx_cleanup();
+#endif
+}
+
+size_t BlockDistanceCache::bytes() const {
+    size_t total = sum_.total() * sum_.elemSize() +
+        energySum_.total() * energySum_.elemSize() +
+        currentEnergy_.total() * currentEnergy_.elemSize() +
+        cross_.total() * cross_.elemSize() + scratch_.capacity() * sizeof(float);
+    for (const auto& energy : energies_) {
+        total += energy.total() * energy.elemSize();
+    }
+    return total;
+}
+
+void BlockDistanceCache::popOldest(const cv::Mat& oldest) {
+    CV_Assert(size_ > 0 && (oldest.type() == CV_32F ||
+        oldest.type() == CV_16U) && oldest.size() == frameSize_);
+    const int capacity = static_cast<int>(energies_.size());
+    energySum_ -= energies_[head_];
+    const cv::Range rows(0, grid_.height * blockSize_);
+    cv::Mat sum = sum_.rowRange(rows);
+    if (oldest.type() == CV_32F) {
+        sum -= oldest.rowRange(rows);
+    }
+    else {
+        // Q8.8 pixels are widened to grey levels like in pushRows()
+        const cv::Mat oldestRows = oldest.rowRange(rows);
+        updateSum<ushort>(sum, nullptr, &oldestRows);
+    }
+    head_ = (head_ + 1) % capacity;
+    --size_;
+}
+
+void BlockDistanceCache::clear() {
+    sum_.setTo(0);
+    energySum_.setTo(0);
+    head_ = 0;
+    size_ = 0;
+    pushedSinceResync_ = 0;
+}
+
+void BlockDistanceCache::resync(const FrameRing& frames) {
+    CV_Assert(frames.size() == size_);
+    const cv::Range rows(0, grid_.height * blockSize_);
+    cv::Mat sum = sum_.rowRange(rows);
+    sum.setTo(0);
+    energySum_.setTo(0);
+    for (int i = 0; i < size_; ++i) {
+        const cv::Mat& frame = frames[i];
+        CV_Assert((frame.type() == CV_32F || frame.type() == CV_16U) &&
+            frame.size() == frameSize_);
+        const cv::Mat frameRows = frame.rowRange(rows);
+        if (frame.type() == CV_32F) {
+            sum += frameRows;
+        }
+        else {
+            updateSum<ushort>(sum, &frameRows, nullptr);
+        }
+        energySum_ += energies_[(head_ + i) % energies_.size()];
+    }
+    pushedSinceResync_ = 0;
+}
+
+void BlockDistanceCache::saveState(StateWriter& state) const {
+    state.value(size_);
+    state.value(pushedSinceResync_);
+    state.plane(sum_);
+    state.plane(energySum_);
+    for (int i = 0; i < size_; ++i) {
+        state.plane(energies_[(head_ + i) % energies_.size()]);
+    }
+}
+
+void BlockDistanceCache::restoreState(StateReader& state) {
+    const int size = state.value();
+    if (size < 0 || size > static_cast<int>(energies_.size())) {
+        throw std::invalid_argument("Block distance history does not match");
+    }
+    const int pushed = state.value();
+    state.plane(sum_);
+    state.plane(energySum_);
+    for (int i = 0; i < size; ++i) {
+        state.plane(energies_[i]);
+    }
+    head_ = 0;
+    size_ = size;
+    pushedSinceResync_ = pushed;
+}
+
+void blockDistanceReference(const cv::Mat& current,
+    const std::vector<cv::Mat>& history, int blockSize, cv::Mat& motion) {
+    const int height = current.rows;
+    const int width = current.cols;
+    motion = cv::Mat::zeros(blockCount(height, blockSize),
+        blockCount(width, blockSize), CV_32F);
+    if (history.empty()) {
+        return;
+    }
+
+    // Compare with each frame in history
+    for (const auto& pastFrame : history) {
+        for (int y = 0; y < height - blockSize; y += blockSize) {
+            for (int x = 0; x < width - blockSize; x += blockSize) {
+                cv::Rect block(x, y, blockSize, blockSize);
+
+                // L2 distance between blocks
+                cv::Mat diff;
+                cv::subtract(current(block), pastFrame(block), diff);
+                cv::multiply(diff, diff, diff);
+                float blockDist = cv::sum(diff)[0] / (blockSize * blockSize);
+
+                motion.at<float>(y / blockSize, x / blockSize) += blockDist;
+            }
+        }
+    }
+
+    // Average motion over all past frames
+    motion /= static_cast<float>(history.size());
+}
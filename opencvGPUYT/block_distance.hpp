@@ -0,0 +1,98 @@
+#pragma once
+#include "engine_state.hpp"
+#include "frame_ring.hpp"
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Per-block temporal distance between the current frame and a frame history.
+//
+// The mean 8x8 SSD against N history frames h_i is expanded as
+//
+//   1/N * sum_i |c - h_i|^2 = |c|^2 - 2/N * <c, S> + 1/N * sum_i |h_i|^2
+//
+// with S = sum_i h_i. S is kept as a running plane and |h_i|^2 is computed per
+// block once, when h_i enters the history, so every new frame costs a single
+// pass over the current frame and S whatever the history depth is. Adding
+// and subtracting CV_32F frames leaves rounding error in S, so the owner
+// rebuilds it from the history once per history cycle (resyncDue()).
+//
+// Every operation also comes as a *Rows variant restricted to a range of
+// block rows, so disjoint strips of the frame can be updated concurrently.
+// Those take a caller-owned scratch buffer and the history change is only
+// published by commitPush() once all strips are done.
+class BlockDistanceCache {
+public:
+    BlockDistanceCache(const cv::Size& frameSize, int blockSize, int capacity);
+
+    // Append a frame to the history. When oldest is given it leaves the
+    // history at the same time; it must be the pixels of front slot. History
+    // frames are CV_32F, or Q8.8 CV_16U (fixed_point.hpp) in compact mode.
+    void push(const cv::Mat& newest, const cv::Mat* oldest = nullptr);
+
+    // Mean per-pixel SSD of every block against the history, one CV_32F
+    // value per block. Blocks follow blockMatchingWithHistory: a block row or
+    // column is only emitted when a full block fits before the last one.
+    void compute(const cv::Mat& current, cv::Mat& motion);
+
+    // Strip variants of push() and compute(). motion must already have the
+    // grid() size. Frames are full-size planes; only rows of blockRows are
+    // read or written.
+    void pushRows(const cv::Mat& newest, const cv::Mat* oldest,
+        const cv::Range& blockRows, std::vector<float>& scratch);
+    void commitPush(bool dropOldest);
+
+    // Drop the oldest frame without adding one; oldest must be its pixels
+    void popOldest(const cv::Mat& oldest);
+
+    // Forget every frame, keeping the buffers
+    void clear();
+
+    // True once a history's worth of frames has been pushed since S was last
+    // rebuilt. resync() rebuilds it and the block energy total from frames,
+    // which must be the history pushed so far, oldest first.
+    bool resyncDue() const {
+        return pushedSinceResync_ >= static_cast<int>(energies_.size());
+    }
+    void resync(const FrameRing& frames);
+    void computeRows(const cv::Mat& current, cv::Mat& motion,
+        const cv::Range& blockRows, std::vector<float>& scratch);
+
+    cv::Size grid() const { return grid_; }
+    int blockSize() const { return blockSize_; }
+    int size() const { return size_; }
+
+    // Persistent memory held by the cache
+    size_t bytes() const;
+
+    // Checkpoint support: the running sums, the per-frame energies, oldest
+    // frame first, and where the resync cycle stands. Restoring needs a cache
+    // of the same geometry and capacity.
+    void saveState(StateWriter& state) const;
+    void restoreState(StateReader& state);
+
+private:
+    // Per-block |a|^2 and, when b is given, <a, b> in one pass over a, with
+    // the block_kernels.hpp kernel for the block size. a is CV_32F or Q8.8
+    // CV_16U, b always CV_32F.
+    void blockSums(const cv::Mat& a, const cv::Mat* b, cv::Mat& aa,
+        cv::Mat* ab, const cv::Range& blockRows, std::vector<float>& scratch);
+
+    cv::Size frameSize_;
+    cv::Size grid_;
+    int blockSize_;
+
+    cv::Mat sum_;                   // S, running sum of the history frames
+    cv::Mat energySum_;             // sum_i |h_i|^2 per block (CV_64F)
+    std::vector<cv::Mat> energies_; // |h_i|^2 per block, one slot per frame
+    int head_ = 0;                  // Slot of the oldest frame
+    int size_ = 0;
+    int pushedSinceResync_ = 0;
+    cv::Mat currentEnergy_, cross_; // Per-call block buffers (CV_64F)
+    std::vector<float> scratch_;    // Column sums for the whole-frame calls
+};
+
+// Original ROI based block matching, one cv::subtract/multiply/sum per block
+// and history frame, writing the same compact block map. Kept for validation
+// and benchmarking.
+void blockDistanceReference(const cv::Mat& current,
+    const std::vector<cv::Mat>& history, int blockSize, cv::Mat& motion);
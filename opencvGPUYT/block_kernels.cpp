@@ -0,0 +1,337 @@
+#include "block_kernels.hpp"
+#include "fixed_point.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <opencv2/core/hal/intrin.hpp>
+
+namespace {
+
+    // Pixels widened to float, CV_16U being Q8.8 fixed point
+    inline float widen(float value) { return value; }
+    inline float widen(ushort value) { return fromFixedPoint(value); }
+    inline float widen(uchar value) { return value; }
+
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    inline cv::v_float32 loadWide(const float* ptr) { return cv::vx_load(ptr); }
+    inline cv::v_float32 loadWide(const ushort* ptr) {
+        return cv::v_mul(cv::v_cvt_f32(cv::v_reinterpret_as_s32(
+            cv::vx_load_expand(ptr))), cv::vx_setall_f32(kFixedPointUnit));
+    }
+    inline cv::v_float32 loadWide(const uchar* ptr) {
+        return cv::v_cvt_f32(cv::v_reinterpret_as_s32(
+            cv::vx_load_expand_q(ptr)));
+    }
+#endif
+
+#if CV_SIMD128
+    // Four pixels widened to float in a 128-bit register
+    inline cv::v_float32x4 load4(const float* ptr) { return cv::v_load(ptr); }
+    inline cv::v_float32x4 load4(const ushort* ptr) {
+        return cv::v_mul(cv::v_cvt_f32(cv::v_reinterpret_as_s32(
+            cv::v_load_expand(ptr))), cv::v_setall_f32(kFixedPointUnit));
+    }
+    inline cv::v_float32x4 load4(const uchar* ptr) {
+        return cv::v_cvt_f32(cv::v_reinterpret_as_s32(
+            cv::v_load_expand_q(ptr)));
+    }
+#endif
+
+    // Generic block sums: column sums of the whole block row through the
+    // scratch buffer, vectorised at the native width, then one reduction
+    // per block
+    template <typename T>
+    void blockSumsAny(const cv::Mat& a, const cv::Mat* b, int blockRow,
+        int blocks, int blockSize, double* aa, double* ab, float* scratch) {
+        const int cols = blocks * blockSize;
+        float* colAA = scratch;
+        float* colAB = scratch + cols;
+        std::fill(colAA, colAA + 2 * cols, 0.0f);
+
+        const int rowBegin = blockRow * blockSize;
+        for (int row = rowBegin; row < rowBegin + blockSize; ++row) {
+            const T* aRow = a.ptr<T>(row);
+            const float* bRow = b ? b->ptr<float>(row) : nullptr;
+
+            int col = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+            const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+            if (bRow) {
+                for (; col <= cols - lanes; col += lanes) {
+                    cv::v_float32 va = loadWide(aRow + col);
+                    cv::v_store(colAA + col,
+                        cv::v_muladd(va, va, cv::vx_load(colAA + col)));
+                    cv::v_store(colAB + col, cv::v_muladd(va,
+                        cv::vx_load(bRow + col), cv::vx_load(colAB + col)));
+                }
+            }
+            else {
+                for (; col <= cols - lanes; col += lanes) {
+                    cv::v_float32 va = loadWide(aRow + col);
+                    cv::v_store(colAA + col,
+                        cv::v_muladd(va, va, cv::vx_load(colAA + col)));
+                }
+            }
+#endif
+            for (; col < cols; ++col) {
+                const float value = widen(aRow[col]);
+                colAA[col] += value * value;
+                if (bRow) {
+                    colAB[col] += value * bRow[col];
+                }
+            }
+        }
+
+        // Reduce each block's columns in double to keep the difference of
+        // the expanded SSD terms accurate
+        for (int bx = 0; bx < blocks; ++bx) {
+            double sumAA = 0.0, sumAB = 0.0;
+            for (int col = bx * blockSize; col < (bx + 1) * blockSize; ++col) {
+                sumAA += colAA[col];
+                sumAB += colAB[col];
+            }
+            aa[bx] = sumAA;
+            if (ab) {
+                ab[bx] = sumAB;
+            }
+        }
+    }
+
+    // Specialised block sums: one block at a time, its columns accumulated
+    // in BlockSize / 4 registers over its rows
+    template <int BlockSize, typename T, bool Cross>
+    void blockSumsFixed(const cv::Mat& a, const cv::Mat* b, int blockRow,
+        int blocks, double* aa, double* ab) {
+        static_assert(BlockSize % 4 == 0, "Block rows fill whole registers");
+        constexpr int kVectors = BlockSize / 4;
+        const int rowBegin = blockRow * BlockSize;
+        const uchar* aBase = a.ptr(rowBegin);
+        const uchar* bBase = Cross ? b->ptr(rowBegin) : nullptr;
+        const size_t aStep = a.step;
+        const size_t bStep = Cross ? b->step : 0;
+
+        for (int bx = 0; bx < blocks; ++bx) {
+            const int x = bx * BlockSize;
+            float colAA[BlockSize];
+            float colAB[BlockSize];
+#if CV_SIMD128
+            cv::v_float32x4 accAA[kVectors];
+            cv::v_float32x4 accAB[kVectors];
+            for (int v = 0; v < kVectors; ++v) {
+                accAA[v] = cv::v_setzero_f32();
+                accAB[v] = cv::v_setzero_f32();
+            }
+            for (int y = 0; y < BlockSize; ++y) {
+                const T* aRow =
+                    reinterpret_cast<const T*>(aBase + y * aStep) + x;
+                const float* bRow = Cross ? reinterpret_cast<const float*>(
+                    bBase + y * bStep) + x : nullptr;
+                for (int v = 0; v < kVectors; ++v) {
+                    const cv::v_float32x4 va = load4(aRow + 4 * v);
+                    accAA[v] = cv::v_muladd(va, va, accAA[v]);
+                    if constexpr (Cross) {
+                        accAB[v] = cv::v_muladd(va, cv::v_load(bRow + 4 * v),
+                            accAB[v]);
+                    }
+                }
+            }
+            for (int v = 0; v < kVectors; ++v) {
+                cv::v_store(colAA + 4 * v, accAA[v]);
+                cv::v_store(colAB + 4 * v, accAB[v]);
+            }
+#else
+            std::fill(colAA, colAA + BlockSize, 0.0f);
+            std::fill(colAB, colAB + BlockSize, 0.0f);
+            for (int y = 0; y < BlockSize; ++y) {
+                const T* aRow =
+                    reinterpret_cast<const T*>(aBase + y * aStep) + x;
+                const float* bRow = Cross ? reinterpret_cast<const float*>(
+                    bBase + y * bStep) + x : nullptr;
+                for (int col = 0; col < BlockSize; ++col) {
+                    const float value = widen(aRow[col]);
+                    colAA[col] += value * value;
+                    if constexpr (Cross) {
+                        colAB[col] += value * bRow[col];
+                    }
+                }
+            }
+#endif
+            double sumAA = 0.0, sumAB = 0.0;
+            for (int col = 0; col < BlockSize; ++col) {
+                sumAA += colAA[col];
+                sumAB += colAB[col];
+            }
+            aa[bx] = sumAA;
+            if constexpr (Cross) {
+                ab[bx] = sumAB;
+            }
+        }
+    }
+
+    template <int BlockSize, typename T>
+    void blockSumsSpecialised(const cv::Mat& a, const cv::Mat* b,
+        int blockRow, int blocks, int /*blockSize*/, double* aa, double* ab,
+        float* /*scratch*/) {
+        if (b) {
+            blockSumsFixed<BlockSize, T, true>(a, b, blockRow, blocks, aa, ab);
+        }
+        else {
+            blockSumsFixed<BlockSize, T, false>(a, b, blockRow, blocks, aa,
+                ab);
+        }
+    }
+
+    // Generic SAD, with the 8 and 16 pixel wide rows vectorised
+    unsigned blockSadAny(const uchar* a, size_t stepA, const uchar* b,
+        size_t stepB, int size) {
+        unsigned sum = 0;
+        int y = 0;
+#if CV_SIMD128
+        if (size == 8) {
+            // Two 8-pixel rows per register
+            for (; y + 1 < size; y += 2) {
+                sum += cv::v_reduce_sad(
+                    cv::v_load_halves(a + y * stepA, a + (y + 1) * stepA),
+                    cv::v_load_halves(b + y * stepB, b + (y + 1) * stepB));
+            }
+        }
+        else if (size % 16 == 0) {
+            for (; y < size; ++y) {
+                for (int x = 0; x < size; x += 16) {
+                    sum += cv::v_reduce_sad(cv::v_load(a + y * stepA + x),
+                        cv::v_load(b + y * stepB + x));
+                }
+            }
+        }
+#endif
+        for (; y < size; ++y) {
+            const uchar* rowA = a + y * stepA;
+            const uchar* rowB = b + y * stepB;
+            for (int x = 0; x < size; ++x) {
+                sum += std::abs(rowA[x] - rowB[x]);
+            }
+        }
+        return sum;
+    }
+
+#if CV_SIMD128
+    // Four 4-pixel rows in one register
+    inline cv::v_uint8x16 loadRows4(const uchar* ptr, size_t step) {
+        unsigned rows[4];
+        for (int y = 0; y < 4; ++y) {
+            std::memcpy(&rows[y], ptr + y * step, sizeof(unsigned));
+        }
+        return cv::v_reinterpret_as_u8(
+            cv::v_uint32x4(rows[0], rows[1], rows[2], rows[3]));
+    }
+#endif
+
+    template <int BlockSize>
+    unsigned blockSadFixed(const uchar* a, size_t stepA, const uchar* b,
+        size_t stepB, int /*size*/) {
+        unsigned sum = 0;
+#if CV_SIMD128
+        if constexpr (BlockSize == 4) {
+            sum = cv::v_reduce_sad(loadRows4(a, stepA), loadRows4(b, stepB));
+        }
+        else if constexpr (BlockSize == 8) {
+            for (int y = 0; y < BlockSize; y += 2) {
+                sum += cv::v_reduce_sad(
+                    cv::v_load_halves(a + y * stepA, a + (y + 1) * stepA),
+                    cv::v_load_halves(b + y * stepB, b + (y + 1) * stepB));
+            }
+        }
+        else {
+            static_assert(BlockSize % 16 == 0, "Rows of whole registers");
+            for (int y = 0; y < BlockSize; ++y) {
+                for (int x = 0; x < BlockSize; x += 16) {
+                    sum += cv::v_reduce_sad(cv::v_load(a + y * stepA + x),
+                        cv::v_load(b + y * stepB + x));
+                }
+            }
+        }
+#else
+        for (int y = 0; y < BlockSize; ++y) {
+            for (int x = 0; x < BlockSize; ++x) {
+                sum += std::abs(a[y * stepA + x] - b[y * stepB + x]);
+            }
+        }
+#endif
+        return sum;
+    }
+
+    struct BlockSumsEntry {
+        int blockSize;
+        int depth;
+        BlockSumsKernel kernel;
+    };
+
+    constexpr BlockSumsEntry kBlockSums[] = {
+        { 4, CV_8U, &blockSumsSpecialised<4, uchar> },
+        { 4, CV_16U, &blockSumsSpecialised<4, ushort> },
+        { 4, CV_32F, &blockSumsSpecialised<4, float> },
+        { 8, CV_8U, &blockSumsSpecialised<8, uchar> },
+        { 8, CV_16U, &blockSumsSpecialised<8, ushort> },
+        { 8, CV_32F, &blockSumsSpecialised<8, float> },
+        { 16, CV_8U, &blockSumsSpecialised<16, uchar> },
+        { 16, CV_16U, &blockSumsSpecialised<16, ushort> },
+        { 16, CV_32F, &blockSumsSpecialised<16, float> },
+    };
+
+    struct BlockSadEntry {
+        int blockSize;
+        BlockSadKernel kernel;
+    };
+
+    constexpr BlockSadEntry kBlockSad[] = {
+        { 4, &blockSadFixed<4> },
+        { 8, &blockSadFixed<8> },
+        { 16, &blockSadFixed<16> },
+    };
+
+} // namespace
+
+BlockSumsKernel blockSumsKernel(int blockSize, int depth) {
+    for (const BlockSumsEntry& entry : kBlockSums) {
+        if (entry.blockSize == blockSize && entry.depth == depth) {
+            return entry.kernel;
+        }
+    }
+    return blockSumsGeneric(depth);
+}
+
+BlockSadKernel blockSadKernel(int blockSize) {
+    for (const BlockSadEntry& entry : kBlockSad) {
+        if (entry.blockSize == blockSize) {
+            return entry.kernel;
+        }
+    }
+    return blockSadGeneric();
+}
+
+BlockSumsKernel blockSumsGeneric(int depth) {
+    switch (depth) {
+    case CV_8U:
+        return &blockSumsAny<uchar>;
+    case CV_16U:
+        return &blockSumsAny<ushort>;
+    case CV_32F:
+        return &blockSumsAny<float>;
+    default:
+        CV_Error(cv::Error::StsUnsupportedFormat,
+            "Block sums need CV_8U, CV_16U or CV_32F pixels");
+    }
+}
+
+BlockSadKernel blockSadGeneric() {
+    return &blockSadAny;
+}
+
+bool hasSpecialisedKernels(int blockSize) {
+    for (const BlockSadEntry& entry : kBlockSad) {
+        if (entry.blockSize == blockSize) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+
+// Block matching kernels, specialised at compile time on the block size
+// (4, 8 and 16) and the pixel type. With the size fixed, the loops over a
+// block's rows and columns unroll and every row of a block is a whole
+// number of 128-bit registers, so the sums stay in registers instead of
+// going through column buffers. Every kernel also has a generic version
+// taking the block size at run time. blockSumsKernel() and blockSadKernel()
+// look the specialised version up in a constexpr table and fall back to
+// the generic one; callers look the pointer up once and call it per block
+// row or block.
+
+// Per-block sums of one row of blocks: aa[bx] = sum of a^2 and, when b is
+// given, ab[bx] = sum of a*b over block bx. Both accumulate per column in
+// float over the block's rows and reduce the columns in double, so every
+// version returns the same sums. a is CV_8U, Q8.8 CV_16U (fixed_point.hpp)
+// or CV_32F, b is CV_32F. scratch holds 2 * blocks * blockSize floats and
+// is only used by the generic version.
+using BlockSumsKernel = void (*)(const cv::Mat& a, const cv::Mat* b,
+    int blockRow, int blocks, int blockSize, double* aa, double* ab,
+    float* scratch);
+
+// Sum of absolute differences of two blockSize x blockSize 8-bit blocks
+using BlockSadKernel = unsigned (*)(const uchar* a, size_t stepA,
+    const uchar* b, size_t stepB, int blockSize);
+
+// Kernel for blockSize and the depth of a (CV_8U, CV_16U or CV_32F)
+BlockSumsKernel blockSumsKernel(int blockSize, int depth);
+BlockSadKernel blockSadKernel(int blockSize);
+
+// The run-time sized versions, for validation and benchmarking
+BlockSumsKernel blockSumsGeneric(int depth);
+BlockSadKernel blockSadGeneric();
+
+// Block sizes with specialised kernels
+bool hasSpecialisedKernels(int blockSize);
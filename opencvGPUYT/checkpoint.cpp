@@ -0,0 +1,323 @@
+#include "checkpoint.hpp"
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    constexpr char kMagic[8] = { 'S', 'T', 'K', 'M', 'B', 'C', 'K', '1' };
+    constexpr uint32_t kVersion = 1;
+
+    static_assert(std::is_trivially_copyable_v<CheckpointHeader> &&
+        sizeof(CheckpointHeader) == 40);
+
+    // CRC-32 (IEEE 802.3, reflected), table driven
+    const std::array<uint32_t, 256>& crcTable() {
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> entries{};
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int bit = 0; bit < 8; ++bit) {
+                    c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                entries[i] = c;
+            }
+            return entries;
+        }();
+        return table;
+    }
+
+    // Running CRC without the final inversion; start from 0xFFFFFFFF
+    uint32_t crcUpdate(uint32_t crc, const void* data, size_t bytes) {
+        const auto& table = crcTable();
+        const auto* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < bytes; ++i) {
+            crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+    // fwrite that folds every byte into the checksum
+    class ChecksumFile {
+    public:
+        explicit ChecksumFile(const std::string& path)
+            : file_(std::fopen(path.c_str(), "wb")) {}
+        ~ChecksumFile() {
+            if (file_) {
+                std::fclose(file_);
+            }
+        }
+
+        bool isOpen() const { return file_ != nullptr; }
+
+        void write(const void* data, size_t bytes) {
+            if (bytes > 0 && ok_) {
+                ok_ = std::fwrite(data, bytes, 1, file_) == 1;
+                crc_ = crcUpdate(crc_, data, bytes);
+            }
+        }
+
+        // Append the checksum and close; false on any I/O error
+        bool finish() {
+            const uint32_t crc = ~crc_;
+            ok_ = ok_ && std::fwrite(&crc, sizeof(crc), 1, file_) == 1;
+            ok_ = std::fclose(file_) == 0 && ok_;
+            file_ = nullptr;
+            return ok_;
+        }
+
+    private:
+        std::FILE* file_;
+        uint32_t crc_ = 0xFFFFFFFFu;
+        bool ok_ = true;
+    };
+
+    // Bounds-checked cursor over the file contents
+    class Cursor {
+    public:
+        Cursor(const std::vector<unsigned char>& data, size_t end,
+            const std::string& path)
+            : data_(data), end_(end), path_(path) {}
+
+        const unsigned char* take(size_t bytes) {
+            if (bytes > end_ - offset_) {
+                throw std::runtime_error("Checkpoint '" + path_ +
+                    "' is truncated");
+            }
+            const unsigned char* p = data_.data() + offset_;
+            offset_ += bytes;
+            return p;
+        }
+
+        template <typename T>
+        T get() {
+            T value;
+            std::memcpy(&value, take(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        std::string string(size_t bytes) {
+            const auto* p = take(bytes);
+            return std::string(reinterpret_cast<const char*>(p), bytes);
+        }
+
+        bool atEnd() const { return offset_ == end_; }
+
+    private:
+        const std::vector<unsigned char>& data_;
+        size_t end_;
+        const std::string& path_;
+        size_t offset_ = 0;
+    };
+
+} // namespace
+
+void writeCheckpoint(const std::string& path, const Checkpoint& checkpoint) {
+    const EngineState& state = checkpoint.state;
+    CheckpointHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.planeCount = static_cast<uint32_t>(state.planes.size());
+    header.nextFrame = checkpoint.nextFrame;
+    header.firstFrame = checkpoint.firstFrame;
+    header.contextBytes = static_cast<uint32_t>(checkpoint.context.size());
+    header.layoutBytes = static_cast<uint32_t>(state.layout.size());
+
+    const std::string temporary = path + ".tmp";
+    {
+        ChecksumFile file(temporary);
+        if (!file.isOpen()) {
+            throw std::runtime_error("Cannot create checkpoint '" +
+                temporary + "'");
+        }
+        file.write(&header, sizeof(header));
+        file.write(checkpoint.context.data(), checkpoint.context.size());
+        file.write(state.layout.data(), state.layout.size());
+        for (const cv::Mat& plane : state.planes) {
+            const int32_t shape[3] = { plane.type(), plane.rows, plane.cols };
+            file.write(shape, sizeof(shape));
+            const size_t rowBytes = plane.cols * plane.elemSize();
+            for (int y = 0; y < plane.rows; ++y) {
+                file.write(plane.ptr(y), rowBytes);
+            }
+        }
+        if (!file.finish()) {
+            throw std::runtime_error("Cannot write checkpoint '" +
+                temporary + "'");
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        throw std::runtime_error("Cannot replace checkpoint '" + path +
+            "': " + error.message());
+    }
+}
+
+Checkpoint readCheckpoint(const std::string& path) {
+    std::vector<unsigned char> data;
+    {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) {
+            throw std::runtime_error("Cannot open checkpoint '" + path + "'");
+        }
+        unsigned char buffer[1 << 16];
+        size_t bytes;
+        while ((bytes = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            data.insert(data.end(), buffer, buffer + bytes);
+        }
+        std::fclose(file);
+    }
+
+    if (data.size() < sizeof(CheckpointHeader) + sizeof(uint32_t)) {
+        throw std::runtime_error("Checkpoint '" + path + "' is truncated");
+    }
+    const size_t end = data.size() - sizeof(uint32_t);
+    uint32_t stored;
+    std::memcpy(&stored, data.data() + end, sizeof(stored));
+    if (~crcUpdate(0xFFFFFFFFu, data.data(), end) != stored) {
+        throw std::runtime_error("Checkpoint '" + path +
+            "' fails its checksum");
+    }
+
+    Cursor cursor(data, end, path);
+    const auto header = cursor.get<CheckpointHeader>();
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        throw std::runtime_error("'" + path + "' is not a checkpoint");
+    }
+    if (header.version != kVersion) {
+        throw std::runtime_error("Checkpoint '" + path + "' has version " +
+            std::to_string(header.version) + ", expected " +
+            std::to_string(kVersion));
+    }
+
+    Checkpoint checkpoint;
+    checkpoint.nextFrame = header.nextFrame;
+    checkpoint.firstFrame = header.firstFrame;
+    checkpoint.context = cursor.string(header.contextBytes);
+    checkpoint.state.layout = cursor.string(header.layoutBytes);
+    for (uint32_t i = 0; i < header.planeCount; ++i) {
+        const auto type = cursor.get<int32_t>();
+        const auto rows = cursor.get<int32_t>();
+        const auto cols = cursor.get<int32_t>();
+        if (CV_MAT_DEPTH(type) > CV_16F || type != CV_MAT_TYPE(type) ||
+            rows < 0 || cols < 0) {
+            throw std::runtime_error("Checkpoint '" + path +
+                "' has a malformed plane");
+        }
+        // The bytes are taken before anything is allocated for them
+        const size_t bytes = static_cast<size_t>(rows) * cols *
+            CV_ELEM_SIZE(type);
+        const unsigned char* pixels = cursor.take(bytes);
+        cv::Mat plane(rows, cols, type);
+        if (bytes > 0) {
+            std::memcpy(plane.data, pixels, bytes);
+        }
+        checkpoint.state.planes.push_back(std::move(plane));
+    }
+    if (!cursor.atEnd()) {
+        throw std::runtime_error("Checkpoint '" + path +
+            "' has trailing data");
+    }
+    return checkpoint;
+}
+
+CheckpointWriter::CheckpointWriter(std::string path, std::string context,
+    int64_t firstFrame)
+    : path_(std::move(path)) {
+    pending_.context = writing_.context = std::move(context);
+    pending_.firstFrame = writing_.firstFrame = firstFrame;
+    thread_ = std::thread(&CheckpointWriter::run, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+}
+
+void CheckpointWriter::save(const Denoiser& denoiser, int64_t nextFrame) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error_) {
+            std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+        // The writer only touches writing_, so pending_ is ours under the lock
+        denoiser.saveState(pending_.state);
+        pending_.nextFrame = nextFrame;
+        hasPending_ = true;
+    }
+    changed_.notify_all();
+}
+
+void CheckpointWriter::hold(const Denoiser& denoiser, int64_t nextFrame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error_) {
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+    denoiser.saveState(held_.state);
+    held_.nextFrame = nextFrame;
+    hasHeld_ = true;
+}
+
+void CheckpointWriter::release(int64_t nextFrame) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!hasHeld_ || held_.nextFrame > nextFrame) {
+            return;
+        }
+        std::swap(held_.state, pending_.state);
+        pending_.nextFrame = held_.nextFrame;
+        hasHeld_ = false;
+        hasPending_ = true;
+    }
+    changed_.notify_all();
+}
+
+void CheckpointWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return !hasPending_ && !busy_; });
+    if (error_) {
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+}
+
+void CheckpointWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        changed_.wait(lock, [this] { return hasPending_ || stop_; });
+        // Pending snapshots are still written on shutdown
+        if (!hasPending_) {
+            return;
+        }
+        std::swap(pending_.state, writing_.state);
+        writing_.nextFrame = pending_.nextFrame;
+        hasPending_ = false;
+        busy_ = true;
+
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            writeCheckpoint(path_, writing_);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        busy_ = false;
+        if (error) {
+            error_ = error;
+        }
+        changed_.notify_all();
+    }
+}
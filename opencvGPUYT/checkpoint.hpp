@@ -0,0 +1,91 @@
+#pragma once
+#include "denoiser.hpp"
+#include "engine_state.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Resumable position of a long job: the engine state after frame
+// nextFrame - 1, plus what the job needs to carry on from there.
+//
+// On disk, little-endian:
+//
+//   CheckpointHeader
+//   context, then the engine layout tag (contextBytes, layoutBytes)
+//   per plane: int32 type, rows, cols, then the rows without padding
+//   uint32 CRC-32 of every byte before it
+struct Checkpoint {
+    int64_t nextFrame = 0;  // First input frame a resumed run reads
+    int64_t firstFrame = 0; // First input frame of the whole job
+    std::string context;    // Job settings outside the engine (colour mode)
+    EngineState state;
+};
+
+struct CheckpointHeader {
+    char magic[8];         // "STKMBCK1"
+    uint32_t version;      // 1
+    uint32_t planeCount;
+    int64_t nextFrame;
+    int64_t firstFrame;
+    uint32_t contextBytes;
+    uint32_t layoutBytes;
+};
+
+// Write checkpoint to a temporary file next to path and rename it over
+// path, so a crash mid-write leaves the previous checkpoint intact. Throws
+// std::runtime_error on I/O errors.
+void writeCheckpoint(const std::string& path, const Checkpoint& checkpoint);
+
+// Throws std::runtime_error when the file is missing, truncated, of another
+// version or fails its checksum
+Checkpoint readCheckpoint(const std::string& path);
+
+// Periodic checkpoints off the processing thread. save() only copies the
+// engine state into a staging snapshot; a background thread serialises it.
+// When a write is still running, a newer snapshot replaces the waiting one,
+// so the caller never blocks on the disk.
+class CheckpointWriter {
+public:
+    CheckpointWriter(std::string path, std::string context, int64_t firstFrame);
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    // Snapshot denoiser after it processed frame nextFrame - 1. Rethrows the
+    // error of a failed earlier write.
+    void save(const Denoiser& denoiser, int64_t nextFrame);
+
+    // Like save(), but the snapshot is held back until release() reports
+    // frame nextFrame - 1 as written, for pipelines whose output lags behind
+    // the engine. A newer hold replaces one not yet released.
+    void hold(const Denoiser& denoiser, int64_t nextFrame);
+
+    // Every frame before nextFrame is in the output: queue a held snapshot
+    // that does not go past it
+    void release(int64_t nextFrame);
+
+    // Wait until the latest snapshot is on disk; rethrows write errors
+    void flush();
+
+    const std::string& path() const { return path_; }
+
+private:
+    void run();
+
+    std::string path_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    Checkpoint held_;    // Snapshot waiting for its frames to be written
+    Checkpoint pending_; // Latest snapshot, waiting for the writer
+    Checkpoint writing_; // Snapshot being written
+    bool hasHeld_ = false;
+    bool hasPending_ = false;
+    bool busy_ = false;
+    bool stop_ = false;
+    std::exception_ptr error_;
+    std::thread thread_;
+};
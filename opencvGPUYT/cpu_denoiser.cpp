@@ -0,0 +1,181 @@
+#include "cpu_denoiser.hpp"
+#include "tuning_profile.hpp"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+CpuDenoiser::CpuDenoiser(const DenoiserOptions& options) : options_(options) {}
+
+void CpuDenoiser::init(const cv::Mat& firstFrame) {
+    float noise = 0.0f;
+    if (!options_.tuningProfiles.empty()) {
+        noise = options_.noiseLevel > 0.0f ? options_.noiseLevel
+            : estimateNoise(firstFrame);
+    }
+    setup(firstFrame, noise);
+}
+
+void CpuDenoiser::setup(const cv::Mat& firstFrame, float noise) {
+    frameSize_ = firstFrame.size();
+    frameType_ = firstFrame.type();
+    profileNoise_ = noise;
+
+    // The profile for this frame size and noise level replaces the tuned
+    // settings
+    profile_.clear();
+    if (!options_.tuningProfiles.empty()) {
+        const std::vector<TuningProfile> profiles =
+            loadTuningProfiles(options_.tuningProfiles);
+        if (const TuningProfile* profile =
+            findTuningProfile(profiles, firstFrame.size(), noise)) {
+            profile->settings.applyTo(options_);
+            std::ostringstream text;
+            text << profile->size.width << "x" << profile->size.height
+                << " noise " << profile->noise << " for noise " << noise
+                << ": " << profile->settings.describe();
+            profile_ = text.str();
+        }
+    }
+
+    engine_ = std::make_unique<STKMBCpu>(firstFrame, options_.historySize,
+        options_.blockSize, options_.compactState ? StatePrecision::Compact
+        : StatePrecision::Float32, options_.filter);
+    engine_->setParallel(options_.threads);
+    engine_->setSparse(options_.sparse);
+    engine_->setMotionCompensation(options_.motion);
+    if (options_.bilateralLevels > 0) {
+        engine_->setBilateral(BilateralMode::Fast, options_.bilateralLevels);
+    }
+    faces_.reset();
+    if (!options_.faceCascade.empty()) {
+        FaceRegionOptions faceOptions;
+        faceOptions.cascadePath = options_.faceCascade;
+        faceOptions.interval = options_.faceInterval;
+        faceOptions.background = options_.faceBackground;
+        faces_ = std::make_unique<FaceRegions>(faceOptions);
+        engine_->setRegionPriority(true);
+    }
+
+    // Each step is applied on top of the configured settings and kept only
+    // when it makes the level cheaper than the one before
+    const int history = options_.historySize;
+    const QualityLevel configured{ options_.bilateralLevels, history,
+        options_.sparse || faces_ != nullptr };
+    const QualityLevel steps[] = {
+        { 8, history, false }, { 4, history, false }, { 4, 3, false },
+        { 4, 3, true }, { 4, 2, true }
+    };
+    levels_.assign(1, configured);
+    for (const QualityLevel& step : steps) {
+        QualityLevel level = configured;
+        level.bilateralLevels = configured.bilateralLevels > 0
+            ? std::min(configured.bilateralLevels, step.bilateralLevels)
+            : step.bilateralLevels;
+        level.history = std::min(configured.history, step.history);
+        level.sparse = configured.sparse || step.sparse;
+        if (!(level == levels_.back())) {
+            levels_.push_back(level);
+        }
+    }
+    level_ = 0;
+}
+
+void CpuDenoiser::setQualityLevel(int level) {
+    if (!engine_) {
+        throw std::logic_error("CpuDenoiser::setQualityLevel called before init");
+    }
+    level = std::clamp(level, 0, qualityLevels() - 1);
+    if (level == level_) {
+        return;
+    }
+    const QualityLevel& settings = levels_[level];
+    engine_->setBilateral(settings.bilateralLevels > 0 ? BilateralMode::Fast
+        : BilateralMode::Exact, settings.bilateralLevels);
+    engine_->setHistoryDepth(settings.history);
+    if (settings.sparse != levels_[level_].sparse) {
+        engine_->setSparse(settings.sparse);
+    }
+    level_ = level;
+}
+
+void CpuDenoiser::process(const cv::Mat& input, cv::Mat& output) {
+    if (!engine_) {
+        throw std::logic_error("CpuDenoiser::process called before init");
+    }
+    if (faces_) {
+        engine_->setPriorityRegions(
+            faces_->update(input, engine_->motionVectors(),
+                options_.blockSize));
+    }
+    engine_->processFrame(input, output);
+}
+
+void CpuDenoiser::saveState(EngineState& state) const {
+    if (!engine_) {
+        throw std::logic_error("CpuDenoiser::saveState called before init");
+    }
+    StateWriter writer(state, stateLayout());
+    if (!options_.tuningProfiles.empty()) {
+        float noise = profileNoise_;
+        writer.plane(cv::Mat(1, 1, CV_32F, &noise));
+    }
+    engine_->saveState(writer);
+    if (faces_) {
+        faces_->saveState(writer);
+    }
+}
+
+void CpuDenoiser::restoreState(const EngineState& state) {
+    if (!engine_) {
+        throw std::logic_error("CpuDenoiser::restoreState called before init");
+    }
+
+    // A resumed run estimates the noise on a later frame and may have picked
+    // another profile: set up again under the one the state was saved with
+    if (!options_.tuningProfiles.empty() && !state.planes.empty()) {
+        const cv::Mat& saved = state.planes.front();
+        if (saved.type() == CV_32F && saved.total() == 1 &&
+            saved.at<float>(0) != profileNoise_) {
+            setup(cv::Mat::zeros(frameSize_, frameType_), saved.at<float>(0));
+        }
+    }
+
+    StateReader reader(state, stateLayout());
+    if (!options_.tuningProfiles.empty()) {
+        const cv::Mat& saved = reader.plane();
+        if (saved.type() != CV_32F || saved.total() != 1 ||
+            saved.at<float>(0) != profileNoise_) {
+            throw std::invalid_argument("Engine state of another profile");
+        }
+    }
+    engine_->restoreState(reader);
+    if (faces_) {
+        faces_->restoreState(reader);
+    }
+    if (!reader.done()) {
+        throw std::invalid_argument("Engine state has extra planes");
+    }
+}
+
+std::string CpuDenoiser::stateLayout() const {
+    std::string layout = engine_->stateLayout();
+    if (!options_.tuningProfiles.empty()) {
+        layout += " profiled";
+    }
+    if (faces_) {
+        layout += " faces" + std::to_string(options_.faceInterval);
+        if (options_.faceBackground) {
+            layout += " async";
+        }
+    }
+    return layout;
+}
+
+DenoiserCapabilities CpuDenoiser::capabilities() const {
+    DenoiserCapabilities caps;
+    caps.name = "cpu";
+    caps.usesGpu = false;
+    caps.threads = std::max(1, options_.threads);
+    caps.profile = profile_;
+    return caps;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "denoiser.hpp"
+#include "face_regions.hpp"
+#include "stmkb_cpu.hpp"
+#include <memory>
+#include <vector>
+
+// Denoiser backend running STKMBCpu, whole-frame or strip-parallel. With a
+// face cascade, FaceRegions picks the regions of STKMBCpu's region-of-interest
+// mode before every frame. With a tuning profile file, init() first applies
+// the profile closest to the first frame's size and noise level; the noise
+// level that picked it travels with the saved state, so a resumed run keeps
+// the profile.
+class CpuDenoiser : public Denoiser {
+public:
+    explicit CpuDenoiser(const DenoiserOptions& options);
+
+    void init(const cv::Mat& firstFrame) override;
+    void process(const cv::Mat& input, cv::Mat& output) override;
+    DenoiserCapabilities capabilities() const override;
+    void saveState(EngineState& state) const override;
+    void restoreState(const EngineState& state) override;
+
+    // Levels below the configured one trade the exact bilateral filter for
+    // FastBilateral, shorten the history and finally turn on the sparse path
+    int qualityLevels() const override {
+        return static_cast<int>(levels_.size());
+    }
+    void setQualityLevel(int level) override;
+
+private:
+    struct QualityLevel {
+        int bilateralLevels; // 0 = exact filter
+        int history;
+        bool sparse;
+
+        bool operator==(const QualityLevel& other) const {
+            return bilateralLevels == other.bilateralLevels &&
+                history == other.history && sparse == other.sparse;
+        }
+    };
+
+    // init() once the noise level picking the profile is known
+    void setup(const cv::Mat& firstFrame, float noise);
+
+    std::string stateLayout() const;
+
+    std::vector<QualityLevel> levels_;
+    int level_ = 0;
+
+    DenoiserOptions options_;
+    std::string profile_; // Tuning profile applied by init()
+    float profileNoise_ = 0.0f; // Noise level the profile was picked by
+    cv::Size frameSize_;  // Of the first frame, to set up again on restore
+    int frameType_ = 0;
+    std::unique_ptr<STKMBCpu> engine_;
+    std::unique_ptr<FaceRegions> faces_;
+};
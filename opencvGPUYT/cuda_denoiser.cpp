@@ -0,0 +1,116 @@
+#include "cuda_denoiser.hpp"
+#include "profiler.hpp"
+#include <iostream>
+#include <opencv2/core/cuda.hpp>
+#include <stdexcept>
+
+CudaDenoiser::CudaDenoiser(const DenoiserOptions& options)
+    : filter_(options.filter) {
+    const std::string option = unsupported(options);
+    if (!option.empty()) {
+        throw std::invalid_argument("The CUDA backend does not support " +
+            option);
+    }
+
+    std::cout << "Enabled CUDA devices: " << cv::cuda::getCudaEnabledDeviceCount()
+        << std::endl;
+
+    cv::cuda::setDevice(0);
+    std::cout << "Chosen device: --------------------> "
+        << cv::cuda::DeviceInfo(cv::cuda::getDevice()).name() << std::endl;
+}
+
+bool CudaDenoiser::available() {
+    return cv::cuda::getCudaEnabledDeviceCount() > 0;
+}
+
+std::string CudaDenoiser::unsupported(const DenoiserOptions& options) {
+    // STKMBGpu filters every pixel of the whole frame with the exact
+    // bilateral filter and keeps no frame history
+    const DenoiserOptions defaults;
+    if (options.threads != defaults.threads) {
+        return "CPU threads";
+    }
+    if (options.compactState) {
+        return "compact state";
+    }
+    if (options.bilateralLevels > 0) {
+        return "the fast bilateral filter";
+    }
+    if (options.sparse) {
+        return "sparse processing";
+    }
+    if (options.motion) {
+        return "motion compensation";
+    }
+    if (!options.faceCascade.empty()) {
+        return "face regions";
+    }
+    if (options.historySize != defaults.historySize ||
+        options.blockSize != defaults.blockSize) {
+        return "block matching settings";
+    }
+    if (!options.tuningProfiles.empty()) {
+        return "tuning profiles";
+    }
+    return {};
+}
+
+void CudaDenoiser::upload(const cv::Mat& input) {
+    STKMB_PROFILE(Stage::Upload);
+    if (input.channels() == 3) {
+        uploadGpu_.upload(input);
+        cv::cuda::cvtColor(uploadGpu_, frameGpu_, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        frameGpu_.upload(input);
+    }
+}
+
+void CudaDenoiser::init(const cv::Mat& firstFrame) {
+    upload(firstFrame);
+    engine_ = std::make_unique<STKMBGpu>(frameGpu_, filter_.processNoise,
+        5.0f, 5, filter_.bilateralDiameter, filter_.bilateralSigma);
+}
+
+void CudaDenoiser::process(const cv::Mat& input, cv::Mat& output) {
+    if (!engine_) {
+        throw std::logic_error("CudaDenoiser::process called before init");
+    }
+    upload(input);
+    engine_->process(frameGpu_, outputGpu_);
+    STKMB_PROFILE(Stage::Download);
+    if (input.channels() == 1) {
+        outputGpu_.download(output);
+        return;
+    }
+    outputGpu_.download(gray_);
+    cv::cvtColor(gray_, output, cv::COLOR_GRAY2BGR);
+}
+
+void CudaDenoiser::saveState(EngineState& state) const {
+    if (!engine_) {
+        throw std::logic_error("CudaDenoiser::saveState called before init");
+    }
+    StateWriter writer(state, engine_->stateLayout());
+    engine_->saveState(writer);
+}
+
+void CudaDenoiser::restoreState(const EngineState& state) {
+    if (!engine_) {
+        throw std::logic_error("CudaDenoiser::restoreState called before init");
+    }
+    StateReader reader(state, engine_->stateLayout());
+    engine_->restoreState(reader);
+    if (!reader.done()) {
+        throw std::invalid_argument("Engine state has extra planes");
+    }
+}
+
+DenoiserCapabilities CudaDenoiser::capabilities() const {
+    DenoiserCapabilities caps;
+    caps.name = "cuda";
+    caps.usesGpu = true;
+    caps.threads = 1;
+    return caps;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "denoiser.hpp"
+#include "stmkb_gpu.hpp"
+#include <memory>
+#include <string>
+
+// Denoiser backend running STKMBGpu on the current CUDA device. It honours
+// the filter constants and rejects every option of the CPU engine it has no
+// counterpart for.
+class CudaDenoiser : public Denoiser {
+public:
+    // Throws std::invalid_argument for options unsupported() names
+    explicit CudaDenoiser(const DenoiserOptions& options);
+
+    // True when OpenCV sees at least one CUDA device
+    static bool available();
+
+    // The first option set to something STKMBGpu cannot do, "" when none
+    static std::string unsupported(const DenoiserOptions& options);
+
+    void init(const cv::Mat& firstFrame) override;
+    void process(const cv::Mat& input, cv::Mat& output) override;
+    DenoiserCapabilities capabilities() const override;
+    void saveState(EngineState& state) const override;
+    void restoreState(const EngineState& state) override;
+
+private:
+    // Upload a BGR or luma frame into frameGpu_, converting BGR to gray
+    void upload(const cv::Mat& input);
+
+    FilterParameters filter_;
+    std::unique_ptr<STKMBGpu> engine_;
+    cv::cuda::GpuMat uploadGpu_; // Input frame on GPU
+    cv::cuda::GpuMat frameGpu_;  // Gray input on GPU
+    cv::cuda::GpuMat outputGpu_; // Output frame on GPU
+    cv::Mat gray_;               // Downloaded output
+};
@@ -0,0 +1,127 @@
+#include "deadline.hpp"
+#include "percentile.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+    // Weight of the newest frame in the smoothed latency
+    constexpr double kSmoothing = 0.25;
+
+    // Latency histogram layout: below 8 us one bucket per microsecond, then
+    // 8 buckets per octave, bucket 8 * (octave - 2) + sub holding
+    // [(8 + sub) << (octave - 3), (9 + sub) << (octave - 3)) us
+    constexpr int kSubBuckets = 8;
+
+    int latencyBucket(double latencyMs, int buckets) {
+        const uint64_t us = static_cast<uint64_t>(
+            std::max(0.0, latencyMs) * 1000.0);
+        if (us < kSubBuckets) {
+            return static_cast<int>(us);
+        }
+        int octave = 0;
+        while ((us >> (octave + 1)) != 0) {
+            ++octave;
+        }
+        const int sub = static_cast<int>((us >> (octave - 3)) & 7);
+        return std::min(kSubBuckets * (octave - 2) + sub, buckets - 1);
+    }
+
+    // Exclusive upper bound of a bucket, ms
+    double bucketUpperMs(int bucket) {
+        if (bucket < kSubBuckets) {
+            return (bucket + 1) / 1000.0;
+        }
+        const int octave = bucket / kSubBuckets + 2;
+        const int sub = bucket % kSubBuckets;
+        return std::ldexp(9.0 + sub, octave - 3) / 1000.0;
+    }
+
+} // namespace
+
+DeadlineController::DeadlineController(const DeadlineOptions& options,
+    int levels)
+    : options_(options), levels_(levels), framesPerLevel_(levels, 0) {
+    if (options.budgetMs <= 0.0 || levels < 1 || options.upAt <= 0.0 ||
+        options.upAt >= options.downAt || options.upAfter < 1 ||
+        options.settleFrames < 0) {
+        throw std::invalid_argument("Invalid real-time controller settings");
+    }
+}
+
+bool DeadlineController::dropNext() const {
+    return level_ == levels_ - 1 && lateness_ >= options_.budgetMs;
+}
+
+void DeadlineController::dropped() {
+    ++dropped_;
+    // The source moved on by a frame that took no time here
+    lateness_ = std::max(0.0, lateness_ - options_.budgetMs);
+}
+
+int DeadlineController::update(double latencyMs) {
+    const double budget = options_.budgetMs;
+    ++processed_;
+    maxMs_ = std::max(maxMs_, latencyMs);
+    ++latencyBuckets_[latencyBucket(latencyMs, kLatencyBuckets)];
+    ++framesPerLevel_[level_];
+    hits_ += latencyMs <= budget;
+    lateness_ = std::max(0.0, lateness_ + latencyMs - budget);
+    average_ = processed_ == 1 ? latencyMs
+        : average_ + kSmoothing * (latencyMs - average_);
+
+    calm_ = average_ < options_.upAt * budget ? calm_ + 1 : 0;
+    if (settle_ > 0) {
+        --settle_;
+        return level_;
+    }
+
+    int next = level_;
+    if (average_ > options_.downAt * budget && level_ + 1 < levels_) {
+        next = level_ + 1;
+    }
+    else if (calm_ >= options_.upAfter && level_ > 0) {
+        next = level_ - 1;
+    }
+    if (next != level_) {
+        level_ = next;
+        ++switches_;
+        calm_ = 0;
+        settle_ = options_.settleFrames;
+        // Lateness built up at a dearer level is not a reason to drop
+        // frames at this one
+        lateness_ = 0.0;
+    }
+    return level_;
+}
+
+DeadlineReport DeadlineController::report() const {
+    DeadlineReport report;
+    report.frames = processed_ + dropped_;
+    report.dropped = dropped_;
+    report.hits = hits_;
+    report.switches = switches_;
+    report.framesPerLevel = framesPerLevel_;
+
+    // Upper bound of the bucket holding the nearest-rank percentile, never
+    // past the slowest frame
+    auto percentileMs = [&](double p) {
+        const size_t target = nearestRank(p, processed_);
+        size_t seen = 0;
+        for (int b = 0; b < kLatencyBuckets; ++b) {
+            seen += latencyBuckets_[b];
+            if (target > 0 && seen >= target) {
+                // The last bucket is open-ended
+                return b + 1 < kLatencyBuckets
+                    ? std::min(bucketUpperMs(b), maxMs_) : maxMs_;
+            }
+        }
+        return maxMs_;
+    };
+    report.p50 = percentileMs(0.50);
+    report.p95 = percentileMs(0.95);
+    report.p99 = percentileMs(0.99);
+    report.max = maxMs_;
+    return report;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+
+struct DeadlineOptions {
+    double budgetMs = 0.0; // Per-frame budget, 0 = real-time mode off
+    double downAt = 0.9;   // Step down once the smoothed latency passes this
+                           // share of the budget
+    double upAt = 0.6;     // Step up after upAfter frames below this share
+    int upAfter = 30;
+    int settleFrames = 5;  // Frames without a decision after a switch
+};
+
+// Summary of a real-time run
+struct DeadlineReport {
+    int frames = 0;   // Input frames, dropped ones included
+    int dropped = 0;
+    int hits = 0;     // Processed within the budget
+    int switches = 0; // Quality level changes
+    // Latency, ms. Percentiles are upper bounds of histogram buckets an
+    // eighth of an octave wide, so at most 12.5% above the exact value.
+    double p50 = 0.0, p95 = 0.0, p99 = 0.0, max = 0.0;
+    std::vector<int> framesPerLevel;
+
+    double hitRate() const { return frames > 0 ? double(hits) / frames : 0.0; }
+};
+
+// Feedback controller of the real-time mode. It smooths the per-frame
+// latency with an exponential average and moves one quality level down
+// (cheaper) as soon as the average nears the budget, and one level up only
+// after a long stretch well under it, so the level does not oscillate.
+// A few frames after every switch are ignored while the new level warms up.
+//
+// Time over the budget accumulates as lateness, and time under it pays the
+// lateness back. At the cheapest level, a lateness of a whole budget drops
+// the next frame, which is what a live source does to a consumer that
+// cannot keep up.
+//
+// Latencies go into a fixed log-bucket histogram rather than a per-frame
+// list, so a live run of any length holds constant memory.
+class DeadlineController {
+public:
+    // levels is the number of quality levels, level 0 the best
+    DeadlineController(const DeadlineOptions& options, int levels);
+
+    // True when the next frame must be dropped to catch up
+    bool dropNext() const;
+
+    // Record a dropped frame
+    void dropped();
+
+    // Record the latency of a processed frame; returns the level for the
+    // next one
+    int update(double latencyMs);
+
+    int level() const { return level_; }
+
+    DeadlineReport report() const;
+
+private:
+    // 8 sub-buckets per octave of microseconds, up to about 2^33 us
+    static constexpr int kLatencyBuckets = 256;
+
+    DeadlineOptions options_;
+    int levels_;
+    int level_ = 0;
+    double average_ = 0.0;  // Smoothed latency, ms
+    double lateness_ = 0.0; // Accumulated time over the budget, ms
+    int calm_ = 0;          // Consecutive frames under upAt
+    int settle_ = 0;        // Frames left before the next decision
+    int dropped_ = 0;
+    int hits_ = 0;
+    int switches_ = 0;
+    int processed_ = 0;
+    double maxMs_ = 0.0;
+    std::array<uint32_t, kLatencyBuckets> latencyBuckets_{};
+    std::vector<int> framesPerLevel_;
+};
@@ -0,0 +1,65 @@
+#pragma once
+#include "engine_state.hpp"
+#include "filter_parameters.hpp"
+#include <opencv2/opencv.hpp>
+#include <string>
+
+// What a backend can do, for selection and reporting
+struct DenoiserCapabilities {
+    std::string name;
+    bool usesGpu = false;
+    int threads = 1; // Worker threads used per frame
+    std::string profile; // Tuning profile applied by init(), if any
+};
+
+// Tunables shared by all backends. The CPU backend honours all of them; the
+// others reject what they cannot do (see DenoiserBackend::unsupported).
+struct DenoiserOptions {
+    int threads = 0; // CPU worker threads, 0 = whole-frame single-threaded path
+    bool compactState = false; // CPU: 16-bit state and history planes
+    int bilateralLevels = 0;   // CPU: > 0 selects FastBilateral with N levels
+    bool sparse = false;       // CPU: motion-adaptive sparse processing
+    bool motion = false;       // CPU: motion-compensated state and history
+    std::string faceCascade;   // CPU: filter around the faces it finds
+    int faceInterval = 15;     // CPU: frames between face detections
+    bool faceBackground = false; // CPU: detect faces on a worker thread
+    int historySize = 5;       // CPU: frames block matching compares against
+    int blockSize = 8;         // CPU: block matching block size
+    FilterParameters filter;   // Kalman and bilateral constants
+    std::string tuningProfiles; // CPU: profile file (tuning_profile.hpp);
+                                // init() applies the one for the first frame
+    float noiseLevel = 0.0f;   // CPU: noise std picking the profile,
+                               // 0 = estimated from the first frame
+};
+
+// Common interface of the STKMB denoiser engines
+class Denoiser {
+public:
+    virtual ~Denoiser() = default;
+
+    // Set up the filter state from the first frame of the stream, BGR
+    // (CV_8UC3) or luma (CV_8UC1)
+    virtual void init(const cv::Mat& firstFrame) = 0;
+
+    // Denoise a frame into output, owned by the caller and reused across
+    // calls. Luma input gives luma output and BGR input a gray BGR frame.
+    virtual void process(const cv::Mat& input, cv::Mat& output) = 0;
+
+    virtual DenoiserCapabilities capabilities() const = 0;
+
+    // Quality ladder for real-time operation. Level 0 is the configured
+    // quality and every further level is cheaper. Switching takes effect
+    // with the next frame and never rebuilds the engine. Backends without a
+    // ladder have the single level 0.
+    virtual int qualityLevels() const { return 1; }
+    virtual void setQualityLevel(int /*level*/) {}
+
+    // Checkpoint support. saveState() copies everything carried between
+    // frames into state, reusing its buffers. restoreState() needs an engine
+    // initialised from a frame of the same size with the same options, and
+    // makes it continue exactly where the saved one stopped. Both throw
+    // std::logic_error before init; restoreState() throws
+    // std::invalid_argument for a state saved under other options.
+    virtual void saveState(EngineState& state) const = 0;
+    virtual void restoreState(const EngineState& state) = 0;
+};
@@ -0,0 +1,75 @@
+#include "denoiser_registry.hpp"
+#include "cpu_denoiser.hpp"
+#include <stdexcept>
+#ifndef STKMB_NO_CUDA
+#include "cuda_denoiser.hpp"
+#endif
+
+DenoiserRegistry::DenoiserRegistry() {
+#ifndef STKMB_NO_CUDA
+    add({ "cuda", "STKMB on the first CUDA device (OpenCV CUDA modules)",
+        [] { return CudaDenoiser::available(); },
+        [](const DenoiserOptions& options) -> std::unique_ptr<Denoiser> {
+            return std::make_unique<CudaDenoiser>(options);
+        },
+        &CudaDenoiser::unsupported });
+#endif
+    add({ "cpu", "STKMB on the CPU, strip-parallel with --threads",
+        [] { return true; },
+        [](const DenoiserOptions& options) -> std::unique_ptr<Denoiser> {
+            return std::make_unique<CpuDenoiser>(options);
+        },
+        nullptr });
+}
+
+DenoiserRegistry& DenoiserRegistry::instance() {
+    static DenoiserRegistry registry;
+    return registry;
+}
+
+void DenoiserRegistry::add(DenoiserBackend backend) {
+    if (find(backend.name)) {
+        throw std::invalid_argument("Duplicate denoiser backend '" +
+            backend.name + "'");
+    }
+    backends_.push_back(std::move(backend));
+}
+
+const DenoiserBackend* DenoiserRegistry::find(const std::string& name) const {
+    for (const auto& backend : backends_) {
+        if (backend.name == name) {
+            return &backend;
+        }
+    }
+    return nullptr;
+}
+
+const DenoiserBackend& DenoiserRegistry::automatic(
+    const DenoiserOptions& options) const {
+    for (const auto& backend : backends_) {
+        if (backend.available() && (!backend.unsupported ||
+            backend.unsupported(options).empty())) {
+            return backend;
+        }
+    }
+    throw std::runtime_error("No denoiser backend can run on this machine");
+}
+
+std::unique_ptr<Denoiser> DenoiserRegistry::create(const std::string& name,
+    const DenoiserOptions& options) const {
+    const DenoiserBackend* backend = nullptr;
+    if (name == "auto") {
+        backend = &automatic(options);
+    }
+    else {
+        backend = find(name);
+        if (!backend) {
+            throw std::invalid_argument("Unknown denoiser backend '" + name + "'");
+        }
+        if (!backend->available()) {
+            throw std::runtime_error("Denoiser backend '" + name +
+                "' is not available on this machine");
+        }
+    }
+    return backend->create(options);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "denoiser.hpp"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A denoiser engine that can be picked by name
+struct DenoiserBackend {
+    std::string name;
+    std::string description;
+    std::function<bool()> available;
+    std::function<std::unique_ptr<Denoiser>(const DenoiserOptions&)> create;
+    // First option the backend cannot honour, "" when it takes them all;
+    // unset for backends that take every option
+    std::function<std::string(const DenoiserOptions&)> unsupported;
+};
+
+// Backends compiled into this build, in order of preference. The CUDA
+// backend is left out of builds defining STKMB_NO_CUDA.
+class DenoiserRegistry {
+public:
+    static DenoiserRegistry& instance();
+
+    void add(DenoiserBackend backend);
+
+    const std::vector<DenoiserBackend>& backends() const { return backends_; }
+    const DenoiserBackend* find(const std::string& name) const;
+
+    // Most preferred backend usable on this machine with these options
+    const DenoiserBackend& automatic(const DenoiserOptions& options = {}) const;
+
+    // Create a backend by name, or automatic() for "auto". Throws
+    // std::invalid_argument for unknown names and options the backend does
+    // not support, and std::runtime_error when the backend cannot run here.
+    std::unique_ptr<Denoiser> create(const std::string& name,
+        const DenoiserOptions& options = {}) const;
+
+private:
+    DenoiserRegistry();
+
+    std::vector<DenoiserBackend> backends_;
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Snapshot of everything a denoiser carries from one frame to the next, for
+// checkpoints. Planes are deep copies in an order fixed by the engine; the
+// layout tag names the engine and every option that changes its output, so
+// a state is only restored into an engine that continues it bit-exactly.
+struct EngineState {
+    std::string layout;
+    std::vector<cv::Mat> planes;
+};
+
+// Fills an EngineState plane by plane, reusing the buffers of the previous
+// snapshot so periodic checkpoints do not allocate
+class StateWriter {
+public:
+    StateWriter(EngineState& state, std::string layout) : state_(state) {
+        state_.layout = std::move(layout);
+    }
+    ~StateWriter() { state_.planes.resize(count_); }
+
+    StateWriter(const StateWriter&) = delete;
+    StateWriter& operator=(const StateWriter&) = delete;
+
+    void plane(const cv::Mat& plane) { plane.copyTo(slot()); }
+
+    // Buffer of the next plane, for planes filled by the caller (e.g.
+    // downloaded from the GPU)
+    cv::Mat& slot() {
+        if (count_ == state_.planes.size()) {
+            state_.planes.emplace_back();
+        }
+        return state_.planes[count_++];
+    }
+
+    // Counters and flags travel as 1x1 CV_32S planes
+    void value(int value) {
+        plane(cv::Mat(1, 1, CV_32S, &value));
+    }
+
+private:
+    EngineState& state_;
+    size_t count_ = 0;
+};
+
+// Reads planes back in the order they were written. Throws
+// std::invalid_argument when the layout or any plane does not match.
+class StateReader {
+public:
+    StateReader(const EngineState& state, const std::string& layout)
+        : state_(state) {
+        if (state.layout != layout) {
+            throw std::invalid_argument("Engine state of '" + state.layout +
+                "' cannot be restored into '" + layout + "'");
+        }
+    }
+
+    // Copy the next plane into target, which keeps its buffer and must
+    // already have the plane's size and type
+    void plane(cv::Mat& target) {
+        const cv::Mat& source = next();
+        if (source.size() != target.size() || source.type() != target.type()) {
+            throw std::invalid_argument("Engine state plane does not match");
+        }
+        source.copyTo(target);
+    }
+
+    // The next plane as stored, for planes without a preallocated target
+    const cv::Mat& plane() { return next(); }
+
+    int value() {
+        const cv::Mat& source = next();
+        if (source.total() != 1 || source.type() != CV_32S) {
+            throw std::invalid_argument("Engine state value does not match");
+        }
+        return source.at<int>(0);
+    }
+
+    // True once every plane has been read
+    bool done() const { return index_ == state_.planes.size(); }
+
+private:
+    const cv::Mat& next() {
+        if (index_ == state_.planes.size()) {
+            throw std::invalid_argument("Engine state is truncated");
+        }
+        return state_.planes[index_++];
+    }
+
+    const EngineState& state_;
+    size_t index_ = 0;
+};
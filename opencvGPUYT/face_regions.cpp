@@ -0,0 +1,253 @@
+#include "face_regions.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+    // Intersection over union of two rectangles
+    double overlap(const cv::Rect& a, const cv::Rect& b) {
+        const double common = (a & b).area();
+        return common > 0.0 ? common / (a.area() + b.area() - common) : 0.0;
+    }
+
+} // namespace
+
+FaceRegions::FaceRegions(const FaceRegionOptions& options)
+    : options_(options) {
+    CV_Assert(options_.interval > 0 && options_.detectWidth > 0 &&
+        options_.margin >= 0.0f && options_.keepMissed >= 0);
+    if (!cascade_.load(options_.cascadePath)) {
+        throw std::runtime_error("Cannot load face cascade '" +
+            options_.cascadePath + "'");
+    }
+    if (options_.background) {
+        thread_ = std::thread(&FaceRegions::run, this);
+    }
+}
+
+FaceRegions::~FaceRegions() {
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        changed_.notify_all();
+        thread_.join();
+    }
+}
+
+const std::vector<cv::Rect>& FaceRegions::update(const cv::Mat& frame,
+    const cv::Mat* vectors, int blockSize) {
+    CV_Assert(frame.type() == CV_8UC3 || frame.type() == CV_8UC1);
+    frameSize_ = frame.size();
+    if (vectors && !vectors->empty()) {
+        follow(*vectors, blockSize);
+    }
+
+    if (options_.background) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error_) {
+            std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+        if (hasResult_) {
+            merge(result_, resultScale_);
+            hasResult_ = false;
+        }
+    }
+
+    if (frameIndex_++ % options_.interval == 0) {
+        const cv::Mat* gray = &frame;
+        if (frame.channels() == 3) {
+            cv::cvtColor(frame, gray_, cv::COLOR_BGR2GRAY);
+            gray = &gray_;
+        }
+        const int width = std::min(options_.detectWidth, frame.cols);
+        const double scale = static_cast<double>(frame.cols) / width;
+        const cv::Size size(width, std::max(1,
+            static_cast<int>(std::lround(frame.rows / scale))));
+
+        if (!options_.background) {
+            cv::resize(*gray, small_, size, 0.0, 0.0, cv::INTER_AREA);
+            detect(small_, found_);
+            merge(found_, scale);
+        }
+        else {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!hasJob_ && !busy_) {
+                lock.unlock();
+                // The worker only reads job_ once hasJob_ is set
+                cv::resize(*gray, job_, size, 0.0, 0.0, cv::INTER_AREA);
+                lock.lock();
+                jobScale_ = scale;
+                hasJob_ = true;
+                changed_.notify_all();
+            }
+        }
+    }
+
+    // Regions with the margin, clipped to the frame
+    const cv::Rect bounds(cv::Point(0, 0), frameSize_);
+    regions_.clear();
+    for (const Face& face : faces_) {
+        const int dx = static_cast<int>(face.rect.width * options_.margin);
+        const int dy = static_cast<int>(face.rect.height * options_.margin);
+        const cv::Rect region = cv::Rect(face.rect.x - dx, face.rect.y - dy,
+            face.rect.width + 2 * dx, face.rect.height + 2 * dy) & bounds;
+        if (!region.empty()) {
+            regions_.push_back(region);
+        }
+    }
+    return regions_;
+}
+
+int FaceRegions::detections() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return detections_;
+}
+
+double FaceRegions::detectorSeconds() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return detectorSeconds_;
+}
+
+void FaceRegions::detect(const cv::Mat& small, std::vector<cv::Rect>& faces) {
+    STKMB_PROFILE(Stage::FaceDetection);
+    const auto begin = std::chrono::steady_clock::now();
+    cv::Mat equalized;
+    cv::equalizeHist(small, equalized);
+    cascade_.detectMultiScale(equalized, faces, 1.1, 3, 0, cv::Size(24, 24));
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - begin).count();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++detections_;
+    detectorSeconds_ += seconds;
+}
+
+void FaceRegions::merge(const std::vector<cv::Rect>& found, double scale) {
+    for (Face& face : faces_) {
+        ++face.missed;
+    }
+    for (const cv::Rect& small : found) {
+        const cv::Rect rect(static_cast<int>(std::lround(small.x * scale)),
+            static_cast<int>(std::lround(small.y * scale)),
+            static_cast<int>(std::lround(small.width * scale)),
+            static_cast<int>(std::lround(small.height * scale)));
+
+        // The best overlapping face takes the new position, otherwise the
+        // detection starts a new face
+        Face* match = nullptr;
+        double best = 0.3;
+        for (Face& face : faces_) {
+            const double o = overlap(face.rect, rect);
+            if (face.missed > 0 && o > best) {
+                best = o;
+                match = &face;
+            }
+        }
+        if (match) {
+            match->rect = rect;
+            match->missed = 0;
+        }
+        else {
+            faces_.push_back({ rect, 0 });
+        }
+    }
+    faces_.erase(std::remove_if(faces_.begin(), faces_.end(),
+        [this](const Face& face) {
+            return face.missed > options_.keepMissed;
+        }), faces_.end());
+}
+
+void FaceRegions::follow(const cv::Mat& vectors, int blockSize) {
+    CV_Assert(vectors.type() == CV_32SC2 && blockSize > 0);
+    // A block's vector points from the new frame back into the previous
+    // one, so the content under it moved by minus the vector
+    for (Face& face : faces_) {
+        const int x0 = std::max(0, face.rect.x / blockSize);
+        const int y0 = std::max(0, face.rect.y / blockSize);
+        const int x1 = std::min(vectors.cols, face.rect.br().x / blockSize);
+        const int y1 = std::min(vectors.rows, face.rect.br().y / blockSize);
+        cv::Point sum(0, 0);
+        int count = 0;
+        for (int by = y0; by < y1; ++by) {
+            const cv::Point* row = vectors.ptr<cv::Point>(by);
+            for (int bx = x0; bx < x1; ++bx) {
+                sum += row[bx];
+                ++count;
+            }
+        }
+        if (count > 0) {
+            face.rect.x -= static_cast<int>(std::lround(
+                static_cast<double>(sum.x) / count));
+            face.rect.y -= static_cast<int>(std::lround(
+                static_cast<double>(sum.y) / count));
+        }
+    }
+}
+
+void FaceRegions::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        changed_.wait(lock, [this] { return hasJob_ || stop_; });
+        if (stop_) {
+            return;
+        }
+        hasJob_ = false;
+        busy_ = true;
+        const double scale = jobScale_;
+
+        lock.unlock();
+        std::exception_ptr error;
+        try {
+            detect(job_, found_);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        busy_ = false;
+        if (error) {
+            error_ = error;
+        }
+        else {
+            std::swap(result_, found_);
+            resultScale_ = scale;
+            hasResult_ = true;
+        }
+    }
+}
+
+void FaceRegions::saveState(StateWriter& state) const {
+    state.value(frameIndex_);
+    cv::Mat faces(static_cast<int>(faces_.size()), 5, CV_32S);
+    for (int i = 0; i < faces.rows; ++i) {
+        const Face& face = faces_[i];
+        int* row = faces.ptr<int>(i);
+        row[0] = face.rect.x;
+        row[1] = face.rect.y;
+        row[2] = face.rect.width;
+        row[3] = face.rect.height;
+        row[4] = face.missed;
+    }
+    state.plane(faces);
+}
+
+void FaceRegions::restoreState(StateReader& state) {
+    frameIndex_ = state.value();
+    const cv::Mat& faces = state.plane();
+    if (!faces.empty() && (faces.type() != CV_32S || faces.cols != 5)) {
+        throw std::invalid_argument("Engine state plane does not match");
+    }
+    faces_.clear();
+    for (int i = 0; i < faces.rows; ++i) {
+        const int* row = faces.ptr<int>(i);
+        faces_.push_back({ cv::Rect(row[0], row[1], row[2], row[3]),
+            row[4] });
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "engine_state.hpp"
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <opencv2/objdetect.hpp>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FaceRegionOptions {
+    std::string cascadePath = "haarcascade_frontalface_default.xml";
+    int interval = 15;       // Frames between two detections
+    int detectWidth = 480;   // The cascade runs on the frame scaled to this
+    float margin = 0.25f;    // Growth of a face on every side, in face sizes
+    int keepMissed = 2;      // Detections a face survives without being found
+    bool background = false; // Detect on a worker thread
+};
+
+// Face rectangles for the region-of-interest mode of STKMBCpu.
+//
+// The Haar cascade runs on a downscaled gray copy of every interval-th
+// frame. In between, the faces found last are kept and, when motion
+// vectors are given, moved along with the blocks under them. A face the
+// detector misses survives keepMissed detections before it is dropped, so
+// a turned head does not lose its filter at once. In background mode the
+// detection runs on a worker thread while frames keep flowing; its result
+// is merged by the first update() after it finishes, and a detection is
+// skipped while the previous one is still running.
+class FaceRegions {
+public:
+    // Throws std::runtime_error when the cascade cannot be loaded
+    explicit FaceRegions(const FaceRegionOptions& options);
+    ~FaceRegions();
+
+    FaceRegions(const FaceRegions&) = delete;
+    FaceRegions& operator=(const FaceRegions&) = delete;
+
+    // Regions of frame (BGR or gray, full resolution), grown by the margin
+    // and clipped to the frame. vectors are the block vectors of the
+    // previous frame (MotionSearch layout), or nullptr. Rethrows the error
+    // of a failed background detection.
+    const std::vector<cv::Rect>& update(const cv::Mat& frame,
+        const cv::Mat* vectors = nullptr, int blockSize = 8);
+
+    const std::vector<cv::Rect>& regions() const { return regions_; }
+
+    // Detector runs so far and their total time, on whichever thread
+    int detections() const;
+    double detectorSeconds() const;
+
+    // Checkpoint support: the frame counter and the tracked faces. A
+    // pending background detection is not part of it, and where results
+    // land depends on timing, so a resumed background run is not exact.
+    void saveState(StateWriter& state) const;
+    void restoreState(StateReader& state);
+
+private:
+    struct Face {
+        cv::Rect rect; // Full-resolution pixels, without the margin
+        int missed = 0;
+    };
+
+    // Faces of a downscaled gray frame, in its coordinates
+    void detect(const cv::Mat& small, std::vector<cv::Rect>& faces);
+    void merge(const std::vector<cv::Rect>& faces, double scale);
+    void follow(const cv::Mat& vectors, int blockSize);
+    void run();
+
+    FaceRegionOptions options_;
+    cv::CascadeClassifier cascade_;
+    cv::Size frameSize_;
+    int frameIndex_ = 0;
+    std::vector<Face> faces_;
+    std::vector<cv::Rect> regions_;
+    cv::Mat gray_, small_;
+    std::vector<cv::Rect> found_;
+
+    // Statistics and the background worker, under mutex_
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    int detections_ = 0;
+    double detectorSeconds_ = 0.0;
+    cv::Mat job_;                  // Downscaled frame waiting for the worker
+    double jobScale_ = 1.0;
+    std::vector<cv::Rect> result_; // Worker output, in job coordinates
+    double resultScale_ = 1.0;
+    bool hasJob_ = false;
+    bool busy_ = false;
+    bool hasResult_ = false;
+    bool stop_ = false;
+    std::exception_ptr error_;
+    std::thread thread_;
+};
@@ -0,0 +1,149 @@
+#include "fast_bilateral.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Range weights below this are too close to the rounding error of the
+    // running sums to divide by
+    constexpr double kMinWeight = 1e-10;
+} // namespace
+
+FastBilateral::FastBilateral(int d, float sigmaColor, float sigmaSpace,
+    int levels)
+    : radius_(d / 2), levels_(levels) {
+    CV_Assert(d > 0 && sigmaColor > 0.0f && sigmaSpace > 0.0f);
+    CV_Assert(levels >= 2 && levels <= 256);
+
+    // Per-axis variance of the circular Gaussian window of cv::bilateralFilter
+    const double spaceCoeff = -0.5 / (sigmaSpace * sigmaSpace);
+    double weightSum = 0.0, varianceSum = 0.0;
+    for (int dy = -radius_; dy <= radius_; ++dy) {
+        for (int dx = -radius_; dx <= radius_; ++dx) {
+            const double r2 = static_cast<double>(dy * dy + dx * dx);
+            if (r2 > radius_ * radius_) {
+                continue;
+            }
+            const double w = std::exp(r2 * spaceCoeff);
+            weightSum += w;
+            varianceSum += w * dx * dx;
+        }
+    }
+    // A box of width n has variance (n^2 - 1) / 12; take the nearest odd
+    // width that stays inside the window
+    const double width = std::sqrt(12.0 * varianceSum / weightSum + 1.0);
+    boxSize_ = std::clamp(2 * static_cast<int>(std::lround((width - 1.0) / 2.0)) + 1,
+        1, 2 * radius_ + 1);
+
+    spacing_ = 255.0f / (levels_ - 1);
+    const double colorCoeff = -0.5 / (sigmaColor * sigmaColor);
+    rangeWeights_.resize(static_cast<size_t>(levels_) * 256);
+    interpolation_.resize(static_cast<size_t>(levels_) * 256);
+    for (int k = 0; k < levels_; ++k) {
+        const double level = k * spacing_;
+        for (int v = 0; v < 256; ++v) {
+            const double diff = v - level;
+            rangeWeights_[k * 256 + v] =
+                static_cast<float>(std::exp(diff * diff * colorCoeff));
+            interpolation_[k * 256 + v] = static_cast<float>(
+                std::max(0.0, 1.0 - std::abs(diff) / spacing_));
+        }
+    }
+}
+
+void FastBilateral::apply(const cv::Mat& padded, cv::Mat& dst,
+    Buffers& buffers) const {
+    CV_Assert(padded.type() == CV_8U);
+    const int rows = padded.rows - 2 * radius_;
+    const int cols = padded.cols - 2 * radius_;
+    CV_Assert(rows > 0 && cols > 0);
+    dst.create(rows, cols, CV_32F);
+    dst.setTo(0.0f);
+    if (buffers.horizontal.rows < padded.rows ||
+        buffers.horizontal.cols < cols) {
+        buffers.horizontal.create(std::max(buffers.horizontal.rows, padded.rows),
+            std::max(buffers.horizontal.cols, cols), CV_32FC2);
+    }
+    cv::Mat horizontal =
+        buffers.horizontal(cv::Rect(0, 0, cols, padded.rows));
+
+    // Levels whose tent misses every intensity present contribute nothing
+    double minValue = 0.0, maxValue = 0.0;
+    cv::minMaxLoc(padded, &minValue, &maxValue);
+    const int firstLevel = std::max(0,
+        static_cast<int>(std::floor(minValue / spacing_)));
+    const int lastLevel = std::min(levels_ - 1,
+        static_cast<int>(std::ceil(maxValue / spacing_)));
+
+    // The box never leaves the padding for the pixels that are kept. Running
+    // sums are kept in double: far from its level a window's weights can be
+    // many orders of magnitude below what the sum held a few steps earlier.
+    const int half = boxSize_ / 2;
+    const int offset = radius_ - half;
+
+    for (int k = firstLevel; k <= lastLevel; ++k) {
+        const float* range = &rangeWeights_[k * 256];
+        const float* tent = &interpolation_[k * 256];
+
+        // Row sums of (w * v, w) over the box width for every kept column
+        for (int y = 0; y < padded.rows; ++y) {
+            const uchar* in = padded.ptr<uchar>(y) + offset;
+            float* out = horizontal.ptr<float>(y);
+            double sum = 0.0, weight = 0.0;
+            for (int i = 0; i < boxSize_; ++i) {
+                const double w = range[in[i]];
+                sum += w * in[i];
+                weight += w;
+            }
+            out[0] = static_cast<float>(sum);
+            out[1] = static_cast<float>(weight);
+            for (int x = 1; x < cols; ++x) {
+                const uchar entering = in[x + boxSize_ - 1];
+                const uchar leaving = in[x - 1];
+                sum += static_cast<double>(range[entering]) * entering -
+                    static_cast<double>(range[leaving]) * leaving;
+                weight += static_cast<double>(range[entering]) - range[leaving];
+                out[2 * x] = static_cast<float>(sum);
+                out[2 * x + 1] = static_cast<float>(weight);
+            }
+        }
+
+        // Running column sums down the kept rows
+        buffers.columnSums.assign(2 * static_cast<size_t>(cols), 0.0);
+        double* sums = buffers.columnSums.data();
+        for (int y = offset; y < offset + boxSize_ - 1; ++y) {
+            const float* row = horizontal.ptr<float>(y);
+            for (int x = 0; x < 2 * cols; ++x) {
+                sums[x] += row[x];
+            }
+        }
+        for (int y = 0; y < rows; ++y) {
+            const float* entering =
+                horizontal.ptr<float>(y + offset + boxSize_ - 1);
+            for (int x = 0; x < 2 * cols; ++x) {
+                sums[x] += entering[x];
+            }
+
+            const uchar* center = padded.ptr<uchar>(y + radius_) + radius_;
+            float* out = dst.ptr<float>(y);
+            for (int x = 0; x < cols; ++x) {
+                const float t = tent[center[x]];
+                if (t <= 0.0f) {
+                    continue;
+                }
+                // The pixel's own weight is a lower bound of the window's.
+                // When it underflows, or the running sum has cancelled
+                // below it, the pixel stands in for the level's average.
+                const double own = range[center[x]];
+                const double weight = sums[2 * x + 1];
+                const double value = own > kMinWeight && weight > 0.5 * own
+                    ? sums[2 * x] / weight : center[x];
+                out[x] += static_cast<float>(t * value);
+            }
+
+            const float* leaving = horizontal.ptr<float>(y + offset);
+            for (int x = 0; x < 2 * cols; ++x) {
+                sums[x] -= leaving[x];
+            }
+        }
+    }
+}
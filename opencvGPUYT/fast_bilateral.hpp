@@ -0,0 +1,52 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Selects the bilateral filter STKMBCpu uses for the correction term
+enum class BilateralMode {
+    Exact, // cv::bilateralFilter, or BilateralLut on the strip path (default)
+    Fast   // FastBilateral, constant cost in the diameter
+};
+
+// Constant-time approximation of the bilateral filter after Yang, Tan and
+// Ahuja, "Real-time O(1) bilateral filtering" (CVPR 2009). The range axis is
+// sampled at `levels` evenly spaced intensities. For each level the image is
+// weighted by the range kernel around that level and box-filtered together
+// with its weights, and every pixel interpolates linearly between the two
+// levels around its own intensity. Range weights come from per-level tables
+// and the box sums are running sums, so the cost is O(levels) per pixel
+// whatever the diameter; more levels trade speed for accuracy. Where the
+// levels are many sigmaColor apart the weights around a pixel can vanish,
+// and the pixel keeps its own value there. Nothing is allocated once the
+// buffers have their size.
+//
+// The box width matches the per-axis variance of the circular Gaussian
+// window cv::bilateralFilter would use for the same d and sigmaSpace.
+// Same padded-input contract as BilateralLut: the input carries radius()
+// pixels of border on every side and dst gets the unpadded size, CV_32F.
+class FastBilateral {
+public:
+    // Per-caller buffers, reused across calls. They only grow, so calls on
+    // inputs of varying size (e.g. edge blocks) stop allocating once the
+    // largest has been seen.
+    struct Buffers {
+        cv::Mat horizontal;             // Row box sums of (w * v, w), CV_32FC2
+        std::vector<double> columnSums; // Running vertical sums, 2 per column
+    };
+
+    FastBilateral(int d, float sigmaColor, float sigmaSpace, int levels = 8);
+
+    void apply(const cv::Mat& padded, cv::Mat& dst, Buffers& buffers) const;
+
+    int radius() const { return radius_; }
+    int levels() const { return levels_; }
+    int boxSize() const { return boxSize_; }
+
+private:
+    int radius_;
+    int levels_;
+    int boxSize_;
+    float spacing_;                        // Intensity step between levels
+    std::vector<float> rangeWeights_;      // levels x 256, range kernel
+    std::vector<float> interpolation_;     // levels x 256, tent weights
+};
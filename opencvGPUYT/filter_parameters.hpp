@@ -0,0 +1,9 @@
+#pragma once
+
+// Constants of the STKMB filter; the defaults are the values it was tuned
+// with
+struct FilterParameters {
+    float processNoise = 0.1f;    // Kalman process noise q
+    int bilateralDiameter = 5;
+    float bilateralSigma = 25.0f; // Range and space sigma of the bilateral
+};
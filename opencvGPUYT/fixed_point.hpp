@@ -0,0 +1,17 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+
+// Pixel-valued planes ([0, 255] state, blur and history frames) of the
+// compact state mode are stored as unsigned Q8.8 fixed point in CV_16U:
+// value * 256, rounded. That keeps 1/256 of a grey level, and sums of a few
+// such values stay exact in float.
+constexpr float kFixedPointScale = 256.0f;
+constexpr float kFixedPointUnit = 1.0f / kFixedPointScale;
+
+inline ushort toFixedPoint(float value) {
+    return cv::saturate_cast<ushort>(value * kFixedPointScale);
+}
+
+inline float fromFixedPoint(ushort value) {
+    return value * kFixedPointUnit;
+}
@@ -0,0 +1,460 @@
+#include "frame_graph.hpp"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+namespace {
+
+    // Planes of a node, reads first
+    std::vector<int> touched(const std::vector<int>& reads,
+        const std::vector<int>& writes) {
+        std::vector<int> planes(reads);
+        planes.insert(planes.end(), writes.begin(), writes.end());
+        return planes;
+    }
+
+} // namespace
+
+FrameGraph::Plane FrameGraph::external(const std::string& name,
+    cv::Size size, int type) {
+    return addPlane(name, Kind::External, size, type, nullptr);
+}
+
+FrameGraph::Plane FrameGraph::bound(const std::string& name,
+    cv::Mat& storage) {
+    CV_Assert(!storage.empty());
+    return addPlane(name, Kind::Bound, storage.size(), storage.type(),
+        &storage);
+}
+
+FrameGraph::Plane FrameGraph::scratch(const std::string& name,
+    cv::Size size, int type) {
+    return addPlane(name, Kind::Scratch, size, type, nullptr);
+}
+
+FrameGraph::Plane FrameGraph::addPlane(const std::string& name, Kind kind,
+    cv::Size size, int type, cv::Mat* storage) {
+    CV_Assert(!compiled_ && size.area() > 0);
+    planes_.push_back({ name, kind, size, type, storage });
+    alias_.push_back(static_cast<Plane>(alias_.size()));
+    return alias_.back();
+}
+
+void FrameGraph::stage(const std::string& op, Stage profile, bool perPixel,
+    std::vector<Plane> reads, std::vector<Plane> writes, Body body) {
+    CV_Assert(body);
+    addNode(op, profile, perPixel, false, std::move(reads), std::move(writes),
+        std::move(body));
+}
+
+void FrameGraph::swap(Plane boundPlane, Plane scratchPlane) {
+    CV_Assert(boundPlane >= 0 && boundPlane < static_cast<int>(planes_.size()));
+    CV_Assert(scratchPlane >= 0 &&
+        scratchPlane < static_cast<int>(planes_.size()));
+    const PlaneInfo& target = planes_[boundPlane];
+    const PlaneInfo& source = planes_[scratchPlane];
+    if (target.kind != Kind::Bound || source.kind != Kind::Scratch ||
+        target.size != source.size || target.type != source.type) {
+        throw std::logic_error("Cannot swap " + source.name + " into " +
+            target.name);
+    }
+    addNode("swap", Stage::Frame, false, true, { scratchPlane },
+        { boundPlane }, nullptr);
+}
+
+void FrameGraph::addNode(const std::string& op, Stage profile, bool perPixel,
+    bool swap, std::vector<Plane> reads, std::vector<Plane> writes,
+    Body body) {
+    CV_Assert(!compiled_);
+    for (const Plane plane : touched(reads, writes)) {
+        CV_Assert(plane >= 0 && plane < static_cast<int>(planes_.size()));
+    }
+    nodes_.push_back({ op, profile, perPixel, swap, std::move(reads),
+        std::move(writes), std::move(body), {} });
+}
+
+FrameGraph::Plane FrameGraph::resolve(Plane plane) const {
+    while (alias_[plane] != plane) {
+        plane = alias_[plane];
+    }
+    return plane;
+}
+
+void FrameGraph::compile(size_t bandBytes) {
+    CV_Assert(!compiled_ && bandBytes > 0);
+
+    // Scratch planes are written once, before anything reads them
+    std::vector<int> writers(planes_.size(), 0);
+    for (const Node& node : nodes_) {
+        for (const Plane plane : node.reads) {
+            if (planes_[plane].kind == Kind::Scratch && writers[plane] == 0) {
+                throw std::logic_error(node.op + " reads " +
+                    planes_[plane].name + " before it is written");
+            }
+        }
+        for (const Plane plane : node.writes) {
+            if (planes_[plane].kind == Kind::Scratch && ++writers[plane] > 1) {
+                throw std::logic_error(planes_[plane].name +
+                    " has more than one writer");
+            }
+        }
+    }
+
+    deduplicate();
+    dropUnused();
+    schedule(bandBytes);
+    allocate();
+    compiled_ = true;
+}
+
+void FrameGraph::deduplicate() {
+    // Contents of a plane are identified by the plane and the number of
+    // writes it has seen so far
+    std::vector<int> version(planes_.size(), 0);
+    std::map<std::string, int> seen;
+    for (int i = 0; i < static_cast<int>(nodes_.size()); ++i) {
+        Node& node = nodes_[i];
+        for (Plane& plane : node.reads) {
+            plane = resolve(plane);
+        }
+
+        // Only stages that write nothing but scratch planes can be shared
+        bool shareable = !node.swap && !node.writes.empty();
+        for (const Plane plane : node.writes) {
+            shareable = shareable && planes_[plane].kind == Kind::Scratch;
+        }
+        if (shareable) {
+            std::string key = node.op;
+            for (const Plane plane : node.reads) {
+                key += "|" + std::to_string(plane) + "." +
+                    std::to_string(version[plane]);
+            }
+            const auto found = seen.find(key);
+            if (found != seen.end()) {
+                const Node& first = nodes_[found->second];
+                bool same = first.writes.size() == node.writes.size();
+                for (size_t j = 0; same && j < node.writes.size(); ++j) {
+                    const PlaneInfo& a = planes_[first.writes[j]];
+                    const PlaneInfo& b = planes_[node.writes[j]];
+                    same = a.size == b.size && a.type == b.type;
+                }
+                if (same) {
+                    for (size_t j = 0; j < node.writes.size(); ++j) {
+                        alias_[node.writes[j]] = first.writes[j];
+                    }
+                    node.dropped = "duplicate";
+                    continue;
+                }
+            }
+            seen.emplace(key, i);
+        }
+        for (const Plane plane : node.writes) {
+            ++version[plane];
+        }
+    }
+}
+
+void FrameGraph::dropUnused() {
+    std::vector<char> needed(planes_.size(), 0);
+    for (int i = static_cast<int>(nodes_.size()) - 1; i >= 0; --i) {
+        Node& node = nodes_[i];
+        if (!node.dropped.empty()) {
+            continue;
+        }
+        bool live = node.writes.empty();
+        for (const Plane plane : node.writes) {
+            live = live || planes_[plane].kind != Kind::Scratch ||
+                needed[plane];
+        }
+        if (!live) {
+            node.dropped = "unused";
+            continue;
+        }
+        for (const Plane plane : node.reads) {
+            needed[plane] = 1;
+        }
+    }
+}
+
+void FrameGraph::schedule(size_t bandBytes) {
+    // A swapped plane holds the previous state afterwards
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        if (!nodes_[i].swap || !nodes_[i].dropped.empty()) {
+            continue;
+        }
+        const Plane swapped = nodes_[i].reads.front();
+        for (size_t j = i + 1; j < nodes_.size(); ++j) {
+            const std::vector<Plane>& reads = nodes_[j].reads;
+            if (nodes_[j].dropped.empty() &&
+                std::find(reads.begin(), reads.end(), swapped) != reads.end()) {
+                throw std::logic_error(nodes_[j].op + " reads " +
+                    planes_[swapped].name + " after its swap");
+            }
+        }
+    }
+
+    // Runs of consecutive per-pixel stages become one pass
+    for (int i = 0; i < static_cast<int>(nodes_.size()); ++i) {
+        const Node& node = nodes_[i];
+        if (!node.dropped.empty()) {
+            continue;
+        }
+        const bool extend = node.perPixel && !steps_.empty() &&
+            nodes_[steps_.back().nodes.back()].perPixel;
+        if (!extend) {
+            steps_.emplace_back();
+        }
+        steps_.back().nodes.push_back(i);
+    }
+
+    // Scratch planes written and read only inside one pass
+    std::vector<int> writerStep(planes_.size(), -1);
+    std::vector<char> local(planes_.size(), 1);
+    for (int s = 0; s < static_cast<int>(steps_.size()); ++s) {
+        for (const int index : steps_[s].nodes) {
+            for (const Plane plane : nodes_[index].reads) {
+                local[plane] = local[plane] && writerStep[plane] == s;
+            }
+            for (const Plane plane : nodes_[index].writes) {
+                writerStep[plane] = s;
+            }
+        }
+    }
+
+    for (int s = 0; s < static_cast<int>(steps_.size()); ++s) {
+        Step& step = steps_[s];
+        step.io.resize(step.nodes.size());
+        if (step.nodes.size() < 2) {
+            continue;
+        }
+
+        size_t rowBytes = 0;
+        for (const int index : step.nodes) {
+            const Node& node = nodes_[index];
+            for (const Plane plane : touched(node.reads, node.writes)) {
+                if (std::find(step.viewPlanes.begin(), step.viewPlanes.end(),
+                    plane) != step.viewPlanes.end()) {
+                    continue;
+                }
+                const PlaneInfo& info = planes_[plane];
+                if (!step.viewPlanes.empty() &&
+                    info.size != planes_[step.viewPlanes.front()].size) {
+                    throw std::logic_error(node.op +
+                        " is fused with planes of another size");
+                }
+                const bool bandLocal = info.kind == Kind::Scratch &&
+                    local[plane] && writerStep[plane] == s;
+                step.viewPlanes.push_back(plane);
+                step.viewBands.push_back(bandLocal ?
+                    static_cast<int>(step.bands.size()) : -1);
+                if (bandLocal) {
+                    step.bands.emplace_back();
+                }
+                rowBytes += static_cast<size_t>(info.size.width) *
+                    CV_ELEM_SIZE(info.type);
+            }
+        }
+
+        // Bands of every plane of the pass together fit in bandBytes
+        step.rows = planes_[step.viewPlanes.front()].size.height;
+        step.bandRows = std::clamp(static_cast<int>(std::min<size_t>(
+            bandBytes / rowBytes, step.rows)), 1, step.rows);
+        step.views.resize(step.viewPlanes.size());
+        for (size_t v = 0; v < step.viewPlanes.size(); ++v) {
+            if (step.viewBands[v] >= 0) {
+                const PlaneInfo& info = planes_[step.viewPlanes[v]];
+                step.bands[step.viewBands[v]].create(step.bandRows,
+                    info.size.width, info.type);
+            }
+        }
+    }
+}
+
+void FrameGraph::allocate() {
+    // Lifetimes of the remaining scratch planes, in steps. A plane nothing
+    // reads lives for its writer's step.
+    std::vector<int> firstStep(planes_.size(), -1);
+    std::vector<int> lastStep(planes_.size(), -1);
+    std::vector<char> inBand(planes_.size(), 0);
+    for (int s = 0; s < static_cast<int>(steps_.size()); ++s) {
+        const Step& step = steps_[s];
+        for (size_t v = 0; v < step.viewPlanes.size(); ++v) {
+            inBand[step.viewPlanes[v]] = step.viewBands[v] >= 0;
+        }
+        for (const int index : step.nodes) {
+            for (const Plane plane : nodes_[index].writes) {
+                if (firstStep[plane] < 0) {
+                    firstStep[plane] = s;
+                }
+                lastStep[plane] = std::max(lastStep[plane], s);
+            }
+            for (const Plane plane : nodes_[index].reads) {
+                lastStep[plane] = std::max(lastStep[plane], s);
+            }
+        }
+    }
+
+    // Greedy sharing in step order: a plane takes the first buffer of its
+    // size and type whose previous plane died before its first step
+    struct Slot {
+        cv::Size size;
+        int type;
+        int busyUntil;
+    };
+    std::vector<Slot> slots;
+    std::vector<int> slotOf(planes_.size(), -1);
+    for (int s = 0; s < static_cast<int>(steps_.size()); ++s) {
+        for (Plane plane = 0; plane < static_cast<int>(planes_.size());
+            ++plane) {
+            const PlaneInfo& info = planes_[plane];
+            if (info.kind != Kind::Scratch || firstStep[plane] != s ||
+                inBand[plane]) {
+                continue;
+            }
+            auto slot = std::find_if(slots.begin(), slots.end(),
+                [&](const Slot& candidate) {
+                    return candidate.size == info.size &&
+                        candidate.type == info.type && candidate.busyUntil < s;
+                });
+            if (slot == slots.end()) {
+                slots.push_back(Slot{ info.size, info.type, -1 });
+                slot = slots.end() - 1;
+            }
+            slot->busyUntil = lastStep[plane];
+            slotOf[plane] = static_cast<int>(slot - slots.begin());
+        }
+    }
+
+    slots_.resize(slots.size());
+    for (size_t i = 0; i < slots.size(); ++i) {
+        slots_[i].create(slots[i].size, slots[i].type);
+    }
+    externals_.resize(planes_.size());
+    for (Plane plane = 0; plane < static_cast<int>(planes_.size()); ++plane) {
+        PlaneInfo& info = planes_[plane];
+        if (info.kind == Kind::External) {
+            info.storage = &externals_[plane];
+        }
+        else if (slotOf[plane] >= 0) {
+            info.storage = &slots_[slotOf[plane]];
+        }
+    }
+
+    // Whole-plane nodes see the storage, fused ones the band views
+    for (Step& step : steps_) {
+        for (size_t j = 0; j < step.nodes.size(); ++j) {
+            const Node& node = nodes_[step.nodes[j]];
+            Io& io = step.io[j];
+            auto view = [&](Plane plane) {
+                if (step.bandRows == 0) {
+                    return planes_[plane].storage;
+                }
+                const auto found = std::find(step.viewPlanes.begin(),
+                    step.viewPlanes.end(), plane);
+                return &step.views[found - step.viewPlanes.begin()];
+            };
+            for (const Plane plane : node.reads) {
+                io.in_.push_back(view(plane));
+            }
+            for (const Plane plane : node.writes) {
+                io.out_.push_back(view(plane));
+            }
+        }
+    }
+}
+
+void FrameGraph::bindInput(Plane plane, const cv::Mat& frame) {
+    CV_Assert(compiled_ && plane >= 0 &&
+        plane < static_cast<int>(planes_.size()));
+    const PlaneInfo& info = planes_[plane];
+    CV_Assert(info.kind == Kind::External && frame.size() == info.size &&
+        frame.type() == info.type);
+    externals_[plane] = frame;
+}
+
+void FrameGraph::bindOutput(Plane plane, cv::Mat& frame) {
+    CV_Assert(compiled_ && plane >= 0 &&
+        plane < static_cast<int>(planes_.size()));
+    const PlaneInfo& info = planes_[plane];
+    CV_Assert(info.kind == Kind::External);
+    frame.create(info.size, info.type);
+    externals_[plane] = frame;
+}
+
+void FrameGraph::run() {
+    CV_Assert(compiled_);
+    for (Plane plane = 0; plane < static_cast<int>(planes_.size()); ++plane) {
+        if (planes_[plane].kind == Kind::External &&
+            externals_[plane].empty()) {
+            throw std::logic_error(planes_[plane].name + " is not bound");
+        }
+    }
+
+    for (Step& step : steps_) {
+        if (step.bandRows > 0) {
+            runPass(step);
+            continue;
+        }
+        const Node& node = nodes_[step.nodes.front()];
+        if (node.swap) {
+            cv::swap(*planes_[node.writes.front()].storage,
+                *planes_[node.reads.front()].storage);
+            continue;
+        }
+        STKMB_PROFILE(node.profile);
+        node.body(step.io.front());
+    }
+
+    // The caller's frames are not kept beyond the run
+    for (cv::Mat& frame : externals_) {
+        frame.release();
+    }
+}
+
+void FrameGraph::runPass(Step& step) {
+    // Timed as a whole under the stage of its first node
+    STKMB_PROFILE(nodes_[step.nodes.front()].profile);
+    for (int begin = 0; begin < step.rows; begin += step.bandRows) {
+        const int end = std::min(begin + step.bandRows, step.rows);
+        for (size_t v = 0; v < step.views.size(); ++v) {
+            const int band = step.viewBands[v];
+            step.views[v] = band >= 0 ?
+                step.bands[band].rowRange(0, end - begin) :
+                planes_[step.viewPlanes[v]].storage->rowRange(begin, end);
+        }
+        for (size_t j = 0; j < step.nodes.size(); ++j) {
+            nodes_[step.nodes[j]].body(step.io[j]);
+        }
+    }
+}
+
+std::string FrameGraph::describe() const {
+    std::string text;
+    for (const Step& step : steps_) {
+        text += text.empty() ? "" : " | ";
+        text += step.nodes.size() > 1 ? "[" : "";
+        for (size_t j = 0; j < step.nodes.size(); ++j) {
+            text += (j > 0 ? " + " : "") + nodes_[step.nodes[j]].op;
+        }
+        text += step.nodes.size() > 1 ? "]" : "";
+    }
+    for (const Node& node : nodes_) {
+        if (!node.dropped.empty()) {
+            text += "; dropped " + node.op + " (" + node.dropped + ")";
+        }
+    }
+    return text;
+}
+
+size_t FrameGraph::scratchBytes() const {
+    size_t bytes = 0;
+    for (const cv::Mat& slot : slots_) {
+        bytes += slot.total() * slot.elemSize();
+    }
+    for (const Step& step : steps_) {
+        for (const cv::Mat& band : step.bands) {
+            bytes += band.total() * band.elemSize();
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include "profiler.hpp"
+#include <functional>
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Declarative per-frame pipeline. Each stage names the planes it reads and
+// writes and says whether it works per pixel. compile() turns the
+// declaration into a schedule:
+//  - a stage with the same operation as an earlier one, on the same
+//    contents of the same planes, is dropped and readers of its outputs
+//    read the earlier stage's outputs instead
+//  - stages whose outputs nothing reads are dropped; a stage without
+//    outputs runs for its side effects and is always kept
+//  - consecutive per-pixel stages are fused into one pass over bands of
+//    rows, sized so that a band of every plane they touch stays in cache.
+//    A plane written and read only inside such a pass lives in a band-sized
+//    buffer instead of a whole plane.
+// The remaining scratch planes then share buffers of the same size and type
+// wherever their lifetimes do not overlap. compile() allocates every
+// buffer; run() allocates nothing of its own.
+class FrameGraph {
+public:
+    using Plane = int;
+
+    // Planes of one stage call in the order of the declaration. Per-pixel
+    // stages get the same band of rows of every plane, other stages whole
+    // planes.
+    class Io {
+    public:
+        const cv::Mat& in(int i) const { return *in_[i]; }
+        cv::Mat& out(int i) const { return *out_[i]; }
+
+    private:
+        friend class FrameGraph;
+        std::vector<cv::Mat*> in_, out_;
+    };
+    using Body = std::function<void(const Io& io)>;
+
+    // Plane the caller binds before every run: the frame or the result
+    Plane external(const std::string& name, cv::Size size, int type);
+
+    // Plane kept by the caller across frames and updated in place. Stages
+    // writing one always run.
+    Plane bound(const std::string& name, cv::Mat& storage);
+
+    // Plane that lives for one frame, stored by the graph
+    Plane scratch(const std::string& name, cv::Size size, int type);
+
+    // op names the operation with every parameter that changes its result;
+    // stages with the same op and inputs are duplicates. Scratch planes have
+    // a single writer. Per-pixel stages must give the same result on any
+    // band of rows as on the whole plane.
+    void stage(const std::string& op, Stage profile, bool perPixel,
+        std::vector<Plane> reads, std::vector<Plane> writes, Body body);
+
+    // Exchange the contents of a bound plane with those of a scratch plane
+    // of the same size and type, which nothing may read afterwards. Hands a
+    // result over as state without copying it.
+    void swap(Plane boundPlane, Plane scratchPlane);
+
+    // Build the schedule and its buffers. No stage may be added afterwards.
+    void compile(size_t bandBytes = 256 * 1024);
+    bool compiled() const { return compiled_; }
+
+    // Bind the external planes for the next run. Outputs are (re)created
+    // with the declared size and type.
+    void bindInput(Plane plane, const cv::Mat& frame);
+    void bindOutput(Plane plane, cv::Mat& frame);
+
+    void run();
+
+    // Schedule in execution order, fused passes in brackets, followed by
+    // the dropped stages
+    std::string describe() const;
+
+    // Bytes of the graph's own buffers, whole planes and bands
+    size_t scratchBytes() const;
+
+private:
+    enum class Kind { External, Bound, Scratch };
+
+    struct PlaneInfo {
+        std::string name;
+        Kind kind;
+        cv::Size size;
+        int type;
+        cv::Mat* storage = nullptr; // Resolved by compile() for scratch
+    };
+
+    struct Node {
+        std::string op;
+        Stage profile;
+        bool perPixel;
+        bool swap;
+        std::vector<Plane> reads, writes;
+        Body body;
+        std::string dropped; // Why compile() dropped it, empty if kept
+    };
+
+    // A node run on whole planes, or a fused pass of per-pixel nodes
+    struct Step {
+        std::vector<int> nodes;
+        std::vector<Io> io;            // One per node
+        std::vector<cv::Mat> views;    // Band headers the io points to
+        std::vector<Plane> viewPlanes; // Plane of every view
+        std::vector<int> viewBands;    // Its band-local buffer, or -1
+        std::vector<cv::Mat> bands;    // Band-local planes of the pass
+        int rows = 0;
+        int bandRows = 0;              // 0 for a single whole-plane node
+    };
+
+    Plane addPlane(const std::string& name, Kind kind, cv::Size size,
+        int type, cv::Mat* storage);
+    void addNode(const std::string& op, Stage profile, bool perPixel,
+        bool swap, std::vector<Plane> reads, std::vector<Plane> writes,
+        Body body);
+    Plane resolve(Plane plane) const;
+    void deduplicate();
+    void dropUnused();
+    void schedule(size_t bandBytes);
+    void allocate();
+    void runPass(Step& step);
+
+    std::vector<PlaneInfo> planes_;
+    std::vector<Node> nodes_;
+    std::vector<Plane> alias_;       // Plane each plane reads from
+    std::vector<cv::Mat> externals_; // Headers of the bound frames
+    std::vector<cv::Mat> slots_;     // Whole scratch planes
+    std::vector<Step> steps_;
+    bool compiled_ = false;
+};
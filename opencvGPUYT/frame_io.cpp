@@ -0,0 +1,440 @@
+#include "frame_io.hpp"
+#include "frame_store.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace {
+
+    // stdio buffer of the streams; whole-frame reads and writes bypass it
+    constexpr size_t kStreamBuffer = 1 << 20;
+    constexpr size_t kMaxHeaderLine = 4096;
+
+    bool isStdio(const std::string& path) { return path == "-"; }
+
+    std::FILE* openStream(const std::string& path, bool write) {
+        if (isStdio(path)) {
+            std::FILE* stream = write ? stdout : stdin;
+#ifdef _WIN32
+            _setmode(_fileno(stream), _O_BINARY);
+#endif
+            return stream;
+        }
+        std::FILE* stream = std::fopen(path.c_str(), write ? "wb" : "rb");
+        if (!stream) {
+            throw std::runtime_error("Cannot open '" + path + "' for " +
+                (write ? "writing" : "reading"));
+        }
+        return stream;
+    }
+
+    // Read up to and excluding '\n'. False on end of stream before any byte.
+    bool readLine(std::FILE* stream, std::string& line) {
+        line.clear();
+        int c = std::fgetc(stream);
+        if (c == EOF) {
+            return false;
+        }
+        for (; c != EOF && c != '\n'; c = std::fgetc(stream)) {
+            if (line.size() == kMaxHeaderLine) {
+                throw std::runtime_error("Y4M header line too long");
+            }
+            line.push_back(static_cast<char>(c));
+        }
+        return true;
+    }
+
+    // Rows of the frame plane for a layout and frame size
+    int planeRows(FrameFormat format, const cv::Size& size) {
+        return format == FrameFormat::I420 ? size.height * 3 / 2 : size.height;
+    }
+
+    // fseek with 64-bit offsets, raw files easily pass 2 GB
+    bool seekTo(std::FILE* stream, int64_t offset) {
+#ifdef _WIN32
+        return _fseeki64(stream, offset, SEEK_SET) == 0;
+#else
+        return fseeko(stream, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+    }
+
+    class CaptureSource : public FrameSource {
+    public:
+        explicit CaptureSource(const std::string& path)
+            : path_(path), capture_(path) {
+            if (!capture_.isOpened()) {
+                throw std::runtime_error("Cannot open video '" + path + "'");
+            }
+            info_.frameCount =
+                static_cast<int>(capture_.get(cv::CAP_PROP_FRAME_COUNT));
+            info_.size = cv::Size(
+                static_cast<int>(capture_.get(cv::CAP_PROP_FRAME_WIDTH)),
+                static_cast<int>(capture_.get(cv::CAP_PROP_FRAME_HEIGHT)));
+            toFrameRate(capture_.get(cv::CAP_PROP_FPS), info_.fpsNum,
+                info_.fpsDen);
+            info_.format = FrameFormat::Bgr;
+        }
+
+        const StreamInfo& info() const override { return info_; }
+        bool read(cv::Mat& frame) override { return capture_.read(frame); }
+
+        bool seek(int index) override {
+            if (index < 0 ||
+                (info_.frameCount > 0 && index > info_.frameCount)) {
+                return false;
+            }
+            // Backends may land on a nearby keyframe instead; the position
+            // is only trusted when it reads back as asked, otherwise the
+            // frames before index are decoded from the start
+            if (capture_.set(cv::CAP_PROP_POS_FRAMES, index) &&
+                static_cast<int>(capture_.get(cv::CAP_PROP_POS_FRAMES)) ==
+                index) {
+                return true;
+            }
+            if (!capture_.open(path_)) {
+                return false;
+            }
+            for (int skipped = 0; skipped < index; ++skipped) {
+                if (!capture_.grab()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    private:
+        std::string path_;
+        cv::VideoCapture capture_;
+        StreamInfo info_;
+    };
+
+    class RawSource : public FrameSource {
+    public:
+        RawSource(const std::string& path, StreamFormat format,
+            const cv::Size& rawSize, double rawFps)
+            : path_(path), y4m_(format == StreamFormat::Y4m),
+            stream_(openStream(path, false)) {
+            std::setvbuf(stream_, nullptr, _IOFBF, kStreamBuffer);
+
+            if (y4m_) {
+                headerBytes_ = parseHeader();
+            }
+            else {
+                if (rawSize.width <= 0 || rawSize.height <= 0) {
+                    close();
+                    throw std::runtime_error(
+                        "Raw gray input needs a frame size");
+                }
+                info_.size = rawSize;
+                info_.format = FrameFormat::Gray;
+                toFrameRate(rawFps, info_.fpsNum, info_.fpsDen);
+            }
+            frameBytes_ = static_cast<size_t>(info_.size.width) *
+                planeRows(info_.format, info_.size);
+
+            // Files (not pipes) tell the frame count up front and can seek
+            std::error_code error;
+            if (!isStdio(path) && std::filesystem::is_regular_file(path, error)) {
+                seekable_ = true;
+                const auto fileBytes = std::filesystem::file_size(path, error);
+                if (!error && fileBytes > headerBytes_) {
+                    info_.frameCount = static_cast<int>(
+                        (fileBytes - headerBytes_) / frameStride());
+                }
+            }
+        }
+
+        ~RawSource() override { close(); }
+
+        const StreamInfo& info() const override { return info_; }
+
+        bool read(cv::Mat& frame) override {
+            if (y4m_) {
+                // Per-frame parameters are allowed but ignored
+                if (!readLine(stream_, line_)) {
+                    return false;
+                }
+                if (line_.compare(0, 5, "FRAME") != 0) {
+                    throw std::runtime_error("Bad Y4M frame marker in '" +
+                        path_ + "'");
+                }
+            }
+
+            frame.create(planeRows(info_.format, info_.size),
+                info_.size.width, CV_8UC1);
+            size_t got = 0;
+            if (frame.isContinuous()) {
+                got = std::fread(frame.data, 1, frameBytes_, stream_);
+            }
+            else {
+                for (int y = 0; y < frame.rows; ++y) {
+                    got += std::fread(frame.ptr(y), 1, frame.cols, stream_);
+                }
+            }
+            if (got == 0 && !y4m_) {
+                return false;
+            }
+            if (got != frameBytes_) {
+                throw std::runtime_error("Truncated frame in '" + path_ + "'");
+            }
+            return true;
+        }
+
+        // Frames sit at a fixed stride after the header. Y4M frames with
+        // per-frame parameters break that, which read() then reports as a
+        // bad frame marker.
+        bool seek(int index) override {
+            if (!seekable_ || index < 0 || index > info_.frameCount) {
+                return false;
+            }
+            return seekTo(stream_, static_cast<int64_t>(headerBytes_) +
+                static_cast<int64_t>(index) * frameStride());
+        }
+
+    private:
+        // Bytes from one frame to the next, with the Y4M "FRAME\n" marker
+        size_t frameStride() const { return frameBytes_ + (y4m_ ? 6 : 0); }
+
+        // Returns the size of the header in bytes
+        size_t parseHeader() {
+            if (!readLine(stream_, line_) ||
+                line_.compare(0, 10, "YUV4MPEG2 ") != 0) {
+                close();
+                throw std::runtime_error("'" + path_ + "' is not a Y4M stream");
+            }
+
+            // Numbers that do not parse come out as 0 and fail the checks
+            std::string colorspace = "420jpeg";
+            std::istringstream tokens(line_.substr(10));
+            std::string token;
+            while (tokens >> token) {
+                const std::string value = token.substr(1);
+                switch (token[0]) {
+                case 'W': info_.size.width = std::atoi(value.c_str()); break;
+                case 'H': info_.size.height = std::atoi(value.c_str()); break;
+                case 'F': {
+                    const size_t colon = value.find(':');
+                    if (colon != std::string::npos) {
+                        info_.fpsNum = std::atoi(value.substr(0, colon).c_str());
+                        info_.fpsDen = std::atoi(value.substr(colon + 1).c_str());
+                    }
+                    break;
+                }
+                case 'C': colorspace = value; break;
+                default: break; // Interlacing, aspect ratio, extensions
+                }
+            }
+
+            if (colorspace == "mono") {
+                info_.format = FrameFormat::Gray;
+            }
+            else if (colorspace == "420" || colorspace == "420jpeg" ||
+                colorspace == "420paldv" || colorspace == "420mpeg2") {
+                info_.format = FrameFormat::I420;
+            }
+            else {
+                close();
+                throw std::runtime_error("Unsupported Y4M colour space C" +
+                    colorspace + " (8-bit 4:2:0 or mono only)");
+            }
+            if (info_.size.width <= 0 || info_.size.height <= 0 ||
+                info_.fpsNum <= 0 || info_.fpsDen <= 0 ||
+                (info_.format == FrameFormat::I420 &&
+                    (info_.size.width % 2 != 0 || info_.size.height % 2 != 0))) {
+                close();
+                throw std::runtime_error("Bad Y4M header: " + line_);
+            }
+            return line_.size() + 1;
+        }
+
+        void close() {
+            if (stream_ && !isStdio(path_)) {
+                std::fclose(stream_);
+            }
+            stream_ = nullptr;
+        }
+
+        std::string path_;
+        bool y4m_;
+        std::FILE* stream_;
+        StreamInfo info_;
+        size_t headerBytes_ = 0;
+        size_t frameBytes_ = 0;
+        bool seekable_ = false;
+        std::string line_;
+    };
+
+    class RawSink : public FrameSink {
+    public:
+        RawSink(const std::string& path, StreamFormat format,
+            const StreamInfo& info, FrameFormat frameFormat)
+            : path_(path), y4m_(format == StreamFormat::Y4m), size_(info.size),
+            format_(y4m_ && frameFormat == FrameFormat::I420 ?
+                FrameFormat::I420 : FrameFormat::Gray),
+            stream_(openStream(path, true)) {
+            std::setvbuf(stream_, nullptr, _IOFBF, kStreamBuffer);
+            if (y4m_) {
+                std::fprintf(stream_, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C%s\n",
+                    size_.width, size_.height, info.fpsNum, info.fpsDen,
+                    format_ == FrameFormat::I420 ? "420jpeg" : "mono");
+            }
+        }
+
+        ~RawSink() override {
+            try {
+                close();
+            }
+            catch (const std::exception&) {
+                // Errors only surface from an explicit close()
+            }
+        }
+
+        FrameFormat format() const override { return format_; }
+
+        void write(const cv::Mat& frame) override {
+            CV_Assert(frame.type() == CV_8UC1 && frame.cols == size_.width &&
+                frame.rows == planeRows(format_, size_));
+            if (y4m_) {
+                std::fputs("FRAME\n", stream_);
+            }
+            bool ok = true;
+            if (frame.isContinuous()) {
+                ok = std::fwrite(frame.data, frame.total(), 1, stream_) == 1;
+            }
+            else {
+                for (int y = 0; y < frame.rows && ok; ++y) {
+                    ok = std::fwrite(frame.ptr(y), frame.cols, 1, stream_) == 1;
+                }
+            }
+            if (!ok) {
+                throw std::runtime_error("Cannot write to '" + path_ + "'");
+            }
+        }
+
+        void close() override {
+            if (!stream_) {
+                return;
+            }
+            const bool ok = std::fflush(stream_) == 0 && !std::ferror(stream_);
+            if (!isStdio(path_)) {
+                std::fclose(stream_);
+            }
+            stream_ = nullptr;
+            if (!ok) {
+                throw std::runtime_error("Cannot write to '" + path_ + "'");
+            }
+        }
+
+    private:
+        std::string path_;
+        bool y4m_;
+        cv::Size size_;
+        FrameFormat format_;
+        std::FILE* stream_;
+    };
+
+} // namespace
+
+StreamFormat resolveStreamFormat(StreamFormat format, const std::string& path) {
+    if (format != StreamFormat::Auto) {
+        return format;
+    }
+    const std::string extension = std::filesystem::path(path).extension().string();
+    if (isStdio(path) || extension == ".y4m") {
+        return StreamFormat::Y4m;
+    }
+    return extension == ".stkraw" ? StreamFormat::Store : StreamFormat::Video;
+}
+
+void toFrameRate(double fps, int& num, int& den) {
+    if (!(fps > 0.0)) {
+        num = 25;
+        den = 1;
+        return;
+    }
+    // 24000/1001, 30000/1001, 60000/1001, ...
+    const double ntsc = std::round(fps * 1.001) * 1000.0;
+    if (std::abs(ntsc / 1001.0 - fps) < 1e-3 &&
+        std::abs(std::round(fps) - fps) > 1e-3) {
+        num = static_cast<int>(ntsc);
+        den = 1001;
+        return;
+    }
+    num = static_cast<int>(std::lround(fps * 1000.0));
+    den = 1000;
+    const int divisor = std::gcd(num, den);
+    num /= divisor;
+    den /= divisor;
+}
+
+void convertFrame(const cv::Mat& src, FrameFormat from, cv::Mat& dst,
+    FrameFormat to) {
+    if (from == to) {
+        src.copyTo(dst);
+        return;
+    }
+    switch (from) {
+    case FrameFormat::Bgr:
+        cv::cvtColor(src, dst, to == FrameFormat::Gray ? cv::COLOR_BGR2GRAY
+            : cv::COLOR_BGR2YUV_I420);
+        return;
+    case FrameFormat::Gray:
+        if (to == FrameFormat::Bgr) {
+            cv::cvtColor(src, dst, cv::COLOR_GRAY2BGR);
+        }
+        else {
+            dst.create(src.rows * 3 / 2, src.cols, CV_8UC1);
+            src.copyTo(dst.rowRange(0, src.rows));
+            dst.rowRange(src.rows, dst.rows).setTo(128);
+        }
+        return;
+    case FrameFormat::I420:
+        if (to == FrameFormat::Bgr) {
+            cv::cvtColor(src, dst, cv::COLOR_YUV2BGR_I420);
+        }
+        else {
+            src.rowRange(0, src.rows * 2 / 3).copyTo(dst);
+        }
+        return;
+    }
+}
+
+std::unique_ptr<FrameSource> openVideoSource(const std::string& path) {
+    return std::make_unique<CaptureSource>(path);
+}
+
+std::unique_ptr<FrameSource> openFrameSource(const std::string& path,
+    StreamFormat format, const cv::Size& rawSize, double rawFps) {
+    format = resolveStreamFormat(format, path);
+    switch (format) {
+    case StreamFormat::Store:
+        return std::make_unique<FrameStoreSource>(path);
+    case StreamFormat::Y4m:
+    case StreamFormat::Gray:
+        return openRawSource(path, format, rawSize, rawFps);
+    default:
+        return openVideoSource(path);
+    }
+}
+
+std::unique_ptr<FrameSource> openRawSource(const std::string& path,
+    StreamFormat format, const cv::Size& rawSize, double rawFps) {
+    CV_Assert(format == StreamFormat::Y4m || format == StreamFormat::Gray);
+    return std::make_unique<RawSource>(path, format, rawSize, rawFps);
+}
+
+std::unique_ptr<FrameSink> openRawSink(const std::string& path,
+    StreamFormat format, const StreamInfo& info, FrameFormat frameFormat) {
+    CV_Assert(format == StreamFormat::Y4m || format == StreamFormat::Gray);
+    return std::make_unique<RawSink>(path, format, info, frameFormat);
+}
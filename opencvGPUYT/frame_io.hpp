@@ -0,0 +1,92 @@
+#pragma once
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+// Pixel layout of frames entering or leaving the pipeline
+enum class FrameFormat {
+    Bgr,  // CV_8UC3
+    Gray, // CV_8UC1
+    I420  // CV_8UC1 with height * 3 / 2 rows: Y, then U and V at half size
+};
+
+// Container of an input or output stream
+enum class StreamFormat {
+    Auto,  // From the path: ".y4m" and "-" are Y4M, ".stkraw" Store,
+           // anything else Video
+    Video, // cv::VideoCapture / cv::VideoWriter
+    Y4m,   // YUV4MPEG2, 4:2:0 or mono, 8 bits
+    Gray,  // Headerless 8-bit gray frames of a size given separately
+    Store  // Memory-mapped frame store (frame_store.hpp)
+};
+
+// Resolve StreamFormat::Auto for a path
+StreamFormat resolveStreamFormat(StreamFormat format, const std::string& path);
+
+// Geometry and rate of a stream. frameCount is 0 when unknown (pipes)
+struct StreamInfo {
+    cv::Size size;
+    int fpsNum = 25;
+    int fpsDen = 1;
+    int frameCount = 0;
+    FrameFormat format = FrameFormat::Bgr;
+
+    double fps() const { return static_cast<double>(fpsNum) / fpsDen; }
+};
+
+// Closest num/den pair for a frame rate, exact for the NTSC family
+void toFrameRate(double fps, int& num, int& den);
+
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+
+    virtual const StreamInfo& info() const = 0;
+
+    // Read the next frame in info().format into frame, which is reused when
+    // it already has the right size and type. Sources holding frames in
+    // memory may instead point frame at their own read-only data, so callers
+    // must not write into it. False at the end of the stream.
+    virtual bool read(cv::Mat& frame) = 0;
+
+    // Make frame index the next one read. False when the source cannot
+    // seek or index is out of range.
+    virtual bool seek(int /*index*/) { return false; }
+};
+
+class FrameSink {
+public:
+    virtual ~FrameSink() = default;
+
+    // Layout write() expects
+    virtual FrameFormat format() const = 0;
+
+    virtual void write(const cv::Mat& frame) = 0;
+
+    // Flush and close; write() must not be called afterwards
+    virtual void close() = 0;
+};
+
+// Convert a frame between layouts; dst is reused when it fits. Gray to I420
+// gives neutral chroma.
+void convertFrame(const cv::Mat& src, FrameFormat from, cv::Mat& dst,
+    FrameFormat to);
+
+// Any source cv::VideoCapture can open, delivering BGR frames
+std::unique_ptr<FrameSource> openVideoSource(const std::string& path);
+
+// Source of any StreamFormat (Auto is resolved from the path)
+std::unique_ptr<FrameSource> openFrameSource(const std::string& path,
+    StreamFormat format, const cv::Size& rawSize = {}, double rawFps = 25.0);
+
+// Y4M or raw gray frames from a file, a FIFO or stdin ("-"). Frames are
+// read with one fread straight into the destination buffer. Raw gray input
+// needs its frame size and rate from the caller. Throws std::runtime_error
+// when the stream cannot be opened or its header is not supported.
+std::unique_ptr<FrameSource> openRawSource(const std::string& path,
+    StreamFormat format, const cv::Size& rawSize = {}, double rawFps = 25.0);
+
+// Y4M or raw gray frames to a file, a FIFO or stdout ("-"). Y4M output is
+// 4:2:0 when frames arrive as I420 and mono otherwise.
+std::unique_ptr<FrameSink> openRawSink(const std::string& path,
+    StreamFormat format, const StreamInfo& info, FrameFormat frameFormat);
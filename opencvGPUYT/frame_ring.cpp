@@ -0,0 +1,51 @@
+#include "frame_ring.hpp"
+
+namespace {
+
+    // Row strides are padded to this many bytes so every slot, and every row
+    // inside it, starts on a boundary suitable for aligned SIMD loads
+    constexpr size_t kSlotAlignment = 64;
+
+} // namespace
+
+FrameRing::FrameRing(const cv::Size& size, int type, int capacity) {
+    CV_Assert(capacity > 0 && size.area() > 0);
+
+    const size_t elemSize = CV_ELEM_SIZE(type);
+    const size_t step = cv::alignSize(size.width * elemSize, kSlotAlignment);
+    CV_Assert(step % elemSize == 0);
+    const int paddedCols = static_cast<int>(step / elemSize);
+
+    // One allocation for all slots (cv::Mat data is at least 64-byte aligned)
+    arena_.create(size.height * capacity, paddedCols, type);
+    allocations_ = 1;
+
+    slots_.reserve(capacity);
+    for (int i = 0; i < capacity; ++i) {
+        slots_.push_back(arena_.rowRange(i * size.height, (i + 1) * size.height)
+            .colRange(0, size.width));
+    }
+}
+
+void FrameRing::push(const cv::Mat& frame) {
+    const int slot = (head_ + size_) % capacity();
+    cv::Mat& target = slots_[slot];
+    CV_Assert(frame.size() == target.size() && frame.type() == target.type());
+
+    const uchar* before = target.data;
+    frame.copyTo(target);
+    if (target.data != before) {
+        ++allocations_;
+    }
+
+    advance();
+}
+
+void FrameRing::advance() {
+    if (full()) {
+        head_ = (head_ + 1) % capacity();
+    }
+    else {
+        ++size_;
+    }
+}
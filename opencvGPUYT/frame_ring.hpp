@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <iterator>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Fixed-capacity history of equally sized frames. All slots live in a single
+// arena allocated at construction, each slot starting on a SIMD-aligned row
+// stride. Pushing copies into the next slot and, once full, overwrites the
+// oldest one, so steady-state use never touches the heap.
+class FrameRing {
+public:
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = cv::Mat;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const cv::Mat*;
+        using reference = const cv::Mat&;
+
+        const_iterator(const FrameRing* ring, int index)
+            : ring_(ring), index_(index) {}
+
+        reference operator*() const { return (*ring_)[index_]; }
+        pointer operator->() const { return &(*ring_)[index_]; }
+        const_iterator& operator++() { ++index_; return *this; }
+        const_iterator operator++(int) { auto it = *this; ++index_; return it; }
+        bool operator==(const const_iterator& other) const {
+            return index_ == other.index_;
+        }
+        bool operator!=(const const_iterator& other) const {
+            return index_ != other.index_;
+        }
+
+    private:
+        const FrameRing* ring_;
+        int index_;
+    };
+
+    FrameRing(const cv::Size& size, int type, int capacity);
+
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+    // Copy frame into the next slot, replacing the oldest frame when full
+    void push(const cv::Mat& frame);
+
+    // Slot the next push() writes to, which is the oldest frame when full.
+    // It can be filled piecewise (e.g. by strips) and published with
+    // advance(); until then the ring contents are unchanged.
+    const cv::Mat& nextSlot() const {
+        return slots_[(head_ + size_) % capacity()];
+    }
+    void advance();
+
+    // Forget the oldest frame
+    void popFront() {
+        CV_Assert(size_ > 0);
+        head_ = (head_ + 1) % capacity();
+        --size_;
+    }
+
+    // Forget every frame, keeping the slots
+    void clear() { head_ = 0; size_ = 0; }
+
+    // Frames from oldest (0) to newest (size() - 1)
+    const cv::Mat& operator[](int index) const {
+        return slots_[(head_ + index) % capacity()];
+    }
+    const cv::Mat& front() const { return (*this)[0]; }
+    const cv::Mat& back() const { return (*this)[size_ - 1]; }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size_); }
+
+    int size() const { return size_; }
+    int capacity() const { return static_cast<int>(slots_.size()); }
+    bool empty() const { return size_ == 0; }
+    bool full() const { return size_ == capacity(); }
+
+    // Heap allocations made for frame storage so far. It is 1 after
+    // construction and must stay 1; anything more means a push had to
+    // reallocate a slot.
+    size_t allocations() const { return allocations_; }
+
+    // Bytes of the slot arena, row padding included
+    size_t bytes() const { return arena_.total() * arena_.elemSize(); }
+
+private:
+    cv::Mat arena_;
+    std::vector<cv::Mat> slots_; // Headers into arena_
+    int head_ = 0;               // Slot of the oldest frame
+    int size_ = 0;
+    size_t allocations_ = 0;
+};
@@ -0,0 +1,247 @@
+#include "frame_store.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+    constexpr char kMagic[8] = { 'S', 'T', 'K', 'M', 'B', 'F', 'S', '1' };
+    constexpr uint32_t kVersion = 1;
+
+    static_assert(std::is_trivially_copyable_v<FrameStoreHeader> &&
+        sizeof(FrameStoreHeader) <= kFrameStorePage);
+
+    int planeRows(FrameFormat format, int height) {
+        return format == FrameFormat::I420 ? height * 3 / 2 : height;
+    }
+
+    size_t roundToPage(size_t bytes) {
+        return (bytes + kFrameStorePage - 1) / kFrameStorePage * kFrameStorePage;
+    }
+
+} // namespace
+
+uint64_t frameStoreBytes(const cv::Size& size, FrameFormat format,
+    int frames) {
+    const uint64_t frameBytes = static_cast<uint64_t>(size.width) *
+        planeRows(format, size.height);
+    return kFrameStorePage + roundToPage(frameBytes) *
+        static_cast<uint64_t>(std::max(0, frames));
+}
+
+FrameStoreWriter::FrameStoreWriter(const std::string& path,
+    const StreamInfo& info, FrameFormat format)
+    : path_(path),
+    format_(format == FrameFormat::I420 ? FrameFormat::I420 : FrameFormat::Gray) {
+    if (format_ == FrameFormat::I420 &&
+        (info.size.width % 2 != 0 || info.size.height % 2 != 0)) {
+        throw std::runtime_error("I420 frame stores need even frame sizes");
+    }
+
+    std::memcpy(header_.magic, kMagic, sizeof(kMagic));
+    header_.version = kVersion;
+    header_.format = static_cast<uint32_t>(format_);
+    header_.width = info.size.width;
+    header_.height = info.size.height;
+    header_.fpsNum = info.fpsNum;
+    header_.fpsDen = info.fpsDen;
+    header_.frameBytes = static_cast<uint64_t>(info.size.width) *
+        planeRows(format_, info.size.height);
+    header_.frameStride = roundToPage(header_.frameBytes);
+    header_.dataOffset = kFrameStorePage;
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+        throw std::runtime_error("Cannot create frame store '" + path + "'");
+    }
+    // The header page is rewritten with the final count by close()
+    const std::vector<char> page(kFrameStorePage, 0);
+    std::fwrite(page.data(), page.size(), 1, file_);
+}
+
+FrameStoreWriter::~FrameStoreWriter() {
+    try {
+        close();
+    }
+    catch (const std::exception&) {
+        // Errors only surface from an explicit close()
+    }
+}
+
+void FrameStoreWriter::write(const cv::Mat& frame) {
+    CV_Assert(frame.type() == CV_8UC1 && frame.cols == header_.width &&
+        frame.rows == planeRows(format_, header_.height));
+    CV_Assert(file_);
+
+    bool ok = true;
+    for (int y = 0; y < frame.rows && ok; ++y) {
+        ok = std::fwrite(frame.ptr(y), frame.cols, 1, file_) == 1;
+    }
+    // Pad to the next page so every frame starts page-aligned
+    static const char zeros[kFrameStorePage] = {};
+    const size_t padding = header_.frameStride - header_.frameBytes;
+    if (ok && padding > 0) {
+        ok = std::fwrite(zeros, padding, 1, file_) == 1;
+    }
+    if (!ok) {
+        throw std::runtime_error("Cannot write to frame store '" + path_ + "'");
+    }
+    ++header_.frameCount;
+}
+
+void FrameStoreWriter::close() {
+    if (!file_) {
+        return;
+    }
+    bool ok = std::fseek(file_, 0, SEEK_SET) == 0 &&
+        std::fwrite(&header_, sizeof(header_), 1, file_) == 1;
+    ok = std::fclose(file_) == 0 && ok;
+    file_ = nullptr;
+    if (!ok) {
+        throw std::runtime_error("Cannot write to frame store '" + path_ + "'");
+    }
+}
+
+FrameStore::FrameStore(const std::string& path) {
+#ifdef _WIN32
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+        file_ = nullptr;
+        throw std::runtime_error("Cannot open frame store '" + path + "'");
+    }
+    LARGE_INTEGER fileSize{};
+    GetFileSizeEx(file_, &fileSize);
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+    mapping_ = size_ >= sizeof(FrameStoreHeader) ?
+        CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    data_ = mapping_ ? static_cast<const uchar*>(
+        MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    if (!data_) {
+        unmap();
+        throw std::runtime_error("Cannot map frame store '" + path + "'");
+    }
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open frame store '" + path + "'");
+    }
+    struct stat status {};
+    void* mapped = MAP_FAILED;
+    if (::fstat(fd, &status) == 0 &&
+        static_cast<size_t>(status.st_size) >= sizeof(FrameStoreHeader)) {
+        size_ = static_cast<size_t>(status.st_size);
+        mapped = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd); // The mapping keeps the file referenced
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("Cannot map frame store '" + path + "'");
+    }
+    data_ = static_cast<const uchar*>(mapped);
+#endif
+
+    std::memcpy(&header_, data_, sizeof(header_));
+    const FrameFormat format = static_cast<FrameFormat>(header_.format);
+    const bool valid = std::memcmp(header_.magic, kMagic, sizeof(kMagic)) == 0 &&
+        header_.version == kVersion &&
+        (format == FrameFormat::Gray || format == FrameFormat::I420) &&
+        header_.width > 0 && header_.height > 0 &&
+        header_.frameBytes == static_cast<uint64_t>(header_.width) *
+        planeRows(format, header_.height) &&
+        header_.frameStride >= header_.frameBytes &&
+        header_.dataOffset % kFrameStorePage == 0 &&
+        header_.dataOffset + header_.frameStride * header_.frameCount <= size_;
+    if (!valid) {
+        unmap();
+        throw std::runtime_error("'" + path + "' is not a valid frame store");
+    }
+
+    info_.size = cv::Size(header_.width, header_.height);
+    info_.fpsNum = header_.fpsNum;
+    info_.fpsDen = header_.fpsDen;
+    info_.frameCount = static_cast<int>(header_.frameCount);
+    info_.format = format;
+}
+
+FrameStore::~FrameStore() {
+    unmap();
+}
+
+void FrameStore::unmap() {
+#ifdef _WIN32
+    if (data_) {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_) {
+        CloseHandle(mapping_);
+    }
+    if (file_) {
+        CloseHandle(file_);
+    }
+    data_ = nullptr;
+    mapping_ = nullptr;
+    file_ = nullptr;
+#else
+    if (data_) {
+        ::munmap(const_cast<uchar*>(data_), size_);
+    }
+    data_ = nullptr;
+#endif
+}
+
+cv::Mat FrameStore::frame(int index) const {
+    CV_Assert(index >= 0 && index < info_.frameCount);
+    const uchar* frame = data_ + header_.dataOffset +
+        header_.frameStride * static_cast<uint64_t>(index);
+    // cv::Mat has no const data; the pages are mapped read-only
+    return cv::Mat(planeRows(info_.format, info_.size.height), info_.size.width,
+        CV_8UC1, const_cast<uchar*>(frame));
+}
+
+bool FrameStoreSource::read(cv::Mat& frame) {
+    if (next_ >= store_.frameCount()) {
+        return false;
+    }
+    frame = store_.frame(next_++);
+    return true;
+}
+
+bool FrameStoreSource::seek(int index) {
+    if (index < 0 || index > store_.frameCount()) {
+        return false;
+    }
+    next_ = index;
+    return true;
+}
+
+int writeFrameStore(FrameSource& source, const std::string& path,
+    FrameFormat format) {
+    FrameStoreWriter writer(path, source.info(), format);
+    cv::Mat frame, converted;
+    int frames = 0;
+    while (source.read(frame)) {
+        if (source.info().format == writer.format()) {
+            writer.write(frame);
+        }
+        else {
+            convertFrame(frame, source.info().format, converted,
+                writer.format());
+            writer.write(converted);
+        }
+        ++frames;
+    }
+    writer.close();
+    return frames;
+}
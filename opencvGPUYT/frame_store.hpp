@@ -0,0 +1,112 @@
+#pragma once
+#include "frame_io.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <opencv2/opencv.hpp>
+#include <string>
+
+// On-disk container of decoded frames for repeated runs over the same clip.
+// One header page is followed by gray or I420 frames stored back to back
+// without row padding, each starting on a page boundary, so frame i lives at
+// a fixed offset and can be mapped straight into a cv::Mat header.
+//
+//   offset 0      FrameStoreHeader, zero-padded to kFrameStorePage
+//   dataOffset    frame 0, frameBytes used out of frameStride
+//   + i * stride  frame i
+constexpr size_t kFrameStorePage = 4096;
+
+struct FrameStoreHeader {
+    char magic[8];        // "STKMBFS1"
+    uint32_t version;     // 1
+    uint32_t format;      // FrameFormat::Gray or FrameFormat::I420
+    int32_t width;
+    int32_t height;
+    int32_t fpsNum;
+    int32_t fpsDen;
+    uint32_t frameCount;
+    uint32_t reserved;
+    uint64_t frameBytes;  // width * rows of the frame plane
+    uint64_t frameStride; // frameBytes rounded up to kFrameStorePage
+    uint64_t dataOffset;  // Offset of frame 0
+};
+
+// Size on disk of a store holding frames frames of the given size and layout
+uint64_t frameStoreBytes(const cv::Size& size, FrameFormat format,
+    int frames);
+
+// Appends frames to a new store. The frame count in the header is written
+// by close(), so the target has to be a regular, seekable file. Throws
+// std::runtime_error on I/O errors.
+class FrameStoreWriter : public FrameSink {
+public:
+    // format is the layout of the stored frames, Gray or I420
+    FrameStoreWriter(const std::string& path, const StreamInfo& info,
+        FrameFormat format);
+    ~FrameStoreWriter() override;
+
+    FrameStoreWriter(const FrameStoreWriter&) = delete;
+    FrameStoreWriter& operator=(const FrameStoreWriter&) = delete;
+
+    FrameFormat format() const override { return format_; }
+    void write(const cv::Mat& frame) override;
+    void close() override;
+
+private:
+    std::string path_;
+    FrameFormat format_;
+    FrameStoreHeader header_{};
+    std::FILE* file_ = nullptr;
+};
+
+// Read-only memory mapping of a store. frame() is O(1) and returns a header
+// pointing into the mapping: no copy and no decode. The pages are shared
+// with the OS cache, so repeated runs over a clip read it from memory.
+class FrameStore {
+public:
+    explicit FrameStore(const std::string& path);
+    ~FrameStore();
+
+    FrameStore(const FrameStore&) = delete;
+    FrameStore& operator=(const FrameStore&) = delete;
+
+    const StreamInfo& info() const { return info_; }
+    int frameCount() const { return info_.frameCount; }
+
+    // Frame index in info().format. The data is read-only: writing through
+    // the returned header faults.
+    cv::Mat frame(int index) const;
+
+private:
+    void unmap();
+
+    StreamInfo info_;
+    FrameStoreHeader header_{};
+    const uchar* data_ = nullptr; // Start of the mapping
+    size_t size_ = 0;             // Bytes mapped
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+// Sequential FrameSource over a FrameStore. read() points frame at the
+// mapping instead of copying; seek() jumps to any frame in O(1).
+class FrameStoreSource : public FrameSource {
+public:
+    explicit FrameStoreSource(const std::string& path) : store_(path) {}
+
+    const StreamInfo& info() const override { return store_.info(); }
+    bool read(cv::Mat& frame) override;
+    bool seek(int index) override;
+
+    const FrameStore& store() const { return store_; }
+
+private:
+    FrameStore store_;
+    int next_ = 0;
+};
+
+// Copy every remaining frame of source into a new store at path, converted
+// to format (Gray or I420). Returns the number of frames written.
+int writeFrameStore(FrameSource& source, const std::string& path,
+    FrameFormat format);
@@ -0,0 +1,179 @@
+#include "kalman_kernel.hpp"
+#include "fixed_point.hpp"
+#include <opencv2/core/hal/intrin.hpp>
+
+void kalmanUpdateFused(const cv::Mat& z, const cv::Mat& blurred,
+    const cv::Mat& bilateral, const cv::Mat& prevBlurred, float q,
+    cv::Mat& x, cv::Mat& p, cv::Mat& k, cv::Mat& r) {
+    CV_Assert(z.type() == CV_32F && blurred.type() == CV_32F &&
+        bilateral.type() == CV_32F && prevBlurred.type() == CV_32F);
+    CV_Assert(x.type() == CV_32F && p.type() == CV_32F &&
+        k.type() == CV_32F && r.type() == CV_32F);
+    CV_Assert(z.size() == blurred.size() && z.size() == bilateral.size() &&
+        z.size() == prevBlurred.size() && z.size() == x.size() &&
+        z.size() == p.size() && z.size() == k.size() && z.size() == r.size());
+
+    const int width = z.cols;
+
+    for (int row = 0; row < z.rows; ++row) {
+        const float* zRow = z.ptr<float>(row);
+        const float* bRow = blurred.ptr<float>(row);
+        const float* bfRow = bilateral.ptr<float>(row);
+        const float* bpRow = prevBlurred.ptr<float>(row);
+        float* xRow = x.ptr<float>(row);
+        float* pRow = p.ptr<float>(row);
+        float* kRow = k.ptr<float>(row);
+        float* rRow = r.ptr<float>(row);
+
+        int col = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+        const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+        const cv::v_float32 vOne = cv::vx_setall_f32(1.0f);
+        const cv::v_float32 vQ = cv::vx_setall_f32(q);
+
+        for (; col <= width - lanes; col += lanes) {
+            cv::v_float32 vx = cv::vx_load(xRow + col);
+            cv::v_float32 vk = cv::vx_load(kRow + col);
+            cv::v_float32 vr = cv::vx_load(rRow + col);
+            cv::v_float32 vDelta = cv::v_sub(cv::vx_load(bpRow + col),
+                cv::vx_load(bRow + col));
+
+            vr = cv::v_add(vOne,
+                cv::v_mul(vr, cv::v_div(vOne, cv::v_add(vOne, vk))));
+            cv::v_float32 vPred = cv::v_muladd(cv::v_mul(vQ, vDelta), vDelta,
+                cv::vx_load(pRow + col));
+            vk = cv::v_div(vPred, cv::v_add(vPred, vr));
+            cv::v_float32 vOneMinusK = cv::v_sub(vOne, vk);
+
+            cv::v_float32 vState = cv::v_muladd(vk,
+                cv::v_sub(cv::vx_load(zRow + col), vx), vx);
+            vx = cv::v_muladd(vOneMinusK, vState,
+                cv::v_mul(vk, cv::vx_load(bfRow + col)));
+
+            cv::v_store(xRow + col, vx);
+            cv::v_store(pRow + col, cv::v_mul(vPred, vOneMinusK));
+            cv::v_store(kRow + col, vk);
+            cv::v_store(rRow + col, vr);
+        }
+#endif
+        for (; col < width; ++col) {
+            const float delta = bpRow[col] - bRow[col];
+            const float rNew = 1.0f + rRow[col] * (1.0f / (1.0f + kRow[col]));
+            const float pPred = pRow[col] + q * delta * delta;
+            const float kNew = pPred / (pPred + rNew);
+            const float xPred = xRow[col];
+
+            xRow[col] = (1.0f - kNew) * (xPred + kNew * (zRow[col] - xPred)) +
+                kNew * bfRow[col];
+            pRow[col] = pPred * (1.0f - kNew);
+            kRow[col] = kNew;
+            rRow[col] = rNew;
+        }
+    }
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    cv::vx_cleanup();
+#endif
+}
+
+void kalmanUpdateCompact(const cv::Mat& z, const cv::Mat& blurred,
+    const cv::Mat& bilateral, float q, cv::Mat& prevBlurred,
+    cv::Mat& x, cv::Mat& p, cv::Mat& k, cv::Mat& r) {
+    CV_Assert(z.type() == CV_32F && blurred.type() == CV_32F &&
+        bilateral.type() == CV_32F);
+    CV_Assert(prevBlurred.type() == CV_16U && x.type() == CV_16U &&
+        p.type() == CV_16F && k.type() == CV_16F && r.type() == CV_16F);
+    CV_Assert(z.size() == blurred.size() && z.size() == bilateral.size() &&
+        z.size() == prevBlurred.size() && z.size() == x.size() &&
+        z.size() == p.size() && z.size() == k.size() && z.size() == r.size());
+
+    const int width = z.cols;
+
+    for (int row = 0; row < z.rows; ++row) {
+        const float* zRow = z.ptr<float>(row);
+        const float* bRow = blurred.ptr<float>(row);
+        const float* bfRow = bilateral.ptr<float>(row);
+        ushort* bpRow = prevBlurred.ptr<ushort>(row);
+        ushort* xRow = x.ptr<ushort>(row);
+        cv::float16_t* pRow = p.ptr<cv::float16_t>(row);
+        cv::float16_t* kRow = k.ptr<cv::float16_t>(row);
+        cv::float16_t* rRow = r.ptr<cv::float16_t>(row);
+
+        int col = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+        const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+        const cv::v_float32 vOne = cv::vx_setall_f32(1.0f);
+        const cv::v_float32 vQ = cv::vx_setall_f32(q);
+        const cv::v_float32 vUnit = cv::vx_setall_f32(kFixedPointUnit);
+        const cv::v_float32 vScale = cv::vx_setall_f32(kFixedPointScale);
+        auto loadFixed = [&](const ushort* ptr) {
+            return cv::v_mul(cv::v_cvt_f32(cv::v_reinterpret_as_s32(
+                cv::vx_load_expand(ptr))), vUnit);
+        };
+
+        for (; col <= width - lanes; col += lanes) {
+            cv::v_float32 vx = loadFixed(xRow + col);
+            cv::v_float32 vk = cv::vx_load_expand(kRow + col);
+            cv::v_float32 vr = cv::vx_load_expand(rRow + col);
+            const cv::v_float32 vBlurred = cv::vx_load(bRow + col);
+            cv::v_float32 vDelta = cv::v_sub(loadFixed(bpRow + col), vBlurred);
+
+            vr = cv::v_add(vOne,
+                cv::v_mul(vr, cv::v_div(vOne, cv::v_add(vOne, vk))));
+            cv::v_float32 vPred = cv::v_muladd(cv::v_mul(vQ, vDelta), vDelta,
+                cv::vx_load_expand(pRow + col));
+            vk = cv::v_div(vPred, cv::v_add(vPred, vr));
+            cv::v_float32 vOneMinusK = cv::v_sub(vOne, vk);
+
+            cv::v_float32 vState = cv::v_muladd(vk,
+                cv::v_sub(cv::vx_load(zRow + col), vx), vx);
+            vx = cv::v_muladd(vOneMinusK, vState,
+                cv::v_mul(vk, cv::vx_load(bfRow + col)));
+
+            cv::v_pack_u_store(xRow + col, cv::v_round(cv::v_mul(vx, vScale)));
+            cv::v_pack_u_store(bpRow + col,
+                cv::v_round(cv::v_mul(vBlurred, vScale)));
+            cv::v_pack_store(pRow + col, cv::v_mul(vPred, vOneMinusK));
+            cv::v_pack_store(kRow + col, vk);
+            cv::v_pack_store(rRow + col, vr);
+        }
+#endif
+        for (; col < width; ++col) {
+            const float delta = fromFixedPoint(bpRow[col]) - bRow[col];
+            const float kOld = static_cast<float>(kRow[col]);
+            const float rNew = 1.0f + static_cast<float>(rRow[col]) *
+                (1.0f / (1.0f + kOld));
+            const float pPred = static_cast<float>(pRow[col]) + q * delta * delta;
+            const float kNew = pPred / (pPred + rNew);
+            const float xPred = fromFixedPoint(xRow[col]);
+
+            xRow[col] = toFixedPoint((1.0f - kNew) *
+                (xPred + kNew * (zRow[col] - xPred)) + kNew * bfRow[col]);
+            bpRow[col] = toFixedPoint(bRow[col]);
+            pRow[col] = cv::float16_t(pPred * (1.0f - kNew));
+            kRow[col] = cv::float16_t(kNew);
+            rRow[col] = cv::float16_t(rNew);
+        }
+    }
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    cv::vx_cleanup();
+#endif
+}
+
+void kalmanUpdateReference(const cv::Mat& z, const cv::Mat& blurred,
+    const cv::Mat& bilateral, const cv::Mat& prevBlurred, float q,
+    cv::Mat& x, cv::Mat& p, cv::Mat& k, cv::Mat& r) {
+    cv::Mat delta = prevBlurred - blurred;
+
+    r = 1.0f + (r).mul(1.0f / (1.0f + k));
+
+    // Prediction step
+    cv::Mat xPredicted = x.clone();
+    cv::Mat pPredicted = p + q * delta.mul(delta);
+
+    // Update step - Kalman gain
+    k = pPredicted / (pPredicted + r);
+
+    // Final correction step combining Kalman and bilateral results
+    x = (1.0f - k).mul(xPredicted + k.mul(z - xPredicted)) + k.mul(bilateral);
+    p = pPredicted.mul(1.0f - k);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+
+// Selects how STKMBCpu applies the per-pixel Kalman recursion
+enum class KalmanUpdate {
+    Fused,     // Single SIMD pass over all planes (default)
+    Reference  // Original chain of whole-frame cv::Mat expressions
+};
+
+// Selects how STKMBCpu stores its per-pixel state and frame history
+enum class StatePrecision {
+    Float32, // Every plane CV_32F (default)
+    Compact  // x, blurred and history as Q8.8 CV_16U, P, K and R as CV_16F
+};
+
+// One fused pass of the STKMB Kalman recursion. For every pixel it reads the
+// measurement z(k), the blurred measurement, the bilateral output and the
+// previous state, and writes the new state in place:
+//
+//   R(k)     = 1 + R(k-1) / (1 + K(k-1))
+//   P(k|k-1) = P(k-1|k-1) + q * (blurred(k-1) - blurred(k))^2
+//   K(k)     = P(k|k-1) / (P(k|k-1) + R(k))
+//   x(k|k)   = (1 - K) * (x + K * (z - x)) + K * BF(z)
+//   P(k|k)   = P(k|k-1) * (1 - K)
+//
+// All planes are CV_32F and of the same size. prevBlurred is only read; the
+// caller swaps it with blurred afterwards.
+void kalmanUpdateFused(const cv::Mat& z, const cv::Mat& blurred,
+    const cv::Mat& bilateral, const cv::Mat& prevBlurred, float q,
+    cv::Mat& x, cv::Mat& p, cv::Mat& k, cv::Mat& r);
+
+// Same recursion written as whole-frame cv::Mat expressions, as it was before
+// the fused kernel. Kept for validation and benchmarking.
+void kalmanUpdateReference(const cv::Mat& z, const cv::Mat& blurred,
+    const cv::Mat& bilateral, const cv::Mat& prevBlurred, float q,
+    cv::Mat& x, cv::Mat& p, cv::Mat& k, cv::Mat& r);
+
+// kalmanUpdateFused on compact state: x and prevBlurred are Q8.8 CV_16U (see
+// fixed_point.hpp), p, k and r CV_16F, while z, blurred and bilateral are the
+// CV_32F planes of the current frame. Values are widened to float for the
+// arithmetic and rounded back once per pixel. prevBlurred is replaced by
+// blurred in the same pass.
+void kalmanUpdateCompact(const cv::Mat& z, const cv::Mat& blurred,
+    const cv::Mat& bilateral, float q, cv::Mat& prevBlurred,
+    cv::Mat& x, cv::Mat& p, cv::Mat& k, cv::Mat& r);
@@ -1,41 +1,508 @@
+#include "autotune.hpp"
+#include "denoiser_registry.hpp"
+#include "frame_store.hpp"
+#include "profiler.hpp"
+#include "segment_processor.hpp"
 #include "video_processor.hpp"
+#include <cstdlib>
 #include <filesystem>
+#include <iomanip>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <chrono>
 
+namespace {
+
+    void printUsage(const char* argv0) {
+        std::cerr << "Usage: " << std::filesystem::path(argv0).filename().string()
+            << " <video_path> [--backend auto|<name>] [--threads N]"
+            " [--queue-depth N] [--compact-state] [--fast-bilateral levels]\n"
+            "       [--color bgr|luma|yuv|yuv-chroma] [--sparse] [--motion]\n"
+            "       [--faces cascade.xml [--face-interval N] [--face-async]]\n"
+            "       [--deadline ms] [--tuning-profiles file [--noise N]]\n"
+            "       [--input-format video|y4m|gray|store] [--size WxH] [--fps N]\n"
+            "       [--start N] [--frames N] [--segments N [--warmup N]"
+            " [--verify-segments]\n"
+            "       [--segment-dir dir]]\n"
+            "       [--output path|-] [--output-format video|y4m|gray|store]\n"
+            "       [--checkpoint state.ckpt [--checkpoint-every N] [--resume]]\n"
+            "       [--profile report.json] [--trace trace.json"
+            " [--trace-frames N]]\n"
+            << "       " << std::filesystem::path(argv0).filename().string()
+            << " --list-backends\n"
+            << "       " << std::filesystem::path(argv0).filename().string()
+            << " <video_path> --make-store clip.stkraw [--color luma]\n"
+            << "       " << std::filesystem::path(argv0).filename().string()
+            << " <video_path> --autotune profiles.txt [--noise N] [--frames N]"
+            " [--min-psnr dB]\n                [--threads N]"
+            << std::endl;
+        std::cerr << "A video_path or output of '-' is stdin or stdout. Y4M"
+            " (the default for '-' and *.y4m)\nand raw gray streams bypass"
+            " the codec; raw gray input needs --size. Frame stores\n(*.stkraw)"
+            " hold decoded gray or I420 frames for repeated runs. --segments"
+            " splits\na seekable input across engines run concurrently,"
+            " staging all but the first\nsegment in --segment-dir (the temp"
+            " directory by default). --resume continues an\ninterrupted job"
+            " from its checkpoint;"
+            " pass the same options again. --deadline\nlowers the quality"
+            " to keep every frame within the budget and drops frames\nwhen"
+            " even the lowest level cannot.\n--autotune searches the CPU"
+            " settings on a sample of the input with noise N\nadded (10 by"
+            " default) and saves the fastest within 0.5 dB of the best PSNR\n"
+            "(or reaching --min-psnr) as the profile for its size and noise."
+            " --tuning-profiles\napplies the profile closest to the input,"
+            " whose noise is estimated unless\n--noise pins it (do so with"
+            " --segments or --resume so every segment agrees).\n";
+    }
+
+    void listBackends() {
+        for (const auto& backend : DenoiserRegistry::instance().backends()) {
+            std::cout << "  " << backend.name
+                << (backend.available() ? "" : " (not available)") << ": "
+                << backend.description << "\n";
+        }
+        std::cout.flush();
+    }
+
+    bool parseColorMode(const std::string& name, ColorMode& mode) {
+        static const std::pair<const char*, ColorMode> modes[] = {
+            { "bgr", ColorMode::Bgr },
+            { "luma", ColorMode::Luma },
+            { "yuv", ColorMode::Yuv },
+            { "yuv-chroma", ColorMode::YuvChroma },
+        };
+        for (const auto& [modeName, value] : modes) {
+            if (name == modeName) {
+                mode = value;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool parseStreamFormat(const std::string& name, StreamFormat& format) {
+        static const std::pair<const char*, StreamFormat> formats[] = {
+            { "auto", StreamFormat::Auto },
+            { "video", StreamFormat::Video },
+            { "y4m", StreamFormat::Y4m },
+            { "gray", StreamFormat::Gray },
+            { "store", StreamFormat::Store },
+        };
+        for (const auto& [formatName, value] : formats) {
+            if (name == formatName) {
+                format = value;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Search the CPU settings on the first frames of the input and save the
+    // choice as the profile for its size and noise level
+    void autotuneInput(const std::string& videoPath,
+        const StreamOptions& streams, const DenoiserOptions& options,
+        const std::string& profilePath, double minPsnr) {
+        auto source = openFrameSource(videoPath, streams.inputFormat,
+            streams.rawSize, streams.rawFps);
+        if (streams.startFrame > 0 && !source->seek(streams.startFrame)) {
+            throw std::runtime_error("Cannot seek to the start frame");
+        }
+        const int frames = streams.frameLimit > 0 ? streams.frameLimit : 30;
+        std::vector<cv::Mat> clip;
+        cv::Mat frame;
+        while (static_cast<int>(clip.size()) < frames && source->read(frame)) {
+            cv::Mat gray;
+            convertFrame(frame, source->info().format, gray, FrameFormat::Gray);
+            clip.push_back(gray);
+        }
+        if (clip.size() < 2) {
+            throw std::runtime_error("Autotuning needs at least two frames");
+        }
+
+        AutotuneOptions tuning;
+        tuning.noiseStd = options.noiseLevel > 0.0f ? options.noiseLevel
+            : 10.0f;
+        tuning.threads = options.threads;
+        tuning.minPsnr = minPsnr;
+        const cv::Size size = clip.front().size();
+        std::cout << "Autotuning " << size.width << "x" << size.height
+            << ", " << clip.size() << " frames, noise " << tuning.noiseStd
+            << std::endl;
+        const AutotuneReport report = autotune(clip, options, tuning);
+
+        std::cout << report.results.size() << " candidates, noise estimated"
+            " at " << std::fixed << std::setprecision(1)
+            << report.measuredNoise << "; Pareto front (dB, SSIM, frames/s):"
+            << std::endl;
+        for (size_t i = 0; i < report.results.size(); ++i) {
+            const TuningResult& result = report.results[i];
+            if (!result.pareto) {
+                continue;
+            }
+            std::cout << (static_cast<int>(i) == report.chosen ? "* " : "  ")
+                << std::setprecision(2) << result.psnr << "  "
+                << std::setprecision(4) << result.ssim << "  "
+                << std::setprecision(1) << std::setw(6) << result.fps << "  "
+                << result.settings.describe() << std::endl;
+        }
+        std::cout.unsetf(std::ios::floatfield);
+
+        const TuningResult& chosen = report.results[report.chosen];
+        TuningProfile profile;
+        profile.size = size;
+        // Keyed the way init() looks it up: by the given noise level, or
+        // else by the estimate, which also counts the clip's own noise
+        profile.noise = options.noiseLevel > 0.0f ? options.noiseLevel
+            : report.measuredNoise;
+        profile.settings = chosen.settings;
+        profile.psnr = chosen.psnr;
+        profile.ssim = chosen.ssim;
+        profile.fps = chosen.fps;
+        saveTuningProfile(profilePath, profile);
+        std::cout << "Profile for " << size.width << "x" << size.height
+            << " noise " << profile.noise << " saved to " << profilePath
+            << std::endl;
+    }
+
+    // "WxH"
+    bool parseSize(const std::string& text, cv::Size& size) {
+        const size_t x = text.find('x');
+        if (x == std::string::npos) {
+            return false;
+        }
+        size = cv::Size(std::atoi(text.substr(0, x).c_str()),
+            std::atoi(text.substr(x + 1).c_str()));
+        return size.width > 0 && size.height > 0;
+    }
+
+} // namespace
+
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << std::filesystem::path(argv[0]).filename().string()
-            << " <video_path>" << std::endl;
+    std::string video_path;
+    std::string backendName = "auto";
+    DenoiserOptions options;
+    int queueDepth = 4;
+    bool queueDepthSet = false;
+    ColorMode colorMode = ColorMode::Bgr;
+    StreamOptions streams;
+    std::string storePath;
+    std::string autotunePath;
+    double minPsnr = 0.0;
+    std::string profilePath;
+    std::string tracePath;
+    int traceFrames = 100;
+    CheckpointOptions checkpoints;
+    DeadlineOptions deadline;
+    SegmentOptions segmentOptions;
+    segmentOptions.segments = 1;
+
+    // std::stoi and friends throw on a value that is not a number or out
+    // of range; argv[i] is that value then
+    int i = 1;
+    try {
+        for (; i < argc; ++i) {
+            const std::string arg{ argv[i] };
+            const bool hasValue = i + 1 < argc;
+            if (arg == "--list-backends") {
+                listBackends();
+                return EXIT_SUCCESS;
+            }
+            else if (arg == "--backend" && hasValue) {
+                backendName = argv[++i];
+            }
+            else if (arg == "--threads" && hasValue) {
+                options.threads = std::stoi(argv[++i]);
+            }
+            else if (arg == "--color" && hasValue &&
+                parseColorMode(argv[i + 1], colorMode)) {
+                ++i;
+            }
+            else if (arg == "--input-format" && hasValue &&
+                parseStreamFormat(argv[i + 1], streams.inputFormat)) {
+                ++i;
+            }
+            else if (arg == "--output-format" && hasValue &&
+                parseStreamFormat(argv[i + 1], streams.outputFormat)) {
+                ++i;
+            }
+            else if (arg == "--size" && hasValue &&
+                parseSize(argv[i + 1], streams.rawSize)) {
+                ++i;
+            }
+            else if (arg == "--fps" && hasValue) {
+                streams.rawFps = std::stod(argv[++i]);
+            }
+            else if (arg == "--start" && hasValue) {
+                streams.startFrame = std::stoi(argv[++i]);
+            }
+            else if (arg == "--frames" && hasValue) {
+                streams.frameLimit = std::stoi(argv[++i]);
+            }
+            else if (arg == "--segments" && hasValue) {
+                segmentOptions.segments = std::stoi(argv[++i]);
+            }
+            else if (arg == "--warmup" && hasValue) {
+                segmentOptions.warmupFrames = std::stoi(argv[++i]);
+            }
+            else if (arg == "--verify-segments") {
+                segmentOptions.verify = true;
+            }
+            else if (arg == "--segment-dir" && hasValue) {
+                segmentOptions.temporaryDirectory = argv[++i];
+            }
+            else if (arg == "--checkpoint" && hasValue) {
+                checkpoints.path = argv[++i];
+            }
+            else if (arg == "--checkpoint-every" && hasValue) {
+                checkpoints.interval = std::stoi(argv[++i]);
+            }
+            else if (arg == "--resume") {
+                checkpoints.resume = true;
+            }
+            else if (arg == "--make-store" && hasValue) {
+                storePath = argv[++i];
+            }
+            else if (arg == "--autotune" && hasValue) {
+                autotunePath = argv[++i];
+            }
+            else if (arg == "--min-psnr" && hasValue) {
+                minPsnr = std::stod(argv[++i]);
+            }
+            else if (arg == "--tuning-profiles" && hasValue) {
+                options.tuningProfiles = argv[++i];
+            }
+            else if (arg == "--noise" && hasValue) {
+                options.noiseLevel = std::stof(argv[++i]);
+            }
+            else if (arg == "--output" && hasValue) {
+                streams.outputPath = argv[++i];
+            }
+            else if (arg == "--fast-bilateral" && hasValue) {
+                options.bilateralLevels = std::stoi(argv[++i]);
+            }
+            else if (arg == "--sparse") {
+                options.sparse = true;
+            }
+            else if (arg == "--motion") {
+                options.motion = true;
+            }
+            else if (arg == "--faces" && hasValue) {
+                options.faceCascade = argv[++i];
+            }
+            else if (arg == "--face-interval" && hasValue) {
+                options.faceInterval = std::stoi(argv[++i]);
+            }
+            else if (arg == "--face-async") {
+                options.faceBackground = true;
+            }
+            else if (arg == "--compact-state") {
+                options.compactState = true;
+            }
+            else if (arg == "--deadline" && hasValue) {
+                deadline.budgetMs = std::stod(argv[++i]);
+            }
+            else if (arg == "--queue-depth" && hasValue) {
+                queueDepth = std::stoi(argv[++i]);
+                queueDepthSet = true;
+            }
+            else if (arg == "--profile" && hasValue) {
+                profilePath = argv[++i];
+            }
+            else if (arg == "--trace" && hasValue) {
+                tracePath = argv[++i];
+            }
+            else if (arg == "--trace-frames" && hasValue) {
+                traceFrames = std::stoi(argv[++i]);
+            }
+            else if (video_path.empty() &&
+                (arg == "-" || arg.rfind("--", 0) != 0)) {
+                video_path = arg;
+            }
+            else {
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    catch (const std::logic_error&) {
+        std::cerr << "Error: invalid value '" << argv[i] << "'" << std::endl;
+        printUsage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    const std::string video_path{ argv[1] };
+    if (video_path.empty() || (checkpoints.resume && checkpoints.path.empty())) {
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    // Quality levels change the engine layout, and segments run offline
+    if (deadline.budgetMs > 0.0 &&
+        (!checkpoints.path.empty() || segmentOptions.segments > 1)) {
+        std::cerr << "Error: --deadline cannot be combined with --checkpoint"
+            " or --segments" << std::endl;
+        return EXIT_FAILURE;
+    }
+    // Segments run without the frame pipeline and its queue
+    if (queueDepthSet && segmentOptions.segments > 1) {
+        std::cerr << "Error: --queue-depth cannot be combined with --segments"
+            << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!segmentOptions.temporaryDirectory.empty() &&
+        segmentOptions.segments <= 1) {
+        std::cerr << "Error: --segment-dir needs --segments 2 or more"
+            << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (segmentOptions.verify && segmentOptions.segments <= 1) {
+        std::cerr << "Error: --verify-segments needs --segments 2 or more"
+            << std::endl;
+        return EXIT_FAILURE;
+    }
+    // Segments start from fresh engines and have nothing to resume from
+    if (!checkpoints.path.empty() && segmentOptions.segments > 1) {
+        std::cerr << "Error: --checkpoint cannot be combined with --segments"
+            << std::endl;
+        return EXIT_FAILURE;
+    }
+    // Background detections land on whichever frame is current when they
+    // finish, so such runs cannot be resumed or reproduced exactly
+    if (options.faceBackground && (!checkpoints.path.empty() ||
+        segmentOptions.verify)) {
+        std::cerr << "Error: --face-async cannot be combined with --checkpoint"
+            " or --verify-segments" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!checkpoints.path.empty() && checkpoints.interval <= 0) {
+        checkpoints.interval = 500;
+    }
 
-    if (!std::filesystem::exists(video_path)) {
+    if (video_path != "-" && !std::filesystem::exists(video_path)) {
         std::cerr << "Error: File '" << video_path << "' does not exist"
             << std::endl;
         return EXIT_FAILURE;
     }
 
-    if (cv::cuda::getCudaEnabledDeviceCount() < 1) {
-        std::cout << "No CUDA devices found" << std::endl;
-        return EXIT_FAILURE;
+    // Decode once into a frame store: luma keeps the Y plane, any other mode
+    // the full I420 frame
+    if (!storePath.empty()) {
+        try {
+            auto source = openFrameSource(video_path, streams.inputFormat,
+                streams.rawSize, streams.rawFps);
+            const int frames = writeFrameStore(*source, storePath,
+                colorMode == ColorMode::Luma ? FrameFormat::Gray
+                : FrameFormat::I420);
+            std::cout << frames << " frames written to " << storePath
+                << std::endl;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // Tune the CPU engine on the input instead of processing it
+    if (!autotunePath.empty()) {
+        try {
+            autotuneInput(video_path, streams, options, autotunePath, minPsnr);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // With frames going to stdout every message goes to stderr instead
+    if (streams.outputPath == "-") {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
+    // Stage timers stay off unless a report or a trace was requested
+    if (!profilePath.empty() || !tracePath.empty()) {
+        Profiler::setEnabled(true);
+        Profiler::setTraceFrames(tracePath.empty() ? 0 : traceFrames);
     }
+    auto writeProfile = [&] {
+        Profiler::setEnabled(false);
+        try {
+            if (!profilePath.empty()) {
+                Profiler::writeReport(profilePath);
+                std::cout << "Stage profile written to " << profilePath
+                    << std::endl;
+            }
+            if (!tracePath.empty()) {
+                Profiler::writeChromeTrace(tracePath);
+                std::cout << "Chrome trace written to " << tracePath
+                    << std::endl;
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    };
 
-    std::cout << "Enabled CUDA devices: " << cv::cuda::getCudaEnabledDeviceCount()
-        << std::endl;
+    // Without a CUDA device, or with options only the CPU engine has, "auto"
+    // falls back to the CPU engine
+    if (segmentOptions.segments > 1) {
+        try {
+            SegmentProcessor processor(video_path, streams, colorMode,
+                [&] {
+                    return DenoiserRegistry::instance().create(backendName,
+                        options);
+                },
+                segmentOptions);
+            const SegmentReport report = processor.process();
+            std::cout << report.frames << " frames in " << report.segments
+                << " segments: " << report.segmentSeconds * 1000.0
+                << " ms processing, " << report.stitchSeconds * 1000.0
+                << " ms stitching" << std::endl;
+            for (const SegmentBoundary& boundary : report.boundaries) {
+                std::cout << "  boundary at frame " << boundary.frame
+                    << ": max diff " << boundary.firstDiff << ", "
+                    << boundary.windowDiff << " over the warm-up window"
+                    << std::endl;
+            }
+            if (segmentOptions.verify) {
+                std::cout << "Serial: " << report.serialSeconds * 1000.0
+                    << " ms, speedup " << report.speedup() << "x" << std::endl;
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        return writeProfile() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    cv::cuda::setDevice(0);
-    std::cout << "Chosen device: --------------------> "
-        << cv::cuda::DeviceInfo(cv::cuda::getDevice()).name() << std::endl;
+    std::unique_ptr<Denoiser> denoiser;
+    try {
+        denoiser = DenoiserRegistry::instance().create(backendName, options);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        listBackends();
+        return EXIT_FAILURE;
+    }
 
     std::chrono::steady_clock::time_point begin =
         std::chrono::steady_clock::now();
 
-    VideoProcessor processor(video_path, false);
-    processor.process();
+    try {
+        VideoProcessor processor(video_path, std::move(denoiser), queueDepth,
+            colorMode, streams, checkpoints, deadline);
+        processor.process();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
     std::cout << "Time difference = "
         << std::chrono::duration_cast<std::chrono::milliseconds>(end -
@@ -43,5 +510,5 @@ int main(int argc, char* argv[]) {
         .count()
         << "[ms]" << std::endl;
 
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+    return writeProfile() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
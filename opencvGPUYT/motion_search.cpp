@@ -0,0 +1,215 @@
+#include "motion_search.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+    // dst = rounded mean of every 2x2 block of src
+    void downsample(const cv::Mat& src, cv::Mat& dst) {
+        for (int y = 0; y < dst.rows; ++y) {
+            const uchar* top = src.ptr(2 * y);
+            const uchar* bottom = src.ptr(2 * y + 1);
+            uchar* out = dst.ptr(y);
+            for (int x = 0; x < dst.cols; ++x) {
+                out[x] = static_cast<uchar>((top[2 * x] + top[2 * x + 1] +
+                    bottom[2 * x] + bottom[2 * x + 1] + 2) >> 2);
+            }
+        }
+    }
+
+} // namespace
+
+MotionSearch::MotionSearch(const cv::Size& frameSize, int blockSize,
+    int levels, int range)
+    : blockSize_(blockSize), sad_(blockSadKernel(blockSize)), range_(range),
+    lambda_(blockSize * blockSize / 16.0f) {
+    CV_Assert(blockSize > 0 && levels > 0 && range > 0 &&
+        frameSize.area() > 0);
+
+    // Every level keeps at least one whole block
+    int count = 1;
+    while (count < levels &&
+        std::min(frameSize.width, frameSize.height) >> count >= blockSize) {
+        ++count;
+    }
+    current_.resize(count);
+    reference_.resize(count);
+    vectors_.resize(count);
+    for (int l = 0; l < count; ++l) {
+        const cv::Size size(frameSize.width >> l, frameSize.height >> l);
+        if (l > 0) {
+            current_[l].create(size, CV_8U);
+            reference_[l].create(size, CV_8U);
+        }
+        vectors_[l] = cv::Mat::zeros(size.height / blockSize,
+            size.width / blockSize, CV_32SC2);
+    }
+    previous_ = vectors_.front().clone();
+}
+
+void MotionSearch::estimate(const cv::Mat& current, const cv::Mat& reference,
+    ThreadPool* pool) {
+    const cv::Size size(vectors_.front().cols * blockSize_,
+        vectors_.front().rows * blockSize_);
+    CV_Assert(current.type() == CV_8UC1 && reference.type() == CV_8UC1 &&
+        current.size() == reference.size() && current.cols >= size.width &&
+        current.rows >= size.height);
+
+    current_.front() = current;
+    reference_.front() = reference;
+    for (size_t l = 1; l < current_.size(); ++l) {
+        downsample(current_[l - 1], current_[l]);
+        downsample(reference_[l - 1], reference_[l]);
+    }
+
+    // Coarse to fine; the rows of one level only depend on the level above
+    for (int l = levels() - 1; l >= 0; --l) {
+        const int rows = vectors_[l].rows;
+        if (pool && rows > 1) {
+            pool->parallelFor(rows, [&](int row) { searchRow(l, row); });
+        }
+        else {
+            for (int row = 0; row < rows; ++row) {
+                searchRow(l, row);
+            }
+        }
+    }
+
+    vectors_.front().copyTo(previous_);
+    still_ = cv::countNonZero(previous_.reshape(1)) == 0;
+
+    // Drop the references to the caller's frames
+    current_.front().release();
+    reference_.front().release();
+}
+
+void MotionSearch::searchRow(int level, int row) {
+    const cv::Mat& current = current_[level];
+    const cv::Mat& reference = reference_[level];
+    const int maxX = reference.cols - blockSize_;
+    const int maxY = reference.rows - blockSize_;
+    const bool coarsest = level + 1 == levels();
+    const cv::Mat* parent = coarsest ? nullptr : &vectors_[level + 1];
+    cv::Point* out = vectors_[level].ptr<cv::Point>(row);
+    const int y = row * blockSize_;
+
+    for (int column = 0; column < vectors_[level].cols; ++column) {
+        const int x = column * blockSize_;
+        const uchar* block = current.ptr(y) + x;
+
+        cv::Point best(0, 0);
+        float bestCost = static_cast<float>(sad_(block, current.step,
+            reference.ptr(y) + x, reference.step, blockSize_));
+        auto consider = [&](int dx, int dy) {
+            if (x + dx < 0 || x + dx > maxX || y + dy < 0 || y + dy > maxY) {
+                return FLT_MAX;
+            }
+            const float cost = sad_(block, current.step,
+                reference.ptr(y + dy) + x + dx, reference.step, blockSize_) +
+                lambda_ * (std::abs(dx) + std::abs(dy));
+            if (cost < bestCost) {
+                bestCost = cost;
+                best = cv::Point(dx, dy);
+            }
+            return cost;
+        };
+
+        // Predictors: the parent and its four neighbours, which carry
+        // vectors across parents that fell into a wrong minimum
+        cv::Point fromParent = best;
+        float fromParentCost = FLT_MAX;
+        if (parent) {
+            const int parentRow = std::min(row / 2, parent->rows - 1);
+            const int parentColumn = std::min(column / 2, parent->cols - 1);
+            static const cv::Point offsets[] = {
+                { 0, 0 }, { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 }
+            };
+            for (const cv::Point& offset : offsets) {
+                const int r = parentRow + offset.y;
+                const int c = parentColumn + offset.x;
+                if (r >= 0 && r < parent->rows && c >= 0 && c < parent->cols) {
+                    const cv::Point up = parent->ptr<cv::Point>(r)[c];
+                    const float cost = consider(2 * up.x, 2 * up.y);
+                    if (cost < fromParentCost) {
+                        fromParentCost = cost;
+                        fromParent = cv::Point(2 * up.x, 2 * up.y);
+                    }
+                }
+            }
+        }
+        if (column > 0) {
+            consider(out[column - 1].x, out[column - 1].y);
+        }
+        const cv::Point last = previous_.ptr<cv::Point>(
+            std::min(row << level, previous_.rows - 1))[
+                std::min(column << level, previous_.cols - 1)];
+        consider(last.x >> level, last.y >> level);
+
+        // Refinement around the best predictor. A scaled parent vector is up
+        // to a pixel off, so it can lose to a stale predictor that is merely
+        // close on noise; the best parent is refined as well.
+        const int radius = coarsest ? range_ : 1;
+        const cv::Point centers[] = { best, fromParent };
+        const int centerCount = parent && fromParent != best ? 2 : 1;
+        for (int i = 0; i < centerCount; ++i) {
+            for (int dy = -radius; dy <= radius; ++dy) {
+                for (int dx = -radius; dx <= radius; ++dx) {
+                    if (dx != 0 || dy != 0) {
+                        consider(centers[i].x + dx, centers[i].y + dy);
+                    }
+                }
+            }
+        }
+        out[column] = best;
+    }
+}
+
+void MotionSearch::saveState(StateWriter& state) const {
+    state.plane(previous_);
+}
+
+void MotionSearch::restoreState(StateReader& state) {
+    state.plane(previous_);
+}
+
+void compensateMotion(const cv::Mat& src, cv::Mat& dst, const cv::Mat& vectors,
+    int blockSize, ThreadPool* pool) {
+    CV_Assert(vectors.type() == CV_32SC2 && blockSize > 0);
+    dst.create(src.size(), src.type());
+    CV_Assert(dst.data != src.data);
+    if (vectors.empty()) {
+        src.copyTo(dst);
+        return;
+    }
+
+    const size_t elemSize = src.elemSize();
+    const int rows = (src.rows + blockSize - 1) / blockSize;
+    const int columns = (src.cols + blockSize - 1) / blockSize;
+    auto body = [&](int by) {
+        const int y = by * blockSize;
+        const int height = std::min(blockSize, src.rows - y);
+        const cv::Point* row = vectors.ptr<cv::Point>(
+            std::min(by, vectors.rows - 1));
+        for (int bx = 0; bx < columns; ++bx) {
+            const int x = bx * blockSize;
+            const int width = std::min(blockSize, src.cols - x);
+            const cv::Point v = row[std::min(bx, vectors.cols - 1)];
+            const int sx = std::clamp(x + v.x, 0, src.cols - width);
+            const int sy = std::clamp(y + v.y, 0, src.rows - height);
+            for (int i = 0; i < height; ++i) {
+                std::memcpy(dst.ptr(y + i) + x * elemSize,
+                    src.ptr(sy + i) + sx * elemSize, width * elemSize);
+            }
+        }
+    };
+    if (pool && rows > 1) {
+        pool->parallelFor(rows, body);
+    }
+    else {
+        for (int by = 0; by < rows; ++by) {
+            body(by);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "block_kernels.hpp"
+#include "engine_state.hpp"
+#include "thread_pool.hpp"
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Block motion estimation between two 8-bit gray frames of a fixed size.
+//
+// Both frames are reduced to a pyramid of 2x2 means. Blocks keep their pixel
+// size on every level, so a block of level l covers 2^l times the area of
+// one at full resolution and sits over four blocks of level l - 1. Each
+// level starts from a few predictors: the zero vector, the vectors of the
+// parent block and its neighbours scaled up, the left neighbour's vector and
+// the block's vector from the previous call. The cheapest is refined by a
+// full search of +-range pixels on the coarsest level and +-1 pixel below
+// it. The cost is the SAD
+// (SIMD for 8- and 16-pixel blocks) plus a small penalty on the vector
+// length, so noise alone does not produce vectors. Block rows of a level are
+// independent and run on the pool when one is given.
+class MotionSearch {
+public:
+    MotionSearch(const cv::Size& frameSize, int blockSize = 8, int levels = 3,
+        int range = 4);
+
+    // Find for every block of current the displacement into reference:
+    // block (bx, by) at (bx, by) * blockSize in current matches the block of
+    // reference at that position plus its vector. Allocates nothing once
+    // constructed.
+    void estimate(const cv::Mat& current, const cv::Mat& reference,
+        ThreadPool* pool = nullptr);
+
+    // Full-resolution vectors of the last estimate(), CV_32SC2 of grid() size
+    const cv::Mat& vectors() const { return vectors_.front(); }
+    cv::Size grid() const { return vectors_.front().size(); }
+    int blockSize() const { return blockSize_; }
+    int levels() const { return static_cast<int>(vectors_.size()); }
+
+    // True when every vector of the last estimate() is zero
+    bool still() const { return still_; }
+
+    // Checkpoint support: the vectors seeding the next estimate()
+    void saveState(StateWriter& state) const;
+    void restoreState(StateReader& state);
+
+private:
+    void searchRow(int level, int row);
+
+    int blockSize_;
+    BlockSadKernel sad_; // Specialised for blockSize_ when there is one
+    int range_;
+    float lambda_; // Cost of one pixel of vector length, in SAD units
+    std::vector<cv::Mat> current_;   // Pyramids, level 0 only referenced
+    std::vector<cv::Mat> reference_;
+    std::vector<cv::Mat> vectors_;   // Per level, CV_32SC2
+    cv::Mat previous_;               // Full-resolution vectors of the last call
+    bool still_ = true;
+};
+
+// Copy src into dst block by block, each block of the vectors' grid taken
+// from src displaced by its vector and clamped to the frame. Rows and columns
+// past the grid follow the nearest block. Any pixel type; dst is reused when
+// it has the size and type of src and must not share its data.
+void compensateMotion(const cv::Mat& src, cv::Mat& dst, const cv::Mat& vectors,
+    int blockSize, ThreadPool* pool = nullptr);
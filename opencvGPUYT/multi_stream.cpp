@@ -0,0 +1,134 @@
+#include "multi_stream.hpp"
+#include "opencv_threads.hpp"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+    int poolSize(int threads) {
+        if (threads < 0) {
+            throw std::invalid_argument("Thread count cannot be negative");
+        }
+        return threads > 0 ? threads
+            : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+
+} // namespace
+
+MultiStreamEngine::MultiStreamEngine(const MultiStreamOptions& options)
+    : options_(options), pool_(poolSize(options.threads)) {
+    CV_Assert(options_.batchPixels > 0 && options_.bilateralLevels >= 0);
+    disableOpenCvThreads();
+}
+
+MultiStreamEngine::~MultiStreamEngine() {
+    restoreOpenCvThreads();
+}
+
+int MultiStreamEngine::addStream(const cv::Mat& firstFrame) {
+    auto stream = std::make_unique<Stream>(firstFrame, options_);
+    if (options_.bilateralLevels > 0) {
+        stream->engine.setBilateral(BilateralMode::Fast,
+            options_.bilateralLevels);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    streams_.push_back(std::move(stream));
+    return static_cast<int>(streams_.size()) - 1;
+}
+
+void MultiStreamEngine::submit(int stream, const cv::Mat& input,
+    cv::Mat& output) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stream < 0 || stream >= static_cast<int>(streams_.size())) {
+        throw std::out_of_range("Unknown stream");
+    }
+    streams_[stream]->pending.push_back({ input, &output });
+}
+
+bool MultiStreamEngine::collectRound() {
+    round_.clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& stream : streams_) {
+        if (!stream->pending.empty()) {
+            round_.push_back({ stream.get(), stream->pending.front() });
+            stream->pending.pop_front();
+        }
+    }
+    return !round_.empty();
+}
+
+int MultiStreamEngine::drain() {
+    const auto begin = std::chrono::steady_clock::now();
+    int frames = 0;
+    while (collectRound()) {
+        const auto area = [](const RoundJob& job) {
+            return static_cast<int64_t>(job.job.input.cols) * job.job.input.rows;
+        };
+        const auto sameSize = [](const RoundJob& a, const RoundJob& b) {
+            return a.job.input.size() == b.job.input.size();
+        };
+
+        // One task per frame, or runs of same-size frames up to batchPixels.
+        // The largest frames go first so they do not finish the round alone.
+        tasks_.clear();
+        if (options_.batching) {
+            std::stable_sort(round_.begin(), round_.end(),
+                [&](const RoundJob& a, const RoundJob& b) {
+                    return area(a) > area(b) || (area(a) == area(b) &&
+                        a.job.input.cols > b.job.input.cols);
+                });
+        }
+        const int count = static_cast<int>(round_.size());
+        for (int first = 0; first < count;) {
+            int last = first + 1;
+            if (options_.batching) {
+                int64_t pixels = area(round_[first]);
+                while (last < count && sameSize(round_[first], round_[last]) &&
+                    pixels + area(round_[last]) <= options_.batchPixels) {
+                    pixels += area(round_[last++]);
+                }
+            }
+            tasks_.emplace_back(first, last);
+            first = last;
+        }
+
+        // A stream appears once per round, so its engine and statistics are
+        // only touched by one task
+        pool_.parallelFor(static_cast<int>(tasks_.size()), [this](int task) {
+            for (int i = tasks_[task].start; i < tasks_[task].end; ++i) {
+                RoundJob& job = round_[i];
+                const auto start = std::chrono::steady_clock::now();
+                job.stream->engine.processFrame(job.job.input, *job.job.output);
+                job.stream->stats.seconds += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+                ++job.stream->stats.frames;
+            }
+            });
+        frames += count;
+    }
+
+    framesDrained_ += frames;
+    secondsDrained_ += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - begin).count();
+    return frames;
+}
+
+int MultiStreamEngine::streams() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<int>(streams_.size());
+}
+
+StreamStats MultiStreamEngine::stats(int stream) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stream < 0 || stream >= static_cast<int>(streams_.size())) {
+        throw std::out_of_range("Unknown stream");
+    }
+    return streams_[stream]->stats;
+}
+
+double MultiStreamEngine::aggregateFps() const {
+    return secondsDrained_ > 0.0 ? framesDrained_ / secondsDrained_ : 0.0;
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include "stmkb_cpu.hpp"
+#include "thread_pool.hpp"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+struct MultiStreamOptions {
+    int threads = 0;               // Shared pool, 0 = one per hardware thread
+    bool batching = true;          // Pack same-size frames into one task
+    int batchPixels = 640 * 480;   // Pixels a packed task grows to
+    StatePrecision precision = StatePrecision::Float32;
+    int bilateralLevels = 0;       // > 0 selects FastBilateral
+    int historySize = 5;           // Frames block matching compares against
+    int blockSize = 8;             // Block matching block size
+    FilterParameters filter;       // Kalman and bilateral constants
+};
+
+struct StreamStats {
+    int64_t frames = 0;
+    double seconds = 0.0; // Time spent denoising this stream's frames
+};
+
+// Many independent denoiser states on one shared worker pool.
+//
+// Each stream owns a whole-frame STKMBCpu; the parallelism comes from
+// running different streams at the same time, never from inside a frame.
+// Frames are scheduled in rounds that take at most one queued frame per
+// stream, so a stream with a deep queue cannot starve the others, and the
+// frames of one stream stay in order. With batching, the frames of a round
+// are sorted by size and consecutive same-size frames share a task until
+// it holds batchPixels, so small frames do not each pay a dispatch.
+//
+// OpenCV's own worker threads would compete with the pool, so they are
+// switched off while any engine exists.
+class MultiStreamEngine {
+public:
+    explicit MultiStreamEngine(const MultiStreamOptions& options = {});
+    ~MultiStreamEngine();
+
+    MultiStreamEngine(const MultiStreamEngine&) = delete;
+    MultiStreamEngine& operator=(const MultiStreamEngine&) = delete;
+
+    // New stream initialised from its first frame (BGR or gray); returns
+    // its id, counted from 0. Thread-safe.
+    int addStream(const cv::Mat& firstFrame);
+
+    // Queue a frame of a stream. output belongs to the caller and is written
+    // by a later drain(); input and output must stay valid until then.
+    // Thread-safe.
+    void submit(int stream, const cv::Mat& input, cv::Mat& output);
+
+    // Process every queued frame, including frames submitted meanwhile.
+    // Returns the number of frames processed. One caller at a time.
+    int drain();
+
+    int streams() const;
+    int threads() const { return pool_.size(); }
+
+    // Per-stream statistics, and frames over the wall time spent in drain()
+    // across all streams. Written by drain(), so read them between drains.
+    StreamStats stats(int stream) const;
+    double aggregateFps() const;
+
+private:
+    struct Job {
+        cv::Mat input;
+        cv::Mat* output;
+    };
+
+    struct Stream {
+        Stream(const cv::Mat& firstFrame, const MultiStreamOptions& options)
+            : engine(firstFrame, options.historySize, options.blockSize,
+                options.precision, options.filter) {}
+
+        STKMBCpu engine;
+        std::deque<Job> pending;
+        StreamStats stats;
+    };
+
+    struct RoundJob {
+        Stream* stream;
+        Job job;
+    };
+
+    // Take one frame of every stream with a queued frame; false when none
+    bool collectRound();
+
+    MultiStreamOptions options_;
+    ThreadPool pool_;
+
+    mutable std::mutex mutex_; // Guards streams_ and the pending queues
+    std::vector<std::unique_ptr<Stream>> streams_;
+
+    // Scheduling buffers of drain(), reused across rounds
+    std::vector<RoundJob> round_;
+    std::vector<cv::Range> tasks_;
+    int64_t framesDrained_ = 0;
+    double secondsDrained_ = 0.0;
+};
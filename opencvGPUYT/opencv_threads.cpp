@@ -0,0 +1,26 @@
+#include "opencv_threads.hpp"
+#include <mutex>
+#include <opencv2/opencv.hpp>
+
+namespace {
+
+    std::mutex openCvThreadsMutex;
+    int openCvThreadUsers = 0;
+    int savedOpenCvThreads = 0;
+
+} // namespace
+
+void disableOpenCvThreads() {
+    std::lock_guard<std::mutex> lock(openCvThreadsMutex);
+    if (openCvThreadUsers++ == 0) {
+        savedOpenCvThreads = cv::getNumThreads();
+        cv::setNumThreads(0);
+    }
+}
+
+void restoreOpenCvThreads() {
+    std::lock_guard<std::mutex> lock(openCvThreadsMutex);
+    if (--openCvThreadUsers == 0) {
+        cv::setNumThreads(savedOpenCvThreads);
+    }
+}
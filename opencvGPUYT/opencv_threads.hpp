@@ -0,0 +1,18 @@
+#pragma once
+
+// OpenCV's worker thread count is process-wide, so engines that run their
+// own pools switch it off through these rather than cv::setNumThreads. The
+// first user saves the current count and sets it to 0, the last one puts it
+// back; calls must be paired and may come from any thread.
+void disableOpenCvThreads();
+void restoreOpenCvThreads();
+
+// disableOpenCvThreads() for the lifetime of the object
+class SerialOpenCv {
+public:
+    SerialOpenCv() { disableOpenCvThreads(); }
+    ~SerialOpenCv() { restoreOpenCvThreads(); }
+
+    SerialOpenCv(const SerialOpenCv&) = delete;
+    SerialOpenCv& operator=(const SerialOpenCv&) = delete;
+};
@@ -0,0 +1,28 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Nearest-rank percentiles, shared by every latency report so they agree on
+// what p95 means. p is a fraction in [0, 1].
+
+// 1-based rank of the p-th percentile among count sorted values: the
+// smallest rank with at least a share p of the values at or below it. The
+// slack keeps p * count from rounding up past a whole rank. 0 when count
+// is 0.
+inline size_t nearestRank(double p, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    const size_t rank = static_cast<size_t>(
+        std::ceil(p * static_cast<double>(count) - 1e-9));
+    return std::clamp<size_t>(rank, 1, count);
+}
+
+// Nearest-rank percentile of values sorted in ascending order, 0 when empty
+template <typename T>
+double percentile(const std::vector<T>& sorted, double p) {
+    const size_t rank = nearestRank(p, sorted.size());
+    return rank == 0 ? 0.0 : static_cast<double>(sorted[rank - 1]);
+}
@@ -0,0 +1,224 @@
+#include "profiler.hpp"
+#include "percentile.hpp"
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+std::atomic<bool> Profiler::enabled_{ false };
+
+namespace {
+
+    constexpr int kStages = static_cast<int>(Stage::Count);
+    constexpr int kBuckets = 48;                // Bucket b holds [2^b, 2^(b+1)) ns
+    constexpr size_t kMaxEventsPerThread = 1 << 18;
+
+    struct StageHistogram {
+        uint64_t count = 0;
+        uint64_t totalNs = 0;
+        uint64_t minNs = std::numeric_limits<uint64_t>::max();
+        uint64_t maxNs = 0;
+        std::array<uint64_t, kBuckets> buckets{};
+    };
+
+    struct TraceEvent {
+        Stage stage;
+        int64_t beginNs;
+        int64_t durationNs;
+    };
+
+    // Written only by its owning thread; read after recording has stopped
+    struct ThreadBuffer {
+        int id = 0;
+        std::array<StageHistogram, kStages> stages;
+        std::vector<TraceEvent> events;
+    };
+
+    struct Registry {
+        std::mutex mutex; // Guards buffers, taken once per thread
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        const Profiler::Clock::time_point epoch = Profiler::Clock::now();
+        std::atomic<int> traceFramesLeft{ 0 };
+    };
+
+    Registry& registry() {
+        static Registry instance;
+        return instance;
+    }
+
+    ThreadBuffer& threadBuffer() {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer) {
+            Registry& reg = registry();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            reg.buffers.push_back(std::make_unique<ThreadBuffer>());
+            buffer = reg.buffers.back().get();
+            buffer->id = static_cast<int>(reg.buffers.size());
+        }
+        return *buffer;
+    }
+
+    int bucketOf(uint64_t ns) {
+        int bucket = 0;
+        while (ns > 1 && bucket < kBuckets - 1) {
+            ns >>= 1;
+            ++bucket;
+        }
+        return bucket;
+    }
+
+    // Upper bound of the bucket holding the nearest-rank percentile
+    double percentileMs(const StageHistogram& histogram, double p) {
+        const uint64_t target = nearestRank(p, histogram.count);
+        uint64_t seen = 0;
+        for (int b = 0; b < kBuckets; ++b) {
+            seen += histogram.buckets[b];
+            if (seen >= target && histogram.buckets[b] > 0) {
+                const double upper = static_cast<double>(uint64_t(2) << b);
+                return std::min(upper, static_cast<double>(histogram.maxNs)) / 1.0e6;
+            }
+        }
+        return histogram.maxNs / 1.0e6;
+    }
+
+    std::ofstream openOutput(const std::string& path) {
+        std::ofstream file(path);
+        if (!file) {
+            throw std::runtime_error("Cannot write " + path);
+        }
+        return file;
+    }
+
+} // namespace
+
+const char* stageName(Stage stage) {
+    static const char* const names[kStages] = {
+        "decode", "frame", "bgr_to_gray", "blur", "block_matching",
+        "motion_search", "face_detection", "bilateral", "kalman", "history",
+        "gray_to_bgr", "upload", "download", "encode"
+    };
+    const int index = static_cast<int>(stage);
+    return index < kStages ? names[index] : "unknown";
+}
+
+void Profiler::setEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void Profiler::setTraceFrames(int frames) {
+    registry().traceFramesLeft.store(std::max(0, frames));
+}
+
+void Profiler::frameDone() {
+    auto& left = registry().traceFramesLeft;
+    int current = left.load(std::memory_order_relaxed);
+    while (current > 0 &&
+        !left.compare_exchange_weak(current, current - 1,
+            std::memory_order_relaxed)) {
+    }
+}
+
+void Profiler::record(Stage stage, Clock::time_point begin,
+    Clock::time_point end) {
+    ThreadBuffer& buffer = threadBuffer();
+    const auto durationNs = static_cast<uint64_t>(std::max<int64_t>(0,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)
+        .count()));
+
+    StageHistogram& histogram = buffer.stages[static_cast<int>(stage)];
+    ++histogram.count;
+    histogram.totalNs += durationNs;
+    histogram.minNs = std::min(histogram.minNs, durationNs);
+    histogram.maxNs = std::max(histogram.maxNs, durationNs);
+    ++histogram.buckets[bucketOf(durationNs)];
+
+    Registry& reg = registry();
+    if (reg.traceFramesLeft.load(std::memory_order_relaxed) > 0 &&
+        buffer.events.size() < kMaxEventsPerThread) {
+        const auto beginNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            begin - reg.epoch).count();
+        buffer.events.push_back({ stage, beginNs,
+            static_cast<int64_t>(durationNs) });
+    }
+}
+
+void Profiler::writeReport(const std::string& path) {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    std::array<StageHistogram, kStages> merged;
+    for (const auto& buffer : reg.buffers) {
+        for (int s = 0; s < kStages; ++s) {
+            const StageHistogram& h = buffer->stages[s];
+            StageHistogram& m = merged[s];
+            m.count += h.count;
+            m.totalNs += h.totalNs;
+            m.minNs = std::min(m.minNs, h.minNs);
+            m.maxNs = std::max(m.maxNs, h.maxNs);
+            for (int b = 0; b < kBuckets; ++b) {
+                m.buckets[b] += h.buckets[b];
+            }
+        }
+    }
+
+    std::ofstream file = openOutput(path);
+    file << std::fixed << std::setprecision(4) << "{\n  \"stages\": [\n";
+    bool first = true;
+    for (int s = 0; s < kStages; ++s) {
+        const StageHistogram& h = merged[s];
+        if (h.count == 0) {
+            continue;
+        }
+        file << (first ? "" : ",\n")
+            << "    {\"stage\": \"" << stageName(static_cast<Stage>(s)) << "\", "
+            << "\"count\": " << h.count << ", "
+            << "\"total_ms\": " << h.totalNs / 1.0e6 << ", "
+            << "\"mean_ms\": " << h.totalNs / 1.0e6 / h.count << ", "
+            << "\"min_ms\": " << h.minNs / 1.0e6 << ", "
+            << "\"max_ms\": " << h.maxNs / 1.0e6 << ", "
+            << "\"p50_ms\": " << percentileMs(h, 0.50) << ", "
+            << "\"p95_ms\": " << percentileMs(h, 0.95) << ", "
+            << "\"p99_ms\": " << percentileMs(h, 0.99) << ", "
+            << "\"histogram_log2_ns\": [";
+        for (int b = 0; b < kBuckets; ++b) {
+            file << (b ? ", " : "") << h.buckets[b];
+        }
+        file << "]}";
+        first = false;
+    }
+    file << "\n  ]\n}\n";
+}
+
+void Profiler::writeChromeTrace(const std::string& path) {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    std::ofstream file = openOutput(path);
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\": [\n";
+    bool first = true;
+    for (const auto& buffer : reg.buffers) {
+        for (const TraceEvent& event : buffer->events) {
+            file << (first ? "" : ",\n")
+                << "  {\"name\": \"" << stageName(event.stage)
+                << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->id
+                << ", \"ts\": " << event.beginNs / 1.0e3
+                << ", \"dur\": " << event.durationNs / 1.0e3 << "}";
+            first = false;
+        }
+    }
+    file << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+void Profiler::reset() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (auto& buffer : reg.buffers) {
+        buffer->stages = {};
+        buffer->events.clear();
+    }
+}
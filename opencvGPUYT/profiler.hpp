@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Hot-path stages timed by the profiler
+enum class Stage : uint8_t {
+    Decode,        // VideoCapture::read
+    Frame,         // Whole denoiser call for one frame
+    BgrToGray,     // BGR -> gray and 8-bit -> float
+    Blur,          // 3x3 pre-filter
+    BlockMatching, // Block distance against the history
+    MotionSearch,  // Motion vectors and compensation of the state
+    FaceDetection, // Face cascade of the region-of-interest mode
+    Bilateral,     // Bilateral filter
+    Kalman,        // Kalman prediction/correction
+    History,       // Frame history update
+    GrayToBgr,     // float -> 8-bit and gray -> BGR
+    Upload,        // Host -> GPU copy
+    Download,      // GPU -> host copy
+    Encode,        // VideoWriter::write
+    Count
+};
+
+const char* stageName(Stage stage);
+
+// Scoped-timer instrumentation. Each thread records into its own buffer
+// (per-stage log2 histograms plus an optional list of trace events), so the
+// hot path takes no locks; buffers are merged only when exporting. While
+// disabled a timer costs one relaxed atomic load.
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static bool enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+    static void setEnabled(bool enabled);
+
+    // Also keep individual trace events until frameDone() has been called
+    // for the given number of frames
+    static void setTraceFrames(int frames);
+    static void frameDone();
+
+    static void record(Stage stage, Clock::time_point begin,
+        Clock::time_point end);
+
+    // Per-stage count, total, mean, min/max and p50/p95/p99 (from the
+    // histogram buckets) as JSON
+    static void writeReport(const std::string& path);
+
+    // Trace events in the Chrome trace-event format (chrome://tracing,
+    // Perfetto)
+    static void writeChromeTrace(const std::string& path);
+
+    // Forget everything recorded so far
+    static void reset();
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+class ScopedStage {
+public:
+    explicit ScopedStage(Stage stage)
+        : stage_(stage), active_(Profiler::enabled()) {
+        if (active_) {
+            begin_ = Profiler::Clock::now();
+        }
+    }
+    ~ScopedStage() {
+        if (active_) {
+            Profiler::record(stage_, begin_, Profiler::Clock::now());
+        }
+    }
+
+    ScopedStage(const ScopedStage&) = delete;
+    ScopedStage& operator=(const ScopedStage&) = delete;
+
+private:
+    Stage stage_;
+    bool active_;
+    Profiler::Clock::time_point begin_;
+};
+
+#define STKMB_PROFILE_CONCAT_(a, b) a##b
+#define STKMB_PROFILE_CONCAT(a, b) STKMB_PROFILE_CONCAT_(a, b)
+
+// Time the rest of the enclosing scope as the given stage
+#define STKMB_PROFILE(stage) \
+    ScopedStage STKMB_PROFILE_CONCAT(stkmbProfile, __LINE__)(stage)
@@ -27,6 +27,17 @@ public:
         }
         last_update_ = now;
 
+        // Un flujo desde una tubera no tiene longitud conocida
+        if (total_ <= 0)
+        {
+            auto seconds = std::chrono::duration<float>(now - start_time_).count();
+            std::cout << "\r" << current << " frames | " << std::fixed
+                << std::setprecision(1)
+                << (seconds > 0 ? current / seconds : 0.0f) << " fps";
+            std::cout.flush();
+            return;
+        }
+
         float progress = static_cast<float>(current) / total_;
         int filled_width = static_cast<int>(width_ * progress);
 
@@ -0,0 +1,260 @@
+#include "segment_processor.hpp"
+#include "frame_store.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+    double secondsSince(std::chrono::steady_clock::time_point begin) {
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+    }
+
+    // Removes the segment stores however process() exits
+    struct TemporaryFiles {
+        std::vector<std::string> paths;
+
+        ~TemporaryFiles() {
+            std::error_code error;
+            for (const std::string& path : paths) {
+                std::filesystem::remove(path, error);
+            }
+        }
+    };
+
+    // Joins the segment threads however process() exits
+    struct JoinedThreads {
+        std::vector<std::thread> threads;
+
+        ~JoinedThreads() {
+            for (std::thread& thread : threads) {
+                if (thread.joinable()) {
+                    thread.join();
+                }
+            }
+        }
+    };
+
+} // namespace
+
+SegmentProcessor::SegmentProcessor(std::string inputPath,
+    StreamOptions streams, ColorMode colorMode, DenoiserFactory factory,
+    SegmentOptions options)
+    : inputPath_(std::move(inputPath)), streams_(std::move(streams)),
+    colorMode_(colorMode), factory_(std::move(factory)), options_(options) {
+    if (options_.segments < 1 || options_.warmupFrames < 0) {
+        throw std::invalid_argument("Bad segment options");
+    }
+    // Bgr output is gray replicated over three channels, stored once
+    const FrameFormat format = pipelineFormat(colorMode_);
+    storeFormat_ = format == FrameFormat::Bgr ? FrameFormat::Gray : format;
+}
+
+SegmentReport SegmentProcessor::process() {
+    auto probe = openFrameSource(inputPath_, streams_.inputFormat,
+        streams_.rawSize, streams_.rawFps);
+    info_ = probe->info();
+    firstFrame_ = std::max(0, streams_.startFrame);
+    int frames = info_.frameCount - firstFrame_;
+    if (streams_.frameLimit > 0) {
+        frames = std::min(frames, streams_.frameLimit);
+    }
+    if (info_.frameCount <= 0 || frames <= 0 || !probe->seek(firstFrame_)) {
+        throw std::runtime_error("Segment-parallel processing needs a "
+            "seekable input of known length (a video file or frame store)");
+    }
+    probe.reset();
+
+    // Contiguous segments of (nearly) equal length
+    SegmentReport report;
+    report.frames = frames;
+    report.segments = std::min(options_.segments, frames);
+    const std::filesystem::path directory =
+        options_.temporaryDirectory.empty()
+        ? std::filesystem::temp_directory_path()
+        : std::filesystem::path(options_.temporaryDirectory);
+    const auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    TemporaryFiles temporary;
+    std::vector<Segment> segments(report.segments);
+    uint64_t storeBytes = 0;
+    for (int i = 0; i < report.segments; ++i) {
+        Segment& segment = segments[i];
+        segment.begin = firstFrame_ + static_cast<int>(
+            static_cast<int64_t>(frames) * i / report.segments);
+        segment.end = firstFrame_ + static_cast<int>(
+            static_cast<int64_t>(frames) * (i + 1) / report.segments);
+        if (i == 0) {
+            continue; // Written to the output directly
+        }
+        segment.path = (directory / ("stkmb_segment_" +
+            std::to_string(stamp) + "_" + std::to_string(i) +
+            ".stkraw")).string();
+        temporary.paths.push_back(segment.path);
+        storeBytes += frameStoreBytes(info_.size, storeFormat_,
+            segment.end - segment.begin);
+    }
+    const std::filesystem::space_info space =
+        std::filesystem::space(directory);
+    if (space.available < storeBytes) {
+        throw std::runtime_error("Segment stores need " +
+            std::to_string(storeBytes >> 20) + " MiB in '" +
+            directory.string() + "', " + std::to_string(space.available >> 20) +
+            " MiB available");
+    }
+
+    auto sink = openOutputSink(streams_, info_, colorMode_);
+    cv::Mat converted;
+    auto write = [&](const cv::Mat& frame) {
+        if (sink->format() == storeFormat_) {
+            sink->write(frame);
+        }
+        else {
+            convertFrame(frame, storeFormat_, converted, sink->format());
+            sink->write(converted);
+        }
+    };
+
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point begin = Clock::now();
+    std::vector<Clock::time_point> finished(segments.size(), begin);
+    std::vector<std::exception_ptr> errors(segments.size());
+    JoinedThreads workers;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        workers.threads.emplace_back([&, i] {
+            try {
+                const Segment& segment = segments[i];
+                if (i == 0) {
+                    run(segment.begin, segment.begin, segment.end,
+                        [&](int, const cv::Mat& frame) { write(frame); });
+                }
+                else {
+                    runSegment(segment);
+                }
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+            }
+            finished[i] = Clock::now();
+        });
+    }
+
+    // Stitch in order from the mapped stores while later segments still run
+    for (size_t i = 0; i < segments.size(); ++i) {
+        workers.threads[i].join();
+        if (errors[i]) {
+            std::rethrow_exception(errors[i]);
+        }
+        if (i == 0) {
+            continue;
+        }
+        {
+            const FrameStore store(segments[i].path);
+            for (int f = 0; f < store.frameCount(); ++f) {
+                write(store.frame(f));
+            }
+        }
+        if (!options_.verify) {
+            std::error_code error;
+            std::filesystem::remove(segments[i].path, error);
+        }
+    }
+    sink->close();
+    const Clock::time_point lastSegment =
+        *std::max_element(finished.begin(), finished.end());
+    report.segmentSeconds =
+        std::chrono::duration<double>(lastSegment - begin).count();
+    report.stitchSeconds = std::max(0.0,
+        secondsSince(begin) - report.segmentSeconds);
+
+    if (options_.verify) {
+        verify(segments, report);
+    }
+    return report;
+}
+
+void SegmentProcessor::run(int from, int begin, int end,
+    const std::function<void(int, const cv::Mat&)>& consume) const {
+    auto source = openFrameSource(inputPath_, streams_.inputFormat,
+        streams_.rawSize, streams_.rawFps);
+    if (!source->seek(from)) {
+        throw std::runtime_error("Cannot seek to frame " + std::to_string(from));
+    }
+    const FrameFormat format = pipelineFormat(colorMode_);
+    std::unique_ptr<Denoiser> denoiser = factory_();
+
+    cv::Mat frame, input, output, stored;
+    for (int f = from; f < end; ++f) {
+        if (!source->read(frame)) {
+            throw std::runtime_error("Input ended at frame " + std::to_string(f));
+        }
+        const cv::Mat* pipelineFrame = &frame;
+        if (info_.format != format) {
+            convertFrame(frame, info_.format, input, format);
+            pipelineFrame = &input;
+        }
+        if (f == from) {
+            denoiser->init(pipelineFrame->rowRange(0, info_.size.height));
+        }
+
+        denoiseFrame(*denoiser, colorMode_, *pipelineFrame, output);
+        Profiler::frameDone();
+        if (f < begin) {
+            continue; // Warm-up
+        }
+        if (format == storeFormat_) {
+            consume(f, output);
+        }
+        else {
+            convertFrame(output, format, stored, storeFormat_);
+            consume(f, stored);
+        }
+    }
+}
+
+void SegmentProcessor::runSegment(const Segment& segment) const {
+    const int from =
+        std::max(firstFrame_, segment.begin - options_.warmupFrames);
+    FrameStoreWriter writer(segment.path, info_, storeFormat_);
+    run(from, segment.begin, segment.end,
+        [&](int, const cv::Mat& frame) { writer.write(frame); });
+    writer.close();
+}
+
+void SegmentProcessor::verify(const std::vector<Segment>& segments,
+    SegmentReport& report) const {
+    // The first segment went straight to the output and has no store
+    std::vector<std::unique_ptr<FrameStore>> stores(segments.size());
+    for (size_t i = 1; i < segments.size(); ++i) {
+        stores[i] = std::make_unique<FrameStore>(segments[i].path);
+        SegmentBoundary boundary;
+        boundary.frame = segments[i].begin;
+        report.boundaries.push_back(boundary);
+    }
+
+    // One engine over the whole range, compared where segments start
+    size_t segment = 0;
+    const auto begin = std::chrono::steady_clock::now();
+    run(firstFrame_, firstFrame_, segments.back().end,
+        [&](int f, const cv::Mat& frame) {
+            while (f >= segments[segment].end) {
+                ++segment;
+            }
+            const int offset = f - segments[segment].begin;
+            if (segment == 0 || offset >= std::max(1, options_.warmupFrames)) {
+                return;
+            }
+            const double diff = cv::norm(frame,
+                stores[segment]->frame(offset), cv::NORM_INF);
+            SegmentBoundary& boundary = report.boundaries[segment - 1];
+            if (offset == 0) {
+                boundary.firstDiff = diff;
+            }
+            boundary.windowDiff = std::max(boundary.windowDiff, diff);
+        });
+    report.serialSeconds = secondsSince(begin);
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "denoiser.hpp"
+#include "video_processor.hpp"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct SegmentOptions {
+    int segments = 4;      // Segments processed concurrently
+    int warmupFrames = 30; // Frames run ahead of each segment but the first
+    bool verify = false;   // Also run serially, then compare and time
+    std::string temporaryDirectory; // Segment stores, empty = system temp
+};
+
+// Difference to the serial run where a segment starts
+struct SegmentBoundary {
+    int frame = 0;           // First frame of the segment
+    double firstDiff = 0.0;  // Max absolute difference on that frame
+    double windowDiff = 0.0; // Max over the segment's first warmupFrames
+};
+
+struct SegmentReport {
+    int frames = 0;
+    int segments = 0;
+    double segmentSeconds = 0.0; // Until the last segment finished
+    double stitchSeconds = 0.0;  // Stitching left after that
+    double serialSeconds = 0.0;  // verify only: one engine over every frame
+    std::vector<SegmentBoundary> boundaries; // verify only
+
+    double speedup() const {
+        return serialSeconds / (segmentSeconds + stitchSeconds);
+    }
+};
+
+// Offline processing of one long input on several engines at once. The
+// frame range is cut into contiguous segments, each denoised on its own
+// thread by its own engine. Every segment but the first starts
+// warmupFrames early, discarding that output, so the Kalman state has
+// converged by the segment's first frame. The first segment writes to the
+// output directly; the others go to temporary frame stores, each copied to
+// the output and deleted as soon as every segment before it is done.
+//
+// The stores live in SegmentOptions::temporaryDirectory. Segments may all
+// finish together, so process() first checks that it has room for every
+// segment but the first: about (segments - 1) / segments of the frames,
+// one page-rounded gray or I420 plane per frame (frameStoreBytes()).
+// verify keeps the stores until the comparison is done.
+//
+// The input must seek and know its length: a video file or a frame store,
+// not a pipe. Per-engine options come from the factory; with several
+// segments running, engines with few or no threads of their own scale best.
+class SegmentProcessor {
+public:
+    using DenoiserFactory = std::function<std::unique_ptr<Denoiser>()>;
+
+    SegmentProcessor(std::string inputPath, StreamOptions streams,
+        ColorMode colorMode, DenoiserFactory factory, SegmentOptions options);
+
+    // Throws std::runtime_error when the input does not seek, the store
+    // directory lacks space or a segment fails; temporary stores are
+    // removed either way
+    SegmentReport process();
+
+private:
+    struct Segment {
+        int begin = 0; // First frame written
+        int end = 0;   // One past the last frame
+        std::string path; // Store, empty for the first segment
+    };
+
+    // Denoise frames [from, end) with a fresh engine initialised on frame
+    // from, handing every frame at or after begin to consume in the store
+    // layout
+    void run(int from, int begin, int end,
+        const std::function<void(int, const cv::Mat&)>& consume) const;
+
+    // Denoise a segment after the first into its store
+    void runSegment(const Segment& segment) const;
+    void verify(const std::vector<Segment>& segments, SegmentReport& report)
+        const;
+
+    std::string inputPath_;
+    StreamOptions streams_;
+    ColorMode colorMode_;
+    DenoiserFactory factory_;
+    SegmentOptions options_;
+    StreamInfo info_;
+    FrameFormat storeFormat_ = FrameFormat::Gray; // Layout of segment stores
+    int firstFrame_ = 0; // First frame of the first segment
+};
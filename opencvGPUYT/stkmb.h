@@ -0,0 +1,102 @@
+#pragma once
+
+/* C interface of the STKMB denoiser, for embedding and FFI use.
+ *
+ * Frames are caller-owned buffers described by stkmb_frame: an 8-bit luma
+ * plane, or NV12 (luma plane followed by an interleaved half-resolution
+ * CbCr plane), each with its own stride. The denoiser reads the input
+ * planes in place and writes the filtered luma straight into the output
+ * plane; only NV12 chroma is copied through, and not even that when the
+ * output shares the input's chroma plane. Once the first frame has set up
+ * the filter state, nothing is allocated per frame except by the exact
+ * bilateral filter of the single-threaded path, OpenCV's, which allocates
+ * internally. That is the default (threads and bilateral_levels 0); set
+ * either one to run allocation-free.
+ *
+ * A denoiser is not thread-safe; use one per stream. Every function
+ * reports errors through its return value and never throws or aborts. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(STKMB_STATIC)
+#define STKMB_API
+#elif defined(_WIN32)
+#if defined(STKMB_BUILDING_API)
+#define STKMB_API __declspec(dllexport)
+#else
+#define STKMB_API __declspec(dllimport)
+#endif
+#else
+#define STKMB_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STKMB_API_VERSION 1
+
+typedef enum stkmb_status {
+    STKMB_OK = 0,
+    STKMB_INVALID_ARGUMENT = 1, /* Bad settings, frame or buffer */
+    STKMB_ERROR = 2             /* Failure inside the filter */
+} stkmb_status;
+
+typedef enum stkmb_format {
+    STKMB_FORMAT_GRAY8 = 0, /* Luma plane only */
+    STKMB_FORMAT_NV12 = 1   /* Luma plane plus interleaved CbCr plane */
+} stkmb_format;
+
+typedef struct stkmb_frame {
+    stkmb_format format;
+    int width;
+    int height;
+    uint8_t* luma;
+    size_t luma_stride;   /* Bytes between rows, at least width */
+    uint8_t* chroma;      /* NV12 only: (height + 1) / 2 rows */
+    size_t chroma_stride; /* NV12 only: at least width rounded up to even */
+} stkmb_frame;
+
+/* Filter tunables; start from stkmb_default_settings() */
+typedef struct stkmb_settings {
+    int history_size;       /* Frames block matching compares against */
+    int block_size;         /* Block matching block size, pixels */
+    float process_noise;    /* Kalman process noise q */
+    int bilateral_diameter;
+    float bilateral_sigma;  /* Range and space sigma of the bilateral */
+    int threads;            /* Strip-parallel workers, 0 = single-threaded */
+    int compact_state;      /* Non-zero: 16-bit state and history planes */
+    int bilateral_levels;   /* > 0: fast bilateral with this many levels */
+    int sparse;             /* Non-zero: motion-adaptive sparse processing */
+    int motion;             /* Non-zero: motion-compensated filtering */
+} stkmb_settings;
+
+typedef struct stkmb_denoiser stkmb_denoiser;
+
+/* STKMB_API_VERSION of the library, to check against the header */
+STKMB_API int stkmb_api_version(void);
+
+STKMB_API stkmb_settings stkmb_default_settings(void);
+
+/* New denoiser with the given settings (NULL for the defaults), stored in
+ * *denoiser. The filter state is set up from the first processed frame,
+ * and every later frame must have its size. */
+STKMB_API stkmb_status stkmb_create(const stkmb_settings* settings,
+    stkmb_denoiser** denoiser);
+
+/* Denoise input into output. Both must have the same format and size, and
+ * the luma planes must not overlap. */
+STKMB_API stkmb_status stkmb_process(stkmb_denoiser* denoiser,
+    const stkmb_frame* input, const stkmb_frame* output);
+
+/* Message of the last failed call on denoiser, "" after a success. Valid
+ * until the next call on it. */
+STKMB_API const char* stkmb_last_error(const stkmb_denoiser* denoiser);
+
+/* Accepts NULL */
+STKMB_API void stkmb_destroy(stkmb_denoiser* denoiser);
+
+#ifdef __cplusplus
+}
+#endif
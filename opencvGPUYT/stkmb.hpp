@@ -0,0 +1,56 @@
+#pragma once
+#include "stkmb.h"
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// C++ view of the C interface in stkmb.h, header-only so that it adds
+// nothing to the library's ABI. Throws std::invalid_argument for bad
+// settings or frames and std::runtime_error for failures of the filter,
+// with the library's message.
+class StkmbDenoiser {
+public:
+    explicit StkmbDenoiser(
+        const stkmb_settings& settings = stkmb_default_settings()) {
+        check(stkmb_create(&settings, &denoiser_), "Cannot create denoiser");
+    }
+
+    ~StkmbDenoiser() { stkmb_destroy(denoiser_); }
+
+    StkmbDenoiser(StkmbDenoiser&& other) noexcept
+        : denoiser_(std::exchange(other.denoiser_, nullptr)) {}
+    StkmbDenoiser& operator=(StkmbDenoiser&& other) noexcept {
+        std::swap(denoiser_, other.denoiser_);
+        return *this;
+    }
+
+    void process(const stkmb_frame& input, const stkmb_frame& output) {
+        check(stkmb_process(denoiser_, &input, &output),
+            stkmb_last_error(denoiser_));
+    }
+
+    stkmb_denoiser* handle() const { return denoiser_; }
+
+    // Frame descriptions of caller-owned planes
+    static stkmb_frame gray(uint8_t* luma, int width, int height,
+        size_t stride) {
+        return { STKMB_FORMAT_GRAY8, width, height, luma, stride, nullptr, 0 };
+    }
+    static stkmb_frame nv12(uint8_t* luma, size_t lumaStride, uint8_t* chroma,
+        size_t chromaStride, int width, int height) {
+        return { STKMB_FORMAT_NV12, width, height, luma, lumaStride, chroma,
+            chromaStride };
+    }
+
+private:
+    static void check(stkmb_status status, const std::string& message) {
+        if (status == STKMB_INVALID_ARGUMENT) {
+            throw std::invalid_argument(message);
+        }
+        if (status != STKMB_OK) {
+            throw std::runtime_error(message);
+        }
+    }
+
+    stkmb_denoiser* denoiser_ = nullptr;
+};
@@ -0,0 +1,202 @@
+#include "stkmb.h"
+#include "cpu_denoiser.hpp"
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+struct stkmb_denoiser {
+    DenoiserOptions options;
+    std::unique_ptr<CpuDenoiser> engine; // Created by the first frame
+    cv::Size size;
+    std::string error;
+};
+
+namespace {
+
+    DenoiserOptions toOptions(const stkmb_settings& settings) {
+        if (settings.history_size < 1 || settings.block_size < 1 ||
+            !(settings.process_noise > 0.0f) ||
+            settings.bilateral_diameter < 1 ||
+            !(settings.bilateral_sigma > 0.0f) || settings.threads < 0 ||
+            settings.bilateral_levels < 0) {
+            throw std::invalid_argument("Invalid denoiser settings");
+        }
+        DenoiserOptions options;
+        options.historySize = settings.history_size;
+        options.blockSize = settings.block_size;
+        options.filter.processNoise = settings.process_noise;
+        options.filter.bilateralDiameter = settings.bilateral_diameter;
+        options.filter.bilateralSigma = settings.bilateral_sigma;
+        options.threads = settings.threads;
+        options.compactState = settings.compact_state != 0;
+        options.bilateralLevels = settings.bilateral_levels;
+        options.sparse = settings.sparse != 0;
+        options.motion = settings.motion != 0;
+        return options;
+    }
+
+    int chromaRows(const stkmb_frame& frame) { return (frame.height + 1) / 2; }
+    int chromaCols(const stkmb_frame& frame) { return (frame.width + 1) / 2; }
+
+    void checkFrame(const stkmb_frame* frame, const char* name) {
+        const std::string prefix = std::string("The ") + name + " frame ";
+        if (!frame) {
+            throw std::invalid_argument(prefix + "is missing");
+        }
+        if (frame->format != STKMB_FORMAT_GRAY8 &&
+            frame->format != STKMB_FORMAT_NV12) {
+            throw std::invalid_argument(prefix + "has an unknown format");
+        }
+        if (frame->width < 1 || frame->height < 1 || !frame->luma ||
+            frame->luma_stride < static_cast<size_t>(frame->width)) {
+            throw std::invalid_argument(prefix + "has no valid luma plane");
+        }
+        const size_t chromaBytes = 2 * static_cast<size_t>(chromaCols(*frame));
+        if (frame->format == STKMB_FORMAT_NV12 &&
+            (!frame->chroma || frame->chroma_stride < chromaBytes)) {
+            throw std::invalid_argument(prefix + "has no valid chroma plane");
+        }
+    }
+
+    bool overlaps(const uint8_t* a, size_t aBytes, const uint8_t* b,
+        size_t bBytes) {
+        const auto first = reinterpret_cast<uintptr_t>(a);
+        const auto second = reinterpret_cast<uintptr_t>(b);
+        return first < second + bBytes && second < first + aBytes;
+    }
+
+    // Bytes the luma plane spans, from its first pixel to its last
+    size_t lumaBytes(const stkmb_frame& frame) {
+        return frame.luma_stride * (frame.height - 1) + frame.width;
+    }
+
+    // Headers over the caller's planes; no pixel is copied
+    cv::Mat lumaPlane(const stkmb_frame& frame) {
+        return cv::Mat(frame.height, frame.width, CV_8UC1, frame.luma,
+            frame.luma_stride);
+    }
+    cv::Mat chromaPlane(const stkmb_frame& frame) {
+        return cv::Mat(chromaRows(frame), chromaCols(frame), CV_8UC2,
+            frame.chroma, frame.chroma_stride);
+    }
+
+    // Run body and turn its exception, if any, into a status and the
+    // denoiser's message; nothing may escape through the C interface
+    template <typename Body>
+    stkmb_status guarded(stkmb_denoiser* denoiser, Body&& body) {
+        stkmb_status status = STKMB_ERROR;
+        std::string message;
+        try {
+            body();
+            status = STKMB_OK;
+        }
+        catch (const std::invalid_argument& error) {
+            status = STKMB_INVALID_ARGUMENT;
+            message = error.what();
+        }
+        catch (const std::exception& error) {
+            message = error.what();
+        }
+        catch (...) {
+            message = "Unknown error";
+        }
+        if (denoiser) {
+            try {
+                denoiser->error = message;
+            }
+            catch (...) {
+                denoiser->error.clear();
+            }
+        }
+        return status;
+    }
+
+} // namespace
+
+int stkmb_api_version(void) {
+    return STKMB_API_VERSION;
+}
+
+stkmb_settings stkmb_default_settings(void) {
+    const DenoiserOptions defaults;
+    stkmb_settings settings;
+    settings.history_size = defaults.historySize;
+    settings.block_size = defaults.blockSize;
+    settings.process_noise = defaults.filter.processNoise;
+    settings.bilateral_diameter = defaults.filter.bilateralDiameter;
+    settings.bilateral_sigma = defaults.filter.bilateralSigma;
+    settings.threads = defaults.threads;
+    settings.compact_state = defaults.compactState;
+    settings.bilateral_levels = defaults.bilateralLevels;
+    settings.sparse = defaults.sparse;
+    settings.motion = defaults.motion;
+    return settings;
+}
+
+stkmb_status stkmb_create(const stkmb_settings* settings,
+    stkmb_denoiser** denoiser) {
+    if (!denoiser) {
+        return STKMB_INVALID_ARGUMENT;
+    }
+    *denoiser = nullptr;
+    return guarded(nullptr, [&] {
+        auto created = std::make_unique<stkmb_denoiser>();
+        created->options = toOptions(settings ? *settings
+            : stkmb_default_settings());
+        *denoiser = created.release();
+        });
+}
+
+stkmb_status stkmb_process(stkmb_denoiser* denoiser, const stkmb_frame* input,
+    const stkmb_frame* output) {
+    if (!denoiser) {
+        return STKMB_INVALID_ARGUMENT;
+    }
+    return guarded(denoiser, [&] {
+        checkFrame(input, "input");
+        checkFrame(output, "output");
+        if (input->format != output->format || input->width != output->width ||
+            input->height != output->height) {
+            throw std::invalid_argument(
+                "Input and output frames differ in format or size");
+        }
+        // The strip path reads rows of the input around rows it has written
+        if (overlaps(input->luma, lumaBytes(*input), output->luma,
+            lumaBytes(*output))) {
+            throw std::invalid_argument("Input and output luma planes overlap");
+        }
+
+        const cv::Mat source = lumaPlane(*input);
+        cv::Mat target = lumaPlane(*output);
+        if (!denoiser->engine) {
+            auto engine = std::make_unique<CpuDenoiser>(denoiser->options);
+            engine->init(source);
+            denoiser->engine = std::move(engine);
+            denoiser->size = source.size();
+        }
+        else if (source.size() != denoiser->size) {
+            throw std::invalid_argument(
+                "Frame size differs from the first frame");
+        }
+        denoiser->engine->process(source, target);
+        if (target.data != output->luma) {
+            throw std::logic_error("Denoiser did not write the output plane");
+        }
+
+        if (input->format == STKMB_FORMAT_NV12 &&
+            input->chroma != output->chroma) {
+            cv::Mat chroma = chromaPlane(*output);
+            chromaPlane(*input).copyTo(chroma);
+        }
+        });
+}
+
+const char* stkmb_last_error(const stkmb_denoiser* denoiser) {
+    return denoiser ? denoiser->error.c_str() : "No denoiser";
+}
+
+void stkmb_destroy(stkmb_denoiser* denoiser) {
+    delete denoiser;
+}
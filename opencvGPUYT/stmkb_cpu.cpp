@@ -1,118 +1,893 @@
 #include "stmkb_cpu.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <stdexcept>
 
-STKMBCpu::STKMBCpu(const cv::Mat& firstFrame, int historySize)
-    : maxHistory_(historySize) {
+namespace {
+
+    // Plane types of the pixel-valued and the statistics planes
+    int pixelType(StatePrecision precision) {
+        return precision == StatePrecision::Compact ? CV_16U : CV_32F;
+    }
+
+    int statisticsType(StatePrecision precision) {
+        return precision == StatePrecision::Compact ? CV_16F : CV_32F;
+    }
+
+    size_t planeBytes(const cv::Mat& plane) {
+        return plane.total() * plane.elemSize();
+    }
+
+    // Single-channel frames are luma already; BGR frames are converted into
+    // buffer. Returns the gray plane.
+    const cv::Mat& toGray(const cv::Mat& frame, cv::Mat& buffer) {
+        CV_Assert(frame.type() == CV_8UC3 || frame.type() == CV_8UC1);
+        if (frame.channels() == 1) {
+            return frame;
+        }
+        cv::cvtColor(frame, buffer, cv::COLOR_BGR2GRAY);
+        return buffer;
+    }
+
+} // namespace
+
+STKMBCpu::STKMBCpu(const cv::Mat& firstFrame, int historySize, int blockSize,
+    StatePrecision precision, const FilterParameters& parameters)
+    : blockSize(blockSize), maxHistory_(historySize),
+    historyDepth_(historySize), precision_(precision),
+    pastFrames_(firstFrame.size(), pixelType(precision), historySize),
+    blockDistance_(firstFrame.size(), blockSize, historySize) {
+    CV_Assert(parameters.processNoise > 0.0f &&
+        parameters.bilateralDiameter >= 1 && parameters.bilateralSigma > 0.0f);
 
     height = firstFrame.rows;
     width = firstFrame.cols;
-    blockSize = 8;
+
+    const bool compact = precision_ == StatePrecision::Compact;
+    const double pixelScale = compact ? kFixedPointScale : 1.0;
+    const int statistics = statisticsType(precision_);
 
     cv::Mat firstGray;
-    cv::cvtColor(firstFrame, firstGray, cv::COLOR_BGR2GRAY);
-    firstGray.convertTo(xCorrection_, CV_32F);
+    toGray(firstFrame, firstGray).convertTo(xCorrection_,
+        pixelType(precision_), pixelScale);
 
-    pastFrames_.push_back(xCorrection_.clone());
+    pastFrames_.push(xCorrection_);
+    blockDistance_.push(xCorrection_);
 
-    xPredicted_ = cv::Mat::zeros(height, width, CV_32F);
-    pPredicted_ = cv::Mat::ones(height, width, CV_32F);
-    pCorrection_ = cv::Mat::ones(height, width, CV_32F);
-    kalmanGain_ = cv::Mat::ones(height, width, CV_32F) * 0.5f;
-    blurred_ = cv::Mat::zeros(height, width, CV_32F);
-    r_ = cv::Mat::ones(height, width, CV_32F) * 10.0f;
+    cv::Mat(height, width, CV_32F, cv::Scalar(1.0f))
+        .convertTo(pCorrection_, statistics);
+    cv::Mat(height, width, CV_32F, cv::Scalar(0.5f))
+        .convertTo(kalmanGain_, statistics);
+    blurred_ = cv::Mat::zeros(height, width, pixelType(precision_));
+    cv::Mat(height, width, CV_32F, cv::Scalar(10.0f))
+        .convertTo(r_, statistics);
 
-    q_ = 0.1f;           // Noise
-    d_ = 5;              // Bilateral filter diameter
-    sigmaValue_ = 25.0f; // Bilateral filter sigma
+    preFiltered_.create(height, width, CV_32F);
+    bfFrame_.create(height, width, CV_32F);
+    result_.create(height, width, CV_8U);
+    motion_.create(blockDistance_.grid(), CV_32F);
+    weights_.create(blockDistance_.grid(), CV_32F);
+
+    q_ = parameters.processNoise;
+    sigma_c_ = 50.0f; // Weight 0.5 at a mean block SSD of about 59
+    d_ = parameters.bilateralDiameter;
+    sigmaValue_ = parameters.bilateralSigma;
 }
 
 cv::Mat STKMBCpu::processFrame(const cv::Mat& frame) {
-    cv::Mat currentGray, currentFloat;
-    cv::cvtColor(frame, currentGray, cv::COLOR_BGR2GRAY);
-    currentGray.convertTo(currentFloat, CV_32F);
+    cv::Mat result;
+    processFrame(frame, result);
+    return result;
+}
+
+void STKMBCpu::processFrame(const cv::Mat& frame, cv::Mat& output) {
+    STKMB_PROFILE(Stage::Frame);
+    if (motionSearch_) {
+        followMotion(frame);
+    }
+    if (sparse_ && blockDistance_.grid().area() > 0) {
+        processFrameSparse(frame, output);
+        return;
+    }
+    if (pool_) {
+        processFrameTiled(frame, output);
+        return;
+    }
+    if (!frameGraphEnabled_) {
+        processFrameDirect(frame, output);
+        return;
+    }
+
+    const int key = frame.type() << 8 |
+        static_cast<int>(bilateralMode_) << 4 |
+        static_cast<int>(kalmanUpdate_);
+    if (!frameGraph_ || key != frameGraphKey_) {
+        buildFrameGraph(frame);
+        frameGraphKey_ = key;
+    }
+    frameGraph_->bindInput(graphInput_, frame);
+    frameGraph_->bindOutput(graphOutput_, output);
+    frameGraph_->run();
+}
 
-    cv::Mat preFiltered;
-    cv::blur(currentFloat, preFiltered, cv::Size(3, 3));
+void STKMBCpu::buildFrameGraph(const cv::Mat& frame) {
+    using Io = FrameGraph::Io;
+    using Plane = FrameGraph::Plane;
+    CV_Assert(frame.type() == CV_8UC3 || frame.type() == CV_8UC1);
+    CV_Assert(frame.rows == height && frame.cols == width);
+    const cv::Size size(width, height);
+    frameGraph_.reset();
+    auto graph = std::make_unique<FrameGraph>();
 
-    cv::Mat motionMeasure = blockMatchingWithHistory(preFiltered);
+    graphInput_ = graph->external("frame", size, frame.type());
+    graphOutput_ = graph->external("output", size, frame.type());
+    const Plane x = graph->bound("x", xCorrection_);
+    const Plane p = graph->bound("p", pCorrection_);
+    const Plane k = graph->bound("k", kalmanGain_);
+    const Plane r = graph->bound("r", r_);
+    const Plane blurred = graph->bound("blurred", blurred_);
+    const Plane z = graph->scratch("z", size, CV_32F);
+    const Plane preFiltered = graph->scratch("blur", size, CV_32F);
+    const Plane bilateral = graph->scratch("bilateral", size, CV_32F);
 
-    cv::blur(currentFloat, aux_, cv::Size(3, 3));
-    delta_ = blurred_ - aux_;
-    aux_.copyTo(blurred_);
+    // z(k), from the luma of gray frames directly
+    Plane gray = graphInput_;
+    if (frame.channels() == 3) {
+        gray = graph->scratch("gray", size, CV_8U);
+        graph->stage("bgr2gray", Stage::BgrToGray, true, { graphInput_ },
+            { gray }, [](const Io& io) {
+                cv::cvtColor(io.in(0), io.out(0), cv::COLOR_BGR2GRAY);
+            });
+    }
+    graph->stage("to32f", Stage::BgrToGray, true, { gray }, { z },
+        [](const Io& io) { io.in(0).convertTo(io.out(0), CV_32F); });
 
-    r_ = 1.0f + (r_).mul(1.0f / (1.0f + kalmanGain_));
+    const auto blur3x3 = [this](const Io& io) {
+        this->blur3x3(io.in(0), io.out(0));
+    };
+    graph->stage("blur3x3", Stage::Blur, false, { z }, { preFiltered },
+        blur3x3);
 
-    // Prediction step
-    xPredicted_ = xCorrection_.clone();
-    pPredicted_ = pCorrection_ + q_ * delta_.mul(delta_);
+    // Nothing on this path reads the motion map; the graph drops the stage
+    // until something does
+    if (blockDistance_.grid().area() > 0) {
+        const Plane motion = graph->scratch("motion", blockDistance_.grid(),
+            CV_32F);
+        graph->stage("blockmatch", Stage::BlockMatching, false,
+            { preFiltered }, { motion }, [this](const Io& io) {
+                blockDistance_.compute(io.in(0), io.out(0));
+            });
+    }
 
-    // Update step - Kalman gain
-    kalmanGain_ = pPredicted_ / (pPredicted_ + r_);
+    if (bilateralMode_ == BilateralMode::Fast) {
+        graph->stage("fastbilateral", Stage::Bilateral, false, { gray },
+            { bilateral }, [this](const Io& io) {
+                const int radius = fastBilateral_->radius();
+                cv::copyMakeBorder(io.in(0), paddedGray_, radius, radius,
+                    radius, radius, cv::BORDER_REFLECT_101);
+                fastBilateral_->apply(paddedGray_, io.out(0),
+                    bilateralBuffers_);
+            });
+    }
+    else {
+        graph->stage("bilateral", Stage::Bilateral, false, { z },
+            { bilateral }, [this](const Io& io) {
+                cv::bilateralFilter(io.in(0), io.out(0), d_, sigmaValue_,
+                    sigmaValue_);
+            });
+    }
 
-    cv::bilateralFilter(currentFloat, bfFrame_, d_, sigmaValue_, sigmaValue_);
+    // Kalman prediction and correction combining the bilateral result
+    const bool swapBlur = precision_ == StatePrecision::Float32 &&
+        kalmanUpdate_ == KalmanUpdate::Fused;
+    if (precision_ == StatePrecision::Compact) {
+        // Also stores the 3x3 blur of z(k) into blurred
+        graph->stage("kalman", Stage::Kalman, true,
+            { z, preFiltered, bilateral, blurred, x, p, k, r },
+            { blurred, x, p, k, r }, [this](const Io& io) {
+                kalmanUpdateCompact(io.in(0), io.in(1), io.in(2), q_,
+                    io.out(0), io.out(1), io.out(2), io.out(3), io.out(4));
+            });
+    }
+    else if (swapBlur) {
+        graph->stage("kalman", Stage::Kalman, true,
+            { z, preFiltered, bilateral, blurred, x, p, k, r },
+            { x, p, k, r }, [this](const Io& io) {
+                kalmanUpdateFused(io.in(0), io.in(1), io.in(2), io.in(3), q_,
+                    io.out(0), io.out(1), io.out(2), io.out(3));
+            });
+    }
+    else {
+        // The reference update blurs z(k) once more, which the graph shares
+        // with the pre-filter
+        const Plane again = graph->scratch("blur again", size, CV_32F);
+        graph->stage("blur3x3", Stage::Blur, false, { z }, { again },
+            blur3x3);
+        graph->stage("kalmanreference", Stage::Kalman, false,
+            { z, again, bilateral, blurred, x, p, k, r },
+            { x, p, k, r }, [this](const Io& io) {
+                kalmanUpdateReference(io.in(0), io.in(1), io.in(2), io.in(3),
+                    q_, io.out(0), io.out(1), io.out(2), io.out(3));
+            });
+        graph->stage("copy", Stage::Kalman, false, { again }, { blurred },
+            [](const Io& io) { io.in(0).copyTo(io.out(0)); });
+    }
 
-    // Calculate weights based on motion measure
-    cv::Mat weights = calculateWeights(motionMeasure);
+    // Result in 8 bits, and as BGR for BGR input; fused with the Kalman
+    // update into one pass
+    const double scale = outputScale();
+    const auto to8u = [scale](const Io& io) {
+        io.in(0).convertTo(io.out(0), CV_8U, scale);
+    };
+    if (frame.channels() == 1) {
+        graph->stage("to8u", Stage::GrayToBgr, true, { x }, { graphOutput_ },
+            to8u);
+    }
+    else {
+        const Plane result = graph->scratch("result", size, CV_8U);
+        graph->stage("to8u", Stage::GrayToBgr, true, { x }, { result }, to8u);
+        graph->stage("gray2bgr", Stage::GrayToBgr, true, { result },
+            { graphOutput_ }, [](const Io& io) {
+                cv::cvtColor(io.in(0), io.out(0), cv::COLOR_GRAY2BGR);
+            });
+    }
+    if (swapBlur) {
+        // The pre-filtered frame is already the 3x3 blur of z(k)
+        graph->swap(blurred, preFiltered);
+    }
 
-    // Final correction step combining Kalman and bilateral results
-    xCorrection_ =
-        (1.0f - kalmanGain_)
-        .mul(xPredicted_ + kalmanGain_.mul(currentFloat - xPredicted_)) +
-        kalmanGain_.mul(bfFrame_);
-    pCorrection_ = pPredicted_.mul(1.0f - kalmanGain_);
+    // Update frame history, the ring overwrites the oldest slot when full
+    graph->stage("history", Stage::History, false, { x }, {},
+        [this](const Io& io) {
+            const bool historyFull = pastFrames_.full();
+            blockDistance_.push(io.in(0),
+                historyFull ? &pastFrames_.front() : nullptr);
+            pastFrames_.push(io.in(0));
+            trimHistory();
+        });
 
-    // Update frame history
-    if (pastFrames_.size() >= maxHistory_) {
-        pastFrames_.pop_front();
+    graph->compile();
+    frameGraph_ = std::move(graph);
+}
+
+void STKMBCpu::blur3x3(const cv::Mat& src, cv::Mat& dst) {
+    cv::copyMakeBorder(src, paddedBlur_, 1, 1, 1, 1, cv::BORDER_REFLECT_101);
+    boxBlur3x3(paddedBlur_, dst);
+}
+
+void STKMBCpu::processFrameDirect(const cv::Mat& frame, cv::Mat& output) {
+    // Every plane below is engine-owned and keeps its size from the first
+    // frame on. Only the exact bilateral filter still allocates, inside
+    // cv::bilateralFilter; the fast one and the strip and sparse paths run on
+    // the engine's own kernels.
+    const cv::Mat* currentGray;
+    {
+        STKMB_PROFILE(Stage::BgrToGray);
+        currentGray = &toGray(frame, currentGray_);
+        currentGray->convertTo(currentFloat_, CV_32F);
     }
-    pastFrames_.push_back(xCorrection_.clone());
 
-    // Convert result to BGR
-    cv::Mat result;
-    xCorrection_.convertTo(result, CV_8U);
-    cv::cvtColor(result, result, cv::COLOR_GRAY2BGR);
+    {
+        STKMB_PROFILE(Stage::Blur);
+        blur3x3(currentFloat_, preFiltered_);
+    }
 
-    return result;
+    blockMatchingWithHistory(preFiltered_);
+
+    {
+        STKMB_PROFILE(Stage::Bilateral);
+        if (bilateralMode_ == BilateralMode::Fast) {
+            const int radius = fastBilateral_->radius();
+            cv::copyMakeBorder(*currentGray, paddedGray_, radius, radius,
+                radius, radius, cv::BORDER_REFLECT_101);
+            fastBilateral_->apply(paddedGray_, bfFrame_, bilateralBuffers_);
+        }
+        else {
+            cv::bilateralFilter(currentFloat_, bfFrame_, d_, sigmaValue_,
+                sigmaValue_);
+        }
+    }
+
+    // Kalman prediction and correction combining the bilateral result
+    {
+        STKMB_PROFILE(Stage::Kalman);
+        if (precision_ == StatePrecision::Compact) {
+            // Also stores the 3x3 blur of z(k) into blurred_
+            kalmanUpdateCompact(currentFloat_, preFiltered_, bfFrame_, q_,
+                blurred_, xCorrection_, pCorrection_, kalmanGain_, r_);
+        }
+        else if (kalmanUpdate_ == KalmanUpdate::Fused) {
+            // The pre-filtered frame is already the 3x3 blur of z(k)
+            kalmanUpdateFused(currentFloat_, preFiltered_, bfFrame_, blurred_,
+                q_, xCorrection_, pCorrection_, kalmanGain_, r_);
+            cv::swap(blurred_, preFiltered_);
+        }
+        else {
+            blur3x3(currentFloat_, aux_);
+            kalmanUpdateReference(currentFloat_, aux_, bfFrame_, blurred_, q_,
+                xCorrection_, pCorrection_, kalmanGain_, r_);
+            aux_.copyTo(blurred_);
+        }
+    }
+
+    // Update frame history, the ring overwrites the oldest slot when full
+    {
+        STKMB_PROFILE(Stage::History);
+        const bool historyFull = pastFrames_.full();
+        blockDistance_.push(xCorrection_,
+            historyFull ? &pastFrames_.front() : nullptr);
+        pastFrames_.push(xCorrection_);
+        trimHistory();
+    }
+
+    // Convert result to 8 bits, and to BGR for BGR input
+    STKMB_PROFILE(Stage::GrayToBgr);
+    if (frame.channels() == 1) {
+        xCorrection_.convertTo(output, CV_8U, outputScale());
+    }
+    else {
+        xCorrection_.convertTo(result_, CV_8U, outputScale());
+        cv::cvtColor(result_, output, cv::COLOR_GRAY2BGR);
+    }
+}
+
+void STKMBCpu::setBilateral(BilateralMode mode, int levels) {
+    bilateralMode_ = mode;
+    // The approximate filter is kept across switches to the exact one, so
+    // toggling between the two does not rebuild it
+    if (mode == BilateralMode::Fast &&
+        (!fastBilateral_ || fastBilateral_->levels() != levels)) {
+        fastBilateral_ = std::make_unique<FastBilateral>(d_, sigmaValue_,
+            sigmaValue_, levels);
+    }
+}
+
+void STKMBCpu::setHistoryDepth(int frames) {
+    CV_Assert(frames >= 1 && frames <= maxHistory_);
+    historyDepth_ = frames;
+    trimHistory();
+}
+
+void STKMBCpu::trimHistory() {
+    while (pastFrames_.size() > historyDepth_) {
+        blockDistance_.popOldest(pastFrames_.front());
+        pastFrames_.popFront();
+    }
+    if (blockDistance_.resyncDue()) {
+        blockDistance_.resync(pastFrames_);
+    }
+}
+
+void STKMBCpu::setParallel(int threads, int stripHeight) {
+    if (threads <= 0) {
+        pool_.reset();
+        strips_.clear();
+        return;
+    }
+    CV_Assert(stripHeight > 0);
+
+    pool_ = std::make_unique<ThreadPool>(threads);
+    bilateralLut_ = std::make_unique<BilateralLut>(d_, sigmaValue_, sigmaValue_);
+    // Rows of context the 3x3 blur and the bilateral window need
+    halo_ = std::max(1, bilateralLut_->radius());
+
+    // Strips start on block boundaries so block rows never straddle two
+    const int rowsPerStrip =
+        (stripHeight + blockSize - 1) / blockSize * blockSize;
+    const int gridRows = blockDistance_.grid().height;
+    strips_.clear();
+    for (int begin = 0; begin < height; begin += rowsPerStrip) {
+        Strip strip;
+        strip.rows = cv::Range(begin, std::min(height, begin + rowsPerStrip));
+        strip.blockRows = cv::Range(std::min(gridRows, begin / blockSize),
+            std::min(gridRows, strip.rows.end / blockSize));
+        strips_.push_back(std::move(strip));
+    }
+}
+
+void STKMBCpu::processFrameTiled(const cv::Mat& frame, cv::Mat& output) {
+    CV_Assert(frame.type() == CV_8UC3 || frame.type() == CV_8UC1);
+    output.create(height, width, frame.type());
+    const bool historyFull = pastFrames_.full();
+
+    pool_->parallelFor(static_cast<int>(strips_.size()), [&](int i) {
+        processStrip(strips_[i], frame, output, historyFull);
+        });
+
+    // Publish the history written strip by strip
+    blockDistance_.commitPush(historyFull);
+    pastFrames_.advance();
+    trimHistory();
+    if (precision_ != StatePrecision::Compact) {
+        cv::swap(blurred_, preFiltered_);
+    }
+}
+
+void STKMBCpu::setMotionCompensation(bool enabled, int levels) {
+    if (!enabled) {
+        motionSearch_.reset();
+        return;
+    }
+    motionSearch_ = std::make_unique<MotionSearch>(cv::Size(width, height),
+        blockSize, levels);
+    motionReference_.create(height, width, CV_8U);
+    compensatedPixels_.create(height, width, pixelType(precision_));
+    compensatedStatistics_.create(height, width, statisticsType(precision_));
+}
+
+void STKMBCpu::followMotion(const cv::Mat& frame) {
+    STKMB_PROFILE(Stage::MotionSearch);
+    xCorrection_.convertTo(motionReference_, CV_8U, outputScale());
+    motionSearch_->estimate(toGray(frame, currentGray_), motionReference_,
+        pool_.get());
+    if (motionSearch_->still()) {
+        return;
+    }
+
+    const cv::Mat& vectors = motionSearch_->vectors();
+    ThreadPool* pool = pool_.get();
+    auto shift = [&](cv::Mat& plane, cv::Mat& scratch) {
+        compensateMotion(plane, scratch, vectors, blockSize, pool);
+        cv::swap(plane, scratch);
+    };
+    shift(xCorrection_, compensatedPixels_);
+    shift(blurred_, compensatedPixels_);
+    shift(pCorrection_, compensatedStatistics_);
+    shift(kalmanGain_, compensatedStatistics_);
+    shift(r_, compensatedStatistics_);
+    if (sparse_) {
+        shift(bfFrame_, aux_); // Cached bilateral output, always CV_32F
+    }
+
+    // The history slots live in the ring's arena, so they are copied back,
+    // and the block sums are rebuilt from the shifted frames
+    for (int i = 0; i < pastFrames_.size(); ++i) {
+        cv::Mat slot = pastFrames_[i];
+        compensateMotion(slot, compensatedPixels_, vectors, blockSize, pool);
+        compensatedPixels_.copyTo(slot);
+    }
+    blockDistance_.clear();
+    for (const cv::Mat& past : pastFrames_) {
+        blockDistance_.push(past);
+    }
+}
+
+void STKMBCpu::setSparse(bool enabled, float activeWeight, int freezeAfter) {
+    sparse_ = enabled;
+    sparseCacheValid_ = false;
+    if (!enabled) {
+        return;
+    }
+    CV_Assert(activeWeight > 0.0f && activeWeight <= 1.0f && freezeAfter >= 0);
+    activeWeight_ = activeWeight;
+    freezeAfter_ = freezeAfter;
+
+    if (!bilateralLut_) {
+        bilateralLut_ = std::make_unique<BilateralLut>(d_, sigmaValue_,
+            sigmaValue_);
+    }
+    staticFrames_.create(blockDistance_.grid(), CV_32S);
+    staticFrames_.setTo(0);
+
+    // Every list can end up holding the whole grid
+    const size_t blocks = blockDistance_.grid().area();
+    activeBlocks_.reserve(blocks);
+    fullBlocks_.reserve(blocks);
+    temporalBlocks_.reserve(blocks);
+    frozenBlocks_.reserve(blocks);
 }
 
-cv::Mat STKMBCpu::blockMatchingWithHistory(const cv::Mat& current) {
-    cv::Mat totalMotion = cv::Mat::zeros(height, width, CV_32F);
+void STKMBCpu::setRegionPriority(bool enabled) {
+    regionPriority_ = enabled;
+    if (!enabled) {
+        return;
+    }
+    if (!sparse_) {
+        setSparse(true);
+    }
+    priorityBlocks_.assign(blockDistance_.grid().area(), 0);
+}
+
+void STKMBCpu::setPriorityRegions(const std::vector<cv::Rect>& regions) {
+    CV_Assert(regionPriority_);
+    const cv::Size grid = blockDistance_.grid();
+    std::fill(priorityBlocks_.begin(), priorityBlocks_.end(), 0);
+    const cv::Rect bounds(0, 0, width, height);
+    for (const cv::Rect& region : regions) {
+        const cv::Rect rect = region & bounds;
+        if (rect.empty() || grid.area() == 0) {
+            continue;
+        }
+        // The last block row and column also own the leftover pixels
+        const int x1 = std::min(grid.width - 1,
+            (rect.x + rect.width - 1) / blockSize);
+        const int y1 = std::min(grid.height - 1,
+            (rect.y + rect.height - 1) / blockSize);
+        for (int by = std::min(grid.height - 1, rect.y / blockSize);
+            by <= y1; ++by) {
+            for (int bx = std::min(grid.width - 1, rect.x / blockSize);
+                bx <= x1; ++bx) {
+                priorityBlocks_[by * grid.width + bx] = 1;
+            }
+        }
+    }
+}
+
+void STKMBCpu::processFrameSparse(const cv::Mat& frame, cv::Mat& output) {
+    // The frame is padded once for both the 3x3 blur and the bilateral
+    // windows, mirrored like the default border of cv::blur
+    const int radius = bilateralLut_->radius();
+    const int pad = std::max(1, radius);
+    {
+        STKMB_PROFILE(Stage::BgrToGray);
+        cv::copyMakeBorder(toGray(frame, currentGray_), paddedGray_, pad, pad,
+            pad, pad, cv::BORDER_REFLECT_101);
+        paddedGray_.convertTo(paddedFloat_, CV_32F);
+    }
+    const cv::Mat currentFloat = paddedFloat_(cv::Rect(pad, pad, width,
+        height));
+    {
+        STKMB_PROFILE(Stage::Blur);
+        boxBlur3x3(paddedFloat_(cv::Rect(pad - 1, pad - 1, width + 2,
+            height + 2)), preFiltered_);
+    }
+
+    calculateWeights(blockMatchingWithHistory(preFiltered_), weights_);
+    classifyBlocks(weights_);
+
+    const bool compact = precision_ == StatePrecision::Compact;
+    auto updateBlock = [&](const cv::Rect& rect, bool filter,
+        BlockScratch& scratch) {
+        cv::Mat bilateral = bfFrame_(rect);
+        if (filter) {
+            STKMB_PROFILE(Stage::Bilateral);
+            const cv::Mat window = paddedGray_(cv::Rect(
+                rect.x + pad - radius, rect.y + pad - radius,
+                rect.width + 2 * radius, rect.height + 2 * radius));
+            if (bilateralMode_ == BilateralMode::Fast) {
+                fastBilateral_->apply(window, bilateral,
+                    scratch.bilateralBuffers);
+            }
+            else {
+                bilateralLut_->apply(window, bilateral, scratch.filterScratch);
+            }
+        }
+
+        STKMB_PROFILE(Stage::Kalman);
+        cv::Mat previous = blurred_(rect);
+        cv::Mat x = xCorrection_(rect);
+        cv::Mat p = pCorrection_(rect);
+        cv::Mat k = kalmanGain_(rect);
+        cv::Mat r = r_(rect);
+        if (compact) {
+            kalmanUpdateCompact(currentFloat(rect), preFiltered_(rect),
+                bilateral, q_, previous, x, p, k, r);
+        }
+        else {
+            kalmanUpdateFused(currentFloat(rect), preFiltered_(rect),
+                bilateral, previous, q_, x, p, k, r);
+        }
+    };
+
+    // The block lists are cut into a fixed number of chunks, each with its
+    // own scratch buffers
+    const int chunks = pool_ ? 4 * pool_->size() : 1;
+    if (static_cast<int>(blockScratch_.size()) < chunks) {
+        blockScratch_.resize(chunks);
+    }
+    auto runBlocks = [&](const std::vector<cv::Rect>& blocks, bool filter) {
+        const size_t count = blocks.size();
+        auto body = [&](int chunk) {
+            const size_t begin = count * chunk / chunks;
+            const size_t end = count * (chunk + 1) / chunks;
+            for (size_t i = begin; i < end; ++i) {
+                updateBlock(blocks[i], filter, blockScratch_[chunk]);
+            }
+        };
+        if (pool_ && count > 1) {
+            pool_->parallelFor(chunks, body);
+        }
+        else if (count > 0) {
+            for (int chunk = 0; chunk < chunks; ++chunk) {
+                body(chunk);
+            }
+        }
+    };
+    runBlocks(fullBlocks_, true);
+    runBlocks(temporalBlocks_, false);
 
-    // Compare with each frame in history
-    for (const auto& pastFrame : pastFrames_) {
-        cv::Mat motionForFrame = cv::Mat::zeros(height, width, CV_32F);
+    // blurred_ must hold this frame's blur everywhere, frozen blocks included
+    if (compact) {
+        for (const cv::Rect& rect : frozenBlocks_) {
+            cv::Mat previous = blurred_(rect);
+            preFiltered_(rect).convertTo(previous, CV_16U, kFixedPointScale);
+        }
+    }
+    else {
+        cv::swap(blurred_, preFiltered_);
+    }
 
-        // Block matching
-        for (int y = 0; y < height - blockSize; y += blockSize) {
-            for (int x = 0; x < width - blockSize; x += blockSize) {
-                cv::Rect block(x, y, blockSize, blockSize);
+    {
+        STKMB_PROFILE(Stage::History);
+        const bool historyFull = pastFrames_.full();
+        blockDistance_.push(xCorrection_,
+            historyFull ? &pastFrames_.front() : nullptr);
+        pastFrames_.push(xCorrection_);
+        trimHistory();
+    }
 
-                // Calculate block difference as described in paper
-                cv::Mat currentBlock = current(block);
-                cv::Mat pastBlock = pastFrame(block);
+    STKMB_PROFILE(Stage::GrayToBgr);
+    if (frame.channels() == 1) {
+        xCorrection_.convertTo(output, CV_8U, outputScale());
+    }
+    else {
+        xCorrection_.convertTo(result_, CV_8U, outputScale());
+        cv::cvtColor(result_, output, cv::COLOR_GRAY2BGR);
+    }
+}
 
-                // L2 distance between blocks
-                cv::Mat diff;
-                cv::subtract(currentBlock, pastBlock, diff);
-                cv::multiply(diff, diff, diff);
-                float blockDist = cv::sum(diff)[0] / (blockSize * blockSize);
+void STKMBCpu::classifyBlocks(const cv::Mat& weights) {
+    const int gridWidth = weights.cols;
+    const int gridHeight = weights.rows;
+    activeBlocks_.assign(static_cast<size_t>(gridWidth) * gridHeight, 0);
+    for (int by = 0; by < gridHeight; ++by) {
+        const float* w = weights.ptr<float>(by);
+        for (int bx = 0; bx < gridWidth; ++bx) {
+            activeBlocks_[by * gridWidth + bx] = w[bx] < activeWeight_;
+        }
+    }
 
-                motionForFrame(block).setTo(blockDist);
+    fullBlocks_.clear();
+    temporalBlocks_.clear();
+    frozenBlocks_.clear();
+    for (int by = 0; by < gridHeight; ++by) {
+        int* still = staticFrames_.ptr<int>(by);
+        for (int bx = 0; bx < gridWidth; ++bx) {
+            // Active blocks spill onto their neighbours, whose filter
+            // windows reach into the moving area
+            bool active = false;
+            for (int ny = std::max(0, by - 1);
+                ny <= std::min(gridHeight - 1, by + 1) && !active; ++ny) {
+                for (int nx = std::max(0, bx - 1);
+                    nx <= std::min(gridWidth - 1, bx + 1); ++nx) {
+                    active = active || activeBlocks_[ny * gridWidth + nx];
+                }
             }
+            // With region priority only the regions get the filter; moving
+            // blocks elsewhere fall back to the temporal update
+            const bool filter = !sparseCacheValid_ || (regionPriority_
+                ? priorityBlocks_[by * gridWidth + bx] != 0 : active);
+
+            const cv::Rect rect = blockRect(bx, by);
+            if (filter) {
+                still[bx] = 0;
+                fullBlocks_.push_back(rect);
+            }
+            else if (active) {
+                still[bx] = 0;
+                temporalBlocks_.push_back(rect);
+            }
+            else if (++still[bx] <= freezeAfter_) {
+                temporalBlocks_.push_back(rect);
+            }
+            else {
+                frozenBlocks_.push_back(rect);
+            }
+        }
+    }
+    sparseCacheValid_ = true;
+
+    sparseStats_.full = static_cast<int>(fullBlocks_.size());
+    sparseStats_.temporal = static_cast<int>(temporalBlocks_.size());
+    sparseStats_.frozen = static_cast<int>(frozenBlocks_.size());
+}
+
+cv::Rect STKMBCpu::blockRect(int bx, int by) const {
+    // The last block row and column also take the pixels the block grid
+    // leaves over at the right and bottom edges
+    const cv::Size grid = blockDistance_.grid();
+    const int x = bx * blockSize;
+    const int y = by * blockSize;
+    return cv::Rect(x, y, bx == grid.width - 1 ? width - x : blockSize,
+        by == grid.height - 1 ? height - y : blockSize);
+}
+
+void STKMBCpu::processStrip(Strip& strip, const cv::Mat& frame,
+    cv::Mat& result, bool historyFull) {
+    const cv::Range rows = strip.rows;
+    const int top = std::max(0, rows.start - halo_);
+    const int bottom = std::min(height, rows.end + halo_);
+
+    // z(k) for the strip plus halo; past the frame edge the halo is mirrored
+    // like the default border of cv::blur and cv::bilateralFilter
+    {
+        STKMB_PROFILE(Stage::BgrToGray);
+        cv::copyMakeBorder(toGray(frame.rowRange(top, bottom), strip.gray),
+            strip.paddedGray,
+            halo_ - (rows.start - top), halo_ - (bottom - rows.end), halo_,
+            halo_, cv::BORDER_REFLECT_101);
+        strip.paddedGray.convertTo(strip.paddedFloat, CV_32F);
+    }
+
+    const int stripRows = rows.size();
+    cv::Mat z = strip.paddedFloat(cv::Rect(halo_, halo_, width, stripRows));
+
+    cv::Mat blurred = preFiltered_.rowRange(rows);
+    {
+        STKMB_PROFILE(Stage::Blur);
+        boxBlur3x3(strip.paddedFloat(cv::Rect(halo_ - 1, halo_ - 1, width + 2,
+            stripRows + 2)), blurred);
+    }
+
+    {
+        STKMB_PROFILE(Stage::BlockMatching);
+        blockDistance_.computeRows(preFiltered_, motion_, strip.blockRows,
+            strip.blockScratch);
+    }
+
+    const int radius = bilateralLut_->radius();
+    cv::Mat bilateral = bfFrame_.rowRange(rows);
+    {
+        STKMB_PROFILE(Stage::Bilateral);
+        const cv::Mat window = strip.paddedGray(cv::Rect(halo_ - radius,
+            halo_ - radius, width + 2 * radius, stripRows + 2 * radius));
+        if (bilateralMode_ == BilateralMode::Fast) {
+            fastBilateral_->apply(window, bilateral, strip.bilateralBuffers);
         }
+        else {
+            bilateralLut_->apply(window, bilateral, strip.filterScratch);
+        }
+    }
+
+    cv::Mat x = xCorrection_.rowRange(rows);
+    cv::Mat p = pCorrection_.rowRange(rows);
+    cv::Mat k = kalmanGain_.rowRange(rows);
+    cv::Mat r = r_.rowRange(rows);
+    {
+        STKMB_PROFILE(Stage::Kalman);
+        if (precision_ == StatePrecision::Compact) {
+            cv::Mat previous = blurred_.rowRange(rows);
+            kalmanUpdateCompact(z, blurred, bilateral, q_, previous, x, p, k, r);
+        }
+        else {
+            kalmanUpdateFused(z, blurred, bilateral, blurred_.rowRange(rows),
+                q_, x, p, k, r);
+        }
+    }
+
+    // History rows: the block summaries still need the oldest frame, which
+    // the ring slot about to be written holds when full
+    {
+        STKMB_PROFILE(Stage::History);
+        blockDistance_.pushRows(xCorrection_,
+            historyFull ? &pastFrames_.front() : nullptr, strip.blockRows,
+            strip.blockScratch);
+        cv::Mat slot = pastFrames_.nextSlot().rowRange(rows);
+        x.copyTo(slot);
+    }
+
+    // Convert result to 8 bits, and to BGR for BGR input
+    STKMB_PROFILE(Stage::GrayToBgr);
+    cv::Mat output = result.rowRange(rows);
+    if (frame.channels() == 1) {
+        x.convertTo(output, CV_8U, outputScale());
+    }
+    else {
+        x.convertTo(strip.output, CV_8U, outputScale());
+        cv::cvtColor(strip.output, output, cv::COLOR_GRAY2BGR);
+    }
+}
+
+size_t STKMBCpu::stateBytes() const {
+    return planeBytes(xCorrection_) + planeBytes(pCorrection_) +
+        planeBytes(kalmanGain_) + planeBytes(r_) + planeBytes(blurred_) +
+        pastFrames_.bytes() + blockDistance_.bytes();
+}
 
-        // Accumulate motion information
-        totalMotion += motionForFrame;
+std::string STKMBCpu::stateLayout() const {
+    std::string layout = "stkmb-cpu " + std::to_string(width) + "x" +
+        std::to_string(height) + " block" + std::to_string(blockSize) +
+        " history" + std::to_string(maxHistory_) +
+        (precision_ == StatePrecision::Compact ? " compact" : " float32");
+    const FilterParameters defaults;
+    if (q_ != defaults.processNoise || d_ != defaults.bilateralDiameter ||
+        sigmaValue_ != defaults.bilateralSigma) {
+        layout += " q" + std::to_string(q_) + " d" + std::to_string(d_) +
+            " sigma" + std::to_string(sigmaValue_);
     }
+    if (sparse_) {
+        layout += " sparse" + std::to_string(activeWeight_) + "/" +
+            std::to_string(freezeAfter_);
+    }
+    else if (pool_) {
+        layout += " strips" + std::to_string(strips_.front().rows.size());
+    }
+    if (bilateralMode_ == BilateralMode::Fast) {
+        layout += " fast" + std::to_string(fastBilateral_->levels());
+    }
+    if (kalmanUpdate_ == KalmanUpdate::Reference) {
+        layout += " reference";
+    }
+    if (historyDepth_ < maxHistory_) {
+        layout += " depth" + std::to_string(historyDepth_);
+    }
+    if (motionSearch_) {
+        layout += " motion" + std::to_string(motionSearch_->levels());
+    }
+    if (regionPriority_) {
+        layout += " roi";
+    }
+    return layout;
+}
+
+void STKMBCpu::saveState(StateWriter& state) const {
+    state.plane(xCorrection_);
+    state.plane(pCorrection_);
+    state.plane(kalmanGain_);
+    state.plane(r_);
+    state.plane(blurred_);
 
-    // Average motion over all past frames
-    totalMotion /= static_cast<float>(pastFrames_.size());
+    state.value(pastFrames_.size());
+    for (const cv::Mat& frame : pastFrames_) {
+        state.plane(frame);
+    }
+    blockDistance_.saveState(state);
+
+    // The sparse path reuses the last bilateral output of static blocks
+    if (sparse_) {
+        state.value(sparseCacheValid_);
+        state.plane(staticFrames_);
+        state.plane(bfFrame_);
+    }
+    if (motionSearch_) {
+        motionSearch_->saveState(state);
+    }
+}
+
+void STKMBCpu::restoreState(StateReader& state) {
+    state.plane(xCorrection_);
+    state.plane(pCorrection_);
+    state.plane(kalmanGain_);
+    state.plane(r_);
+    state.plane(blurred_);
+
+    const int frames = state.value();
+    if (frames < 1 || frames > historyDepth_) {
+        throw std::invalid_argument("Frame history does not match");
+    }
+    pastFrames_.clear();
+    for (int i = 0; i < frames; ++i) {
+        const cv::Mat& frame = state.plane();
+        if (frame.size() != xCorrection_.size() ||
+            frame.type() != xCorrection_.type()) {
+            throw std::invalid_argument("Frame history does not match");
+        }
+        pastFrames_.push(frame);
+    }
+    blockDistance_.restoreState(state);
+
+    if (sparse_) {
+        sparseCacheValid_ = state.value() != 0;
+        state.plane(staticFrames_);
+        state.plane(bfFrame_);
+    }
+    if (motionSearch_) {
+        motionSearch_->restoreState(state);
+    }
+}
 
-    return totalMotion;
+const cv::Mat& STKMBCpu::blockMatchingWithHistory(const cv::Mat& current) {
+    // Single pass against the cached history sums instead of one pass and
+    // one ROI per block for every past frame
+    STKMB_PROFILE(Stage::BlockMatching);
+    blockDistance_.compute(current, motion_);
+    return motion_;
 }
 
-cv::Mat STKMBCpu::calculateWeights(const cv::Mat& motionMeasure) {
-    cv::Mat weights;
-    cv::exp(-motionMeasure.mul(motionMeasure) / (2.0f * sigma_c_ * sigma_c_),
-        weights);
-    return weights;
+void STKMBCpu::calculateWeights(const cv::Mat& motionMeasure,
+    cv::Mat& weights) {
+    // exp(-m^2 / (2 sigma_c^2)) in place, without expression temporaries
+    cv::multiply(motionMeasure, motionMeasure, weights,
+        -1.0 / (2.0 * sigma_c_ * sigma_c_));
+    cv::exp(weights, weights);
 }
\ No newline at end of file
@@ -1,40 +1,252 @@
 #pragma once
-#include <deque>
+#include "block_distance.hpp"
+#include "engine_state.hpp"
+#include "fast_bilateral.hpp"
+#include "filter_parameters.hpp"
+#include "fixed_point.hpp"
+#include "frame_graph.hpp"
+#include "frame_ring.hpp"
+#include "kalman_kernel.hpp"
+#include "motion_search.hpp"
+#include "strip_filters.hpp"
+#include "thread_pool.hpp"
+#include <memory>
 #include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Block counts of the last frame of the sparse path
+struct SparseStats {
+	int full = 0;     // Bilateral filter and Kalman update
+	int temporal = 0; // Kalman update with the cached bilateral output
+	int frozen = 0;   // Previous output kept
+};
 
 class STKMBCpu {
 public:
-	STKMBCpu(const cv::Mat& firstFrame, int historySize = 5);
+	STKMBCpu(const cv::Mat& firstFrame, int historySize = 5,
+		int blockSize = 8,
+		StatePrecision precision = StatePrecision::Float32,
+		const FilterParameters& parameters = {});
 
+	// frame is BGR (CV_8UC3) or luma (CV_8UC1); the result has the same
+	// type. firstFrame may be either as well.
 	cv::Mat processFrame(const cv::Mat& frame);
 
+	// Same, writing the result into output (reused when it already has the
+	// frame size and type)
+	void processFrame(const cv::Mat& frame, cv::Mat& output);
+
+	// Select the implementation of the Kalman update (fused by default).
+	// Compact state always uses its own fused kernel.
+	void setKalmanUpdate(KalmanUpdate mode) { kalmanUpdate_ = mode; }
+
+	StatePrecision statePrecision() const { return precision_; }
+
+	// Run the whole-frame path on its stage graph (default) or on the
+	// hand-written sequence the graph replaced, kept for validation and
+	// benchmarking. Both give the same output.
+	void setFrameGraph(bool enabled) { frameGraphEnabled_ = enabled; }
+
+	// Stage graph of the last whole-frame graph run, or nullptr
+	const FrameGraph* frameGraph() const { return frameGraph_.get(); }
+
+	// Select the bilateral filter of the correction term. Fast uses
+	// FastBilateral with the given number of range levels (more is closer
+	// to the exact filter) on both the whole-frame and the strip path.
+	// Switching back and forth with the same levels reuses the filter.
+	void setBilateral(BilateralMode mode, int levels = 8);
+
+	// Frames of history the block matching compares against, 1 up to the
+	// constructor's historySize. Fewer is cheaper for the history update and
+	// less robust to noise. Lowering it drops the oldest frames at once;
+	// raising it lets the history grow back over the next frames. The ring
+	// keeps its capacity, so switching never allocates.
+	void setHistoryDepth(int frames);
+	int historyDepth() const { return historyDepth_; }
+
+	// Heap allocations made by the frame history; stays 1 in steady state
+	size_t historyAllocations() const { return pastFrames_.allocations(); }
+
+	// Bytes of the state carried from frame to frame: Kalman planes, frame
+	// history and block summaries (per-frame scratch planes excluded)
+	size_t stateBytes() const;
+
+	// Split every frame into horizontal strips of stripHeight rows (rounded
+	// up to whole blocks) and run the full per-frame pipeline on each strip,
+	// with its own halo, on a pool of the given number of threads. The strip
+	// layout does not depend on the thread count, so the output is identical
+	// for any number of threads. threads = 0 returns to the whole-frame path.
+	void setParallel(int threads, int stripHeight = 32);
+
+	// Motion-adaptive sparse processing. Blocks whose motion weight
+	// (calculateWeights) falls below activeWeight, and their neighbours, get
+	// the bilateral filter and the full Kalman update. Other blocks run the
+	// Kalman update against their last bilateral output, and blocks static
+	// for more than freezeAfter frames keep their previous output. Only the
+	// cheap full-frame passes (conversion, 3x3 blur, block matching,
+	// history) still touch every pixel. Takes precedence over the strip
+	// path; the active blocks run on its pool when there is one.
+	void setSparse(bool enabled, float activeWeight = 0.5f,
+		int freezeAfter = 30);
+
+	const SparseStats& sparseStats() const { return sparseStats_; }
+
+	// Region-of-interest mode of the sparse path, which it switches on with
+	// its defaults when it is off. Only blocks touching a priority region
+	// get the bilateral filter and the full Kalman update; moving blocks
+	// elsewhere run the temporal update and static ones freeze as usual.
+	void setRegionPriority(bool enabled);
+
+	// Regions, in pixels, of the next frames until the next call; an empty
+	// list leaves every block on the cheap paths
+	void setPriorityRegions(const std::vector<cv::Rect>& regions);
+
+	// Motion-compensated filtering. Before each frame, block vectors from
+	// the previous output to the new frame (MotionSearch with the given
+	// pyramid levels) shift the Kalman state, the previous blur and the
+	// frame history along with the content, so the temporal filter keeps
+	// working on pans and moving objects instead of switching off wherever
+	// the picture moves. Frames without motion skip the shift. Applies to
+	// every path and uses the strip pool when there is one.
+	void setMotionCompensation(bool enabled, int levels = 3);
+
+	// Vectors of the last frame (CV_32SC2, one per block), or nullptr
+	const cv::Mat* motionVectors() const {
+		return motionSearch_ ? &motionSearch_->vectors() : nullptr;
+	}
+
+	// Checkpoint support. The layout names the frame size and every setting
+	// that changes the output; a state restores only into an engine with
+	// the same layout, which then continues exactly as the saved one would.
+	// The caller may append planes of its own after the engine's.
+	std::string stateLayout() const;
+	void saveState(StateWriter& state) const;
+	void restoreState(StateReader& state);
+
 private:
-	cv::Mat blockMatchingWithHistory(const cv::Mat& current);
+	// Per-strip buffers of the parallel path, reused across frames
+	struct Strip {
+		cv::Range rows;
+		cv::Range blockRows;
+		cv::Mat gray, paddedGray, paddedFloat, output;
+		std::vector<float> filterScratch;
+		FastBilateral::Buffers bilateralBuffers;
+		std::vector<float> blockScratch;
+	};
+
+	// Per-chunk buffers of the sparse path
+	struct BlockScratch {
+		std::vector<float> filterScratch;
+		FastBilateral::Buffers bilateralBuffers;
+	};
+
+	void processFrameDirect(const cv::Mat& frame, cv::Mat& output);
+	void processFrameTiled(const cv::Mat& frame, cv::Mat& output);
+
+	// Declare the whole-frame pipeline for frames like frame under the
+	// current settings
+	void buildFrameGraph(const cv::Mat& frame);
+	void processFrameSparse(const cv::Mat& frame, cv::Mat& output);
+
+	// Shift the carried state along the motion from the last output to frame
+	void followMotion(const cv::Mat& frame);
+
+	// Drop the oldest history frames beyond historyDepth_, and rebuild the
+	// block distance sums once per history cycle
+	void trimHistory();
+
+	// Sort the blocks into fullBlocks_, temporalBlocks_ and frozenBlocks_
+	void classifyBlocks(const cv::Mat& weights);
+	cv::Rect blockRect(int bx, int by) const;
+	void processStrip(Strip& strip, const cv::Mat& frame, cv::Mat& result,
+		bool historyFull);
 
-	cv::Mat calculateWeights(const cv::Mat& motionMeasure);
+	// 3x3 box blur of a CV_32F plane with cv::blur's default border, through
+	// paddedBlur_ so that no frame allocates
+	void blur3x3(const cv::Mat& src, cv::Mat& dst);
+
+	// Block-level mean SSD of current against the history (one value per block)
+	const cv::Mat& blockMatchingWithHistory(const cv::Mat& current);
+
+	void calculateWeights(const cv::Mat& motionMeasure, cv::Mat& weights);
+
+	// Scale from the stored state to 8-bit grey levels
+	double outputScale() const {
+		return precision_ == StatePrecision::Compact ? kFixedPointUnit : 1.0;
+	}
 
 	// Dimensions and parameters
 	int width, height, blockSize;
 	int maxHistory_;
+	int historyDepth_; // Frames block matching uses, up to maxHistory_
 	float q_;          // Process noise
-	float sigma_c_;    // Weight calculation parameter
+	float sigma_c_;    // Motion weight scale, in mean block SSD units
 	int d_;            // Bilateral filter diameter
 	float sigmaValue_; // Bilateral filter sigma
+	KalmanUpdate kalmanUpdate_ = KalmanUpdate::Fused;
+	BilateralMode bilateralMode_ = BilateralMode::Exact;
+	StatePrecision precision_;
 
 	// Frame history
-	std::deque<cv::Mat> pastFrames_;
+	FrameRing pastFrames_;
+	BlockDistanceCache blockDistance_; // Per-block summaries of pastFrames_
+	cv::Mat motion_;                   // Block motion map
 
-	// Kalman filter matrices
-	cv::Mat xPredicted_;  // Predicted state
-	cv::Mat pPredicted_;  // Predicted error covariance
+	// Kalman filter matrices. In compact mode x and blurred are Q8.8 CV_16U
+	// and P, K and R CV_16F
 	cv::Mat xCorrection_; // Corrected state
 	cv::Mat pCorrection_; // Corrected error covariance
 	cv::Mat kalmanGain_;  // Kalman gain
 	cv::Mat r_;           // Measurement noise
 	cv::Mat blurred_;     // Previous blurred frame
 
-	// Auxiliary matrices
-	cv::Mat delta_;
+	// Per-frame workspace, sized from the first frame so that steady-state
+	// frames reuse it instead of allocating
 	cv::Mat aux_;
+	cv::Mat currentGray_;  // z(k) as 8-bit gray (BGR input only)
+	cv::Mat currentFloat_; // z(k), CV_32F (hand-written path)
+	cv::Mat result_;       // 8-bit gray result before the BGR expansion
 	cv::Mat bfFrame_;
+	cv::Mat preFiltered_;  // 3x3 blur of z(k)
+	cv::Mat paddedBlur_;   // Input of the 3x3 blur with its one-pixel border
+	cv::Mat weights_;      // Block motion weights of the sparse path
+
+	// Whole-frame path. The graph is rebuilt when the frame type or a
+	// setting that changes its stages does.
+	bool frameGraphEnabled_ = true;
+	std::unique_ptr<FrameGraph> frameGraph_;
+	int frameGraphKey_ = -1;
+	FrameGraph::Plane graphInput_ = -1, graphOutput_ = -1;
+
+	// Approximate bilateral filter
+	std::unique_ptr<FastBilateral> fastBilateral_;
+	FastBilateral::Buffers bilateralBuffers_;
+	cv::Mat paddedGray_;  // Whole-frame padded input of the bilateral filters
+	cv::Mat paddedFloat_; // paddedGray_ as CV_32F (sparse path)
+
+	// Sparse path
+	bool sparse_ = false;
+	bool sparseCacheValid_ = false; // bfFrame_ holds every block's last output
+	float activeWeight_ = 0.5f;
+	int freezeAfter_ = 30;
+	cv::Mat staticFrames_;          // Frames each block has been static (CV_32S)
+	std::vector<uchar> activeBlocks_;
+	std::vector<cv::Rect> fullBlocks_, temporalBlocks_, frozenBlocks_;
+	std::vector<BlockScratch> blockScratch_;
+	SparseStats sparseStats_;
+	bool regionPriority_ = false;
+	std::vector<uchar> priorityBlocks_; // Blocks under a priority region
+
+	// Motion compensation
+	std::unique_ptr<MotionSearch> motionSearch_;
+	cv::Mat motionReference_;       // Last output, 8-bit
+	cv::Mat compensatedPixels_;     // Shift targets, swapped with the state
+	cv::Mat compensatedStatistics_;
+
+	// Parallel path
+	std::unique_ptr<ThreadPool> pool_;
+	std::unique_ptr<BilateralLut> bilateralLut_;
+	std::vector<Strip> strips_;
+	int halo_ = 0;
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 ﻿#include "stmkb_gpu.hpp"
+#include "profiler.hpp"
 
 STKMBGpu::STKMBGpu(const cv::cuda::GpuMat& firstFrame, float q, float r,
     int maskSize, int bilateralD, double bilateralSigma)
@@ -37,27 +38,39 @@ STKMBGpu::STKMBGpu(const cv::cuda::GpuMat& firstFrame, float q, float r,
 void STKMBGpu::process(const cv::cuda::GpuMat& input,
     cv::cuda::GpuMat& output) {
 
+    // Calls run on the default stream, so each scope measures completed
+    // device work rather than just the launch
+    STKMB_PROFILE(Stage::Frame);
+
     // z(k)
     input.convertTo(floatFrame_, CV_32F);
 
     // Pre-filtering
-    avgFilter_->apply(floatFrame_, aux_);
+    {
+        STKMB_PROFILE(Stage::Blur);
+        avgFilter_->apply(floatFrame_, aux_);
+    }
 
     // Apply bilateral filter BF(z(k), d, σ)
-    cv::cuda::bilateralFilter(floatFrame_, temp1_, bilateralD_, bilateralSigma_,
-        bilateralSigma_ / 2.0);
-    cv::cuda::bilateralFilter(temp1_, bfFrame_, bilateralD_, bilateralSigma_,
-        bilateralSigma_ / 2.0);
+    {
+        STKMB_PROFILE(Stage::Bilateral);
+        cv::cuda::bilateralFilter(floatFrame_, temp1_, bilateralD_,
+            bilateralSigma_, bilateralSigma_ / 2.0);
+        cv::cuda::bilateralFilter(temp1_, bfFrame_, bilateralD_,
+            bilateralSigma_, bilateralSigma_ / 2.0);
+    }
+
+    STKMB_PROFILE(Stage::Kalman);
 
     // Cδ = blurred(k-1) - blurred(k)
     cv::cuda::subtract(blurred_, aux_, delta_);
     aux_.copyTo(blurred_);
 
-    // Update measurement noise R(k) = 1 + R(k-1)/(1 + K(k-1))
-    cv::cuda::GpuMat ones(r_.size(), CV_32F, cv::Scalar(1.0f));
-    cv::cuda::add(ones, k_, temp1_);
+    // Update measurement noise R(k) = 1 + R(k-1)/(1 + K(k-1)). The constant
+    // is passed as a scalar so no device buffer is allocated per frame
+    cv::cuda::add(k_, cv::Scalar(1.0f), temp1_);
     cv::cuda::divide(r_, temp1_, r_);
-    cv::cuda::add(ones, r_, r_);
+    cv::cuda::add(r_, cv::Scalar(1.0f), r_);
 
     // Kalman prediction
     xCorrection_.copyTo(xPredicted_);
@@ -76,13 +89,13 @@ void STKMBGpu::process(const cv::cuda::GpuMat& input,
     cv::cuda::multiply(k_, temp1_, temp1_);
     cv::cuda::add(xPredicted_, temp1_, temp1_);
 
-    cv::cuda::subtract(ones, k_, temp2_);
+    cv::cuda::subtract(cv::Scalar(1.0f), k_, temp2_);
     cv::cuda::multiply(temp2_, temp1_, temp1_);
     cv::cuda::multiply(k_, bfFrame_, temp2_);
     cv::cuda::add(temp1_, temp2_, xCorrection_);
 
     // Update error covariance
-    cv::cuda::subtract(ones, k_, temp1_);
+    cv::cuda::subtract(cv::Scalar(1.0f), k_, temp1_);
     cv::cuda::multiply(pPredicted_, temp1_, pCorrection_);
 
     cv::cuda::addWeighted(xCorrection_, 0.7, prevCorrection_, 0.3, 0.0,
@@ -90,4 +103,32 @@ void STKMBGpu::process(const cv::cuda::GpuMat& input,
     xCorrection_.copyTo(prevCorrection_);
 
     xCorrection_.convertTo(output, CV_8UC1);
-}
\ No newline at end of file
+}
+
+std::string STKMBGpu::stateLayout() const {
+    return "stkmb-gpu " + std::to_string(xCorrection_.cols) + "x" +
+        std::to_string(xCorrection_.rows) + " q" + std::to_string(q_) +
+        " mask" + std::to_string(maskSize_) + " bilateral" +
+        std::to_string(bilateralD_) + "/" + std::to_string(bilateralSigma_);
+}
+
+void STKMBGpu::saveState(StateWriter& state) const {
+    // prevCorrection_ always equals xCorrection_ between frames
+    xCorrection_.download(state.slot());
+    pCorrection_.download(state.slot());
+    k_.download(state.slot());
+    r_.download(state.slot());
+    blurred_.download(state.slot());
+}
+
+void STKMBGpu::restoreState(StateReader& state) {
+    for (cv::cuda::GpuMat* plane :
+        { &xCorrection_, &pCorrection_, &k_, &r_, &blurred_ }) {
+        const cv::Mat& source = state.plane();
+        if (source.size() != plane->size() || source.type() != plane->type()) {
+            throw std::invalid_argument("Engine state plane does not match");
+        }
+        plane->upload(source);
+    }
+    xCorrection_.copyTo(prevCorrection_);
+}
@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include "engine_state.hpp"
 #include "opencv2/core.hpp"
 #include "opencv2/cudaarithm.hpp"
 #include "opencv2/cudafilters.hpp"
@@ -33,4 +34,9 @@ public:
         int maskSize = 5, int bilateralD = 7, double bilateralSigma = 35.0);
 
     void process(const cv::cuda::GpuMat& input, cv::cuda::GpuMat& output);
+
+    // Checkpoint support: the Kalman planes, downloaded to host memory
+    std::string stateLayout() const;
+    void saveState(StateWriter& state) const;
+    void restoreState(StateReader& state);
 };
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "strip_filters.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+BilateralLut::BilateralLut(int d, float sigmaColor, float sigmaSpace) {
+    CV_Assert(d > 0 && sigmaColor > 0.0f && sigmaSpace > 0.0f);
+    radius_ = d / 2;
+
+    const double colorCoeff = -0.5 / (sigmaColor * sigmaColor);
+    const double spaceCoeff = -0.5 / (sigmaSpace * sigmaSpace);
+
+    for (int i = 0; i < 256; ++i) {
+        colorWeights_[i] = static_cast<float>(std::exp(i * i * colorCoeff));
+    }
+
+    // Circular window, as in cv::bilateralFilter
+    for (int dy = -radius_; dy <= radius_; ++dy) {
+        for (int dx = -radius_; dx <= radius_; ++dx) {
+            const double r = std::sqrt(static_cast<double>(dy * dy + dx * dx));
+            if (r > radius_) {
+                continue;
+            }
+            tapY_.push_back(dy);
+            tapX_.push_back(dx);
+            tapWeights_.push_back(static_cast<float>(std::exp(r * r * spaceCoeff)));
+        }
+    }
+}
+
+void BilateralLut::apply(const cv::Mat& padded, cv::Mat& dst,
+    std::vector<float>& scratch) const {
+    CV_Assert(padded.type() == CV_8U);
+    const int rows = padded.rows - 2 * radius_;
+    const int cols = padded.cols - 2 * radius_;
+    CV_Assert(rows > 0 && cols > 0);
+    dst.create(rows, cols, CV_32F);
+
+    if (scratch.size() < 2 * static_cast<size_t>(cols)) {
+        scratch.resize(2 * static_cast<size_t>(cols));
+    }
+    float* sums = scratch.data();
+    float* weights = sums + cols;
+    const int taps = static_cast<int>(tapWeights_.size());
+
+    for (int y = 0; y < rows; ++y) {
+        const uchar* center = padded.ptr<uchar>(y + radius_) + radius_;
+        std::fill(sums, sums + 2 * cols, 0.0f);
+
+        // Tap-major so each pass streams one neighbour row
+        for (int t = 0; t < taps; ++t) {
+            const uchar* neighbour =
+                padded.ptr<uchar>(y + radius_ + tapY_[t]) + radius_ + tapX_[t];
+            const float spatial = tapWeights_[t];
+            for (int x = 0; x < cols; ++x) {
+                const int value = neighbour[x];
+                const float w = spatial * colorWeights_[std::abs(value - center[x])];
+                sums[x] += w * value;
+                weights[x] += w;
+            }
+        }
+
+        float* out = dst.ptr<float>(y);
+        for (int x = 0; x < cols; ++x) {
+            out[x] = sums[x] / weights[x];
+        }
+    }
+}
+
+void boxBlur3x3(const cv::Mat& padded, cv::Mat& dst) {
+    CV_Assert(padded.type() == CV_32F);
+    const int rows = padded.rows - 2;
+    const int cols = padded.cols - 2;
+    CV_Assert(rows > 0 && cols > 0);
+    dst.create(rows, cols, CV_32F);
+
+    const float scale = 1.0f / 9.0f;
+    for (int y = 0; y < rows; ++y) {
+        const float* above = padded.ptr<float>(y);
+        const float* middle = padded.ptr<float>(y + 1);
+        const float* below = padded.ptr<float>(y + 2);
+        float* out = dst.ptr<float>(y);
+        for (int x = 0; x < cols; ++x) {
+            const float column0 = above[x] + middle[x] + below[x];
+            const float column1 = above[x + 1] + middle[x + 1] + below[x + 1];
+            const float column2 = above[x + 2] + middle[x + 2] + below[x + 2];
+            out[x] = (column0 + column1 + column2) * scale;
+        }
+    }
+}
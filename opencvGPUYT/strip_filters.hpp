@@ -0,0 +1,35 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Filters for the strip-parallel CPU path. Both work on an input that already
+// carries its border, so a strip of the frame plus its halo rows gives
+// exactly the same pixels as the whole frame would: unlike
+// cv::bilateralFilter on CV_32F, whose range weights depend on the min/max
+// of the ROI it is given, nothing here looks beyond the filter window.
+
+// Bilateral filter of an 8-bit plane with weights taken from precomputed
+// tables. The input is padded by radius() pixels on every side; dst gets the
+// unpadded size and CV_32F. Uses the same circular window and Gaussian
+// weights as cv::bilateralFilter, but exact per integer intensity difference
+// instead of interpolated, and keeps the result in float.
+class BilateralLut {
+public:
+    BilateralLut(int d, float sigmaColor, float sigmaSpace);
+
+    // scratch holds two rows of accumulators and is grown on first use
+    void apply(const cv::Mat& padded, cv::Mat& dst,
+        std::vector<float>& scratch) const;
+
+    int radius() const { return radius_; }
+
+private:
+    int radius_;
+    std::vector<int> tapY_, tapX_;   // Window offsets within the radius
+    std::vector<float> tapWeights_;  // Spatial weight of each tap
+    float colorWeights_[256];        // Range weight per |difference|
+};
+
+// 3x3 box blur of a CV_32F plane padded by one pixel on every side into dst
+// (unpadded size, CV_32F). dst may be a view into a larger plane.
+void boxBlur3x3(const cv::Mat& padded, cv::Mat& dst);
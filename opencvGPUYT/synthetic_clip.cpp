@@ -0,0 +1,49 @@
+#include "synthetic_clip.hpp"
+#include "add_noise.hpp"
+#include <algorithm>
+#include <cmath>
+
+std::vector<cv::Mat> makeSyntheticClip(const cv::Size& size, int frames,
+    float noiseStd, uint64_t seed, int panStep) {
+    CV_Assert(size.area() > 0 && frames > 0 && panStep >= 0);
+
+    // Wide canvas so every frame is a shifted crop of the same scene
+    cv::RNG rng(seed);
+    cv::Mat canvas(size.height, size.width + panStep * frames, CV_8UC3);
+    for (int y = 0; y < canvas.rows; ++y) {
+        cv::Vec3b* row = canvas.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < canvas.cols; ++x) {
+            const uchar value = cv::saturate_cast<uchar>(127.5 + 90.0 *
+                std::sin(0.02 * x) * std::cos(0.015 * y));
+            row[x] = cv::Vec3b(value, value, value);
+        }
+    }
+    const int shapes = std::max(1, canvas.size().area() / 20000);
+    for (int i = 0; i < shapes; ++i) {
+        const cv::Point corner(rng.uniform(0, canvas.cols),
+            rng.uniform(0, canvas.rows));
+        const cv::Size extent(rng.uniform(4, 64), rng.uniform(4, 64));
+        cv::rectangle(canvas, cv::Rect(corner, extent),
+            cv::Scalar::all(rng.uniform(0, 256)), cv::FILLED);
+    }
+
+    // addNoiseGray draws from the global generator
+    cv::theRNG().state = seed;
+
+    const int square = std::max(8, size.height / 10);
+    std::vector<cv::Mat> clip;
+    clip.reserve(frames);
+    for (int f = 0; f < frames; ++f) {
+        cv::Mat frame =
+            canvas(cv::Rect(panStep * f, 0, size.width, size.height)).clone();
+        const int x = (f * 7) % std::max(1, size.width - square);
+        const int y = (size.height - square) / 2;
+        cv::rectangle(frame, cv::Rect(x, y, square, square),
+            cv::Scalar::all(230), cv::FILLED);
+
+        cv::Mat noisy;
+        addNoiseGray(frame, noisy, noiseStd);
+        clip.push_back(noisy);
+    }
+    return clip;
+}
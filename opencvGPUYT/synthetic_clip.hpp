@@ -0,0 +1,11 @@
+#pragma once
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Deterministic synthetic BGR clip for benchmarks: a textured scene panning
+// panStep pixels per frame with a square moving across it, passed through
+// addNoiseGray with the given noise level. panStep = 0 is a static camera
+// where only the square moves. The same seed always gives the same frames.
+std::vector<cv::Mat> makeSyntheticClip(const cv::Size& size, int frames,
+    float noiseStd, uint64_t seed = 12345, int panStep = 2);
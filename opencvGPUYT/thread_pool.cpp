@@ -0,0 +1,132 @@
+#include "thread_pool.hpp"
+#include <stdexcept>
+
+ThreadPool::ThreadPool(int threads) {
+    if (threads < 1) {
+        throw std::invalid_argument("ThreadPool needs at least one thread");
+    }
+
+    for (int i = 0; i < threads; ++i) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    // Worker 0 is whoever calls parallelFor
+    for (int i = 1; i < threads; ++i) {
+        workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::run(int count, Invoke invoke, const void* target) {
+    if (count <= 0) {
+        return;
+    }
+    if (workers_.empty() || count == 1) {
+        for (int i = 0; i < count; ++i) {
+            invoke(target, i);
+        }
+        return;
+    }
+
+    Batch batch;
+    batch.invoke = invoke;
+    batch.target = target;
+    batch.remaining = count;
+
+    // Deal the indices round-robin so every worker starts with local work
+    const int queues = size();
+    for (int q = 0; q < queues; ++q) {
+        std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+        for (int i = q; i < count; i += queues) {
+            queues_[q]->tasks.push_back({ &batch, i });
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        queued_ += count;
+    }
+    wake_.notify_all();
+
+    // Help until our batch is drained, then wait for the stragglers
+    Task task;
+    while (batch.remaining.load() > 0 && tryPop(0, task)) {
+        run(task);
+    }
+    std::unique_lock<std::mutex> lock(doneMutex_);
+    done_.wait(lock, [&] { return batch.remaining.load() == 0; });
+    lock.unlock();
+
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+bool ThreadPool::tryPop(int self, Task& task) {
+    const int queues = size();
+    for (int i = 0; i < queues; ++i) {
+        const int victim = (self + i) % queues;
+        Queue& queue = *queues_[victim];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.head == queue.tasks.size()) {
+            continue;
+        }
+        if (victim == self) {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        else {
+            task = queue.tasks[queue.head++];
+        }
+        if (queue.head == queue.tasks.size()) {
+            queue.tasks.clear();
+            queue.head = 0;
+        }
+
+        std::lock_guard<std::mutex> wakeLock(wakeMutex_);
+        --queued_;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(const Task& task) {
+    Batch* batch = task.batch;
+    try {
+        batch->invoke(batch->target, task.index);
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(batch->errorMutex);
+        if (!batch->error) {
+            batch->error = std::current_exception();
+        }
+    }
+    if (batch->remaining.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(doneMutex_);
+        done_.notify_all();
+    }
+}
+
+void ThreadPool::workerLoop(int self) {
+    for (;;) {
+        Task task;
+        if (tryPop(self, task)) {
+            run(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        wake_.wait(lock, [&] { return stop_ || queued_ > 0; });
+        if (stop_ && queued_ == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Work-stealing pool for data-parallel loops. Each worker owns a task queue,
+// pops from its back and steals from the front of the others when it runs
+// dry. The calling thread joins in as worker 0, so a pool of size 1 starts no
+// threads and runs everything inline. Once the queues have grown to the
+// largest batch seen, dispatching a batch does not touch the heap.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Run body(i) for every i in [0, count) and return once all are done.
+    // The first exception thrown by body is rethrown here. Safe to call from
+    // several threads at once. body is only referenced, never copied.
+    template <typename Body>
+    void parallelFor(int count, Body&& body) {
+        using Target = std::remove_reference_t<Body>;
+        run(count, [](const void* target, int index) {
+            (*static_cast<Target*>(const_cast<void*>(target)))(index);
+            }, std::addressof(body));
+    }
+
+    int size() const { return static_cast<int>(queues_.size()); }
+
+private:
+    using Invoke = void (*)(const void* target, int index);
+
+    struct Batch {
+        Invoke invoke;
+        const void* target;
+        std::atomic<int> remaining;
+        std::mutex errorMutex;
+        std::exception_ptr error;
+    };
+
+    struct Task {
+        Batch* batch;
+        int index;
+    };
+
+    // Owner pops from the back, thieves take from head; storage is kept
+    // when the queue drains
+    struct Queue {
+        std::mutex mutex;
+        std::vector<Task> tasks;
+        size_t head = 0;
+    };
+
+    void run(int count, Invoke invoke, const void* target);
+
+    // Pop from our own queue, else steal from the others
+    bool tryPop(int self, Task& task);
+    void run(const Task& task);
+    void workerLoop(int self);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    int queued_ = 0; // Tasks pushed and not yet popped, guarded by wakeMutex_
+    bool stop_ = false;
+
+    std::mutex doneMutex_;
+    std::condition_variable done_;
+};
@@ -0,0 +1,223 @@
+#include "tuning_profile.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+    bool parseSize(const std::string& text, cv::Size& size) {
+        const size_t x = text.find('x');
+        if (x == std::string::npos) {
+            return false;
+        }
+        size = cv::Size(std::atoi(text.substr(0, x).c_str()),
+            std::atoi(text.substr(x + 1).c_str()));
+        return size.width > 0 && size.height > 0;
+    }
+
+    TuningProfile parseProfile(const std::string& line) {
+        std::istringstream fields(line);
+        std::string sizeText;
+        TuningProfile profile;
+        if (!(fields >> sizeText) || !parseSize(sizeText, profile.size)) {
+            throw std::invalid_argument("bad frame size");
+        }
+
+        std::map<std::string, double> values;
+        std::string key;
+        double value = 0.0;
+        while (fields >> key) {
+            if (!(fields >> value) || !values.emplace(key, value).second) {
+                throw std::invalid_argument("bad value of " + key);
+            }
+        }
+        auto take = [&](const char* name, bool required) {
+            const auto found = values.find(name);
+            if (found == values.end()) {
+                if (required) {
+                    throw std::invalid_argument(std::string("no ") + name);
+                }
+                return 0.0;
+            }
+            const double result = found->second;
+            values.erase(found);
+            return result;
+        };
+
+        TuningSettings& settings = profile.settings;
+        profile.noise = static_cast<float>(take("noise", true));
+        settings.filter.processNoise = static_cast<float>(take("q", true));
+        settings.filter.bilateralDiameter =
+            static_cast<int>(take("diameter", true));
+        settings.filter.bilateralSigma =
+            static_cast<float>(take("sigma", true));
+        settings.bilateralLevels = static_cast<int>(take("levels", true));
+        settings.historySize = static_cast<int>(take("history", true));
+        settings.blockSize = static_cast<int>(take("block", true));
+        settings.sparse = take("sparse", true) != 0.0;
+        profile.psnr = take("psnr", false);
+        profile.ssim = take("ssim", false);
+        profile.fps = take("fps", false);
+        if (!values.empty()) {
+            throw std::invalid_argument("unknown key " + values.begin()->first);
+        }
+        if (profile.noise < 0.0f || !(settings.filter.processNoise > 0.0f) ||
+            settings.filter.bilateralDiameter < 1 ||
+            !(settings.filter.bilateralSigma > 0.0f) ||
+            settings.bilateralLevels < 0 || settings.historySize < 1 ||
+            settings.blockSize < 1) {
+            throw std::invalid_argument("setting out of range");
+        }
+        return profile;
+    }
+
+    std::string formatProfile(const TuningProfile& profile) {
+        std::ostringstream line;
+        line << profile.size.width << "x" << profile.size.height << " noise "
+            << profile.noise << " " << profile.settings.describe() << " psnr "
+            << profile.psnr << " ssim " << profile.ssim << " fps "
+            << profile.fps;
+        return line.str();
+    }
+
+} // namespace
+
+TuningSettings TuningSettings::from(const DenoiserOptions& options) {
+    TuningSettings settings;
+    settings.filter = options.filter;
+    settings.bilateralLevels = options.bilateralLevels;
+    settings.historySize = options.historySize;
+    settings.blockSize = options.blockSize;
+    settings.sparse = options.sparse;
+    return settings;
+}
+
+void TuningSettings::applyTo(DenoiserOptions& options) const {
+    options.filter = filter;
+    options.bilateralLevels = bilateralLevels;
+    options.historySize = historySize;
+    options.blockSize = blockSize;
+    options.sparse = sparse;
+}
+
+std::string TuningSettings::describe() const {
+    std::ostringstream text;
+    text << "q " << filter.processNoise << " diameter "
+        << filter.bilateralDiameter << " sigma " << filter.bilateralSigma
+        << " levels " << bilateralLevels << " history " << historySize
+        << " block " << blockSize << " sparse " << (sparse ? 1 : 0);
+    return text.str();
+}
+
+std::vector<TuningProfile> loadTuningProfiles(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Cannot read tuning profiles '" + path + "'");
+    }
+    std::vector<TuningProfile> profiles;
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number) {
+        const size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+        try {
+            profiles.push_back(parseProfile(line));
+        }
+        catch (const std::invalid_argument& error) {
+            throw std::runtime_error("Tuning profiles '" + path + "', line " +
+                std::to_string(number) + ": " + error.what());
+        }
+    }
+    return profiles;
+}
+
+void saveTuningProfile(const std::string& path, const TuningProfile& profile) {
+    std::vector<TuningProfile> profiles;
+    if (std::filesystem::exists(path)) {
+        profiles = loadTuningProfiles(path);
+    }
+    bool replaced = false;
+    for (TuningProfile& existing : profiles) {
+        if (existing.size == profile.size && existing.noise == profile.noise) {
+            existing = profile;
+            replaced = true;
+        }
+    }
+    if (!replaced) {
+        profiles.push_back(profile);
+    }
+
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary);
+        file << "# STKMB tuning profiles: frame size, noise std, settings and"
+            " what they measured\n";
+        for (const TuningProfile& entry : profiles) {
+            file << formatProfile(entry) << "\n";
+        }
+        if (!file.flush()) {
+            throw std::runtime_error("Cannot write tuning profiles '" +
+                temporary + "'");
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        throw std::runtime_error("Cannot replace tuning profiles '" + path +
+            "': " + error.message());
+    }
+}
+
+const TuningProfile* findTuningProfile(
+    const std::vector<TuningProfile>& profiles, const cv::Size& size,
+    float noise) {
+    // Size first, then noise level
+    const TuningProfile* best = nullptr;
+    double bestSize = std::numeric_limits<double>::max();
+    double bestNoise = std::numeric_limits<double>::max();
+    for (const TuningProfile& profile : profiles) {
+        const double sizeDistance = profile.size == size ? -1.0
+            : std::abs(static_cast<double>(profile.size.area()) - size.area());
+        const double noiseDistance = std::abs(profile.noise - noise);
+        if (sizeDistance < bestSize ||
+            (sizeDistance == bestSize && noiseDistance < bestNoise)) {
+            best = &profile;
+            bestSize = sizeDistance;
+            bestNoise = noiseDistance;
+        }
+    }
+    return best;
+}
+
+float estimateNoise(const cv::Mat& frame) {
+    CV_Assert(frame.type() == CV_8UC1 || frame.type() == CV_8UC3);
+    CV_Assert(frame.rows >= 3 && frame.cols >= 3);
+    cv::Mat gray;
+    if (frame.channels() == 3) {
+        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        gray = frame;
+    }
+
+    // Difference of two Laplacians: zero on planes and ramps, variance
+    // 36 sigma^2 on white noise
+    const cv::Mat mask = (cv::Mat_<float>(3, 3) <<
+        1, -2, 1,
+        -2, 4, -2,
+        1, -2, 1);
+    cv::Mat response;
+    gray.convertTo(response, CV_32F);
+    cv::filter2D(response, response, CV_32F, mask);
+    const cv::Mat inner = cv::abs(response(cv::Rect(1, 1, gray.cols - 2,
+        gray.rows - 2)));
+    const double total = cv::sum(inner)[0];
+    return static_cast<float>(std::sqrt(CV_PI / 2.0) * total /
+        (6.0 * inner.total()));
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "denoiser.hpp"
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// The CPU denoiser settings the autotuner searches (autotune.hpp)
+struct TuningSettings {
+    FilterParameters filter;
+    int bilateralLevels = 0; // 0 = exact bilateral filter
+    int historySize = 5;
+    int blockSize = 8;
+    bool sparse = false;
+
+    static TuningSettings from(const DenoiserOptions& options);
+    void applyTo(DenoiserOptions& options) const;
+
+    // "q 0.1 diameter 5 sigma 25 levels 0 history 5 block 8 sparse 0"
+    std::string describe() const;
+};
+
+// Settings chosen for one frame size and noise level, with what they
+// measured on the tuning clip
+struct TuningProfile {
+    cv::Size size;
+    float noise = 0.0f; // Standard deviation of the added noise
+    TuningSettings settings;
+    double psnr = 0.0;
+    double ssim = 0.0;
+    double fps = 0.0;
+};
+
+// Profiles are kept in a text file, one per line: the frame size followed
+// by key/value pairs, as in
+//
+//   1280x720 noise 10 q 0.1 diameter 5 sigma 25 levels 8 history 5 block 8
+//
+// then sparse, psnr, ssim and fps. Blank lines and lines starting with '#'
+// are skipped. Loading throws std::runtime_error when the file cannot be
+// read or a line does not parse.
+std::vector<TuningProfile> loadTuningProfiles(const std::string& path);
+
+// Add profile to the file at path, replacing the one for the same size and
+// noise level. The file is written next to path and renamed over it.
+void saveTuningProfile(const std::string& path, const TuningProfile& profile);
+
+// Profile for frames of the given size and noise level: the closest noise
+// level among the profiles of that size, or of the closest pixel count when
+// no profile has the size. nullptr when there are none.
+const TuningProfile* findTuningProfile(
+    const std::vector<TuningProfile>& profiles, const cv::Size& size,
+    float noise);
+
+// Standard deviation of the white noise in a gray (CV_8UC1) or BGR frame,
+// from the mean absolute response to a Laplacian difference mask that
+// cancels smooth image structure (Immerkaer's estimator)
+float estimateNoise(const cv::Mat& frame);
@@ -1,170 +1,584 @@
 #include "video_processor.hpp"
+#include "frame_store.hpp"
 #include "add_noise.hpp"
+#include "profiler.hpp"
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
+#include <functional>
+#include <iomanip>
 #include <iostream>
 #include <opencv2/opencv.hpp>
+#include <thread>
+
+namespace {
+
+    // Retry op until it succeeds, counting the wait as a stall of the stage.
+    // Spins briefly, then backs off to short sleeps so a waiting stage does
+    // not burn a core. Gives up (returns false) when stop becomes set.
+    template <typename Op, typename Stalls>
+    bool waitUntil(Op&& op, Stalls& stalls, const std::atomic<bool>* stop) {
+        if (op()) {
+            return true;
+        }
+        const auto begin = std::chrono::steady_clock::now();
+        bool done = false;
+        for (int attempt = 0; !(done = op()); ++attempt) {
+            if (stop && stop->load(std::memory_order_relaxed)) {
+                break;
+            }
+            if (attempt < 64) {
+                std::this_thread::yield();
+            }
+            else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+        const auto waited = std::chrono::steady_clock::now() - begin;
+        stalls.count.fetch_add(1, std::memory_order_relaxed);
+        stalls.nanoseconds.fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count(),
+            std::memory_order_relaxed);
+        return done;
+    }
+
+    // Decoder and encoder threads of process(), ended and joined on every
+    // way out of it: an exception from the denoise loop stops the decoder
+    // and lets the encoder drain, instead of leaving them joinable
+    class PipelineThreads {
+    public:
+        PipelineThreads(SpscQueue<int>& denoised, int endOfStream,
+            std::atomic<bool>& stop)
+            : denoised_(denoised), endOfStream_(endOfStream), stop_(stop) {}
+
+        ~PipelineThreads() {
+            if (decoder.joinable() || encoder.joinable()) {
+                stop_ = true;
+                join();
+            }
+        }
+
+        PipelineThreads(const PipelineThreads&) = delete;
+        PipelineThreads& operator=(const PipelineThreads&) = delete;
+
+        // End the denoised queue and wait for both stages
+        void join() {
+            // The queue has room for every slot plus the marker
+            denoised_.tryPush(endOfStream_);
+            if (decoder.joinable()) {
+                decoder.join();
+            }
+            if (encoder.joinable()) {
+                encoder.join();
+            }
+        }
+
+        std::thread decoder;
+        std::thread encoder;
+
+    private:
+        SpscQueue<int>& denoised_;
+        int endOfStream_;
+        std::atomic<bool>& stop_;
+    };
+
+    const char* colorModeName(ColorMode mode) {
+        switch (mode) {
+        case ColorMode::Luma: return "luma";
+        case ColorMode::Yuv: return "yuv";
+        case ColorMode::YuvChroma: return "yuv-chroma";
+        default: return "bgr";
+        }
+    }
+
+    bool isYuv(ColorMode mode) {
+        return mode == ColorMode::Yuv || mode == ColorMode::YuvChroma;
+    }
+
+    // cv::VideoWriter with the first codec the backend accepts
+    class VideoWriterSink : public FrameSink {
+    public:
+        VideoWriterSink(const std::string& path, const StreamInfo& info,
+            bool color)
+            : format_(color ? FrameFormat::Bgr : FrameFormat::Gray) {
+            const std::vector<int> codecs = {
+                cv::VideoWriter::fourcc('H', '2', '6', '4'),
+                cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
+                cv::VideoWriter::fourcc('X', 'V', 'I', 'D'),
+                cv::VideoWriter::fourcc('D', 'I', 'V', 'X')
+            };
+
+            for (const auto& codec : codecs) {
+                writer_.open(path, codec, info.fps(), info.size, color);
+
+                if (writer_.isOpened()) {
+                    std::cout << "Usando cdec: "
+                        << static_cast<char>(codec & 0xFF)
+                        << static_cast<char>((codec >> 8) & 0xFF)
+                        << static_cast<char>((codec >> 16) & 0xFF)
+                        << static_cast<char>((codec >> 24) & 0xFF) << std::endl;
+                    return;
+                }
+            }
+            throw std::runtime_error(
+                "No se pudo crear el archivo de video de salida");
+        }
+
+        FrameFormat format() const override { return format_; }
+        void write(const cv::Mat& frame) override { writer_.write(frame); }
+        void close() override { writer_.release(); }
+
+    private:
+        FrameFormat format_;
+        cv::VideoWriter writer_;
+    };
+
+} // namespace
 
 void VideoProcessor::process() {
-    cv::Mat frame, processed_frame;
     int frame_number = 0;
     ProgressBar progress(frame_count_);
 
-    if (!readAndInitializeFirstFrame(frame)) {
+    // Buffers are allocated on first use by the decoder and then reused;
+    // queues hold slot indices plus room for the end-of-stream marker
+    const int depth = std::max(1, queueDepth_);
+    std::vector<FrameSlot> slots(depth);
+    SpscQueue<int> freeSlots(depth + 1), decoded(depth + 1), denoised(depth + 1);
+
+    // The first frame initialises the denoiser and is then processed like
+    // any other, so the output has as many frames as the input
+    if (!readAndInitializeFirstFrame(slots[0])) {
         return;
     }
+    decoded.tryPush(0);
+    for (int i = 1; i < depth; ++i) {
+        freeSlots.tryPush(i);
+    }
+    stopPipeline_ = false;
+    if (deadlineOptions_.budgetMs > 0.0) {
+        deadline_ = std::make_unique<DeadlineController>(deadlineOptions_,
+            denoiser_->qualityLevels());
+    }
+
+    PipelineThreads threads(denoised, END_OF_STREAM, stopPipeline_);
+    threads.decoder = std::thread(&VideoProcessor::decodeStage, this,
+        std::ref(slots), std::ref(freeSlots), std::ref(decoded));
+    threads.encoder = std::thread(&VideoProcessor::encodeStage, this,
+        std::ref(slots), std::ref(denoised), std::ref(freeSlots));
 
     // Procesar los fotogramas
-    while (cap_.read(frame)) {
+    for (;;) {
+        int index = END_OF_STREAM;
+        waitUntil([&] { return decoded.tryPop(index); }, denoiseStalls_,
+            nullptr);
+        if (index == END_OF_STREAM) {
+            break;
+        }
+
         try {
-            processFrame(frame);
-            output_.write(processed_frame);
-            progress.update(++frame_number);
+            FrameSlot& slot = slots[index];
+            if (!deadline_) {
+                processFrame(slot.input, slot.output);
+            }
+            else if (deadline_->dropNext() && !lastOutput_.empty()) {
+                lastOutput_.copyTo(slot.output);
+                deadline_->dropped();
+            }
+            else {
+                const auto begin = std::chrono::steady_clock::now();
+                processFrame(slot.input, slot.output);
+                denoiser_->setQualityLevel(deadline_->update(
+                    std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - begin).count()));
+                slot.output.copyTo(lastOutput_);
+            }
         }
-        catch (const cv::Exception& e) {
+        catch (const std::exception& e) {
             std::cerr << "\nError al procesar el fotograma " << frame_number << ": "
                 << e.what() << std::endl;
+            stopPipeline_ = true;
             break;
         }
+
+        // The queue has room for every slot, so this never waits
+        denoised.tryPush(index);
+        Profiler::frameDone();
+        progress.update(++frame_number);
+        if (checkpointWriter_ && frame_number % checkpoints_.interval == 0) {
+            saveCheckpoint(frame_number);
+        }
     }
 
+    threads.join();
+
     finalizeProcessing();
+    printPipelineStats();
+    if (deadline_) {
+        printDeadlineReport();
+    }
+
+    // A finished job has nothing left to resume
+    if (checkpointWriter_ && !stopPipeline_) {
+        try {
+            checkpointWriter_->flush();
+        }
+        catch (const std::exception&) {
+            // The checkpoint is deleted anyway
+        }
+        checkpointWriter_.reset();
+        std::error_code error;
+        std::filesystem::remove(checkpoints_.path, error);
+    }
+}
+
+void VideoProcessor::saveCheckpoint(int processed) {
+    try {
+        // Queued by encodeStage() once the output has every frame it covers
+        checkpointWriter_->hold(*denoiser_, streams_.startFrame + processed);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "\nAviso: no se pudo guardar el punto de control: "
+            << e.what() << std::endl;
+    }
+}
+
+std::string VideoProcessor::checkpointContext() const {
+    return std::string("color ") + colorModeName(colorMode_);
+}
+
+void VideoProcessor::loadCheckpoint() {
+    jobFirstFrame_ = streams_.startFrame;
+    if (!checkpoints_.resume || checkpoints_.path.empty() ||
+        !std::filesystem::exists(checkpoints_.path)) {
+        return;
+    }
+
+    resume_ = std::make_unique<Checkpoint>(readCheckpoint(checkpoints_.path));
+    if (resume_->context != checkpointContext()) {
+        throw std::runtime_error("El punto de control se guard con otra "
+            "configuracin (" + resume_->context + ")");
+    }
+
+    // Same command line as the interrupted run: the frame range is the
+    // job's, minus what the checkpoint already covers
+    jobFirstFrame_ = static_cast<int>(resume_->firstFrame);
+    const int done = static_cast<int>(resume_->nextFrame - resume_->firstFrame);
+    if (streams_.frameLimit > 0) {
+        streams_.frameLimit -= done;
+        if (streams_.frameLimit <= 0) {
+            throw std::runtime_error("El trabajo del punto de control ya "
+                "est completo");
+        }
+    }
+    streams_.startFrame = static_cast<int>(resume_->nextFrame);
+
+    // Keep what the interrupted run wrote
+    const std::filesystem::path output(streams_.outputPath);
+    if (streams_.outputPath != "-" && std::filesystem::exists(output)) {
+        streams_.outputPath = (output.parent_path() / (output.stem().string() +
+            "_" + std::to_string(streams_.startFrame) +
+            output.extension().string())).string();
+    }
+    std::cout << "Reanudando desde el fotograma " << streams_.startFrame
+        << " (" << checkpoints_.path << "), salida en "
+        << streams_.outputPath << std::endl;
+}
+
+void VideoProcessor::decodeStage(std::vector<FrameSlot>& slots,
+    SpscQueue<int>& freeSlots, SpscQueue<int>& decoded) {
+    for (;;) {
+        int index = END_OF_STREAM;
+        if (!waitUntil([&] { return freeSlots.tryPop(index); }, decodeStalls_,
+            &stopPipeline_)) {
+            break;
+        }
+        try {
+            if (stopPipeline_ || !readFrame(slots[index])) {
+                break;
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << "\nError al leer el fotograma: " << e.what()
+                << std::endl;
+            stopPipeline_ = true;
+            break;
+        }
+        decoded.tryPush(index);
+    }
+    decoded.tryPush(END_OF_STREAM);
+}
+
+void VideoProcessor::encodeStage(std::vector<FrameSlot>& slots,
+    SpscQueue<int>& denoised, SpscQueue<int>& freeSlots) {
+    const FrameFormat format = pipelineFormat(colorMode_);
+    bool failed = false;
+    int written = 0;
+    for (;;) {
+        int index = END_OF_STREAM;
+        waitUntil([&] { return denoised.tryPop(index); }, encodeStalls_,
+            nullptr);
+        if (index == END_OF_STREAM) {
+            break;
+        }
+        // After a write error the remaining frames are only recycled
+        FrameSlot& slot = slots[index];
+        try {
+            const cv::Mat* frame = &slot.output;
+            if (!failed && sink_->format() != format) {
+                STKMB_PROFILE(Stage::GrayToBgr);
+                convertFrame(slot.output, format, slot.encoded,
+                    sink_->format());
+                frame = &slot.encoded;
+            }
+            if (!failed) {
+                STKMB_PROFILE(Stage::Encode);
+                sink_->write(*frame);
+                ++written;
+                if (checkpointWriter_) {
+                    checkpointWriter_->release(streams_.startFrame + written);
+                }
+            }
+        }
+        catch (const std::exception& e) {
+            std::cerr << "\nError al escribir el fotograma: " << e.what()
+                << std::endl;
+            failed = true;
+            stopPipeline_ = true;
+        }
+        freeSlots.tryPush(index);
+    }
+}
+
+void VideoProcessor::printPipelineStats() const {
+    auto report = [](const char* stage, const StageStalls& stalls) {
+        std::cout << "  " << stage << ": " << stalls.count.load()
+            << " esperas, " << std::fixed << std::setprecision(1)
+            << stalls.nanoseconds.load() / 1.0e6 << " ms\n";
+    };
+    std::cout << "Pipeline (profundidad " << queueDepth_ << "):\n";
+    report("decodificador (sin buffer libre)", decodeStalls_);
+    report("denoiser (sin fotograma)", denoiseStalls_);
+    report("codificador (sin fotograma)", encodeStalls_);
+    std::cout.flush();
+}
+
+void VideoProcessor::printDeadlineReport() const {
+    const DeadlineReport report = deadline_->report();
+    std::cout << std::fixed << std::setprecision(1)
+        << "Tiempo real (presupuesto " << deadlineOptions_.budgetMs
+        << " ms):\n  a tiempo: " << report.hitRate() * 100.0 << "% de "
+        << report.frames << " fotogramas, descartados " << report.dropped
+        << "\n  latencia p50 " << report.p50 << " ms, p95 " << report.p95
+        << " ms, p99 " << report.p99 << " ms, mx " << report.max
+        << " ms\n  cambios de calidad: " << report.switches
+        << ", fotogramas por nivel:";
+    for (int frames : report.framesPerLevel) {
+        std::cout << " " << frames;
+    }
+    std::cout << std::endl;
 }
 
 void VideoProcessor::initializeVideo() {
-    if (!cap_.isOpened()) {
-        throw std::runtime_error("No se pudo abrir el video: " +
-            std::string(input_path_));
+    source_ = openFrameSource(input_path_, streams_.inputFormat,
+        streams_.rawSize, streams_.rawFps);
+    if (streams_.startFrame > 0 && !source_->seek(streams_.startFrame)) {
+        throw std::runtime_error("No se puede saltar al fotograma " +
+            std::to_string(streams_.startFrame));
     }
 
-    frame_count_ = static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_COUNT));
-    fps_ = cap_.get(cv::CAP_PROP_FPS);
-    frame_width_ = static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_WIDTH));
-    frame_height_ = static_cast<int>(cap_.get(cv::CAP_PROP_FRAME_HEIGHT));
+    // Frames this run will see
+    const StreamInfo& info = source_->info();
+    frame_count_ = info.frameCount > 0 ?
+        std::max(0, info.frameCount - streams_.startFrame) : 0;
+    if (streams_.frameLimit > 0) {
+        frame_count_ = frame_count_ > 0 ?
+            std::min(frame_count_, streams_.frameLimit) : streams_.frameLimit;
+    }
+    fps_ = info.fps();
+    frame_width_ = info.size.width;
+    frame_height_ = info.size.height;
+
+    if (isYuv(colorMode_) && (frame_width_ % 2 != 0 || frame_height_ % 2 != 0)) {
+        throw std::runtime_error(
+            "El modo YUV 4:2:0 necesita un ancho y un alto pares");
+    }
 
     printVideoProperties();
 }
 
 void VideoProcessor::initializeWriter() {
-    std::filesystem::path output_path(OUTPUT_FILE);
+    sink_ = openOutputSink(streams_, source_->info(), colorMode_);
+}
 
-    // Verifica si la carpeta existe, si no, la crea
-    std::filesystem::path dir = output_path.parent_path();
-    if (!std::filesystem::exists(dir)) {
-        std::filesystem::create_directories(dir);
+bool VideoProcessor::readFrame(FrameSlot& slot) {
+    if (streams_.frameLimit > 0 && framesRead_ == streams_.frameLimit) {
+        return false;
     }
 
-    const std::vector<int> codecs = {
-        cv::VideoWriter::fourcc('H', '2', '6', '4'),
-        cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
-        cv::VideoWriter::fourcc('X', 'V', 'I', 'D'),
-        cv::VideoWriter::fourcc('D', 'I', 'V', 'X')
-    };
-
-    bool writer_initialized = false;
-    for (const auto& codec : codecs) {
-        output_.open(OUTPUT_FILE, codec, fps_,
-            cv::Size(frame_width_, frame_height_), true);
-
-        if (output_.isOpened()) {
-            std::cout << "Usando cdec: "
-                << static_cast<char>(codec & 0xFF)
-                << static_cast<char>((codec >> 8) & 0xFF)
-                << static_cast<char>((codec >> 16) & 0xFF)
-                << static_cast<char>((codec >> 24) & 0xFF) << std::endl;
-            writer_initialized = true;
-            break;
+    // Sources already in the pipeline's layout read straight into the
+    // denoiser's input buffer (a frame store maps its frames there without
+    // copying); others are converted once here
+    const FrameFormat sourceFormat = source_->info().format;
+    const FrameFormat format = pipelineFormat(colorMode_);
+    const bool direct = sourceFormat == format;
+    {
+        STKMB_PROFILE(Stage::Decode);
+        if (!source_->read(direct ? slot.input : slot.decoded)) {
+            return false;
         }
     }
+    if (!direct) {
+        STKMB_PROFILE(Stage::BgrToGray);
+        convertFrame(slot.decoded, sourceFormat, slot.input, format);
+    }
+    ++framesRead_;
+    return true;
+}
+
+void VideoProcessor::processFrame(const cv::Mat& input, cv::Mat& output) {
+    denoiseFrame(*denoiser_, colorMode_, input, output);
+}
 
-    if (!writer_initialized) {
-        throw std::runtime_error("No se pudo crear el archivo de video de salida");
+FrameFormat pipelineFormat(ColorMode mode) {
+    switch (mode) {
+    case ColorMode::Luma: return FrameFormat::Gray;
+    case ColorMode::Yuv:
+    case ColorMode::YuvChroma: return FrameFormat::I420;
+    default: return FrameFormat::Bgr;
     }
 }
 
-void VideoProcessor::processFrame(const cv::Mat& input) {
-    if (isCpu_) {
-        cv::Mat output;
-        output = stkmbCpu_->processFrame(input);
-        output_.write(output);
+std::unique_ptr<FrameSink> openOutputSink(const StreamOptions& streams,
+    const StreamInfo& info, ColorMode mode) {
+    const std::string& path = streams.outputPath;
+    const StreamFormat format = resolveStreamFormat(streams.outputFormat, path);
+    if (path == "-" && format != StreamFormat::Y4m &&
+        format != StreamFormat::Gray) {
+        throw std::runtime_error(
+            "La salida estndar solo admite los formatos y4m y gray");
     }
-    else {
-        frameGpu_.upload(input);
 
-        // Convertir a escala de grises si es necesario
-        if (input.channels() == 3) {
-            cv::cuda::cvtColor(frameGpu_, outputGpu_, cv::COLOR_BGR2GRAY);
-            frameGpu_ = outputGpu_; // Guardar la versin en escala de grises
+    // Verifica si la carpeta existe, si no, la crea
+    if (path != "-") {
+        std::filesystem::path dir = std::filesystem::path(path).parent_path();
+        if (!dir.empty() && !std::filesystem::exists(dir)) {
+            std::filesystem::create_directories(dir);
         }
+    }
 
-        // Procesar con el denoiser
-        stkmbGpu_->process(frameGpu_, outputGpu_);
+    if (format == StreamFormat::Video) {
+        return std::make_unique<VideoWriterSink>(path, info,
+            mode != ColorMode::Luma);
+    }
+    if (format == StreamFormat::Store) {
+        return std::make_unique<FrameStoreWriter>(path, info,
+            pipelineFormat(mode));
+    }
+    return openRawSink(path, format, info, pipelineFormat(mode));
+}
 
-        cv::Mat output;
-        outputGpu_.download(output);
+void denoiseFrame(Denoiser& denoiser, ColorMode mode, const cv::Mat& input,
+    cv::Mat& output) {
+    if (!isYuv(mode)) {
+        denoiser.process(input, output);
+        return;
+    }
 
-        cv::Mat colorOutput;
-        cv::cvtColor(output, colorOutput, cv::COLOR_GRAY2BGR);
+    // I420: full-resolution Y rows, then the U and V planes at half
+    // resolution, each stored as height/4 rows of the full width
+    const int height = input.rows * 2 / 3;
+    output.create(input.size(), input.type());
+    cv::Mat luma = output.rowRange(0, height);
+    denoiser.process(input.rowRange(0, height), luma);
 
-        output_.write(colorOutput);
+    // Seen as height rows of width/2: U on top, V below
+    const cv::Mat chromaIn = input.rowRange(height, input.rows).reshape(1, height);
+    cv::Mat chromaOut = output.rowRange(height, output.rows).reshape(1, height);
+    if (mode == ColorMode::YuvChroma) {
+        const int half = height / 2;
+        cv::Mat u = chromaOut.rowRange(0, half);
+        cv::Mat v = chromaOut.rowRange(half, height);
+        cv::blur(chromaIn.rowRange(0, half), u, cv::Size(3, 3));
+        cv::blur(chromaIn.rowRange(half, height), v, cv::Size(3, 3));
+    }
+    else {
+        chromaIn.copyTo(chromaOut);
     }
 }
 
-bool VideoProcessor::readAndInitializeFirstFrame(cv::Mat& frame) {
-    if (!cap_.read(frame)) {
+bool VideoProcessor::readAndInitializeFirstFrame(FrameSlot& slot) {
+    if (!readFrame(slot)) {
         throw std::runtime_error("No se pudo leer el primer fotograma");
         return false;
     }
 
-    if (frame.empty()) {
+    if (slot.input.empty()) {
         throw std::runtime_error("El primer fotograma est vaco");
         return false;
     }
 
-    // Subir el fotograma a la GPU
-    frameGpu_.upload(frame);
-
-    if (frame.channels() == 3) {
-        cv::cuda::cvtColor(frameGpu_, outputGpu_, cv::COLOR_BGR2GRAY);
-        frameGpu_ = outputGpu_; // Guardar la versin en escala de grises
+    // The denoiser only ever sees the Y plane outside Bgr mode
+    denoiser_->init(slot.input.rowRange(0, frame_height_));
+    if (resume_) {
+        denoiser_->restoreState(resume_->state);
+        resume_.reset();
     }
-
-    if (isCpu_) {
-        stkmbCpu_ = std::make_unique<STKMBCpu>(frame);
+    if (!checkpoints_.path.empty() && checkpoints_.interval > 0) {
+        checkpointWriter_ = std::make_unique<CheckpointWriter>(
+            checkpoints_.path, checkpointContext(), jobFirstFrame_);
     }
-    else {
-        stkmbGpu_ = std::make_unique<STKMBGpu>(frameGpu_);
+
+    const DenoiserCapabilities caps = denoiser_->capabilities();
+    std::cout << "Denoiser: " << caps.name << (caps.usesGpu ? " (GPU)" : "")
+        << ", " << caps.threads << " hilo(s), modo de color "
+        << colorModeName(colorMode_) << std::endl;
+    if (!caps.profile.empty()) {
+        std::cout << "Perfil de ajuste " << caps.profile << std::endl;
     }
 
     return true;
 }
 
 void VideoProcessor::cleanup() {
-    if (cap_.isOpened()) {
-        cap_.release();
-    }
-    if (output_.isOpened()) {
-        output_.release();
-    }
+    sink_.reset();
+    source_.reset();
 }
 
 void VideoProcessor::finalizeProcessing() {
-    output_.release();
+    sink_->close();
 
-    std::filesystem::path output_path(OUTPUT_FILE);
+    const std::string& path = streams_.outputPath;
+    if (path == "-") {
+        std::cout << "\nProcesamiento completo! Salida escrita en stdout"
+            << std::endl;
+        return;
+    }
+
+    std::filesystem::path output_path(path);
     if (!std::filesystem::exists(output_path)) {
         throw std::runtime_error("El archivo de salida no fue creado");
     }
 
-    auto file_size = std::filesystem::file_size(output_path);
     std::cout << "\nProcesamiento completo! El archivo de salida se guard en "
-        << OUTPUT_FILE << "\nTamao del archivo: "
-        << file_size << " bytes" << std::endl;
+        << path;
+    if (std::filesystem::is_regular_file(output_path)) {
+        std::cout << "\nTamao del archivo: "
+            << std::filesystem::file_size(output_path) << " bytes";
+    }
+    std::cout << std::endl;
 }
 
 void VideoProcessor::printVideoProperties() const {
     std::cout << "Propiedades del video:\n"
         << "  Resolucin: " << frame_width_ << "x" << frame_height_ << "\n"
         << "  FPS: " << fps_ << "\n"
-        << "  Nmero de fotogramas: " << frame_count_ << "\n"
+        << "  Nmero de fotogramas: ";
+    if (frame_count_ > 0) {
+        std::cout << frame_count_;
+    }
+    else {
+        std::cout << "desconocido";
+    }
+    std::cout << "\n"
         << "Iniciando el procesamiento..." << std::endl;
 }
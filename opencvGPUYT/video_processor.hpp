@@ -1,19 +1,81 @@
 #pragma once
+#include "checkpoint.hpp"
+#include "deadline.hpp"
+#include "denoiser.hpp"
+#include "frame_io.hpp"
 #include "progress_bar.hpp"
-#include "stmkb_cpu.hpp"
-#include "stmkb_gpu.hpp"
+#include "spsc_queue.hpp"
+#include <atomic>
+#include <cstdint>
 #include <filesystem>
 #include <memory>
 #include <opencv2/opencv.hpp>
-#include <opencv2/core/cuda.hpp>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 
+// What the pipeline denoises and what it hands to the writer
+enum class ColorMode {
+    Bgr,      // Gray of the BGR frame, written back as gray BGR (original)
+    Luma,     // Y plane only, written as a single-channel video
+    Yuv,      // Y denoised, 4:2:0 chroma passed through, written in colour
+    YuvChroma // As Yuv, with a 3x3 blur on the subsampled chroma planes
+};
+
+// Where frames come from and go to. Y4M and raw gray streams skip the
+// codec entirely and can be pipes ("-" is stdin or stdout); frame stores
+// are memory-mapped and seek in O(1).
+struct StreamOptions {
+    StreamFormat inputFormat = StreamFormat::Auto;
+    cv::Size rawSize;     // Frame size of raw gray input
+    double rawFps = 25.0; // Frame rate of raw gray input
+    int startFrame = 0;   // First input frame (the source must seek)
+    int frameLimit = 0;   // Frames to process, 0 = up to the end
+    std::string outputPath = "results/output.avi";
+    StreamFormat outputFormat = StreamFormat::Auto;
+};
+
+// Periodic snapshots of the denoiser state for long jobs. A run started
+// with resume set and the same options continues from the last snapshot
+// and produces the frames a single uninterrupted run would have.
+struct CheckpointOptions {
+    std::string path;    // Empty = no checkpoints
+    int interval = 0;    // Frames between snapshots, 0 = never written
+    bool resume = false; // Start from the checkpoint at path if it exists
+};
+
+// Layout of the frames travelling through the pipeline in a colour mode
+FrameFormat pipelineFormat(ColorMode mode);
+
+// Sink for streams.outputPath: a cv::VideoWriter with codec selection, a raw
+// stream or a frame store. Creates the output directory if needed.
+std::unique_ptr<FrameSink> openOutputSink(const StreamOptions& streams,
+    const StreamInfo& info, ColorMode mode);
+
+// Denoise one pipeline frame: the whole frame, or the Y plane of an I420
+// frame with its chroma copied (Yuv) or blurred (YuvChroma)
+void denoiseFrame(Denoiser& denoiser, ColorMode mode, const cv::Mat& input,
+    cv::Mat& output);
+
 class VideoProcessor {
 public:
-    explicit VideoProcessor(const std::string_view& path, bool isCpu)
-        : isCpu_(isCpu), input_path_(path), cap_(path.data()) {
+    // denoiser is initialised from the first frame of the video. queueDepth
+    // is the number of frame buffers in flight between the decoder, denoiser
+    // and encoder stages. A resumed run seeks the input to the checkpoint
+    // and writes the remaining frames; an existing output file is kept and
+    // the new frames go next to it, with the first frame number appended.
+    // With a deadline budget the denoiser's quality level follows the frame
+    // latency, and frames the cheapest level cannot keep up with are
+    // dropped: the previous output is written again in their place.
+    VideoProcessor(const std::string_view& path,
+        std::unique_ptr<Denoiser> denoiser, int queueDepth = 4,
+        ColorMode colorMode = ColorMode::Bgr, StreamOptions streams = {},
+        CheckpointOptions checkpoints = {}, DeadlineOptions deadline = {})
+        : queueDepth_(queueDepth), colorMode_(colorMode),
+        streams_(std::move(streams)), checkpoints_(std::move(checkpoints)),
+        deadlineOptions_(deadline), input_path_(path),
+        denoiser_(std::move(denoiser)) {
+        loadCheckpoint();
         initializeVideo();
         initializeWriter();
     }
@@ -28,32 +90,85 @@ public:
     void process();
 
 private:
-    bool isCpu_;
+    // Pooled buffers travelling decoder -> denoiser -> encoder -> decoder.
+    // Outside Bgr mode input and output hold the Y plane (Luma) or the whole
+    // I420 frame (Yuv). decoded and encoded hold the source and sink frames
+    // when their layout differs from the pipeline's.
+    struct FrameSlot {
+        cv::Mat decoded;
+        cv::Mat input;
+        cv::Mat output;
+        cv::Mat encoded;
+    };
+
+    // Times a stage had to wait on a neighbour, and for how long
+    struct StageStalls {
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<int64_t> nanoseconds{ 0 };
+    };
+
+    static constexpr int END_OF_STREAM = -1;
+
+    int queueDepth_;
+    ColorMode colorMode_;
+    StreamOptions streams_;
+    CheckpointOptions checkpoints_;
+    std::unique_ptr<Checkpoint> resume_;              // Until restored
+    std::unique_ptr<CheckpointWriter> checkpointWriter_;
+    DeadlineOptions deadlineOptions_;
+    std::unique_ptr<DeadlineController> deadline_; // Real-time mode only
+    cv::Mat lastOutput_; // Written again for dropped frames
+    int jobFirstFrame_ = 0; // startFrame of the run that began the job
     std::string input_path_;
-    cv::VideoCapture cap_;
-    cv::VideoWriter output_;
-    std::unique_ptr<STKMBGpu> stkmbGpu_;
-    std::unique_ptr<STKMBCpu> stkmbCpu_;
-    cv::cuda::GpuMat frameGpu_;  // Input frame on GPU
-    cv::cuda::GpuMat outputGpu_; // Output frame on GPU
+    std::unique_ptr<FrameSource> source_;
+    std::unique_ptr<FrameSink> sink_;
+    std::unique_ptr<Denoiser> denoiser_;
     int frame_count_ = 0;
+    int framesRead_ = 0;
     double fps_ = 0.0;
     int frame_width_ = 0;
     int frame_height_ = 0;
-    static constexpr const char* OUTPUT_DIR = "results";
-    static constexpr const char* OUTPUT_FILE = "results/output.avi";
 
-    // Initialize video capture and properties
+    // Pipeline state
+    std::atomic<bool> stopPipeline_{ false };
+    StageStalls decodeStalls_;  // Decoder waiting for a free buffer
+    StageStalls denoiseStalls_; // Denoiser waiting for a decoded frame
+    StageStalls encodeStalls_;  // Encoder waiting for a denoised frame
+
+    // Read the checkpoint to resume from and move the frame range and the
+    // output path past it
+    void loadCheckpoint();
+
+    // Job settings outside the engine a checkpoint must agree on
+    std::string checkpointContext() const;
+
+    // Snapshot the denoiser after processed frames of this run
+    void saveCheckpoint(int processed);
+
+    // Open the frame source and read its properties
     void initializeVideo();
 
-    // Initialize video writer with codec selection
+    // Open the frame sink (video writer with codec selection, or raw stream)
     void initializeWriter();
 
-    // Process a single frame
-    void processFrame(const cv::Mat& input);
-    void processFrameWithDenoiser(const cv::Mat& frame);  // Added this function
 
-    bool readAndInitializeFirstFrame(cv::Mat& frame);
+    // Pipeline stages, each on its own thread
+    void decodeStage(std::vector<FrameSlot>& slots, SpscQueue<int>& freeSlots,
+        SpscQueue<int>& decoded);
+    void encodeStage(std::vector<FrameSlot>& slots, SpscQueue<int>& denoised,
+        SpscQueue<int>& freeSlots);
+    void printPipelineStats() const;
+    void printDeadlineReport() const;
+
+    // Read the next source frame into slot.input, in the pipeline's format.
+    // False at the end of the stream.
+    bool readFrame(FrameSlot& slot);
+
+    // Process a single frame into an output frame of the same format
+    void processFrame(const cv::Mat& input, cv::Mat& output);
+
+    // Read the first frame into slot and initialise the denoiser from it
+    bool readAndInitializeFirstFrame(FrameSlot& slot);
 
     // Cleanup resources
     void cleanup();